@@ -219,6 +219,7 @@ macro(build_libwebsockets)
                -DLWS_IPV6:BOOL=ON
                -DLWS_LOGS_TIMESTAMP:BOOL=ON
                -DLWS_LOG_TAG_LIFECYCLE:BOOL=ON
+               -DLWS_MAX_SMP:STRING=32
                -DLWS_REPRODUCIBLE:BOOL=ON
                -DLWS_ROLE_DBUS:BOOL=OFF
                -DLWS_ROLE_MQTT:BOOL=OFF
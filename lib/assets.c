@@ -0,0 +1,338 @@
+/**
+ * @file assets.c
+ */
+#include "assets.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define ASSET_INOTIFY 1
+#endif
+
+#define ASSET_MIN_COMPRESS 256
+
+static const char* const asset_suffixes[ASSET_ENCODINGS] = {0, ".gz", ".br"};
+
+static uint32_t asset_hash(const char* path) {
+  uint32_t h = 2166136261u;
+
+  while(*path)
+    h = (h ^ (uint8_t)*path++) * 16777619u;
+
+  return h;
+}
+
+static Asset** asset_slot(AssetCache* cache, const char* path, uint32_t hash) {
+  Asset** ptr;
+
+  for(ptr = &cache->slots[hash & (cache->nslots - 1)]; *ptr; ptr = &(*ptr)->next)
+    if((*ptr)->hash == hash && !strcmp((*ptr)->path, path))
+      break;
+
+  return ptr;
+}
+
+static BOOL asset_grow(AssetCache* cache) {
+  uint32_t i, nslots = cache->nslots ? cache->nslots * 2 : 64;
+  Asset **slots, *a, *next;
+
+  if(!(slots = calloc(nslots, sizeof(Asset*))))
+    return FALSE;
+
+  for(i = 0; i < cache->nslots; i++)
+    for(a = cache->slots[i]; a; a = next) {
+      next = a->next;
+      a->next = slots[a->hash & (nslots - 1)];
+      slots[a->hash & (nslots - 1)] = a;
+    }
+
+  free(cache->slots);
+  cache->slots = slots;
+  cache->nslots = nslots;
+  return TRUE;
+}
+
+void asset_free(Asset* asset) {
+  if(--asset->ref_count == 0) {
+    for(int i = 0; i < ASSET_ENCODINGS; i++)
+      free(asset->variant[i].data);
+
+    free(asset->path);
+    free(asset);
+  }
+}
+
+/* unlink an asset from the cache, it lives on while it's still being sent */
+static void asset_remove(AssetCache* cache, Asset* asset) {
+  Asset** ptr;
+
+  if((ptr = asset_slot(cache, asset->path, asset->hash)) && *ptr == asset)
+    *ptr = asset->next;
+
+#ifdef ASSET_INOTIFY
+  if(asset->wd != -1)
+    inotify_rm_watch(cache->inotify, asset->wd);
+#endif
+
+  list_del(&asset->link);
+  cache->bytes -= asset->bytes;
+  cache->count--;
+  asset_free(asset);
+}
+
+/* drop every asset whose file changed since the last call */
+static void asset_cache_poll(AssetCache* cache) {
+#ifdef ASSET_INOTIFY
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+
+  if(cache->inotify == -1)
+    return;
+
+  while((n = read(cache->inotify, buf, sizeof(buf))) > 0) {
+    for(char* p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+      struct inotify_event* ev = (struct inotify_event*)p;
+      struct list_head *el, *next;
+
+      list_for_each_safe(el, next, &cache->lru) {
+        Asset* a = list_entry(el, Asset, link);
+
+        if(a->wd == ev->wd) {
+          /* the watch is gone already */
+          if(ev->mask & IN_IGNORED)
+            a->wd = -1;
+
+          asset_remove(cache, a);
+          break;
+        }
+      }
+    }
+  }
+#endif
+}
+
+AssetCache* asset_cache_new(size_t limit) {
+  AssetCache* cache;
+
+  if(!(cache = calloc(1, sizeof(AssetCache))))
+    return 0;
+
+  cache->limit = limit;
+  init_list_head(&cache->lru);
+
+#ifdef ASSET_INOTIFY
+  cache->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+  cache->inotify = -1;
+#endif
+
+  if(!asset_grow(cache)) {
+    asset_cache_free(cache);
+    return 0;
+  }
+
+  return cache;
+}
+
+void asset_cache_free(AssetCache* cache) {
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &cache->lru) { asset_remove(cache, list_entry(el, Asset, link)); }
+
+  if(cache->inotify != -1)
+    close(cache->inotify);
+
+  free(cache->slots);
+  free(cache);
+}
+
+/**
+ * The cached asset for path, moved to the front of the LRU list.
+ * Without inotify the file is checked with stat().
+ */
+Asset* asset_cache_get(AssetCache* cache, const char* path) {
+  Asset* asset;
+
+  asset_cache_poll(cache);
+
+  if((asset = *asset_slot(cache, path, asset_hash(path)))) {
+    if(asset->wd == -1) {
+      struct stat st;
+
+      if(stat(path, &st) == -1 || st.st_mtime != asset->st.st_mtime || st.st_size != asset->st.st_size || st.st_ino != asset->st.st_ino) {
+        asset_remove(cache, asset);
+        asset = 0;
+      }
+    }
+  }
+
+  if(asset) {
+    list_del(&asset->link);
+    list_add(&asset->link, &cache->lru);
+    cache->hits++;
+  } else {
+    cache->misses++;
+  }
+
+  return asset;
+}
+
+static uint8_t* asset_read(int fd, size_t size) {
+  uint8_t* data;
+  size_t pos = 0;
+  ssize_t n;
+
+  if(!(data = malloc(size ? size : 1)))
+    return 0;
+
+  while(pos < size) {
+    if((n = pread(fd, data + pos, size - pos, pos)) <= 0) {
+      if(n == -1 && errno == EINTR)
+        continue;
+
+      free(data);
+      return 0;
+    }
+
+    pos += n;
+  }
+
+  return data;
+}
+
+/* gzip, kept only when it's smaller */
+static uint8_t* asset_gzip(const uint8_t* data, size_t size, size_t* len) {
+  z_stream z = {0};
+  uint8_t* out;
+  size_t bound;
+
+  if(deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    return 0;
+
+  bound = deflateBound(&z, size);
+
+  if(!(out = malloc(bound))) {
+    deflateEnd(&z);
+    return 0;
+  }
+
+  z.next_in = (Bytef*)data;
+  z.avail_in = size;
+  z.next_out = out;
+  z.avail_out = bound;
+
+  if(deflate(&z, Z_FINISH) != Z_STREAM_END || z.total_out >= size) {
+    deflateEnd(&z);
+    free(out);
+    return 0;
+  }
+
+  *len = z.total_out;
+  deflateEnd(&z);
+  return out;
+}
+
+/* a precompressed sibling on disk, used when it's at least as new as the file */
+static uint8_t* asset_sibling(const char* path, AssetEncoding enc, const struct stat* st, size_t* len) {
+  char name[strlen(path) + 4];
+  struct stat sst;
+  uint8_t* data = 0;
+  int fd;
+
+  snprintf(name, sizeof(name), "%s%s", path, asset_suffixes[enc]);
+
+  if((fd = open(name, O_RDONLY | O_CLOEXEC)) == -1)
+    return 0;
+
+  if(!fstat(fd, &sst) && S_ISREG(sst.st_mode) && sst.st_mtime >= st->st_mtime)
+    if((data = asset_read(fd, sst.st_size)))
+      *len = sst.st_size;
+
+  close(fd);
+  return data;
+}
+
+/**
+ * Load an open file into the cache, making room by evicting the least recently used.
+ * With compress, a gzip variant is built unless there's a .gz sibling. Brotli is only
+ * taken from a .br sibling. Returns 0 when the asset wouldn't fit.
+ */
+Asset* asset_cache_put(AssetCache* cache, const char* path, int fd, const struct stat* st, BOOL compress) {
+  Asset *asset, **ptr;
+  uint32_t hash = asset_hash(path);
+
+  if((size_t)st->st_size > cache->limit)
+    return 0;
+
+  if(!(asset = calloc(1, sizeof(Asset))))
+    return 0;
+
+  asset->ref_count = 1;
+  asset->hash = hash;
+  asset->st = *st;
+  asset->wd = -1;
+
+  if(!(asset->path = strdup(path)) || !(asset->variant[ASSET_IDENTITY].data = asset_read(fd, st->st_size)))
+    goto fail;
+
+  asset->variant[ASSET_IDENTITY].size = st->st_size;
+
+  for(int i = ASSET_GZIP; i < ASSET_ENCODINGS; i++)
+    asset->variant[i].data = asset_sibling(path, i, st, &asset->variant[i].size);
+
+  if(compress && !asset->variant[ASSET_GZIP].data && st->st_size >= ASSET_MIN_COMPRESS)
+    asset->variant[ASSET_GZIP].data = asset_gzip(asset->variant[ASSET_IDENTITY].data, st->st_size, &asset->variant[ASSET_GZIP].size);
+
+  for(int i = 0; i < ASSET_ENCODINGS; i++)
+    asset->bytes += asset->variant[i].size;
+
+  if(asset->bytes > cache->limit)
+    goto fail;
+
+#ifdef ASSET_INOTIFY
+  if(cache->inotify != -1) {
+    struct list_head* el;
+
+    asset->wd = inotify_add_watch(cache->inotify, path, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF);
+
+    /* another path to the same file, one watch can't serve both */
+    list_for_each(el, &cache->lru) {
+      if(asset->wd != -1 && list_entry(el, Asset, link)->wd == asset->wd) {
+        asset->wd = -1;
+        goto fail;
+      }
+    }
+  }
+#endif
+
+  while(cache->bytes + asset->bytes > cache->limit && !list_empty(&cache->lru))
+    asset_remove(cache, list_entry(cache->lru.prev, Asset, link));
+
+  if(cache->count >= cache->nslots && !asset_grow(cache))
+    goto fail;
+
+  if(*(ptr = asset_slot(cache, path, hash)))
+    asset_remove(cache, *ptr);
+
+  ptr = asset_slot(cache, path, hash);
+  *ptr = asset;
+  list_add(&asset->link, &cache->lru);
+  cache->bytes += asset->bytes;
+  cache->count++;
+
+  return asset;
+
+fail:
+#ifdef ASSET_INOTIFY
+  if(asset->wd != -1)
+    inotify_rm_watch(cache->inotify, asset->wd);
+#endif
+
+  asset_free(asset);
+  return 0;
+}
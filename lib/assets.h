@@ -0,0 +1,50 @@
+/**
+ * @file assets.h
+ */
+#ifndef QJSNET_LIB_ASSETS_H
+#define QJSNET_LIB_ASSETS_H
+
+#include <cutils.h>
+#include <list.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+typedef enum { ASSET_IDENTITY = 0, ASSET_GZIP, ASSET_BR, ASSET_ENCODINGS } AssetEncoding;
+
+/* a file held in memory, with the encodings it is available in */
+typedef struct asset {
+  int ref_count;
+  struct list_head link; /* in the cache's LRU list, most recently used first */
+  struct asset* next;    /* in the hash chain */
+  uint32_t hash;
+  char* path;
+  struct stat st;
+  int wd; /* inotify watch, -1 without */
+  struct {
+    uint8_t* data;
+    size_t size;
+  } variant[ASSET_ENCODINGS];
+  size_t bytes;
+} Asset;
+
+typedef struct asset_cache {
+  size_t limit, bytes;
+  struct list_head lru;
+  Asset** slots;
+  uint32_t nslots, count;
+  int inotify; /* changed files drop out of the cache before the next lookup */
+  uint64_t hits, misses;
+} AssetCache;
+
+AssetCache* asset_cache_new(size_t limit);
+void asset_cache_free(AssetCache*);
+Asset* asset_cache_get(AssetCache*, const char* path);
+Asset* asset_cache_put(AssetCache*, const char* path, int fd, const struct stat* st, BOOL compress);
+void asset_free(Asset*);
+
+static inline Asset* asset_dup(Asset* asset) {
+  ++asset->ref_count;
+  return asset;
+}
+
+#endif /* QJSNET_LIB_ASSETS_H */
@@ -3,12 +3,16 @@
  */
 #include "buffer.h"
 #include "js-utils.h"
+#include "pool.h"
 #include <assert.h>
 
+/* not per buffer, so that one which was zeroed doesn't repeat an earlier generation; buffers stay on their thread */
+THREAD_LOCAL uint32_t buffer_generation;
+
 uint8_t* block_alloc(ByteBlock* blk, size_t size) {
   uint8_t* ptr;
 
-  if((ptr = malloc(size + LWS_PRE))) {
+  if((ptr = pool_alloc(size + LWS_PRE))) {
     blk->start = ptr + LWS_PRE;
     blk->end = blk->start + size;
   }
@@ -24,7 +28,7 @@ uint8_t* block_realloc(ByteBlock* blk, size_t size) {
     return 0;
   }
 
-  if((ptr = realloc(block_ALLOC(blk), size + LWS_PRE))) {
+  if((ptr = pool_realloc(block_ALLOC(blk), size + LWS_PRE))) {
     blk->start = ptr + LWS_PRE;
     blk->end = blk->start + size;
   } else {
@@ -36,7 +40,7 @@ uint8_t* block_realloc(ByteBlock* blk, size_t size) {
 
 void block_free(ByteBlock* blk) {
   if(blk->start)
-    free(blk->start - LWS_PRE);
+    pool_free(blk->start - LWS_PRE);
 
   blk->start = blk->end = 0;
 }
@@ -45,7 +49,7 @@ uint8_t* block_grow(ByteBlock* blk, size_t size) {
   uint8_t* alloc;
   size_t newsize = block_SIZE(blk) + size;
 
-  if((alloc = realloc(block_ALLOC(blk), LWS_PRE + newsize))) {
+  if((alloc = pool_realloc(block_ALLOC(blk), LWS_PRE + newsize))) {
     blk->start = alloc + LWS_PRE;
     blk->end = blk->start + newsize;
   }
@@ -53,7 +57,7 @@ uint8_t* block_grow(ByteBlock* blk, size_t size) {
   return alloc ? blk->start : 0;
 }
 
-static void block_finalizer(JSRuntime* rt, void* alloc, void* start) { free(alloc); }
+static void block_finalizer(JSRuntime* rt, void* alloc, void* start) { pool_free(alloc); }
 
 ByteBlock block_copy(const void* ptr, size_t size) {
   ByteBlock ret = {0, 0};
@@ -126,6 +130,7 @@ uint8_t* buffer_alloc(ByteBuffer* buf, size_t size) {
     buf->alloc = ret;
     buf->read = buf->start;
     buf->write = buf->start;
+    buffer_touch(buf);
   }
 
   return ret;
@@ -144,6 +149,7 @@ ssize_t buffer_append(ByteBuffer* buf, const void* x, size_t n) {
   memcpy(buf->write, x, n);
   buf->write[n] = '\0';
   buf->write += n;
+  buffer_touch(buf);
 
   return n;
 }
@@ -153,6 +159,7 @@ void buffer_free(ByteBuffer* buf) {
     block_free(&buf->block);
 
   buf->read = buf->write = buf->alloc = 0;
+  buffer_touch(buf);
 }
 
 BOOL buffer_write(ByteBuffer* buf, const void* x, size_t n) {
@@ -160,6 +167,7 @@ BOOL buffer_write(ByteBuffer* buf, const void* x, size_t n) {
 
   memcpy(buf->write, x, n);
   buf->write += n;
+  buffer_touch(buf);
 
   return TRUE;
 }
@@ -175,6 +183,7 @@ int buffer_vprintf(ByteBuffer* buf, const char* format, va_list ap) {
     n = size;
 
   buf->write += n;
+  buffer_touch(buf);
   return n;
 }
 
@@ -210,13 +219,24 @@ uint8_t* buffer_realloc(ByteBuffer* buf, size_t size) {
   wr = buffer_HEAD(buf);
   assert(size >= wr);
 
-  if((x = block_realloc(&buf->block, size))) {
-    if(buf->alloc == 0 && buf->start && wr)
-      memcpy(x + LWS_PRE, buf->start, wr);
+  /* memory the buffer doesn't own is copied to a chunk of its own */
+  if(!buf->alloc) {
+    ByteBlock blk = BLOCK_0();
+
+    if((x = block_alloc(&blk, size)) && buf->start && wr)
+      memcpy(blk.start, buf->start, wr);
+
+    if(x)
+      buf->block = blk;
+  } else {
+    x = block_realloc(&buf->block, size);
+  }
 
+  if(x) {
     buf->alloc = x;
     buf->write = buf->start + wr;
     buf->read = buf->start + rd;
+    buffer_touch(buf);
   }
   return x;
 }
@@ -229,6 +249,7 @@ BOOL buffer_clone(ByteBuffer* buf, const ByteBuffer* other) {
 
   buf->read = buf->start + buffer_TAIL(other);
   buf->write = buf->start + buffer_HEAD(other);
+  buffer_touch(buf);
 
   return TRUE;
 }
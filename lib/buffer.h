@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
+#include "utils.h"
 
 typedef struct byte_block {
   uint8_t* start;
@@ -46,6 +47,7 @@ static inline ByteBlock block_move(ByteBlock* blk) {
 typedef union byte_buffer {
   struct {
     uint8_t *start, *end, *read, *write, *alloc;
+    uint32_t gen; /* changes with the contents, pooled memory may come back at the same address */
   };
   ByteBlock block;
 } ByteBuffer;
@@ -101,9 +103,15 @@ size_t buffer_bytes(ByteBuffer*);
 ssize_t buffer_read(ByteBuffer*, void*, size_t);
 ssize_t buffer_gets(ByteBuffer*, void*, size_t);
 
+extern THREAD_LOCAL uint32_t buffer_generation;
+
+/* for code which changes the contents other than through the buffer_*() functions */
+static inline void buffer_touch(ByteBuffer* buf) { buf->gen = ++buffer_generation; }
+
 static inline void buffer_reset(ByteBuffer* buf) {
   buf->read = buf->start;
   buf->write = buf->start;
+  buffer_touch(buf);
 }
 
 typedef struct writer {
@@ -118,9 +126,10 @@ typedef struct reader {
 static inline BufferReader buffer_reader(ByteBuffer* bb) { return (BufferReader){&bb->read, bb->write}; }
 
 static inline ByteBuffer buffer_move(ByteBuffer* buf) {
-  ByteBuffer ret = {{buf->start, buf->end, buf->read, buf->write, buf->alloc}};
+  ByteBuffer ret = {{buf->start, buf->end, buf->read, buf->write, buf->alloc, buf->gen}};
 
   buf->start = buf->end = buf->read = buf->write = buf->alloc = 0;
+  buffer_touch(buf);
 
   return ret;
 }
@@ -0,0 +1,264 @@
+/**
+ * @file channel.c
+ */
+#include "channel.h"
+#include "session.h"
+#include "ws.h"
+#include "js-utils.h"
+#include <string.h>
+#include <assert.h>
+
+static void channel_destroy_frame(void* ptr) {
+  ChannelFrame* frame = ptr;
+
+  free(frame->payload);
+  frame->payload = 0;
+  frame->len = 0;
+
+  if(frame->deflated) {
+    free(frame->deflated);
+    frame->deflated = 0;
+  }
+}
+
+/* advance a subscriber's tail by n frames, frames every subscriber got are destroyed */
+static void channel_consume(struct channel* ch, ChannelSubscriber* sub, size_t n) {
+  lws_ring_consume_and_update_oldest_tail(ch->ring, ChannelSubscriber, &sub->tail, n, ch->subscribers, tail, next);
+}
+
+static void channel_remove(struct channel* ch, ChannelSubscriber* sub, JSRuntime* rt) {
+  ChannelSubscriber** ptr;
+  size_t waiting;
+
+  if((waiting = lws_ring_get_count_waiting_elements(ch->ring, &sub->tail)))
+    channel_consume(ch, sub, waiting);
+
+  lws_ll_fwd_remove(ChannelSubscriber, next, sub, ch->subscribers);
+
+  for(ptr = &sub->session->subscriptions; *ptr; ptr = &(*ptr)->sess_next)
+    if(*ptr == sub) {
+      *ptr = sub->sess_next;
+      break;
+    }
+
+  --ch->count;
+  js_free_rt(rt, sub);
+}
+
+struct channel* channel_new(JSContext* ctx, const char* name, size_t capacity) {
+  struct channel* ch;
+
+  if(!(ch = js_mallocz(ctx, sizeof(struct channel))))
+    return 0;
+
+  ch->ref_count = 1;
+  ch->name = js_strdup(ctx, name);
+  ch->capacity = capacity ? capacity : CHANNEL_CAPACITY;
+  ch->policy = CHANNEL_DROP;
+
+  if(!(ch->ring = lws_ring_create(sizeof(ChannelFrame), ch->capacity, channel_destroy_frame))) {
+    js_free(ctx, ch->name);
+    js_free(ctx, ch);
+    return 0;
+  }
+
+  init_list_head(&ch->link);
+
+  return ch;
+}
+
+void channel_free(struct channel* ch, JSRuntime* rt) {
+  if(--ch->ref_count == 0) {
+    while(ch->subscribers)
+      channel_remove(ch, ch->subscribers, rt);
+
+    lws_ring_destroy(ch->ring);
+    js_free_rt(rt, ch->name);
+    js_free_rt(rt, ch);
+  }
+}
+
+struct channel* channel_find(struct list_head* list, const char* name) {
+  struct list_head* el;
+
+  list_for_each(el, list) {
+    struct channel* ch = list_entry(el, struct channel, link);
+
+    if(!strcmp(ch->name, name))
+      return ch;
+  }
+
+  return 0;
+}
+
+ChannelSubscriber* channel_subscribe(struct channel* ch, struct session_data* session, struct lws* wsi, JSContext* ctx) {
+  ChannelSubscriber* sub;
+  struct socket* ws;
+  size_t waiting;
+
+  /* lws masks what a client sends in place, the one copy of a frame is shared by all the subscribers */
+  if((ws = ws_from_wsi(wsi)) && ws->client)
+    return 0;
+
+  for(sub = session->subscriptions; sub; sub = sub->sess_next)
+    if(sub->channel == ch)
+      return sub;
+
+  if(!(sub = js_mallocz(ctx, sizeof(ChannelSubscriber))))
+    return 0;
+
+  sub->channel = ch;
+  sub->session = session;
+  sub->wsi = wsi;
+
+  /* start at the head, a new subscriber only gets frames published from now on */
+  sub->tail = lws_ring_get_oldest_tail(ch->ring);
+
+  if((waiting = lws_ring_get_count_waiting_elements(ch->ring, &sub->tail)))
+    lws_ring_consume(ch->ring, &sub->tail, 0, waiting);
+
+  lws_ll_fwd_insert(sub, next, ch->subscribers);
+
+  sub->sess_next = session->subscriptions;
+  session->subscriptions = sub;
+
+  ++ch->count;
+
+  return sub;
+}
+
+BOOL channel_unsubscribe(struct channel* ch, struct session_data* session, JSRuntime* rt) {
+  ChannelSubscriber* sub;
+
+  for(sub = session->subscriptions; sub; sub = sub->sess_next)
+    if(sub->channel == ch) {
+      channel_remove(ch, sub, rt);
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+void channel_unsubscribe_all(struct session_data* session, JSRuntime* rt) {
+  while(session->subscriptions)
+    channel_remove(session->subscriptions->channel, session->subscriptions, rt);
+}
+
+/* make room for one frame: the subscribers which are a whole ring behind lose their oldest frame, or the connection */
+static void channel_shed(struct channel* ch, JSRuntime* rt) {
+  ChannelSubscriber *sub, *next;
+  uint32_t oldest = lws_ring_get_oldest_tail(ch->ring);
+
+  for(sub = ch->subscribers; sub; sub = next) {
+    next = sub->next;
+
+    if(sub->tail != oldest)
+      continue;
+
+    ++ch->dropped;
+
+    if(ch->policy == CHANNEL_CLOSE) {
+      lws_close_reason(sub->wsi, LWS_CLOSE_STATUS_POLICY_VIOLATION, (uint8_t*)"too slow", 8);
+      lws_set_timeout(sub->wsi, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+      channel_remove(ch, sub, rt);
+    } else {
+      channel_consume(ch, sub, 1);
+    }
+  }
+}
+
+/**
+ * Store the frame once and schedule a writeable callback on every subscriber.
+ *
+ * @return number of subscribers the frame goes to, -1 on error
+ */
+int channel_publish(struct channel* ch, const void* data, size_t size, BOOL binary, JSRuntime* rt) {
+  ChannelFrame frame;
+  ChannelSubscriber* sub;
+
+  if(!ch->subscribers)
+    return 0;
+
+  if(!lws_ring_get_count_free_elements(ch->ring))
+    channel_shed(ch, rt);
+
+  if(!ch->subscribers)
+    return 0;
+
+  if(!(frame.payload = malloc(LWS_PRE + size)))
+    return -1;
+
+  memcpy(frame.payload + LWS_PRE, data, size);
+  frame.len = size;
+  frame.binary = binary;
+  frame.deflated = 0;
+
+  if(!lws_ring_insert(ch->ring, &frame, 1)) {
+    channel_destroy_frame(&frame);
+    return -1;
+  }
+
+  ++ch->published;
+
+  for(sub = ch->subscribers; sub; sub = sub->next)
+    session_want_write(sub->session, sub->wsi);
+
+  return ch->count;
+}
+
+BOOL channel_pending(struct session_data* session) {
+  ChannelSubscriber* sub;
+
+  for(sub = session->subscriptions; sub; sub = sub->sess_next)
+    if(lws_ring_get_element(sub->channel->ring, &sub->tail))
+      return TRUE;
+
+  return FALSE;
+}
+
+/**
+ * Write the next frame of the first subscription which has one.
+ * The subscriptions are rotated, so that a busy channel can't starve the others.
+ */
+int channel_writable(struct session_data* session, struct lws* wsi, struct socket* ws) {
+  ChannelSubscriber **ptr, *sub;
+
+  for(ptr = &session->subscriptions; (sub = *ptr); ptr = &sub->sess_next) {
+    ChannelFrame* frame;
+    int ret;
+
+    if(!(frame = (ChannelFrame*)lws_ring_get_element(sub->channel->ring, &sub->tail)))
+      continue;
+
+    /* deflate once for all the subscribers which negotiated compatible permessage-deflate parameters */
+    if(ws && ws->deflate && !ws->raw && !frame->deflated)
+      frame->deflated = ws_deflate_frame(frame->payload + LWS_PRE, frame->len, frame->binary, &frame->deflated_offset, &frame->deflated_len);
+
+    if(ws && ws->deflate && !ws->raw && frame->deflated)
+      ret = lws_write(wsi, frame->deflated + frame->deflated_offset, frame->deflated_len, LWS_WRITE_RAW);
+    else
+      /* lws_write() builds the frame header in the LWS_PRE area, the payload is shared */
+      ret = lws_write(wsi, frame->payload + LWS_PRE, frame->len, ws && ws->raw ? LWS_WRITE_RAW : frame->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+
+    channel_consume(sub->channel, sub, 1);
+
+    if(sub->sess_next) {
+      ChannelSubscriber* last;
+
+      *ptr = sub->sess_next;
+
+      for(last = *ptr; last->sess_next; last = last->sess_next) {}
+
+      last->sess_next = sub;
+      sub->sess_next = 0;
+    }
+
+    return ret;
+  }
+
+  return 0;
+}
+
+ChannelPolicy channel_policy(const char* name) { return name && !strcmp(name, "close") ? CHANNEL_CLOSE : CHANNEL_DROP; }
+
+const char* channel_policy_name(ChannelPolicy policy) { return policy == CHANNEL_CLOSE ? "close" : "drop"; }
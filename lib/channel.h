@@ -0,0 +1,68 @@
+/**
+ * @file channel.h
+ */
+#ifndef QJSNET_LIB_CHANNEL_H
+#define QJSNET_LIB_CHANNEL_H
+
+#include <quickjs.h>
+#include <cutils.h>
+#include <list.h>
+#include <libwebsockets.h>
+
+struct session_data;
+struct socket;
+
+#define CHANNEL_CAPACITY 64
+
+/* what happens to the slowest subscribers when a publish finds the ring full */
+typedef enum { CHANNEL_DROP = 0, CHANNEL_CLOSE = 1 } ChannelPolicy;
+
+/* a published frame, stored once with LWS_PRE headroom and shared by all subscribers */
+typedef struct channel_frame {
+  uint8_t* payload;
+  size_t len;
+  BOOL binary;
+  /* for permessage-deflate clients: a complete frame, compressed on first use */
+  uint8_t* deflated;
+  size_t deflated_offset, deflated_len;
+} ChannelFrame;
+
+typedef struct channel_subscriber {
+  struct channel_subscriber* next;     /* in channel->subscribers */
+  struct channel_subscriber* sess_next; /* in session->subscriptions */
+  struct channel* channel;
+  struct session_data* session;
+  struct lws* wsi;
+  uint32_t tail;
+} ChannelSubscriber;
+
+struct channel {
+  int ref_count;
+  char* name;
+  struct lws_ring* ring;
+  size_t capacity;
+  ChannelPolicy policy;
+  ChannelSubscriber* subscribers;
+  uint32_t count;
+  uint64_t published, dropped;
+  struct list_head link;
+};
+
+struct channel* channel_new(JSContext*, const char* name, size_t capacity);
+void channel_free(struct channel*, JSRuntime*);
+struct channel* channel_find(struct list_head* list, const char* name);
+ChannelSubscriber* channel_subscribe(struct channel*, struct session_data*, struct lws*, JSContext*);
+BOOL channel_unsubscribe(struct channel*, struct session_data*, JSRuntime*);
+void channel_unsubscribe_all(struct session_data*, JSRuntime*);
+int channel_publish(struct channel*, const void* data, size_t size, BOOL binary, JSRuntime*);
+BOOL channel_pending(struct session_data*);
+int channel_writable(struct session_data*, struct lws*, struct socket*);
+ChannelPolicy channel_policy(const char*);
+const char* channel_policy_name(ChannelPolicy);
+
+static inline struct channel* channel_dup(struct channel* ch) {
+  ++ch->ref_count;
+  return ch;
+}
+
+#endif /* QJSNET_LIB_CHANNEL_H */
@@ -39,7 +39,16 @@ void context_clear(struct context* context) {
 
   lws_set_log_level(0, 0);
 
+  /* a dispatch still pending must not service the destroyed context */
+  if(context->loop)
+    context->loop->lws = 0;
+
   lws_context_destroy(context->lws);
+
+  if(context->loop) {
+    evloop_free(context->loop);
+    context->loop = 0;
+  }
   // lws_set_log_level(((unsigned)minnet_log_level & ((1u << LLL_COUNT) - 1)), minnet_log_callback);
 
   JS_FreeValue(ctx, context->crt);
@@ -9,6 +9,7 @@
 #include <list.h>
 #include <libwebsockets.h>
 #include "js-utils.h"
+#include "evloop.h"
 
 struct context {
   int ref_count;
@@ -16,9 +17,11 @@ struct context {
   struct lws_context* lws;
   ResolveFunctions promise;
   BOOL exception;
+  BOOL shared; /* the lws context serves the clients of an agent, its user pointer is no client */
   JSValue error;
   JSValue crt, key, ca;
   struct TimerClosure* timer;
+  struct event_loop* loop;
   struct list_head link;
   struct lws_context_creation_info info;
 };
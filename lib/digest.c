@@ -0,0 +1,75 @@
+/**
+ * @file digest.c
+ */
+#include "digest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+static const char* const digest_names[] = {
+    [LWS_GENHASH_TYPE_MD5] = "md5",
+    [LWS_GENHASH_TYPE_SHA1] = "sha1",
+    [LWS_GENHASH_TYPE_SHA256] = "sha256",
+    [LWS_GENHASH_TYPE_SHA384] = "sha384",
+    [LWS_GENHASH_TYPE_SHA512] = "sha512",
+};
+
+/* LWS_GENHASH_TYPE_* of "sha256" and the like, LWS_GENHASH_TYPE_UNKNOWN if there's none */
+int digest_type(const char* name) {
+  for(int i = LWS_GENHASH_TYPE_MD5; i <= LWS_GENHASH_TYPE_SHA512; i++)
+    if(!strcasecmp(digest_names[i], name))
+      return i;
+
+  return LWS_GENHASH_TYPE_UNKNOWN;
+}
+
+const char* digest_name(int type) { return type >= LWS_GENHASH_TYPE_MD5 && type <= LWS_GENHASH_TYPE_SHA512 ? digest_names[type] : 0; }
+
+Digest* digest_new(int type) {
+  Digest* d;
+
+  if(!digest_name(type) || !(d = calloc(1, sizeof(Digest))))
+    return 0;
+
+  if(lws_genhash_init(&d->hash, type)) {
+    free(d);
+    return 0;
+  }
+
+  d->type = type;
+  return d;
+}
+
+void digest_free(Digest* d) {
+  if(!d->done)
+    lws_genhash_destroy(&d->hash, 0);
+
+  free(d);
+}
+
+/* hash another chunk, false after digest_final() or when the backend failed */
+BOOL digest_update(Digest* d, const void* data, size_t len) { return !d->done && !lws_genhash_update(&d->hash, data, len); }
+
+BOOL digest_final(Digest* d) {
+  if(d->done)
+    return TRUE;
+
+  d->done = TRUE;
+  return !lws_genhash_destroy(&d->hash, d->value);
+}
+
+size_t digest_size(Digest* d) { return lws_genhash_size(d->type); }
+
+/* the finished digest in lowercase hex, null until digest_final() */
+char* digest_hex(Digest* d, char buf[LWS_GENHASH_LARGEST * 2 + 1]) {
+  size_t i, n = digest_size(d);
+
+  if(!d->done)
+    return 0;
+
+  for(i = 0; i < n; i++)
+    snprintf(&buf[i * 2], 3, "%02x", d->value[i]);
+
+  buf[i * 2] = '\0';
+  return buf;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file digest.h
+ */
+#ifndef QJSNET_LIB_DIGEST_H
+#define QJSNET_LIB_DIGEST_H
+
+#include <libwebsockets.h>
+#include <cutils.h>
+
+/* a hash computed over a body while it passes through, LWS_GENHASH_TYPE_UNKNOWN is none */
+typedef struct digest {
+  struct lws_genhash_ctx hash;
+  enum lws_genhash_types type;
+  BOOL done;
+  uint8_t value[LWS_GENHASH_LARGEST];
+} Digest;
+
+int digest_type(const char* name);
+const char* digest_name(int type);
+Digest* digest_new(int type);
+void digest_free(Digest*);
+BOOL digest_update(Digest*, const void* data, size_t len);
+BOOL digest_final(Digest*);
+size_t digest_size(Digest*);
+char* digest_hex(Digest*, char buf[LWS_GENHASH_LARGEST * 2 + 1]);
+
+#endif /* QJSNET_LIB_DIGEST_H */
@@ -0,0 +1,446 @@
+/**
+ * @file dns.c
+ */
+#include "dns.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* a getaddrinfo() call handed to the threads, it has its own copy of the host so it can outlive the entry */
+typedef struct dns_job {
+  struct list_head link;
+  DnsEntry* entry;
+  char* host;
+  int error;
+  struct addrinfo* res;
+} DnsJob;
+
+typedef struct dns_waiter {
+  struct list_head link;
+  dns_callback* cb;
+  void* opaque;
+} DnsWaiter;
+
+/**
+ * The threads and the owner share the job lists, guarded by lock. Each thread holds
+ * a reference, so dns_free() doesn't have to wait for a getaddrinfo() to return.
+ * The cache is only touched by the owner.
+ */
+struct dns_resolver {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct list_head jobs, done;
+  int ref_count;
+  uint32_t threads, max_threads, idle;
+  BOOL quit;
+  int pipe[2];
+  struct list_head cache;
+  uint32_t ttl, negative_ttl;
+  DnsStats stats;
+};
+
+static int64_t dns_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void dns_job_free(DnsJob* job) {
+  if(job->res)
+    freeaddrinfo(job->res);
+
+  free(job->host);
+  free(job);
+}
+
+/* drop a reference with lock held, the last one frees the resolver */
+static void dns_release(DnsResolver* r) {
+  struct list_head *el, *next;
+  BOOL last = --r->ref_count == 0;
+
+  pthread_mutex_unlock(&r->lock);
+
+  if(!last)
+    return;
+
+  list_for_each_safe(el, next, &r->jobs) { dns_job_free(list_entry(el, DnsJob, link)); }
+  list_for_each_safe(el, next, &r->done) { dns_job_free(list_entry(el, DnsJob, link)); }
+
+  close(r->pipe[0]);
+  close(r->pipe[1]);
+  pthread_cond_destroy(&r->cond);
+  pthread_mutex_destroy(&r->lock);
+  free(r);
+}
+
+static void* dns_thread(void* arg) {
+  DnsResolver* r = arg;
+  struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_ADDRCONFIG};
+
+  pthread_mutex_lock(&r->lock);
+
+  for(;;) {
+    DnsJob* job;
+
+    r->idle++;
+
+    while(!r->quit && list_empty(&r->jobs))
+      pthread_cond_wait(&r->cond, &r->lock);
+
+    r->idle--;
+
+    if(r->quit)
+      break;
+
+    job = list_entry(r->jobs.next, DnsJob, link);
+    list_del(&job->link);
+    pthread_mutex_unlock(&r->lock);
+
+    job->error = getaddrinfo(job->host, 0, &hints, &job->res);
+
+    pthread_mutex_lock(&r->lock);
+    list_add_tail(&job->link, &r->done);
+
+    /* the pipe is non-blocking, when it's full the owner has a wakeup pending anyway */
+    (void)!write(r->pipe[1], "", 1);
+  }
+
+  r->threads--;
+  dns_release(r);
+  return 0;
+}
+
+DnsResolver* dns_new(uint32_t threads) {
+  DnsResolver* r;
+
+  if(!(r = calloc(1, sizeof(DnsResolver))))
+    return 0;
+
+  if(pipe(r->pipe) == -1) {
+    free(r);
+    return 0;
+  }
+
+  for(int i = 0; i < 2; i++) {
+    fcntl(r->pipe[i], F_SETFL, fcntl(r->pipe[i], F_GETFL) | O_NONBLOCK);
+    fcntl(r->pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  pthread_mutex_init(&r->lock, 0);
+  pthread_cond_init(&r->cond, 0);
+  init_list_head(&r->jobs);
+  init_list_head(&r->done);
+  init_list_head(&r->cache);
+  r->ref_count = 1;
+  r->max_threads = threads ? threads : DNS_THREADS;
+  r->ttl = DNS_TTL;
+  r->negative_ttl = DNS_NEGATIVE_TTL;
+
+  return r;
+}
+
+static void dns_entry_free(DnsEntry* e) {
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &e->waiters) { free(list_entry(el, DnsWaiter, link)); }
+
+  for(uint32_t i = 0; i < e->naddrs; i++)
+    free(e->addrs[i]);
+
+  free(e->addrs);
+  free(e->host);
+  free(e);
+}
+
+static void dns_entry_unref(DnsEntry* e) {
+  if(--e->ref_count == 0)
+    dns_entry_free(e);
+}
+
+/* take e out of the cache, it is freed once dns_process() is done calling its waiters */
+static void dns_remove(DnsResolver* r, DnsEntry* e) {
+  list_del(&e->link);
+  init_list_head(&e->link);
+  r->stats.entries--;
+  dns_entry_unref(e);
+}
+
+/**
+ * Give up the resolver. Lookups still running finish in their threads and are thrown
+ * away, the callbacks waiting for them aren't called.
+ */
+void dns_free(DnsResolver* r) {
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &r->cache) { dns_remove(r, list_entry(el, DnsEntry, link)); }
+
+  pthread_mutex_lock(&r->lock);
+  r->quit = TRUE;
+  pthread_cond_broadcast(&r->cond);
+  dns_release(r);
+}
+
+void dns_ttl(DnsResolver* r, uint32_t ttl, uint32_t negative_ttl) {
+  r->ttl = ttl;
+  r->negative_ttl = negative_ttl;
+}
+
+/* readable when dns_process() has callbacks to call */
+int dns_fd(DnsResolver* r) { return r->pipe[0]; }
+
+/* drop the least recently used entries over the limit, those still being looked up stay */
+static void dns_trim(DnsResolver* r) {
+  struct list_head *el, *prev;
+
+  for(el = r->cache.prev; el != &r->cache && r->stats.entries > DNS_MAX_ENTRIES; el = prev) {
+    DnsEntry* e = list_entry(el, DnsEntry, link);
+
+    prev = el->prev;
+
+    if(!e->pending)
+      dns_remove(r, e);
+  }
+}
+
+static DnsEntry* dns_find(DnsResolver* r, const char* host) {
+  struct list_head* el;
+
+  list_for_each(el, &r->cache) {
+    DnsEntry* e = list_entry(el, DnsEntry, link);
+
+    if(!strcasecmp(e->host, host))
+      return e;
+  }
+
+  return 0;
+}
+
+/* queue a getaddrinfo() for entry, starting another thread while none is idle */
+static BOOL dns_submit(DnsResolver* r, DnsEntry* e) {
+  DnsJob* job;
+
+  if(!(job = calloc(1, sizeof(DnsJob))))
+    return FALSE;
+
+  if(!(job->host = strdup(e->host))) {
+    free(job);
+    return FALSE;
+  }
+
+  job->entry = e;
+
+  pthread_mutex_lock(&r->lock);
+  list_add_tail(&job->link, &r->jobs);
+
+  if(r->idle == 0 && r->threads < r->max_threads) {
+    pthread_t thread;
+
+    if(!pthread_create(&thread, 0, dns_thread, r)) {
+      pthread_detach(thread);
+      r->threads++;
+      r->ref_count++;
+    } else if(r->threads == 0) {
+      list_del(&job->link);
+      pthread_mutex_unlock(&r->lock);
+      dns_job_free(job);
+      return FALSE;
+    }
+  }
+
+  pthread_cond_signal(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+
+  r->stats.lookups++;
+  r->stats.pending++;
+  return TRUE;
+}
+
+/**
+ * The addresses of host. Returns 1 with *entryp set when the cache has an answer,
+ * positive or negative. Otherwise returns 0 and cb is called from dns_process() once
+ * the lookup is done, lookups of the same host share one getaddrinfo(). -1 when out of memory.
+ */
+int dns_lookup(DnsResolver* r, const char* host, const DnsEntry** entryp, dns_callback* cb, void* opaque) {
+  DnsEntry* e;
+  DnsWaiter* w;
+
+  if((e = dns_find(r, host)) && !e->pending && e->expires <= dns_now()) {
+    dns_remove(r, e);
+    r->stats.expired++;
+    e = 0;
+  }
+
+  if(e && !e->pending) {
+    list_del(&e->link);
+    list_add(&e->link, &r->cache);
+
+    if(e->error)
+      r->stats.negative_hits++;
+    else
+      r->stats.hits++;
+
+    *entryp = e;
+    return 1;
+  }
+
+  if(!(w = malloc(sizeof(DnsWaiter))))
+    return -1;
+
+  w->cb = cb;
+  w->opaque = opaque;
+
+  if(!e) {
+    if(!(e = calloc(1, sizeof(DnsEntry))) || !(e->host = strdup(host))) {
+      free(e);
+      free(w);
+      return -1;
+    }
+
+    init_list_head(&e->waiters);
+    e->pending = TRUE;
+    e->ref_count = 1;
+
+    if(!dns_submit(r, e)) {
+      dns_entry_free(e);
+      free(w);
+      return -1;
+    }
+
+    list_add(&e->link, &r->cache);
+    r->stats.entries++;
+    dns_trim(r);
+  }
+
+  r->stats.misses++;
+  list_add_tail(&w->link, &e->waiters);
+  return 0;
+}
+
+/* the numeric addresses of a getaddrinfo() result, duplicates left out */
+static void dns_addresses(DnsEntry* e, struct addrinfo* res) {
+  struct addrinfo* ai;
+  uint32_t n = 0;
+
+  for(ai = res; ai; ai = ai->ai_next)
+    n++;
+
+  if(!(e->addrs = calloc(n ? n : 1, sizeof(char*))))
+    return;
+
+  for(ai = res; ai; ai = ai->ai_next) {
+    char buf[INET6_ADDRSTRLEN];
+    const void* addr;
+    uint32_t i;
+
+    if(ai->ai_family == AF_INET)
+      addr = &((struct sockaddr_in*)ai->ai_addr)->sin_addr;
+    else if(ai->ai_family == AF_INET6)
+      addr = &((struct sockaddr_in6*)ai->ai_addr)->sin6_addr;
+    else
+      continue;
+
+    if(!inet_ntop(ai->ai_family, addr, buf, sizeof(buf)))
+      continue;
+
+    for(i = 0; i < e->naddrs; i++)
+      if(!strcmp(e->addrs[i], buf))
+        break;
+
+    if(i == e->naddrs && (e->addrs[e->naddrs] = strdup(buf)))
+      e->naddrs++;
+  }
+}
+
+/**
+ * Move finished lookups into the cache and call whoever waits for them.
+ * Returns the number of lookups completed.
+ */
+int dns_process(DnsResolver* r) {
+  char buf[64];
+  struct list_head done, *el, *next;
+  int ret = 0;
+
+  while(read(r->pipe[0], buf, sizeof(buf)) > 0) {
+  }
+
+  init_list_head(&done);
+
+  pthread_mutex_lock(&r->lock);
+
+  list_for_each_safe(el, next, &r->done) {
+    list_del(el);
+    list_add_tail(el, &done);
+  }
+
+  pthread_mutex_unlock(&r->lock);
+
+  list_for_each_safe(el, next, &done) {
+    DnsJob* job = list_entry(el, DnsJob, link);
+    DnsEntry* e = job->entry;
+    struct list_head waiters, *wl, *wnext;
+
+    if(!job->error)
+      dns_addresses(e, job->res);
+
+    e->error = job->error ? job->error : e->naddrs ? 0 : EAI_NONAME;
+    e->expires = dns_now() + (int64_t)(e->error ? r->negative_ttl : r->ttl) * 1000;
+    e->pending = FALSE;
+
+    if(e->error)
+      r->stats.failures++;
+
+    r->stats.pending--;
+    ret++;
+
+    /* a callback may look up the same host again, it finds the entry complete. it may also
+       flush or trim the cache, the entry stays until the last waiter has seen it */
+    init_list_head(&waiters);
+    e->ref_count++;
+
+    list_for_each_safe(wl, wnext, &e->waiters) {
+      list_del(wl);
+      list_add_tail(wl, &waiters);
+    }
+
+    list_for_each_safe(wl, wnext, &waiters) {
+      DnsWaiter* w = list_entry(wl, DnsWaiter, link);
+
+      w->cb(w->opaque, e);
+      free(w);
+    }
+
+    dns_entry_unref(e);
+    dns_job_free(job);
+  }
+
+  dns_trim(r);
+  return ret;
+}
+
+/* forget every answer, lookups still running stay */
+void dns_flush(DnsResolver* r) {
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &r->cache) {
+    DnsEntry* e = list_entry(el, DnsEntry, link);
+
+    if(!e->pending)
+      dns_remove(r, e);
+  }
+}
+
+const DnsStats* dns_stats(DnsResolver* r) { return &r->stats; }
+
+/* an address that needs no lookup */
+BOOL dns_numeric(const char* host) {
+  uint8_t addr[sizeof(struct in6_addr)];
+
+  return inet_pton(AF_INET, host, addr) == 1 || inet_pton(AF_INET6, host, addr) == 1;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file dns.h
+ */
+#ifndef QJSNET_LIB_DNS_H
+#define QJSNET_LIB_DNS_H
+
+#include <cutils.h>
+#include <list.h>
+#include <stdint.h>
+
+/* getaddrinfo() has no TTL to offer, entries live for a fixed time */
+#define DNS_THREADS 4
+#define DNS_TTL 60
+#define DNS_NEGATIVE_TTL 5
+#define DNS_MAX_ENTRIES 1024
+
+typedef struct dns_entry DnsEntry;
+typedef struct dns_resolver DnsResolver;
+typedef void dns_callback(void* opaque, const DnsEntry* entry);
+
+/* a host and its addresses, or why it has none */
+struct dns_entry {
+  struct list_head link; /* in the cache, most recently used first */
+  char* host;
+  int error; /* EAI_* of a failed lookup */
+  uint32_t naddrs;
+  char** addrs; /* numeric, in the order getaddrinfo() prefers them */
+  int64_t expires;
+  struct list_head waiters; /* callbacks while the lookup runs */
+  BOOL pending;
+  int ref_count; /* the cache's, and dns_process()'s while it calls the waiters */
+};
+
+typedef struct dns_stats {
+  uint64_t hits, negative_hits; /* answered from the cache */
+  uint64_t misses;              /* had to wait for a lookup */
+  uint64_t lookups, failures;   /* getaddrinfo() calls, those that failed */
+  uint64_t expired;
+  uint32_t entries, pending;
+} DnsStats;
+
+DnsResolver* dns_new(uint32_t threads);
+void dns_free(DnsResolver*);
+void dns_ttl(DnsResolver*, uint32_t ttl, uint32_t negative_ttl);
+int dns_fd(DnsResolver*);
+int dns_lookup(DnsResolver*, const char* host, const DnsEntry** entryp, dns_callback* cb, void* opaque);
+int dns_process(DnsResolver*);
+void dns_flush(DnsResolver*);
+const DnsStats* dns_stats(DnsResolver*);
+BOOL dns_numeric(const char* host);
+
+#endif /* QJSNET_LIB_DNS_H */
@@ -0,0 +1,165 @@
+/**
+ * @file evloop.c
+ */
+#include "evloop.h"
+#include "utils.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <poll.h>
+
+static uint32_t evloop_epoll_events(int events) {
+  uint32_t ret = 0;
+
+  if(events & POLLIN)
+    ret |= EPOLLIN;
+  if(events & POLLOUT)
+    ret |= EPOLLOUT;
+
+  return ret;
+}
+
+static short evloop_poll_events(uint32_t events) {
+  short ret = 0;
+
+  if(events & EPOLLIN)
+    ret |= POLLIN;
+  if(events & EPOLLOUT)
+    ret |= POLLOUT;
+  if(events & EPOLLERR)
+    ret |= POLLERR;
+  if(events & (EPOLLHUP | EPOLLRDHUP))
+    ret |= POLLHUP;
+
+  return ret;
+}
+
+static int evloop_ctl(struct event_loop* loop, int op, int fd, int events) {
+  struct epoll_event ev = {.events = evloop_epoll_events(events), .data.fd = fd};
+
+  if(epoll_ctl(loop->fd, op, fd, &ev) == -1) {
+    lwsl_err("epoll_ctl(%d, %d) error: %s\n", op, fd, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+#endif
+
+BOOL evloop_supported(void) {
+#ifdef __linux__
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+struct event_loop* evloop_new(JSContext* ctx) {
+  struct event_loop* loop;
+
+  if(!(loop = js_mallocz(ctx, sizeof(struct event_loop))))
+    return 0;
+
+  loop->ref_count = 1;
+  loop->rt = JS_GetRuntime(ctx);
+  loop->fd = -1;
+
+#ifdef __linux__
+  if((loop->fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    lwsl_err("epoll_create1() error: %s\n", strerror(errno));
+    js_free(ctx, loop);
+    return 0;
+  }
+#endif
+
+  return loop;
+}
+
+struct event_loop* evloop_dup(struct event_loop* loop) {
+  ++loop->ref_count;
+  return loop;
+}
+
+void evloop_free(struct event_loop* loop) {
+  if(--loop->ref_count == 0) {
+    if(loop->fd != -1)
+      close(loop->fd);
+
+    js_free_rt(loop->rt, loop);
+  }
+}
+
+int evloop_add(struct event_loop* loop, int fd, int events) {
+#ifdef __linux__
+  if(evloop_ctl(loop, EPOLL_CTL_ADD, fd, events))
+    return -1;
+
+  ++loop->nfds;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+int evloop_modify(struct event_loop* loop, int fd, int events) {
+#ifdef __linux__
+  return evloop_ctl(loop, EPOLL_CTL_MOD, fd, events);
+#else
+  return -1;
+#endif
+}
+
+int evloop_delete(struct event_loop* loop, int fd) {
+#ifdef __linux__
+  /* the fd may already be closed, in which case the kernel dropped it from the set */
+  if(epoll_ctl(loop->fd, EPOLL_CTL_DEL, fd, 0) == -1) {
+    if(errno != EBADF && errno != ENOENT)
+      lwsl_err("epoll_ctl(DEL, %d) error: %s\n", fd, strerror(errno));
+
+    if(errno == ENOENT)
+      return 0;
+  }
+
+  if(loop->nfds > 0)
+    --loop->nfds;
+
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * Collect all ready fds without blocking and hand them to lws_service_fd() in one batch.
+ *
+ * @return number of serviced fds, or -1 on error
+ */
+int evloop_dispatch(struct event_loop* loop) {
+#ifdef __linux__
+  struct epoll_event events[EVLOOP_MAX_EVENTS];
+  int i, n;
+
+  if(!loop->lws)
+    return 0;
+
+  if((n = epoll_wait(loop->fd, events, countof(events), 0)) == -1) {
+    if(errno != EINTR)
+      lwsl_err("epoll_wait() error: %s\n", strerror(errno));
+    return errno == EINTR ? 0 : -1;
+  }
+
+  for(i = 0; i < n; i++) {
+    short revents = evloop_poll_events(events[i].events);
+    struct lws_pollfd pfd = {events[i].data.fd, revents, revents};
+
+    lws_service_fd(loop->lws, &pfd);
+  }
+
+  return n;
+#else
+  return -1;
+#endif
+}
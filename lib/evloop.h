@@ -0,0 +1,31 @@
+/**
+ * @file evloop.h
+ */
+#ifndef QJSNET_LIB_EVLOOP_H
+#define QJSNET_LIB_EVLOOP_H
+
+#include <quickjs.h>
+#include <libwebsockets.h>
+
+#define EVLOOP_MAX_EVENTS 256
+
+/* native event loop: one epoll fd per lws_context, registered once with the JS loop */
+struct event_loop {
+  int ref_count;
+  int fd;
+  uint32_t nfds;
+  BOOL registered;
+  JSRuntime* rt;
+  struct lws_context* lws;
+};
+
+BOOL evloop_supported(void);
+struct event_loop* evloop_new(JSContext*);
+struct event_loop* evloop_dup(struct event_loop*);
+void evloop_free(struct event_loop*);
+int evloop_add(struct event_loop*, int fd, int events);
+int evloop_modify(struct event_loop*, int fd, int events);
+int evloop_delete(struct event_loop*, int fd);
+int evloop_dispatch(struct event_loop*);
+
+#endif /* QJSNET_LIB_EVLOOP_H */
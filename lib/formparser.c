@@ -1,16 +1,231 @@
 /**
  * @file formparser.c
  */
+#define _GNU_SOURCE
 #include "formparser.h"
 #include "js-utils.h"
 #include "utils.h"
 #include "ws.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* a file part goes to an anonymous O_TMPFILE, an aborted upload leaves nothing behind */
+static int formparser_open(FormParser* fp) {
+  size_t n = strlen(fp->save.dir) + sizeof("/upload-XXXXXX");
+
+#ifdef O_TMPFILE
+  if((fp->save.fd = open(fp->save.dir, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0600)) != -1)
+    return 0;
+#endif
+
+  if(!(fp->save.path = malloc(n)))
+    return -1;
+
+  snprintf(fp->save.path, n, "%s/upload-XXXXXX", fp->save.dir);
+
+  if((fp->save.fd = mkstemp(fp->save.path)) == -1) {
+    free(fp->save.path);
+    fp->save.path = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* a complete O_TMPFILE gets its name, linkat() fails rather than replace another upload */
+static int formparser_link(FormParser* fp) {
+  static uint32_t counter;
+  char proc[32], *path;
+  size_t n = strlen(fp->save.dir) + 64;
+
+  if(fp->save.path)
+    return 0;
+
+  if(!(path = malloc(n)))
+    return -1;
+
+  snprintf(proc, sizeof(proc), "/proc/self/fd/%d", fp->save.fd);
+
+  for(int i = 0; i < 16; i++) {
+    snprintf(path, n, "%s/upload-%d-%lx-%u", fp->save.dir, (int)getpid(), (unsigned long)time(0), ++counter);
+
+    if(!linkat(AT_FDCWD, proc, AT_FDCWD, path, AT_SYMLINK_FOLLOW)) {
+      fp->save.path = path;
+      return 0;
+    }
+
+    if(errno != EEXIST)
+      break;
+  }
+
+  free(path);
+  return -1;
+}
+
+static void formparser_forget(FormParser* fp) {
+  free(fp->save.name);
+  free(fp->save.filename);
+  free(fp->save.path);
+  fp->save.name = fp->save.filename = fp->save.path = 0;
+
+  if(fp->save.digest) {
+    digest_free(fp->save.digest);
+    fp->save.digest = 0;
+  }
+}
+
+/* drop the file part being written */
+static void formparser_discard(FormParser* fp) {
+  if(fp->save.fd == -1)
+    return;
+
+  close(fp->save.fd);
+  fp->save.fd = -1;
+
+  if(fp->save.path)
+    unlink(fp->save.path);
+
+  formparser_forget(fp);
+}
+
+static int formparser_fail(FormParser* fp, int status) {
+  formparser_discard(fp);
+  fp->status = status;
+  return -1;
+}
+
+static void formparser_emit(FormParser* fp, JSCallback* cb, JSValue arg) {
+  JSValue result, args[2] = {JS_NewString(cb->ctx, fp->save.name ? fp->save.name : ""), arg};
+
+  result = callback_emit(cb, 2, args);
+
+  if(JS_IsException(result))
+    js_error_print(cb->ctx, fp->exception = JS_GetException(cb->ctx));
+
+  JS_FreeValue(cb->ctx, result);
+  JS_FreeValue(cb->ctx, args[0]);
+  JS_FreeValue(cb->ctx, args[1]);
+}
+
+/* the file part is complete: onclose(name, { filename, path, size, digest }) */
+static int formparser_finish(FormParser* fp) {
+  JSCallback* cb = &fp->cb.close;
+  char hex[LWS_GENHASH_LARGEST * 2 + 1];
+
+  if(fp->save.fd == -1)
+    return 0;
+
+  if(formparser_link(fp) || (fp->save.digest && !digest_final(fp->save.digest)))
+    return formparser_fail(fp, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+
+  close(fp->save.fd);
+  fp->save.fd = -1;
+
+  if(callback_valid(cb)) {
+    JSValue info = JS_NewObject(cb->ctx);
+
+    JS_SetPropertyStr(cb->ctx, info, "filename", JS_NewString(cb->ctx, fp->save.filename ? fp->save.filename : ""));
+    JS_SetPropertyStr(cb->ctx, info, "path", JS_NewString(cb->ctx, fp->save.path));
+    JS_SetPropertyStr(cb->ctx, info, "size", JS_NewInt64(cb->ctx, fp->save.size));
+
+    if(fp->save.digest)
+      JS_SetPropertyStr(cb->ctx, info, "digest", JS_NewString(cb->ctx, digest_hex(fp->save.digest, hex)));
+
+    formparser_emit(fp, cb, info);
+  }
+
+  formparser_forget(fp);
+  return 0;
+}
+
+static int formparser_write(FormParser* fp, const char* buf, int len) {
+  if(fp->save.max_size && fp->save.size + len > fp->save.max_size)
+    return formparser_fail(fp, HTTP_STATUS_REQ_ENTITY_TOO_LARGE);
+
+  if(fp->save.digest && !digest_update(fp->save.digest, buf, len))
+    return formparser_fail(fp, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+
+  fp->save.size += len;
+
+  while(len > 0) {
+    ssize_t r = write(fp->save.fd, buf, len);
+
+    if(r == -1 && errno == EINTR)
+      continue;
+
+    if(r <= 0)
+      return formparser_fail(fp, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+
+    buf += r;
+    len -= r;
+  }
+
+  return 0;
+}
+
+/* with saveTo, file parts never reach JS, only their start and end do */
+static int formparser_save_callback(FormParser* fp, const char* name, const char* filename, char* buf, int len, enum lws_spa_fileupload_states state) {
+  switch(state) {
+    case LWS_UFS_OPEN: {
+      if(formparser_finish(fp))
+        return -1;
+
+      if(fp->save.max_files && fp->save.files >= fp->save.max_files)
+        return formparser_fail(fp, HTTP_STATUS_REQ_ENTITY_TOO_LARGE);
+
+      if(formparser_open(fp))
+        return formparser_fail(fp, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+
+      if(fp->save.digest_type && !(fp->save.digest = digest_new(fp->save.digest_type)))
+        return formparser_fail(fp, HTTP_STATUS_INTERNAL_SERVER_ERROR);
+
+      fp->save.name = name ? strdup(name) : 0;
+      fp->save.filename = filename ? strdup(filename) : 0;
+      fp->save.size = 0;
+      fp->save.files++;
+
+      if(callback_valid(&fp->cb.open))
+        formparser_emit(fp, &fp->cb.open, filename ? JS_NewString(fp->cb.open.ctx, filename) : JS_NULL);
+
+      break;
+    }
+
+    case LWS_UFS_CONTENT:
+    case LWS_UFS_FINAL_CONTENT: {
+      if(fp->save.fd == -1)
+        break;
+
+      if(len > 0 && formparser_write(fp, buf, len))
+        return -1;
+
+      if(state == LWS_UFS_FINAL_CONTENT)
+        return formparser_finish(fp);
+
+      break;
+    }
+
+    /* lws ends each complete part with LWS_UFS_FINAL_CONTENT, one still open was cut short */
+    case LWS_UFS_CLOSE: {
+      formparser_discard(fp);
+      break;
+    }
+  }
+
+  return 0;
+}
 
 static int formparser_callback(void* data, const char* name, const char* filename, char* buf, int len, enum lws_spa_fileupload_states state) {
   FormParser* fp = data;
   JSCallback* cb = 0;
   JSValue result, args[2] = {JS_NULL, JS_NULL};
 
+  if(fp->save.dir)
+    return formparser_save_callback(fp, name, filename, buf, len, state);
+
   switch(state) {
     case LWS_UFS_CONTENT:
     case LWS_UFS_FINAL_CONTENT: {
@@ -106,6 +321,22 @@ void formparser_init(FormParser* fp, struct socket* ws, int nparams, const char*
   fp->exception = JS_NULL;
   fp->name = JS_UNDEFINED;
   fp->file = JS_UNDEFINED;
+  fp->save.fd = -1;
+}
+
+/**
+ * Write file parts to temporary files in dir instead of passing their content to JS.
+ * A part over max_size bytes or more than max_files parts stop the parser with status 413,
+ * 0 means no limit. digest_type is a LWS_GENHASH_TYPE_* computed while writing, or LWS_GENHASH_TYPE_UNKNOWN.
+ */
+int formparser_save(FormParser* fp, const char* dir, uint64_t max_size, uint32_t max_files, int digest_type) {
+  if(!(fp->save.dir = strdup(dir)))
+    return -1;
+
+  fp->save.max_size = max_size;
+  fp->save.max_files = max_files;
+  fp->save.digest_type = digest_type;
+  return 0;
 }
 
 FormParser* formparser_alloc(JSContext* ctx) {
@@ -118,6 +349,8 @@ FormParser* formparser_alloc(JSContext* ctx) {
 }
 
 void formparser_clear(FormParser* fp, JSRuntime* rt) {
+  formparser_discard(fp);
+
   if(fp->spa) {
     lws_spa_destroy(fp->spa);
     fp->spa = 0;
@@ -131,6 +364,9 @@ void formparser_clear(FormParser* fp, JSRuntime* rt) {
   FREECB_RT(fp->cb.content);
   FREECB_RT(fp->cb.open);
   FREECB_RT(fp->cb.close);
+
+  free(fp->save.dir);
+  fp->save.dir = 0;
 }
 
 void formparser_free(FormParser* fp, JSRuntime* rt) {
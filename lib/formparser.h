@@ -7,6 +7,7 @@
 #include <libwebsockets.h>
 #include <stdbool.h>
 #include "callback.h"
+#include "digest.h"
 
 typedef struct form_parser {
   int ref_count;
@@ -20,9 +21,20 @@ typedef struct form_parser {
   JSValue exception;
   JSValue name, file;
   size_t read;
+  struct {
+    char* dir;
+    char *name, *filename; /* of the file part being written */
+    char* path;            /* null while an O_TMPFILE has no name yet */
+    int fd, digest_type;
+    uint64_t max_size, size;
+    uint32_t max_files, files;
+    Digest* digest;
+  } save;
+  int status; /* HTTP status to answer with when the parser gave up */
 } FormParser;
 
 void formparser_init(FormParser*, struct socket* ws, int nparams, const char* const* param_names, size_t chunk_size);
+int formparser_save(FormParser*, const char* dir, uint64_t max_size, uint32_t max_files, int digest_type);
 FormParser* formparser_alloc(JSContext*);
 void formparser_clear(FormParser*, JSRuntime* rt);
 void formparser_free(FormParser*, JSRuntime* rt);
@@ -17,6 +17,31 @@ static JSValue dequeue_value(Generator* gen, BOOL* done_p, BOOL* binary_p) {
   return ret;
 }
 
+/**
+ * Pauses the writer when more than the high water mark is queued, resumes it below half of that.
+ * A generator collecting everything for its callback can't be drained before it's complete, it never pauses.
+ */
+static void flow_update(Generator* gen) {
+  size_t queued;
+  BOOL collecting;
+
+  if(!gen->flow.fn)
+    return;
+
+  queued = gen->q ? queue_bytes(gen->q) : 0;
+  collecting = JS_IsFunction(gen->ctx, gen->callback);
+
+  if(!gen->flow.paused) {
+    if(queued >= gen->flow.high_water && !collecting) {
+      gen->flow.paused = TRUE;
+      gen->flow.fn(gen->flow.opaque, TRUE);
+    }
+  } else if(queued <= gen->flow.high_water / 2 || collecting) {
+    gen->flow.paused = FALSE;
+    gen->flow.fn(gen->flow.opaque, FALSE);
+  }
+}
+
 static Queue* create_queue(Generator* gen) {
   if(!gen->q) {
 
@@ -87,7 +112,9 @@ static ssize_t enqueue_block(Generator* gen, ByteBlock blk, JSValueConst callbac
 static ssize_t enqueue_value(Generator* gen, JSValueConst value, JSValueConst callback) {
   ssize_t ret;
   JSBuffer buf = js_input_chars(gen->ctx, value);
-  ByteBlock blk = block_copy(buf.data, buf.size);
+  size_t size;
+  const uint8_t* data = js_buffer_view(&buf, &size);
+  ByteBlock blk = block_copy(data, size);
 
   js_buffer_free(&buf, JS_GetRuntime(gen->ctx));
 
@@ -131,7 +158,7 @@ static int generator_update(Generator* gen) {
   while(!list_empty(&gen->iterator.reads) && gen->q && queue_size(gen->q)) {
     BOOL done = FALSE, binary = FALSE;
     JSValue chunk;
-    size_t s = block_SIZE(&queue_front(gen->q)->block);
+    size_t s = queue_item_size(queue_front(gen->q));
 
     if(!gen->closing)
       if(gen->buffering && s < gen->chunk_size)
@@ -163,6 +190,9 @@ static int generator_update(Generator* gen) {
     ++i;
   }
 
+  if(i)
+    flow_update(gen);
+
 #ifdef DEBUG_OUTPUT
   lwsl_user("DEBUG                    %-22s gen: %p chunk_size: %zu i: %i reads: %zu continuous: %i buffering: %i closing: %i closed: %i r/w: %zu/%zu queue: %zu/%zub\n",
             __func__,
@@ -330,7 +360,7 @@ ssize_t generator_write(Generator* gen, const void* data, size_t len, JSValueCon
 
     // gen->buffering = !queue_empty(gen->q);
 
-    while(asynciterator_pending(&gen->iterator) && gen->q && !queue_empty(gen->q) && block_SIZE(&queue_front(gen->q)->block) >= gen->chunk_size) {
+    while(asynciterator_pending(&gen->iterator) && gen->q && !queue_empty(gen->q) && queue_item_size(queue_front(gen->q)) >= gen->chunk_size) {
       BOOL done = FALSE, binary = FALSE;
 
 #ifdef DEBUG_OUTPUT
@@ -349,6 +379,8 @@ ssize_t generator_write(Generator* gen, const void* data, size_t len, JSValueCon
     gen->chunks_written += 1;
   }
 
+  flow_update(gen);
+
 #ifdef DEBUG_OUTPUT
   lwsl_user("DEBUG                    %-22s gen: %p chunk_size: %zu data: '%.*s' len: %zu reads: %zu continuous: %i buffering: %i closing: %i closed: %i r/w: %zu/%zu queue: %zu/%zub\n",
             __func__,
@@ -576,6 +608,7 @@ BOOL generator_continuous(Generator* gen, JSValueConst callback) {
       q->continuous = TRUE;
     }
 
+    flow_update(gen);
     return item != NULL;
   }
 
@@ -641,6 +674,165 @@ BOOL generator_buffering(Generator* gen, size_t chunk_size) {
   return q != NULL;
 }
 
+/**
+ * Lets the writer of a generator know when its reader falls behind.
+ *
+ * @param gen        Pointer to generator struct
+ * @param high_water Queued bytes at which fn is called to pause
+ * @param fn         Called to pause and resume, 0 to stop flow control (a paused writer is resumed)
+ * @param opaque     Passed to fn
+ */
+void generator_flow(Generator* gen, size_t high_water, generator_flow_fn* fn, void* opaque) {
+  if(gen->flow.paused && gen->flow.fn) {
+    gen->flow.paused = FALSE;
+    gen->flow.fn(gen->flow.opaque, FALSE);
+  }
+
+  gen->flow.high_water = high_water;
+  gen->flow.fn = fn;
+  gen->flow.opaque = opaque;
+
+  flow_update(gen);
+}
+
+/**
+ * Takes the chunks queued right now without waiting, to read them in batches.
+ *
+ * @param gen        Pointer to generator struct
+ * @param first      A chunk dequeued already which leads the batch, or JS_UNDEFINED
+ * @param max_bytes  Bytes per batch, at least one chunk is taken (0 for no limit)
+ * @param max_chunks Chunks per batch (0 for no limit)
+ * @param concat     Merge the chunks into one value instead of returning them in an Array
+ * @param done_p     Set when the end of the generator was reached
+ *
+ * @return an Array, the merged value or JS_UNDEFINED when there was nothing to take
+ */
+JSValue generator_drain(Generator* gen, JSValueConst first, size_t max_bytes, uint32_t max_chunks, BOOL concat, BOOL* done_p) {
+  ByteBlock merged = BLOCK_0();
+  JSValue ret = concat ? JS_UNDEFINED : JS_NewArray(gen->ctx);
+  QueueItem* item;
+  size_t bytes = 0;
+  uint32_t n = 0;
+
+  *done_p = FALSE;
+
+  if(!JS_IsUndefined(first)) {
+    JSBuffer buf = js_input_chars(gen->ctx, first);
+
+    if(concat)
+      block_append(&merged, buf.data, buf.size);
+    else
+      JS_SetPropertyUint32(gen->ctx, ret, n, JS_DupValue(gen->ctx, first));
+
+    bytes = buf.size;
+    n++;
+    js_buffer_free(&buf, JS_GetRuntime(gen->ctx));
+  }
+
+  while(gen->q && (item = queue_front(gen->q))) {
+    size_t size;
+    ByteBlock blk;
+
+    queue_check(gen->q, item);
+    size = queue_item_size(item);
+
+    /* the end is an empty item which stays in the queue */
+    if(item->done) {
+      *done_p = TRUE;
+      break;
+    }
+
+    if(n && ((max_chunks && n >= max_chunks) || (max_bytes && bytes + size > max_bytes)))
+      break;
+
+    blk = queue_next(gen->q, 0, 0);
+    gen->bytes_read += size;
+    gen->chunks_read += 1;
+    bytes += size;
+
+    if(!size) {
+      block_free(&blk);
+      continue;
+    }
+
+    if(concat) {
+      block_append(&merged, block_BEGIN(&blk), size);
+      block_free(&blk);
+    } else {
+      JS_SetPropertyUint32(gen->ctx, ret, n, gen->block_fn(&blk, gen->ctx));
+    }
+
+    n++;
+  }
+
+  flow_update(gen);
+
+  if(n == 0) {
+    JS_FreeValue(gen->ctx, ret);
+    return JS_UNDEFINED;
+  }
+
+  return concat ? gen->block_fn(&merged, gen->ctx) : ret;
+}
+
+/**
+ * Copies queued bytes into a buffer of the caller, no value is created for them.
+ *
+ * @param gen    Pointer to generator struct
+ * @param first  A chunk dequeued already whose bytes go first, what doesn't fit is queued again, or JS_UNDEFINED
+ * @param buf    Pointer to the buffer
+ * @param n      Size of the buffer
+ * @param done_p Set when the end of the generator was reached
+ *
+ * @return bytes copied or -1 on error
+ */
+ssize_t generator_read_into(Generator* gen, JSValueConst first, void* buf, size_t n, BOOL* done_p) {
+  size_t r = 0;
+
+  *done_p = FALSE;
+
+  if(!JS_IsUndefined(first)) {
+    JSBuffer in = js_input_chars(gen->ctx, first);
+
+    r = MIN(in.size, n);
+    memcpy(buf, in.data, r);
+
+    if(r < in.size) {
+      ByteBlock rest = block_copy(in.data + r, in.size - r);
+
+      if(!create_queue(gen) || !queue_unshift(gen->q, rest)) {
+        block_free(&rest);
+        js_buffer_free(&in, JS_GetRuntime(gen->ctx));
+        return -1;
+      }
+
+      /* it's counted again when it's read */
+      gen->bytes_read -= in.size - r;
+      gen->chunks_read -= 1;
+    }
+
+    js_buffer_free(&in, JS_GetRuntime(gen->ctx));
+  }
+
+  if(gen->q) {
+    size_t items = queue_size(gen->q);
+
+    if(r < n) {
+      ssize_t k = queue_read(gen->q, (uint8_t*)buf + r, n - r);
+
+      gen->bytes_read += k;
+      gen->chunks_read += items - queue_size(gen->q);
+      r += k;
+    }
+
+    *done_p = queue_closed(gen->q);
+  }
+
+  flow_update(gen);
+
+  return r;
+}
+
 /**
  * @}
  */
@@ -8,6 +8,9 @@
 #include "asynciterator.h"
 #include "queue.h"
 
+/* called with pause TRUE when the generator holds too much unread data, FALSE once it drained */
+typedef void generator_flow_fn(void* opaque, BOOL pause);
+
 typedef struct generator {
   union {
     AsyncIterator iterator;
@@ -29,6 +32,12 @@ typedef struct generator {
   uint32_t chunk_size;
   BOOL started, buffering;
   JSValue (*block_fn)(ByteBlock*, JSContext*);
+  struct {
+    size_t high_water; /* queued bytes at which the writer is paused, it resumes at half of it */
+    BOOL paused;
+    generator_flow_fn* fn;
+    void* opaque;
+  } flow;
 } Generator;
 
 void generator_free(Generator*);
@@ -41,6 +50,9 @@ BOOL generator_yield(Generator*, JSValueConst value, JSValueConst callback);
 BOOL generator_stop(Generator*, JSValueConst);
 BOOL generator_continuous(Generator*, JSValueConst callback);
 BOOL generator_buffering(Generator*, size_t chunk_size);
+void generator_flow(Generator*, size_t high_water, generator_flow_fn* fn, void* opaque);
+JSValue generator_drain(Generator*, JSValueConst first, size_t max_bytes, uint32_t max_chunks, BOOL concat, BOOL* done_p);
+ssize_t generator_read_into(Generator*, JSValueConst first, void* buf, size_t n, BOOL* done_p);
 BOOL generator_finish(Generator* gen);
 ssize_t generator_enqueue(Generator* gen, JSValueConst value);
 
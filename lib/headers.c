@@ -5,6 +5,218 @@
 #include "headers.h"
 #include <libwebsockets.h>
 #include <strings.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/* lws' header names hashed like the fields, 1 + token in each used slot */
+#define TOKEN_SLOTS 256
+
+static int16_t token_slots[TOKEN_SLOTS];
+static uint32_t token_hashes[TOKEN_SLOTS];
+static pthread_once_t token_once = PTHREAD_ONCE_INIT;
+
+/* FNV-1a over the lower-cased name */
+uint32_t headers_hash(const char* name, size_t namelen) {
+  uint32_t h = 2166136261u;
+
+  for(size_t i = 0; i < namelen; i++) {
+    h ^= (uint8_t)tolower(name[i]);
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+/* only the tokens of "name:" headers, the first of a name gets the earlier slot */
+static void token_table(void) {
+  for(int tok = WSI_TOKEN_HOST; tok < WSI_TOKEN_COUNT; tok++) {
+    const char* str;
+    size_t len;
+    uint32_t hash, i;
+
+    if(!(str = (const char*)lws_token_to_string(tok)) || (len = strlen(str)) < 2 || str[len - 1] != ':')
+      continue;
+
+    hash = headers_hash(str, len - 1);
+
+    for(i = hash & (TOKEN_SLOTS - 1); token_slots[i]; i = (i + 1) & (TOKEN_SLOTS - 1)) {}
+
+    token_slots[i] = tok + 1;
+    token_hashes[i] = hash;
+  }
+}
+
+static int token_find(uint32_t hash, const char* name, size_t namelen) {
+  pthread_once(&token_once, token_table);
+
+  for(uint32_t i = hash & (TOKEN_SLOTS - 1); token_slots[i]; i = (i + 1) & (TOKEN_SLOTS - 1)) {
+    const char* str;
+
+    if(token_hashes[i] != hash)
+      continue;
+
+    str = (const char*)lws_token_to_string(token_slots[i] - 1);
+
+    if(!strncasecmp(str, name, namelen) && str[namelen] == ':' && str[namelen + 1] == '\0')
+      return token_slots[i] - 1;
+  }
+
+  return -1;
+}
+
+int headers_token(const char* name, size_t namelen) { return token_find(headers_hash(name, namelen), name, namelen); }
+
+static uint32_t* index_slot(HeaderIndex* idx, const uint8_t* base, uint32_t hash, const char* name, size_t namelen) {
+  uint32_t mask = idx->nslots - 1;
+
+  for(uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    uint32_t* slot = &idx->slots[i];
+    HeaderField* f;
+
+    if(!*slot)
+      return slot;
+
+    f = &idx->fields[*slot - 1];
+
+    if(f->hash == hash && f->namelen == namelen && !strncasecmp((const char*)base + f->name, name, namelen))
+      return slot;
+  }
+}
+
+/* (re)fill the hash slots from the fields, the first field of a name owns its slot */
+static BOOL index_rehash(HeaderIndex* idx, const uint8_t* base) {
+  uint32_t nslots = idx->nslots ? idx->nslots : 16;
+
+  while(nslots < idx->count * 2 + 2)
+    nslots <<= 1;
+
+  if(nslots != idx->nslots) {
+    uint32_t* slots;
+
+    if(!(slots = realloc(idx->slots, nslots * sizeof(uint32_t))))
+      return FALSE;
+
+    idx->slots = slots;
+    idx->nslots = nslots;
+  }
+
+  memset(idx->slots, 0, idx->nslots * sizeof(uint32_t));
+
+  for(uint32_t i = 0; i < idx->count; i++) {
+    HeaderField* f = &idx->fields[i];
+    uint32_t* slot = index_slot(idx, base, f->hash, (const char*)base + f->name, f->namelen);
+
+    if(!*slot)
+      *slot = i + 1;
+  }
+
+  return TRUE;
+}
+
+/* add the line at x to the fields, without updating the slots */
+static HeaderField* index_push(HeaderIndex* idx, const uint8_t* base, const uint8_t* x, size_t len) {
+  HeaderField* f;
+  size_t pos;
+
+  if(idx->count == idx->capacity) {
+    uint32_t capacity = idx->capacity ? idx->capacity * 2 : 16;
+    HeaderField* fields;
+
+    if(!(fields = realloc(idx->fields, capacity * sizeof(HeaderField))))
+      return 0;
+
+    idx->fields = fields;
+    idx->capacity = capacity;
+  }
+
+  f = &idx->fields[idx->count++];
+  f->name = x - base;
+  f->namelen = headers_namelen(x, x + len);
+  f->hash = headers_hash((const char*)x, f->namelen);
+  f->token = f->namelen ? token_find(f->hash, (const char*)x, f->namelen) : -1;
+
+  pos = f->namelen + scan_charsetnskip(x + f->namelen, ":", len - f->namelen);
+  pos += scan_charsetnskip(x + pos, " \t", len - pos);
+
+  f->value = f->name + pos;
+  f->valuelen = len - pos;
+
+  return f;
+}
+
+/* slot the field i, unless an earlier field of that name has it */
+static BOOL index_insert(HeaderIndex* idx, const uint8_t* base, uint32_t i) {
+  HeaderField* f = &idx->fields[i];
+  uint32_t* slot;
+
+  if(idx->nslots < idx->count * 2 + 2)
+    return index_rehash(idx, base);
+
+  if(!*(slot = index_slot(idx, base, f->hash, (const char*)base + f->name, f->namelen)))
+    *slot = i + 1;
+
+  return TRUE;
+}
+
+static void index_sync(HeaderIndex* idx, ByteBuffer* b) {
+  idx->start = b->start;
+  idx->write = b->write;
+  idx->gen = b->gen;
+}
+
+/* move the offsets of the fields from i onwards by delta bytes */
+static void index_shift(HeaderIndex* idx, uint32_t i, ssize_t delta) {
+  for(; i < idx->count; i++) {
+    idx->fields[i].name += delta;
+    idx->fields[i].value += delta;
+  }
+}
+
+void headers_index_free(HeaderIndex* idx) {
+  free(idx->fields);
+  free(idx->slots);
+  memset(idx, 0, sizeof(HeaderIndex));
+}
+
+/**
+ * Bring the index up to date with the buffer, parsing it again only when it was changed
+ * other than through the headers_*() functions given this index. The buffer_*() functions
+ * change its generation, the pointers catch writes which bypass them.
+ */
+BOOL headers_index(HeaderIndex* idx, ByteBuffer* b) {
+  const uint8_t *x, *end = b->write;
+
+  if(idx->gen == b->gen && idx->start == b->start && idx->write == b->write)
+    return TRUE;
+
+  idx->count = 0;
+
+  for(x = b->start; x && x < end;) {
+    size_t next = headers_next(x, end, "\r\n");
+
+    if(!index_push(idx, b->start, x, headers_length(x, end, "\r\n")))
+      return FALSE;
+
+    x += next;
+  }
+
+  if(!index_rehash(idx, b->start))
+    return FALSE;
+
+  index_sync(idx, b);
+  return TRUE;
+}
+
+HeaderField* headers_lookup(HeaderIndex* idx, ByteBuffer* b, const char* name, size_t namelen) {
+  uint32_t* slot;
+
+  if(!headers_index(idx, b) || !idx->count)
+    return 0;
+
+  slot = index_slot(idx, b->start, headers_hash(name, namelen), name, namelen);
+
+  return *slot ? &idx->fields[*slot - 1] : 0;
+}
 
 JSValue headers_object(JSContext* ctx, const void* start, const void* e) {
   JSValue ret = JS_NewObject(ctx);
@@ -90,17 +302,21 @@ int headers_fromobj(ByteBuffer* buffer, JSValueConst obj, const char* itemdelim,
   return i;
 }
 
-ssize_t headers_findb(ByteBuffer* b, const char* name, size_t namelen, const char* itemdelim) {
+ssize_t headers_findb(ByteBuffer* b, HeaderIndex* idx, const char* name, size_t namelen, const char* itemdelim) {
   uint8_t *y, *x;
   ssize_t ret = 0;
 
+  if(idx && headers_index(idx, b)) {
+    HeaderField* f = headers_lookup(idx, b, name, namelen);
+
+    return f ? f - idx->fields : -1;
+  }
+
   for(x = b->start; x < b->write;) {
     size_t c = headers_next(x, b->write, itemdelim);
 
     size_t n = headers_namelen(x, (y = x + c));
 
-    // printf("%s %.*s\n", __func__, (int)c, (char*)x);
-
     if(n == namelen)
       if(!strncasecmp((const char*)x, name, namelen))
         return ret;
@@ -131,10 +347,22 @@ char* headers_at(ByteBuffer* b, size_t* lenptr, size_t index, const char* itemde
   return 0;
 }
 
-char* headers_getlen(ByteBuffer* b, size_t* lenptr, const char* name, const char* itemdelim, const char* keydelim) {
+char* headers_getlen(ByteBuffer* b, HeaderIndex* idx, size_t* lenptr, const char* name, const char* itemdelim, const char* keydelim) {
   ssize_t i;
 
-  if((i = headers_find(b, name, itemdelim)) != -1) {
+  if(idx && headers_index(idx, b)) {
+    HeaderField* f;
+
+    if(!(f = headers_lookup(idx, b, name, strlen(name))))
+      return 0;
+
+    if(lenptr)
+      *lenptr = f->valuelen;
+
+    return (char*)b->start + f->value;
+  }
+
+  if((i = headers_find(b, 0, name, itemdelim)) != -1) {
     size_t l, n;
     char* x = headers_at(b, &l, i, itemdelim);
     n = headers_value(x, b->write, keydelim);
@@ -148,16 +376,16 @@ char* headers_getlen(ByteBuffer* b, size_t* lenptr, const char* name, const char
   return 0;
 }
 
-char* headers_get(ByteBuffer* buffer, const char* name, const char* itemdelim, const char* keydelim, JSContext* ctx) {
+char* headers_get(ByteBuffer* buffer, HeaderIndex* idx, const char* name, const char* itemdelim, const char* keydelim, JSContext* ctx) {
   size_t len;
   char* str;
 
-  if((str = headers_getlen(buffer, &len, name, itemdelim, keydelim)))
+  if((str = headers_getlen(buffer, idx, &len, name, itemdelim, keydelim)))
     return js_strndup(ctx, str, len);
   return 0;
 }
 
-ssize_t headers_find(ByteBuffer* buffer, const char* name, const char* itemdelim) { return headers_findb(buffer, name, strlen(name), itemdelim); }
+ssize_t headers_find(ByteBuffer* buffer, HeaderIndex* idx, const char* name, const char* itemdelim) { return headers_findb(buffer, idx, name, strlen(name), itemdelim); }
 
 int headers_tobuffer(JSContext* ctx, ByteBuffer* headers, struct lws* wsi) {
   int tok, len, count = 0;
@@ -194,48 +422,92 @@ int headers_tobuffer(JSContext* ctx, ByteBuffer* headers, struct lws* wsi) {
   return count;
 }
 
-ssize_t headers_unsetb(ByteBuffer* b, const char* name, size_t namelen, const char* itemdelim) {
+ssize_t headers_unsetb(ByteBuffer* b, HeaderIndex* idx, const char* name, size_t namelen, const char* itemdelim) {
   ssize_t i;
 
-  if((i = headers_findb(b, name, namelen, itemdelim)) >= 0) {
-    uint8_t *y, *x = b->start + i;
+  if(idx && !headers_index(idx, b))
+    idx = 0;
+
+  if((i = headers_findb(b, idx, name, namelen, itemdelim)) >= 0) {
+    uint8_t *y, *x = idx ? b->start + idx->fields[i].name : (uint8_t*)headers_at(b, 0, i, itemdelim);
     size_t c = headers_next(x, b->write, itemdelim);
+
     y = x + c;
     if(b->write > y)
-      memcpy(x, y, b->write - y);
+      memmove(x, y, b->write - y);
     b->write -= c;
 
     if(b->write < b->end)
       memset(b->write, 0, b->end - b->write);
+
+    buffer_touch(b);
+
+    if(idx) {
+      index_shift(idx, i + 1, -(ssize_t)c);
+      memmove(&idx->fields[i], &idx->fields[i + 1], (idx->count - i - 1) * sizeof(HeaderField));
+      idx->count--;
+      index_rehash(idx, b->start);
+      index_sync(idx, b);
+    }
   }
 
   return i;
 }
 
-ssize_t headers_set(ByteBuffer* b, const char* name, const char* value, const char* itemdelim) {
+ssize_t headers_set(ByteBuffer* b, HeaderIndex* idx, const char* name, const char* value, const char* itemdelim) {
   size_t namelen = strlen(name), valuelen = strlen(value);
   size_t c = namelen + 2 + valuelen + 2;
+  uint8_t* x;
 
   if(buffer_SIZE(b))
-    headers_unsetb(b, name, namelen, itemdelim);
+    headers_unsetb(b, idx, name, namelen, itemdelim);
+
+  if(idx && !headers_index(idx, b))
+    idx = 0;
 
   buffer_grow(b, c);
+  x = b->write;
+
+  if(idx)
+    index_sync(idx, b);
+
   buffer_write(b, name, namelen);
   buffer_write(b, ": ", 2);
   buffer_write(b, value, valuelen);
   buffer_write(b, itemdelim, strlen(itemdelim));
 
+  if(idx) {
+    if(index_push(idx, b->start, x, namelen + 2 + valuelen) && index_insert(idx, b->start, idx->count - 1))
+      index_sync(idx, b);
+    else
+      headers_index_reset(idx);
+  }
+
   return c;
 }
 
-ssize_t headers_appendb(ByteBuffer* b, const char* name, size_t namelen, const char* value, size_t valuelen, const char* itemdelim) {
+ssize_t headers_appendb(ByteBuffer* b, HeaderIndex* idx, const char* name, size_t namelen, const char* value, size_t valuelen, const char* itemdelim) {
   ssize_t i;
 
+  if(idx && !headers_index(idx, b))
+    idx = 0;
+
   buffer_grow(b, valuelen + 2);
 
-  if((i = headers_findb(b, name, namelen, itemdelim)) >= 0) {
-    uint8_t *y, *x = buffer_BEGIN(b) + i;
-    size_t len = headers_next(x, b->write, itemdelim);
+  /* the offsets are relative, they survive a reallocation */
+  if(idx)
+    index_sync(idx, b);
+
+  if((i = headers_findb(b, idx, name, namelen, itemdelim)) >= 0) {
+    uint8_t *y, *x;
+    size_t len;
+
+    if(idx) {
+      x = b->start + idx->fields[i].value;
+      len = idx->fields[i].valuelen;
+    } else {
+      x = (uint8_t*)headers_at(b, &len, i, itemdelim);
+    }
 
     y = x + len;
 
@@ -251,6 +523,14 @@ ssize_t headers_appendb(ByteBuffer* b, const char* name, size_t namelen, const c
 
     if(b->write < b->end)
       memset(b->write, 0, b->end - b->write);
+
+    buffer_touch(b);
+
+    if(idx) {
+      idx->fields[i].valuelen += valuelen + 2;
+      index_shift(idx, i + 1, valuelen + 2);
+      index_sync(idx, b);
+    }
   }
 
   return i;
@@ -9,19 +9,43 @@
 #include "buffer.h"
 #include "utils.h"
 
+/* one line of a header buffer, offsets are relative to the buffer start */
+typedef struct header_field {
+  uint32_t hash;
+  uint32_t name, namelen;
+  uint32_t value, valuelen;
+  int token; /* enum lws_token_indexes, -1 for names lws doesn't know */
+} HeaderField;
+
+/* kept alongside a header buffer, it is rebuilt when the buffer was changed behind its back */
+typedef struct header_index {
+  HeaderField* fields;
+  uint32_t count, capacity;
+  uint32_t* slots; /* open addressing, 1 + index of the first field with a name, 0 when empty */
+  uint32_t nslots;
+  const uint8_t *start, *write;
+  uint32_t gen; /* of the buffer when the index was last brought up to date */
+} HeaderIndex;
+
+void headers_index_free(HeaderIndex*);
+BOOL headers_index(HeaderIndex*, ByteBuffer*);
+HeaderField* headers_lookup(HeaderIndex*, ByteBuffer*, const char* name, size_t namelen);
+uint32_t headers_hash(const char* name, size_t namelen);
+int headers_token(const char* name, size_t namelen);
+
 JSValue headers_object(JSContext*, const void* start, const void* e);
 size_t headers_write(ByteBuffer* buffer, struct lws* wsi, uint8_t**, uint8_t* end);
 int headers_fromobj(ByteBuffer*, JSValueConst obj, const char* itemdelim, const char* keydelim, JSContext* ctx);
-ssize_t headers_findb(ByteBuffer*, const char* name, size_t namelen, const char* itemdelim);
+ssize_t headers_findb(ByteBuffer*, HeaderIndex*, const char* name, size_t namelen, const char* itemdelim);
 char* headers_at(ByteBuffer*, size_t* lenptr, size_t index, const char* itemdelim);
-char* headers_getlen(ByteBuffer*, size_t* lenptr, const char* name, const char* itemdelim, const char* keydelim);
-char* headers_get(ByteBuffer*, const char* name, const char* itemdelim, const char* keydelim, JSContext* ctx);
-ssize_t headers_find(ByteBuffer*, const char* name, const char* itemdelim);
+char* headers_getlen(ByteBuffer*, HeaderIndex*, size_t* lenptr, const char* name, const char* itemdelim, const char* keydelim);
+char* headers_get(ByteBuffer*, HeaderIndex*, const char* name, const char* itemdelim, const char* keydelim, JSContext* ctx);
+ssize_t headers_find(ByteBuffer*, HeaderIndex*, const char* name, const char* itemdelim);
 int headers_tobuffer(JSContext*, ByteBuffer* headers, struct lws* wsi);
 char* headers_gettoken(JSContext*, struct lws* wsi, enum lws_token_indexes tok);
-ssize_t headers_unsetb(ByteBuffer*, const char* name, size_t namelen, const char* itemdelim);
-ssize_t headers_set(ByteBuffer*, const char* name, const char* value, const char* itemdelim);
-ssize_t headers_appendb(ByteBuffer*, const char* name, size_t namelen, const char* value, size_t valuelen, const char* itemdelim);
+ssize_t headers_unsetb(ByteBuffer*, HeaderIndex*, const char* name, size_t namelen, const char* itemdelim);
+ssize_t headers_set(ByteBuffer*, HeaderIndex*, const char* name, const char* value, const char* itemdelim);
+ssize_t headers_appendb(ByteBuffer*, HeaderIndex*, const char* name, size_t namelen, const char* value, size_t valuelen, const char* itemdelim);
 
 static inline size_t headers_length(const void* start, const void* end, const char* itemdelim) { return scan_noncharsetnskip(start, itemdelim, (const uint8_t*)end - (const uint8_t*)start); }
 
@@ -42,6 +66,14 @@ size_t headers_size(ByteBuffer* headers, const char* itemdelim);
 
 static inline char* headers_name(const void* start, const void* end, JSContext* ctx) { return js_strndup(ctx, start, headers_namelen(start, end)); }
 
-static inline ssize_t headers_unset(ByteBuffer* buf, const char* name, const char* itemdelim) { return headers_unsetb(buf, name, strlen(name), itemdelim); }
+static inline ssize_t headers_unset(ByteBuffer* buf, HeaderIndex* idx, const char* name, const char* itemdelim) { return headers_unsetb(buf, idx, name, strlen(name), itemdelim); }
+
+/* forget the index, for when the buffer is refilled in place */
+static inline void headers_index_reset(HeaderIndex* idx) {
+  idx->start = 0;
+  idx->write = 0;
+  idx->gen = 0;
+  idx->count = 0;
+}
 
 #endif /* QJSNET_LIB_HEADERS_H */
@@ -331,8 +331,8 @@ JSBuffer js_buffer_fromblock(JSContext* ctx, struct byte_block* blk) {
 JSBuffer js_buffer_alloc(JSContext* ctx, size_t size) {
   ByteBlock block = {0, 0};
 
-  if((block.start = js_malloc(ctx, size)))
-    block.end = block.start + size;
+  /* the ArrayBuffer's finalizer gives the memory back to the pool */
+  block_alloc(&block, size);
 
   return js_buffer_fromblock(ctx, &block);
 }
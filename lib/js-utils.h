@@ -377,4 +377,12 @@ static inline const uint8_t* js_buffer_begin(const JSBuffer* in) { return in->da
 
 static inline const uint8_t* js_buffer_end(const JSBuffer* in) { return in->data + in->size; }
 
+/* the bytes of a typed array's own view, all of them for other input */
+static inline const uint8_t* js_buffer_view(const JSBuffer* in, size_t* sizep) {
+  int64_t offset = MIN(MAX(in->range.offset, 0), (int64_t)in->size);
+
+  *sizep = in->range.length < 0 ? in->size - offset : MIN(in->range.length, (int64_t)in->size - offset);
+  return in->data + offset;
+}
+
 #endif /* QJSNET_LIB_JS_UTILS_H */
@@ -21,6 +21,8 @@ void opaque_clear(struct wsi_opaque_user_data* opaque, JSRuntime* rt) {
   if(opaque->req) {
     Request* req = opaque->req;
     opaque->req = 0;
+    /* a request object that outlives the connection must not read from it */
+    request_detach(req, FALSE, 0);
     request_free(req, rt);
   }
 
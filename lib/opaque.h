@@ -38,6 +38,7 @@ struct wsi_opaque_user_data {
   struct lws* upstream;
   int fd;
   BOOL writable;
+  BOOL counted; /* in the worker's active connections */
   JSValue handlers[2];
 };
 
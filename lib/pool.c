@@ -0,0 +1,160 @@
+/**
+ * @file pool.c
+ */
+#include "pool.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+/* bytes a freelist may hold before chunks go back to malloc() */
+#define POOL_CACHE_BYTES (1 << 20)
+
+/* in front of every chunk: the class it goes back to, and its capacity */
+typedef union pool_header {
+  struct {
+    uint32_t cls;
+    size_t size;
+  };
+  max_align_t align;
+} PoolHeader;
+
+typedef struct pool_chunk {
+  struct pool_chunk* next;
+} PoolChunk;
+
+static const size_t pool_sizes[POOL_CLASSES] = {
+    64,
+    256 + LWS_PRE,
+    1024 + LWS_PRE,
+    4096 + LWS_PRE,
+    16384 + LWS_PRE,
+    65536 + LWS_PRE,
+};
+
+/* each service thread has its own freelists, nothing is locked */
+static THREAD_LOCAL PoolChunk* pool_freelist[POOL_CLASSES];
+static THREAD_LOCAL PoolStats pool_counters[POOL_CLASSES + 1];
+
+static inline uint32_t pool_class(size_t size) {
+  uint32_t cls;
+
+  for(cls = 0; cls < POOL_CLASSES; cls++)
+    if(size <= pool_sizes[cls])
+      break;
+
+  return cls;
+}
+
+void* pool_alloc(size_t size) {
+  uint32_t cls = pool_class(size);
+  PoolStats* st = &pool_counters[cls];
+  PoolHeader* hdr;
+
+  if(cls < POOL_CLASSES && pool_freelist[cls]) {
+    PoolChunk* chunk = pool_freelist[cls];
+
+    pool_freelist[cls] = chunk->next;
+    hdr = (PoolHeader*)chunk - 1;
+
+    st->cached--;
+    st->reused++;
+  } else {
+    size_t capacity = cls < POOL_CLASSES ? pool_sizes[cls] : size;
+
+    if(!(hdr = malloc(sizeof(PoolHeader) + capacity)))
+      return 0;
+
+    hdr->cls = cls;
+    hdr->size = capacity;
+  }
+
+  st->allocs++;
+  st->in_use++;
+
+  return hdr + 1;
+}
+
+void pool_free(void* ptr) {
+  PoolHeader* hdr;
+  PoolStats* st;
+
+  if(!ptr)
+    return;
+
+  hdr = (PoolHeader*)ptr - 1;
+  st = &pool_counters[hdr->cls];
+  st->in_use--;
+
+  if(hdr->cls < POOL_CLASSES && (st->cached + 1) * pool_sizes[hdr->cls] <= POOL_CACHE_BYTES) {
+    PoolChunk* chunk = ptr;
+
+    chunk->next = pool_freelist[hdr->cls];
+    pool_freelist[hdr->cls] = chunk;
+    st->cached++;
+    return;
+  }
+
+  free(hdr);
+}
+
+/**
+ * Resize a chunk. It stays where it is as long as size fits its capacity,
+ * otherwise the contents move to a chunk of the class size falls into.
+ */
+void* pool_realloc(void* ptr, size_t size) {
+  PoolHeader* hdr;
+  void* ret;
+
+  if(!ptr)
+    return pool_alloc(size);
+
+  hdr = (PoolHeader*)ptr - 1;
+
+  if(size <= hdr->size && (hdr->cls < POOL_CLASSES || size > hdr->size / 2))
+    return ptr;
+
+  if(hdr->cls == POOL_LARGE && pool_class(size) == POOL_LARGE) {
+    if(!(hdr = realloc(hdr, sizeof(PoolHeader) + size)))
+      return 0;
+
+    hdr->size = size;
+    return hdr + 1;
+  }
+
+  if((ret = pool_alloc(size))) {
+    memcpy(ret, ptr, MIN(size, hdr->size));
+    pool_free(ptr);
+  }
+
+  return ret;
+}
+
+size_t pool_capacity(const void* ptr) { return ((const PoolHeader*)ptr - 1)->size; }
+
+/* release the chunks on this thread's freelists */
+void pool_trim(void) {
+  for(uint32_t cls = 0; cls < POOL_CLASSES; cls++) {
+    PoolChunk *chunk, *next;
+
+    for(chunk = pool_freelist[cls]; chunk; chunk = next) {
+      next = chunk->next;
+      free((PoolHeader*)chunk - 1);
+    }
+
+    pool_freelist[cls] = 0;
+    pool_counters[cls].cached = 0;
+  }
+}
+
+const PoolStats* pool_stats(int cls) {
+  PoolStats* st;
+
+  if(cls < 0 || cls > POOL_LARGE)
+    return 0;
+
+  st = &pool_counters[cls];
+  st->size = cls < POOL_CLASSES ? pool_sizes[cls] : 0;
+
+  return st;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file pool.h
+ */
+#ifndef QJSNET_LIB_POOL_H
+#define QJSNET_LIB_POOL_H
+
+#include <libwebsockets.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* object-sized chunks, then payloads with LWS_PRE headroom; anything larger goes to malloc() */
+#define POOL_CLASSES 6
+#define POOL_LARGE POOL_CLASSES
+
+typedef struct pool_stats {
+  size_t size;             /* capacity of a chunk, 0 for the large allocations */
+  uint64_t allocs, reused; /* allocations, those served from the freelist */
+  int64_t in_use;          /* chunks handed out, a chunk freed by another thread counts there */
+  uint32_t cached;         /* chunks on the freelist */
+} PoolStats;
+
+void* pool_alloc(size_t size);
+void* pool_realloc(void* ptr, size_t size);
+void pool_free(void* ptr);
+size_t pool_capacity(const void* ptr);
+void pool_trim(void);
+const PoolStats* pool_stats(int cls);
+
+#endif /* QJSNET_LIB_POOL_H */
@@ -2,33 +2,74 @@
  * @file queue.c
  */
 #include "queue.h"
+#include "pool.h"
 #include <assert.h>
 
 void queue_zero(Queue* q) {
-  init_list_head(&q->items);
-
+  q->ring = 0;
+  q->head = 0;
   q->size = 0;
+  q->capacity = 0;
   q->continuous = FALSE;
+  q->rt = 0;
+  q->ctx = 0;
 }
 
-void queue_clear(Queue* q, JSRuntime* rt) {
-  struct list_head *p, *p2;
+/* free the block, or let go of the ArrayBuffer it points into */
+static void queue_release(Queue* q, QueueItem* i) {
+  if(queue_item_pinned(i)) {
+    JS_FreeValueRT(q->rt, i->value);
+    i->value = JS_UNDEFINED;
+    i->block = BLOCK_0();
+  } else {
+    block_free(&i->block);
+  }
+}
+
+/**
+ * Holding an ArrayBuffer doesn't keep it from being detached (by transfer() for example),
+ * which frees its memory. Such an item is emptied, then FALSE is returned.
+ */
+BOOL queue_check(Queue* q, QueueItem* i) {
+  uint8_t* data;
+  size_t size;
 
-  if(q->items.prev == 0 && q->items.next == 0)
-    init_list_head(&q->items);
+  if(!queue_item_pinned(i))
+    return TRUE;
 
-  list_for_each_safe(p, p2, &q->items) {
-    QueueItem* i = list_entry(p, QueueItem, link);
+  if((data = JS_GetArrayBuffer(q->ctx, &size, i->value)) && (uint8_t*)block_BEGIN(&i->block) >= data && (uint8_t*)block_END(&i->block) <= data + size)
+    return TRUE;
 
-    list_del(p);
-    block_free(&i->block);
+  /* JS_GetArrayBuffer() throws for a detached buffer */
+  if(!data)
+    JS_FreeValue(q->ctx, JS_GetException(q->ctx));
 
-    // JS_FreeValueRT(rt, i->value);
+  queue_release(q, i);
+  i->offset = 0;
+  return FALSE;
+}
 
-    free(p);
+/* replace pinned memory by a copy, before it's modified or handed out */
+static void queue_own(Queue* q, QueueItem* i) {
+  if(queue_item_pinned(i) && queue_check(q, i)) {
+    ByteBlock blk = block_copy((uint8_t*)block_BEGIN(&i->block) + i->offset, queue_item_size(i));
+
+    queue_release(q, i);
+    i->block = blk;
+    i->offset = 0;
   }
+}
+
+void queue_clear(Queue* q, JSRuntime* rt) {
+  for(size_t n = 0; n < q->size; n++)
+    queue_release(q, queue_at(q, n));
+
+  pool_free(q->ring);
 
+  q->ring = 0;
+  q->head = 0;
   q->size = 0;
+  q->capacity = 0;
 }
 
 void queue_free(Queue* q, JSRuntime* rt) {
@@ -46,18 +87,71 @@ Queue* queue_new(JSContext* ctx) {
   return q;
 }
 
-QueueItem* queue_front(Queue* q) { return list_empty(&q->items) ? 0 : list_entry(q->items.next, QueueItem, link); }
+/* a free slot at the back, when the ring is full its items move to one twice the size */
+static QueueItem* queue_push(Queue* q) {
+  QueueItem* i;
 
-QueueItem* queue_back(Queue* q) { return list_empty(&q->items) ? 0 : list_entry(q->items.prev, QueueItem, link); }
+  if(q->size == q->capacity) {
+    size_t n, capacity = q->capacity ? q->capacity * 2 : QUEUE_CAPACITY;
+    QueueItem* ring;
 
-QueueItem* queue_last_chunk(Queue* q) {
-  struct list_head* el;
+    if(!(ring = pool_alloc(capacity * sizeof(QueueItem))))
+      return 0;
+
+    for(n = 0; n < q->size; n++)
+      ring[n] = *queue_at(q, n);
+
+    pool_free(q->ring);
+
+    q->ring = ring;
+    q->head = 0;
+    q->capacity = capacity;
+  }
+
+  i = queue_at(q, q->size++);
+  i->block = BLOCK_0();
+  i->offset = 0;
+  i->binary = FALSE;
+  i->done = FALSE;
+  i->flags = 0;
+  i->unref = 0;
+  i->value = JS_UNDEFINED;
+
+  return i;
+}
+
+static void queue_pop(Queue* q) {
+  q->head = (q->head + 1) & (q->capacity - 1);
+  --q->size;
+}
+
+/* the item went out, resolve whoever waits for it */
+static void queue_settle(QueueItem* i) {
+  if(i->unref) {
+    JSContext* ctx = deferred_getctx(i->unref);
+    JSValue fn = deferred_getjs(i->unref);
+
+    JS_FreeValue(ctx, JS_Call(ctx, fn, JS_UNDEFINED, 0, 0));
+
+    deferred_call(i->unref);
+    deferred_free(i->unref);
+    i->unref = 0;
+  }
+}
 
-  list_for_each_prev(el, &q->items) {
-    QueueItem* i = list_entry(el, QueueItem, link);
+QueueItem* queue_front(Queue* q) { return q->size ? queue_at(q, 0) : 0; }
 
-    if(block_SIZE(&i->block) || !i->done)
+QueueItem* queue_back(Queue* q) { return q->size ? queue_at(q, q->size - 1) : 0; }
+
+QueueItem* queue_last_chunk(Queue* q) {
+  for(size_t n = q->size; n > 0; n--) {
+    QueueItem* i = queue_at(q, n - 1);
+
+    if(block_SIZE(&i->block) || !i->done) {
+      /* it's going to be appended to */
+      queue_own(q, i);
       return i;
+    }
   }
 
   return 0;
@@ -69,28 +163,25 @@ ByteBlock queue_next(Queue* q, BOOL* done_p, BOOL* binary_p) {
   BOOL done = FALSE;
 
   if((i = queue_front(q))) {
+    queue_own(q, i);
+
     ret = i->block;
     done = i->done;
 
+    /* partially consumed, hand out the rest */
+    if(i->offset) {
+      ret = block_copy((uint8_t*)block_BEGIN(&i->block) + i->offset, queue_item_size(i));
+      block_free(&i->block);
+      i->offset = 0;
+    }
+
     if(binary_p)
       *binary_p = i->binary;
 
-    if(i->unref) {
-      JSContext* ctx = deferred_getctx(i->unref);
-      JSValue fn = deferred_getjs(i->unref);
+    queue_settle(i);
 
-      JS_FreeValue(ctx, JS_Call(ctx, fn, JS_UNDEFINED, 0, 0));
-
-      deferred_call(i->unref);
-      deferred_free(i->unref);
-    }
-
-    if(!done) {
-      list_del(&i->link);
-
-      --q->size;
-      free(i);
-    }
+    if(!done)
+      queue_pop(q);
   }
 
   if(done_p)
@@ -100,13 +191,17 @@ ByteBlock queue_next(Queue* q, BOOL* done_p, BOOL* binary_p) {
 }
 
 uint8_t* queue_peek(Queue* q, size_t* lenp) {
-  QueueItem* i = queue_front(q);
-  ByteBlock ret = i->block;
+  QueueItem* i;
+
+  if(!(i = queue_front(q)))
+    return 0;
+
+  queue_check(q, i);
 
   if(lenp)
-    *lenp = block_SIZE(&ret);
+    *lenp = queue_item_size(i);
 
-  return block_BEGIN(&ret);
+  return (uint8_t*)block_BEGIN(&i->block) + i->offset;
 }
 
 ssize_t queue_read(Queue* q, void* buf, size_t n) {
@@ -114,43 +209,89 @@ ssize_t queue_read(Queue* q, void* buf, size_t n) {
   char* x = buf;
   ssize_t r = 0;
 
-  while((i = queue_front(q))) {
-    ByteBlock ret = i->block;
-    size_t len = block_SIZE(&ret);
-    char* b = block_BEGIN(&ret);
-    size_t j = MIN(len, n);
+  while(n && (i = queue_front(q)) && !i->done) {
+    size_t len, j;
 
-    memcpy(x, b, j);
+    queue_check(q, i);
+    len = queue_item_size(i);
+    j = MIN(len, n);
 
-    len -= j;
-    r += j;
+    memcpy(x, (uint8_t*)block_BEGIN(&i->block) + i->offset, j);
 
+    r += j;
     x += j;
     n -= j;
 
-    if(len == 0) {
+    if(j < len) {
+      i->offset += j;
+      break;
+    }
 
-      if(i->unref) {
-        JSContext* ctx = deferred_getctx(i->unref);
-        JSValue fn = deferred_getjs(i->unref);
+    queue_settle(i);
+    queue_release(q, i);
+    queue_pop(q);
+  }
 
-        JS_FreeValue(ctx, JS_Call(ctx, fn, JS_UNDEFINED, 0, 0));
+  return r;
+}
+
+/**
+ * Point iov at the unconsumed data of the items up to the end marker, at most max bytes
+ * in total. Nothing is consumed: queue_consume() that much once it's written.
+ * *pinned_p tells whether any of it is pinned memory, without LWS_PRE headroom.
+ *
+ * @return Number of iovecs filled in, the byte count goes to *lenp
+ */
+int queue_gather(Queue* q, struct iovec* iov, int iovcnt, size_t max, size_t* lenp, BOOL* pinned_p) {
+  size_t len = 0;
+  BOOL pinned = FALSE;
+  int n = 0;
+
+  for(size_t k = 0; k < q->size && n < iovcnt && len < max; k++) {
+    QueueItem* i = queue_at(q, k);
+    size_t size;
+
+    if(i->done)
+      break;
+
+    if(!queue_check(q, i) || !(size = queue_item_size(i)))
+      continue;
 
-        deferred_call(i->unref);
-        deferred_free(i->unref);
-      }
+    iov[n].iov_base = (uint8_t*)block_BEGIN(&i->block) + i->offset;
+    iov[n].iov_len = MIN(size, max - len);
+    len += iov[n++].iov_len;
+    pinned |= queue_item_pinned(i);
+  }
 
-      list_del(&i->link);
+  if(lenp)
+    *lenp = len;
+
+  if(pinned_p)
+    *pinned_p = pinned;
+
+  return n;
+}
 
-      --q->size;
-      free(i);
-    } else {
+/* drop n bytes from the front, items which are used up get resolved and freed */
+size_t queue_consume(Queue* q, size_t n) {
+  QueueItem* i;
+  size_t r = 0;
 
-      i->block = block_copy(b + j, len - j);
-      block_free(&ret);
+  while((i = queue_front(q)) && !i->done) {
+    size_t len = queue_item_size(i);
 
+    if(len > n) {
+      i->offset += n;
+      r += n;
       break;
     }
+
+    n -= len;
+    r += len;
+
+    queue_settle(i);
+    queue_release(q, i);
+    queue_pop(q);
   }
 
   return r;
@@ -166,21 +307,68 @@ QueueItem* queue_add(Queue* q, ByteBlock chunk) {
   if(queue_complete(q))
     return 0;
 
-  if(q->items.next == 0 && q->items.prev == 0)
-    init_list_head(&q->items);
-
-  if((i = malloc(sizeof(QueueItem)))) {
+  if((i = queue_push(q)))
     i->block = chunk;
-    i->done = FALSE;
-    i->unref = 0;
 
-    list_add_tail(&i->link, &q->items);
-    ++q->size;
+  return i;
+}
+
+/* put a chunk back in front of the others, even when the queue is complete */
+QueueItem* queue_unshift(Queue* q, ByteBlock chunk) {
+  QueueItem* i;
+
+  /* makes room, the new slot at the back is given up again */
+  if(!queue_push(q))
+    return 0;
+
+  --q->size;
+  q->head = (q->head - 1) & (q->capacity - 1);
+  ++q->size;
+
+  i = queue_at(q, 0);
+  i->block = chunk;
+  i->offset = 0;
+  i->binary = FALSE;
+  i->done = FALSE;
+  i->flags = 0;
+  i->unref = 0;
+  i->value = JS_UNDEFINED;
+
+  return i;
+}
+
+/**
+ * Queue the memory of an ArrayBuffer without copying it. The buffer is held
+ * until its bytes are consumed, it must not change in the meantime.
+ */
+QueueItem* queue_pin(Queue* q, JSValueConst value, const void* data, size_t size, JSContext* ctx) {
+  QueueItem* i;
+
+  if(queue_complete(q))
+    return 0;
+
+  if((i = queue_push(q))) {
+    i->block = (ByteBlock){(uint8_t*)data, (uint8_t*)data + size};
+    i->binary = TRUE;
+    i->value = JS_DupValue(ctx, value);
+    q->rt = JS_GetRuntime(ctx);
+    q->ctx = ctx;
   }
 
   return i;
 }
 
+/* queue what js_input_chars() got, a typed array only with its own range: large binary input is pinned if allowed, the rest copied */
+QueueItem* queue_input(Queue* q, JSBuffer* buf, BOOL pin, JSContext* ctx) {
+  size_t size;
+  const uint8_t* data = js_buffer_view(buf, &size);
+
+  if(pin && !q->continuous && !JS_IsString(buf->value) && size >= QUEUE_PIN_MIN)
+    return queue_pin(q, buf->value, data, size, ctx);
+
+  return queue_write(q, data, size, ctx);
+}
+
 QueueItem* queue_put(Queue* q, ByteBlock chunk, JSContext* ctx) {
   QueueItem* i;
 
@@ -271,32 +459,17 @@ QueueItem* queue_close(Queue* q) {
 
   assert(!queue_closed(q));
 
-  if((i = malloc(sizeof(QueueItem)))) {
-    i->block = (ByteBlock){0, 0};
+  if((i = queue_push(q)))
     i->done = TRUE;
-    i->unref = 0;
-
-    list_add_tail(&i->link, &q->items);
-
-    ++q->size;
-  }
 
   return i;
 }
 
 size_t queue_bytes(Queue* q) {
-  QueueItem* i;
-  struct list_head* el;
   size_t bytes = 0;
 
-  if(queue_size(q) == 0)
-    return 0;
-
-  list_for_each(el, &q->items) {
-    i = list_entry(el, QueueItem, link);
-
-    bytes += block_SIZE(&i->block);
-  }
+  for(size_t n = 0; n < q->size; n++)
+    bytes += queue_item_size(queue_at(q, n));
 
   return bytes;
 }
@@ -306,17 +479,8 @@ QueueItem* queue_continuous(Queue* q) {
 
   q->continuous = TRUE;
 
-  if(!(i = queue_last_chunk(q))) {
-    if((i = malloc(sizeof(QueueItem)))) {
-      i->block = (ByteBlock){0, 0};
-      i->done = FALSE;
-      i->unref = 0;
-
-      list_add_tail(&i->link, &q->items);
-
-      ++q->size;
-    }
-  }
+  if(!(i = queue_last_chunk(q)))
+    i = queue_push(q);
 
   return i;
 }
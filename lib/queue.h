@@ -7,20 +7,32 @@
 #include "buffer.h"
 #include "js-utils.h"
 #include "deferred.h"
+#include <sys/uio.h>
 
-typedef struct queue {
-  struct list_head items;
-  size_t size;
-  BOOL continuous;
-} Queue;
+/* slots of a ring when it's first allocated, it doubles when full */
+#define QUEUE_CAPACITY 16
+
+/* binary input at least this large is pinned instead of copied */
+#define QUEUE_PIN_MIN 16384
 
 typedef struct queue_item {
-  struct list_head link;
   ByteBlock block;
+  size_t offset; /* bytes at the front of block which were consumed already */
   BOOL binary, done;
+  int flags; /* lws_write_protocol of a websocket frame */
   Deferred* unref;
+  JSValue value; /* the ArrayBuffer block points into while it's pinned, JS_UNDEFINED when block is ours */
 } QueueItem;
 
+/* a ring of items, item pointers stay valid until the next item is added */
+typedef struct queue {
+  QueueItem* ring;
+  size_t head, size, capacity;
+  BOOL continuous;
+  JSRuntime* rt; /* pinned values are released there */
+  JSContext* ctx; /* and checked for being detached */
+} Queue;
+
 void queue_zero(Queue*);
 void queue_clear(Queue*, JSRuntime* rt);
 void queue_free(Queue*, JSRuntime* ctx);
@@ -30,7 +42,13 @@ QueueItem* queue_back(Queue*);
 QueueItem* queue_last_chunk(Queue*);
 ByteBlock queue_next(Queue*, BOOL* done_p, BOOL* binary_p);
 ssize_t queue_read(Queue* q, void* buf, size_t n);
+int queue_gather(Queue*, struct iovec* iov, int iovcnt, size_t max, size_t* lenp, BOOL* pinned_p);
+size_t queue_consume(Queue*, size_t n);
 QueueItem* queue_add(Queue*, ByteBlock chunk);
+QueueItem* queue_unshift(Queue*, ByteBlock chunk);
+BOOL queue_check(Queue*, QueueItem*);
+QueueItem* queue_pin(Queue*, JSValueConst value, const void* data, size_t size, JSContext* ctx);
+QueueItem* queue_input(Queue*, JSBuffer* buf, BOOL pin, JSContext* ctx);
 QueueItem* queue_put(Queue*, ByteBlock chunk, JSContext* ctx);
 QueueItem* queue_write(Queue*, const void* data, size_t size, JSContext* ctx);
 QueueItem* queue_append(Queue*, const void* data, size_t size, JSContext* ctx);
@@ -40,7 +58,15 @@ size_t queue_bytes(Queue*);
 QueueItem* queue_continuous(Queue* q);
 uint8_t* queue_peek(Queue* q, size_t* lenp);
 
-static inline BOOL queue_empty(Queue* q) { return list_empty(&q->items); }
+/* the i-th item from the front */
+static inline QueueItem* queue_at(Queue* q, size_t i) { return &q->ring[(q->head + i) & (q->capacity - 1)]; }
+
+static inline size_t queue_item_size(QueueItem* i) { return block_SIZE(&i->block) - i->offset; }
+
+/* pinned memory has no LWS_PRE headroom, it can't be passed to lws_write() as is */
+static inline BOOL queue_item_pinned(QueueItem* i) { return !JS_IsUndefined(i->value); }
+
+static inline BOOL queue_empty(Queue* q) { return q->size == 0; }
 
 static inline BOOL queue_closed(Queue* q) {
   QueueItem* i;
@@ -49,6 +49,8 @@ void request_init(Request* req, URL url, enum http_method method) {
   req->body = 0;
   req->read_only = FALSE;
   req->secure = url_is_tls(url);
+  req->route = 0;
+  req->params.count = 0;
 }
 
 Request* request_alloc(JSContext* ctx) {
@@ -81,24 +83,55 @@ Request* request_fromwsi(struct lws* wsi, JSContext* ctx) {
   HTTPMethod method = wsi_method(wsi);
   URL url = URL_INIT();
 
-  url_fromwsi(&url, wsi, ctx);
+  url_path_fromwsi(&url, wsi, ctx);
 
   ret = request_new(url, method, ctx);
 
   ret->secure = wsi_tls(wsi);
   ret->h2 = wsi_http2(wsi);
+  ret->wsi = wsi;
+  ret->lazy_host = TRUE;
 
   return ret;
 }
 
+static void request_flow_control(void* opaque, BOOL pause) {
+  Request* req = opaque;
+
+  if(req->wsi)
+    lws_rx_flow_control(req->wsi, pause ? 0 : 1);
+}
+
+/**
+ * Stop reading the body from the connection while more than high_water bytes of it are
+ * unread, 0 to read on regardless.
+ */
+void request_flow(Request* req, size_t high_water) {
+  if(req->body)
+    generator_flow(req->body, high_water, high_water ? request_flow_control : 0, req);
+}
+
 void request_clear(Request* req, JSRuntime* rt) {
   url_free(&req->url, rt);
   buffer_free(&req->headers);
+  headers_index_free(&req->header_index);
+
+  if(req->ip) {
+    free(req->ip);
+    req->ip = 0;
+  }
 
   if(req->body) {
+    /* JS may hold on to the body */
+    generator_flow(req->body, 0, 0, 0);
     generator_free(req->body);
     req->body = 0;
   }
+
+  if(req->digest) {
+    digest_free(req->digest);
+    req->digest = 0;
+  }
 }
 
 void request_free(Request* req, JSRuntime* rt) {
@@ -128,6 +161,72 @@ Request* request_from(int argc, JSValueConst argv[], JSContext* ctx) {
   return req;
 }
 
+URL* request_url(Request* req, JSContext* ctx) {
+  if(req->lazy_host) {
+    if(req->wsi && !req->url.host)
+      url_host_fromwsi(&req->url, req->wsi, ctx);
+
+    req->lazy_host = FALSE;
+  }
+
+  return &req->url;
+}
+
+/* the header buffer, copied from the connection on first use */
+ByteBuffer* request_headers(Request* req, JSContext* ctx) {
+  if(req->wsi && !req->headers.start)
+    headers_tobuffer(ctx, &req->headers, req->wsi);
+
+  return &req->headers;
+}
+
+/**
+ * Value of a single header. As long as the headers weren't copied, a name lws knows
+ * is read from its header table, the others aren't there either.
+ */
+char* request_header(Request* req, const char* name, JSContext* ctx) {
+  if(req->wsi && !req->headers.start) {
+    int tok, len;
+    char* ret;
+
+    if((tok = headers_token(name, strlen(name))) == -1 || (len = lws_hdr_total_length(req->wsi, tok)) <= 0)
+      return 0;
+
+    if((ret = js_malloc(ctx, len + 1)))
+      lws_hdr_copy(req->wsi, ret, len + 1, tok);
+
+    return ret;
+  }
+
+  return headers_get(&req->headers, &req->header_index, name, "\r\n", ":", ctx);
+}
+
+const char* request_ip(Request* req) {
+  if(!req->ip && req->wsi)
+    req->ip = wsi_ipaddr(req->wsi);
+
+  return req->ip;
+}
+
+/**
+ * The connection is done with the request. With keep, whatever still is to be read
+ * from it is copied, as the request outlives it.
+ */
+void request_detach(Request* req, BOOL keep, JSContext* ctx) {
+  if(!req->wsi)
+    return;
+
+  if(keep) {
+    request_url(req, ctx);
+    request_headers(req, ctx);
+    request_ip(req);
+  }
+
+  request_flow(req, 0);
+  req->wsi = 0;
+  req->lazy_host = FALSE;
+}
+
 BOOL request_match(Request* req, const char* path, enum http_method method) {
   if(path && strcmp(req->url.path, path))
     return FALSE;
@@ -6,8 +6,11 @@
 
 #include "lws-utils.h"
 #include "buffer.h"
+#include "headers.h"
 #include "generator.h"
+#include "digest.h"
 #include "url.h"
+#include "route.h"
 
 const char* method_string(enum http_method);
 int method_number(const char*);
@@ -18,7 +21,16 @@ typedef struct http_request {
   enum http_method method;
   URL url;
   ByteBuffer headers;
+  HeaderIndex header_index;
+  /* until request_detach(), headers, host and peer address are read from the connection on first use */
+  struct lws* wsi;
+  BOOL lazy_host;
+  BOOL exposed; /* handed to JS, which may keep it past the transaction */
+  char* ip;
   Generator* body;
+  Digest* digest; /* of the body as it is received */
+  const RouteEntry* route; /* the handler being run, names the captures in params */
+  RouteParams params;
 } Request;
 
 const char* method_name(int m);
@@ -33,5 +45,11 @@ void request_clear(Request*, JSRuntime* rt);
 void request_free(Request*, JSRuntime* rt);
 Request* request_from(int, JSValueConst argv[], JSContext* ctx);
 BOOL request_match(Request*, const char* path, enum http_method method);
+URL* request_url(Request*, JSContext* ctx);
+ByteBuffer* request_headers(Request*, JSContext* ctx);
+char* request_header(Request*, const char* name, JSContext* ctx);
+const char* request_ip(Request*);
+void request_detach(Request*, BOOL keep, JSContext* ctx);
+void request_flow(Request*, size_t high_water);
 
 #endif /* QJSNET_LIB_REQUEST_H */
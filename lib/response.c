@@ -35,6 +35,7 @@ Response* response_dup(Response* resp) {
 void response_clear(Response* resp, JSRuntime* rt) {
   url_free(&resp->url, rt);
   buffer_free(&resp->headers);
+  headers_index_free(&resp->header_index);
 
   if(resp->status_text) {
     js_free_rt(rt, resp->status_text);
@@ -45,6 +46,11 @@ void response_clear(Response* resp, JSRuntime* rt) {
     generator_free(resp->body);
     resp->body = 0;
   }
+
+  if(resp->digest) {
+    digest_free(resp->digest);
+    resp->digest = 0;
+  }
 }
 
 void response_free(Response* resp, JSRuntime* rt) {
@@ -63,11 +69,11 @@ Response* response_new(JSContext* ctx) {
   return resp;
 }
 
-ssize_t response_settype(Response* resp, const char* type) { return headers_set(&resp->headers, "content-type", type, "\r\n"); }
+ssize_t response_settype(Response* resp, const char* type) { return headers_set(&resp->headers, &resp->header_index, "content-type", type, "\r\n"); }
 
 void response_redirect(Response* resp, int code, const char* location) {
   resp->status = code;
-  headers_set(&resp->headers, "location", location, "\r\n");
+  headers_set(&resp->headers, &resp->header_index, "location", location, "\r\n");
 }
 
-char* response_type(Response* resp, JSContext* ctx) { return headers_get(&resp->headers, "content-type", "\r\n", ":", ctx); }
+char* response_type(Response* resp, JSContext* ctx) { return headers_get(&resp->headers, &resp->header_index, "content-type", "\r\n", ":", ctx); }
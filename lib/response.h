@@ -8,7 +8,9 @@
 #include <sys/types.h>
 #include "url.h"
 #include "buffer.h"
+#include "headers.h"
 #include "generator.h"
+#include "digest.h"
 
 struct session_data;
 
@@ -19,7 +21,9 @@ typedef struct http_response {
   int status;
   char* status_text;
   ByteBuffer headers;
+  HeaderIndex header_index;
   Generator* body;
+  Digest* digest; /* of the body as it is received */
 } Response;
 
 void response_zero(Response*);
@@ -0,0 +1,307 @@
+/**
+ * @file route.c
+ */
+#include "route.h"
+#include "js-utils.h"
+#include <string.h>
+#include <assert.h>
+
+static RouteNode* node_new(JSContext* ctx, const char* label, size_t len) {
+  RouteNode* node;
+
+  if(!(node = js_mallocz(ctx, sizeof(RouteNode))))
+    return 0;
+
+  if(!(node->label = js_strndup(ctx, label, len))) {
+    js_free(ctx, node);
+    return 0;
+  }
+
+  node->len = len;
+
+  return node;
+}
+
+static void node_free(RouteNode* node, JSRuntime* rt) {
+  RouteEntry *e, *next;
+
+  if(!node)
+    return;
+
+  node_free(node->child, rt);
+  node_free(node->sibling, rt);
+  node_free(node->param, rt);
+  node_free(node->wildcard, rt);
+
+  for(e = node->entries; e; e = next) {
+    next = e->next;
+
+    for(uint8_t i = 0; i < e->nparams; i++)
+      js_free_rt(rt, e->params[i]);
+
+    JS_FreeValueRT(rt, e->value);
+    js_free_rt(rt, e);
+  }
+
+  js_free_rt(rt, node->label);
+  js_free_rt(rt, node);
+}
+
+/* descend along s, splitting edges where s diverges from their label */
+static RouteNode* node_insert(RouteNode* node, const char* s, size_t n, JSContext* ctx) {
+  while(n > 0) {
+    RouteNode* c;
+    size_t i;
+
+    for(c = node->child; c; c = c->sibling)
+      if(c->label[0] == s[0])
+        break;
+
+    if(!c) {
+      if(!(c = node_new(ctx, s, n)))
+        return 0;
+
+      c->sibling = node->child;
+      node->child = c;
+      return c;
+    }
+
+    for(i = 0; i < c->len && i < n && c->label[i] == s[i]; i++) {}
+
+    if(i < c->len) {
+      RouteNode* rest;
+
+      if(!(rest = node_new(ctx, c->label + i, c->len - i)))
+        return 0;
+
+      rest->child = c->child;
+      rest->param = c->param;
+      rest->wildcard = c->wildcard;
+      rest->entries = c->entries;
+
+      c->child = rest;
+      c->param = c->wildcard = 0;
+      c->entries = 0;
+      c->len = i;
+      c->label[i] = '\0';
+    }
+
+    node = c;
+    s += i;
+    n -= i;
+  }
+
+  return node;
+}
+
+/* whether the node has an entry for the method, with method -1 any entry does */
+static BOOL node_accepts(RouteNode* node, int method) {
+  RouteEntry* e;
+
+  for(e = node->entries; e; e = e->next)
+    if(method == -1 || e->method == -1 || e->method == method)
+      return TRUE;
+
+  return FALSE;
+}
+
+static BOOL node_match(RouteNode* node, int method, const char* path, const char* s, size_t n, RouteParams* params, RouteNode** result) {
+  RouteNode* c;
+
+  if(n == 0 && node_accepts(node, method)) {
+    *result = node;
+    return TRUE;
+  }
+
+  if(n > 0)
+    for(c = node->child; c; c = c->sibling)
+      if(c->label[0] == s[0] && c->len <= n && !memcmp(c->label, s, c->len))
+        if(node_match(c, method, path, s + c->len, n - c->len, params, result))
+          return TRUE;
+
+  if(node->param && params->count < ROUTE_MAX_PARAMS) {
+    size_t k;
+
+    for(k = 0; k < n && s[k] != '/'; k++) {}
+
+    if(k > 0) {
+      uint8_t i = params->count++;
+
+      params->v[i].start = s - path;
+      params->v[i].len = k;
+
+      if(node_match(node->param, method, path, s + k, n - k, params, result))
+        return TRUE;
+
+      params->count = i;
+    }
+  }
+
+  if(node->wildcard && node_accepts(node->wildcard, method) && params->count < ROUTE_MAX_PARAMS) {
+    uint8_t i = params->count++;
+
+    params->v[i].start = s - path;
+    params->v[i].len = n;
+
+    *result = node->wildcard;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+void route_init(RouteTable* table) {
+  table->root = 0;
+  table->any = 0;
+  table->seq = 0;
+}
+
+void route_clear(RouteTable* table, JSRuntime* rt) {
+  RouteEntry *e, *next;
+
+  node_free(table->root, rt);
+
+  for(e = table->any; e; e = next) {
+    next = e->next;
+    JS_FreeValueRT(rt, e->value);
+    js_free_rt(rt, e);
+  }
+
+  route_init(table);
+}
+
+/**
+ * Add an entry for a path, or for every path when pattern is 0.
+ * With patterns, a segment ':name' captures one segment and '*' or '*name' the rest of the path.
+ */
+RouteEntry* route_add(RouteTable* table, const char* pattern, int method, BOOL patterns, JSContext* ctx) {
+  RouteEntry *entry, **ptr;
+  RouteNode* node;
+  const char* p;
+
+  if(!(entry = js_mallocz(ctx, sizeof(RouteEntry))))
+    return 0;
+
+  entry->seq = table->seq++;
+  entry->method = method;
+  entry->value = JS_UNDEFINED;
+
+  if(!pattern) {
+    for(ptr = &table->any; *ptr; ptr = &(*ptr)->next) {}
+
+    return *ptr = entry;
+  }
+
+  if(!table->root && !(table->root = node_new(ctx, "", 0)))
+    goto fail;
+
+  node = table->root;
+
+  for(p = pattern; *p;) {
+    const char* q;
+
+    if(patterns && (p == pattern || p[-1] == '/') && (*p == ':' || *p == '*')) {
+      RouteNode** child = *p == ':' ? &node->param : &node->wildcard;
+      BOOL rest = *p == '*';
+      size_t len;
+
+      q = p + 1;
+      len = *p == ':' ? strcspn(q, "/") : strlen(q);
+
+      if(!*child && !(*child = node_new(ctx, "", 0)))
+        goto fail;
+
+      if(entry->nparams < ROUTE_MAX_PARAMS)
+        entry->params[entry->nparams++] = len ? js_strndup(ctx, q, len) : js_strdup(ctx, "*");
+
+      node = *child;
+      p = q + len;
+
+      /* nothing can follow the rest of the path */
+      if(rest)
+        break;
+
+      continue;
+    }
+
+    for(q = p + 1; *q && !(patterns && q[-1] == '/' && (*q == ':' || *q == '*')); q++) {}
+
+    if(!(node = node_insert(node, p, q - p, ctx)))
+      goto fail;
+
+    p = q;
+  }
+
+  for(ptr = &node->entries; *ptr; ptr = &(*ptr)->next) {}
+
+  return *ptr = entry;
+
+fail:
+  for(uint8_t i = 0; i < entry->nparams; i++)
+    js_free(ctx, entry->params[i]);
+
+  js_free(ctx, entry);
+  return 0;
+}
+
+/**
+ * Find the node for a path, static segments take precedence over ':param', which take precedence over '*'.
+ * Only nodes with an entry for method (or for any, -1) match, otherwise the search backtracks.
+ * Nothing is allocated, the captures are offsets into path.
+ */
+RouteNode* route_match(RouteTable* table, const char* path, int method, RouteParams* params) {
+  RouteNode* result = 0;
+
+  params->count = 0;
+
+  if(table->root)
+    node_match(table->root, method, path, path, strcspn(path, "?"), params, &result);
+
+  return result;
+}
+
+static inline BOOL route_boundary(const char* path, size_t pos, size_t n, const char* boundary) { return !boundary || pos == n || strchr(boundary, path[pos]); }
+
+/**
+ * Find the node of the longest key that is a prefix of path[0..n).
+ * With boundary, the prefix must be followed by the end of path or one of its characters.
+ */
+RouteNode* route_prefix(RouteTable* table, const char* path, size_t n, const char* boundary) {
+  RouteNode *node, *c, *result = 0;
+  size_t pos = 0;
+
+  if(!(node = table->root))
+    return 0;
+
+  if(node->entries && route_boundary(path, pos, n, boundary))
+    result = node;
+
+  while(pos < n) {
+    for(c = node->child; c; c = c->sibling)
+      if(c->label[0] == path[pos])
+        break;
+
+    if(!c || c->len > n - pos || memcmp(c->label, path + pos, c->len))
+      break;
+
+    node = c;
+    pos += c->len;
+
+    if(node->entries && route_boundary(path, pos, n, boundary))
+      result = node;
+  }
+
+  return result;
+}
+
+JSValue route_params_object(JSContext* ctx, const RouteEntry* entry, const RouteParams* params, const char* path) {
+  JSValue ret = JS_NewObject(ctx);
+  size_t n = path ? strlen(path) : 0;
+
+  for(uint8_t i = 0; entry && i < params->count && i < entry->nparams; i++)
+    /* the path could have been changed since the lookup */
+    if(params->v[i].start + params->v[i].len <= n)
+      JS_SetPropertyStr(ctx, ret, entry->params[i], JS_NewStringLen(ctx, path + params->v[i].start, params->v[i].len));
+
+  return ret;
+}
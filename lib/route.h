@@ -0,0 +1,54 @@
+/**
+ * @file route.h
+ */
+#ifndef QJSNET_LIB_ROUTE_H
+#define QJSNET_LIB_ROUTE_H
+
+#include <quickjs.h>
+#include <cutils.h>
+#include <stdint.h>
+
+#define ROUTE_MAX_PARAMS 8
+
+typedef struct route_entry {
+  struct route_entry* next; /* in registration order */
+  uint32_t seq;
+  int method; /* -1 matches any method */
+  JSValue value;
+  void* ptr;
+  uint8_t nparams;
+  char* params[ROUTE_MAX_PARAMS];
+} RouteEntry;
+
+typedef struct route_node {
+  char* label;
+  size_t len;
+  struct route_node *child, *sibling;
+  struct route_node *param, *wildcard;
+  RouteEntry* entries;
+} RouteNode;
+
+/* captures of one lookup, as offsets into the looked up path */
+typedef struct route_params {
+  uint8_t count;
+  struct {
+    uint16_t start, len;
+  } v[ROUTE_MAX_PARAMS];
+} RouteParams;
+
+typedef struct route_table {
+  RouteNode* root;
+  RouteEntry* any; /* entries without a path, they match every request */
+  uint32_t seq;
+} RouteTable;
+
+void route_init(RouteTable*);
+void route_clear(RouteTable*, JSRuntime*);
+RouteEntry* route_add(RouteTable*, const char* pattern, int method, BOOL patterns, JSContext*);
+RouteNode* route_match(RouteTable*, const char* path, int method, RouteParams*);
+RouteNode* route_prefix(RouteTable*, const char* path, size_t n, const char* boundary);
+JSValue route_params_object(JSContext*, const RouteEntry*, const RouteParams*, const char* path);
+
+static inline BOOL route_empty(RouteTable* rt) { return !rt->root && !rt->any; }
+
+#endif /* QJSNET_LIB_ROUTE_H */
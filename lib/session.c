@@ -10,28 +10,47 @@
 #include "ws.h"
 #include "context.h"
 #include "lws-utils.h"
+#include "channel.h"
 #include <assert.h>
 
+/* payload bytes of a pinned message written per writeable callback */
+#define SESSION_FRAGMENT 65536
+
+/* the first piece is copied, it's at least WS_FRAME_HEADER_MAX for the header of the next */
+#define SESSION_FIRST_PIECE 256
+
 static void session_zero(struct session_data* session) {
   session->ws_obj = JS_NULL;
   session->req_obj = JS_NULL;
   session->resp_obj = JS_NULL;
   session->mount = 0;
   session->proxy = 0;
+  session->file = 0;
   session->generator = JS_NULL;
   session->next = JS_NULL;
   session->in_body = FALSE;
   session->response_sent = FALSE;
   session->want_write = FALSE;
+  session->refused = FALSE;
   session->wait_resolve = FALSE;
   session->generator_run = FALSE;
   session->callback_count = 0;
   session->callback = NULL;
   session->wait_resolve_ptr = NULL;
+  session->subscriptions = NULL;
 
   queue_zero(&session->sendq);
 }
 
+/* resolve the promise returned by a queued send() */
+static void session_settle(Deferred* def, BOOL written) {
+  JSContext* ctx = deferred_getctx(def);
+  JSValue arg = JS_NewBool(ctx, written);
+
+  JS_FreeValue(ctx, JS_Call(ctx, deferred_getjs(def), JS_UNDEFINED, 1, &arg));
+  deferred_free(def);
+}
+
 void session_init(struct session_data* session, struct context* context) {
   session_zero(session);
   session->context = context;
@@ -54,7 +73,19 @@ void session_clear(struct session_data* session, JSRuntime* rt) {
     session->wait_resolve_ptr = 0;
   }
 
+  /* frames which never went out: their send() promises resolve to false */
+  for(size_t n = 0; n < queue_size(&session->sendq); n++) {
+    QueueItem* i = queue_at(&session->sendq, n);
+
+    if(i->unref) {
+      session_settle(i->unref, FALSE);
+      i->unref = 0;
+    }
+  }
+
   queue_clear(&session->sendq, rt);
+
+  channel_unsubscribe_all(session, rt);
 }
 
 JSValue session_object(struct session_data* session, JSContext* ctx) {
@@ -75,24 +106,114 @@ void session_want_write(struct session_data* session, struct lws* wsi) {
   }
 }
 
+/**
+ * Write the next piece of a pinned message as a frame of its own, so that control frames
+ * lws sends in between (pongs, close) don't end up in the middle of one. The pinned memory
+ * has no LWS_PRE headroom: the first piece is copied behind its header, the header of each
+ * other one is written over the end of the piece before, which went out already, and put
+ * back afterwards. Header and payload so go out in a single raw write.
+ *
+ * @return payload bytes written, -1 on error
+ */
+static ssize_t session_pinned(struct lws* wsi, struct socket* ws, QueueItem* item) {
+  uint8_t *x = (uint8_t*)block_BEGIN(&item->block) + item->offset, hdr[WS_FRAME_HEADER_MAX];
+  size_t hlen, len = MIN(queue_item_size(item), item->offset || (ws && ws->raw) ? SESSION_FRAGMENT : SESSION_FIRST_PIECE);
+  int ret, flags = item->offset ? LWS_WRITE_CONTINUATION : (item->flags & 0xf);
+
+  if(ws && ws->raw)
+    return lws_write(wsi, x, len, LWS_WRITE_RAW) < 0 ? -1 : (ssize_t)len;
+
+  if(len < queue_item_size(item) || (item->flags & LWS_WRITE_NO_FIN))
+    flags |= LWS_WRITE_NO_FIN;
+
+  hlen = ws_frame_header(hdr, len, flags, FALSE);
+
+  if(!item->offset) {
+    uint8_t buf[WS_FRAME_HEADER_MAX + SESSION_FIRST_PIECE];
+
+    memcpy(buf, hdr, hlen);
+    memcpy(buf + hlen, x, len);
+    ret = lws_write(wsi, buf, hlen + len, LWS_WRITE_RAW);
+  } else {
+    uint8_t saved[WS_FRAME_HEADER_MAX];
+
+    memcpy(saved, x - hlen, hlen);
+    memcpy(x - hlen, hdr, hlen);
+    ret = lws_write(wsi, x - hlen, hlen + len, LWS_WRITE_RAW);
+    memcpy(x - hlen, saved, hlen);
+  }
+
+  return ret < 0 ? -1 : (ssize_t)len;
+}
+
+/**
+ * Write one queued frame, as lws allows only one lws_write() per writeable callback.
+ * Frames of send() go before those of subscribed channels.
+ * While lws still holds the rest of a partially sent frame, nothing is written.
+ */
 int session_writable(struct session_data* session, struct lws* wsi, JSContext* ctx) {
+  struct socket* ws = ws_from_wsi(wsi);
   int ret = 0;
-  size_t size;
 
   session->want_write = FALSE;
 
-  if((size = queue_size(&session->sendq)) > 0) {
-    ByteBlock chunk;
-    BOOL done = FALSE, binary = FALSE;
+  if(queue_size(&session->sendq) > 0 && !lws_partial_buffered(wsi)) {
+    QueueItem* item = queue_front(&session->sendq);
+    Deferred* settle = 0;
+
+    if(queue_item_pinned(item)) {
+      /* the ArrayBuffer was detached and its memory is gone: the message is dropped */
+      if(!queue_check(&session->sendq, item)) {
+        if(item->unref) {
+          session_settle(item->unref, FALSE);
+          item->unref = 0;
+        }
+
+        /* the peer got a part of it already, the message can't be ended */
+        if(item->offset > 0)
+          return -1;
 
-    chunk = queue_next(&session->sendq, &done, &binary);
+        queue_consume(&session->sendq, 0);
+      } else {
+        size_t size = queue_item_size(item);
+        ssize_t n;
+
+        if((n = session_pinned(wsi, ws, item)) < 0)
+          return -1;
+
+        /* queue_consume() would resolve it before lws took the last byte */
+        if((size_t)n == size) {
+          settle = item->unref;
+          item->unref = 0;
+        }
+
+        queue_consume(&session->sendq, n);
+      }
+    } else {
+      ByteBlock chunk;
+      int flags = ws && ws->raw ? LWS_WRITE_RAW : item->flags;
+
+      /* queue_next() would resolve it before the frame is written */
+      settle = item->unref;
+      item->unref = 0;
+
+      chunk = queue_next(&session->sendq, 0, 0);
+
+      ret = lws_write(wsi, block_BEGIN(&chunk), block_SIZE(&chunk), flags);
+
+      block_free(&chunk);
+    }
 
-    ret = lws_write(wsi, block_BEGIN(&chunk), block_SIZE(&chunk), binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+    if(settle)
+      session_settle(settle, ret >= 0);
 
-    block_free(&chunk);
+    if(ws && session->context)
+      JS_FreeValue(session->context->js, context_exception(session->context, ws_drained(ws, session->ws_obj)));
+  } else if(session->subscriptions && !lws_partial_buffered(wsi)) {
+    ret = channel_writable(session, wsi, ws);
   }
 
-  if(queue_bytes(&session->sendq) > 0)
+  if(queue_size(&session->sendq) > 0 || lws_partial_buffered(wsi) || channel_pending(session))
     session_want_write(session, wsi);
 
   return ret;
@@ -9,9 +9,11 @@
 
 struct http_mount;
 struct proxy_connection;
+struct static_file;
 struct context;
 struct server_context;
 struct wsi_opaque_user_data;
+struct channel_subscriber;
 
 typedef enum { SYNC = 0, ASYNC = 1, GENERATOR = 2, ASYNC_GENERATOR = 3 } FunctionType;
 
@@ -27,11 +29,15 @@ struct session_data {
   struct context* context;
   struct http_mount* mount;
   struct proxy_connection* proxy;
+  struct static_file* file;
   JSValue generator, next;
   BOOL in_body, response_sent, want_write;
+  BOOL refused;       /* answered with an error status, the rest of the body is dropped */
+  uint64_t body_size; /* of the request, received so far */
   uint32_t wait_resolve, generator_run, callback_count;
   struct session_data** wait_resolve_ptr;
   Queue sendq;
+  struct channel_subscriber* subscriptions;
   lws_callback_function* callback;
 };
 
@@ -414,10 +414,9 @@ BOOL url_fromvalue(URL* url, JSValueConst value, JSContext* ctx) {
   return TRUE;
 }
 
-void url_fromwsi(URL* url, struct lws* wsi, JSContext* ctx) {
+void url_host_fromwsi(URL* url, struct lws* wsi, JSContext* ctx) {
   int i, port = -1;
   char* p;
-  const char* protocol;
   typedef char* get_host_and_port(struct lws*, int*);
   get_host_and_port* fns[] = {
       &wsi_host_and_port,
@@ -439,6 +438,12 @@ void url_fromwsi(URL* url, struct lws* wsi, JSContext* ctx) {
       }
     }
   }
+}
+
+/* everything but the host, which takes a header lookup and an allocation */
+void url_path_fromwsi(URL* url, struct lws* wsi, JSContext* ctx) {
+  char* p;
+  const char* protocol;
 
   if((p = wsi_uri_and_method(wsi, 0))) {
     if(url->path)
@@ -473,6 +478,11 @@ void url_fromwsi(URL* url, struct lws* wsi, JSContext* ctx) {
   // url->query = minnet_query_string(wsi, ctx);
 }
 
+void url_fromwsi(URL* url, struct lws* wsi, JSContext* ctx) {
+  url_host_fromwsi(url, wsi, ctx);
+  url_path_fromwsi(url, wsi, ctx);
+}
+
 URL* url_new(JSContext* ctx) {
 
   URL* url;
@@ -56,6 +56,8 @@ const char* url_search(const URL, size_t* len_p);
 const char* url_hash(const URL);
 void url_fromobj(URL*, JSValueConst obj, JSContext* ctx);
 BOOL url_fromvalue(URL*, JSValueConst value, JSContext* ctx);
+void url_host_fromwsi(URL*, struct lws* wsi, JSContext* ctx);
+void url_path_fromwsi(URL*, struct lws* wsi, JSContext* ctx);
 void url_fromwsi(URL*, struct lws* wsi, JSContext* ctx);
 URL* url_new(JSContext*);
 JSValue url_object(const URL, JSContext* ctx);
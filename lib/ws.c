@@ -8,8 +8,11 @@
 #include "session.h"
 #include "ringbuffer.h"
 #include "queue.h"
+#include "lws-utils.h"
+#include <stdlib.h>
 #include <strings.h>
 #include <assert.h>
+#include <zlib.h>
 
 struct socket* ws_new(struct lws* wsi, JSContext* ctx) {
   struct socket* ws;
@@ -22,6 +25,10 @@ struct socket* ws_new(struct lws* wsi, JSContext* ctx) {
   ws->ref_count = 2;
   ws->raw = FALSE;
   ws->binary = TRUE;
+  ws->high_water = WS_HIGH_WATER_MARK;
+  ws->low_water = WS_LOW_WATER_MARK;
+
+  callback_zero(&ws->ondrain);
 
   if((opaque = opaque_from_wsi(wsi, ctx)))
     opaque->ws = ws;
@@ -49,6 +56,7 @@ void ws_clear(struct socket* ws, JSRuntime* rt) {
 void ws_free(struct socket* ws, JSRuntime* rt) {
   if(--ws->ref_count == 0) {
     ws_clear(ws, rt);
+    FREECB_RT(ws->ondrain);
     js_free_rt(rt, ws);
   }
 }
@@ -72,7 +80,7 @@ Queue* ws_queue(struct socket* ws) {
 QueueItem* ws_enqueue(struct socket* ws, ByteBlock chunk) {
   struct wsi_opaque_user_data* opaque;
   struct session_data* session;
-  QueueItem* item;
+  QueueItem* item = 0;
 
   if((opaque = ws_opaque(ws)))
     if((session = opaque->sess))
@@ -82,8 +90,153 @@ QueueItem* ws_enqueue(struct socket* ws, ByteBlock chunk) {
   return item;
 }
 
-QueueItem* ws_send(struct socket* ws, const void* data, size_t size, JSContext* ctx) {
-  QueueItem* item = ws_enqueue(ws, block_copy(data, size));
+/**
+ * Queue a message, large binary ones are pinned rather than copied. Frames of clients are
+ * masked and those of HTTP/2 streams are framed by lws, so they can't be written raw from
+ * the pinned memory and get copied.
+ */
+QueueItem* ws_send(struct socket* ws, JSBuffer* buf, JSContext* ctx) {
+  struct wsi_opaque_user_data* opaque;
+  struct session_data* session;
+  QueueItem* item = 0;
+  BOOL pin = ws->raw || (!ws->client && !wsi_http2(ws->lwsi));
+
+  if((opaque = ws_opaque(ws)))
+    if((session = opaque->sess))
+      if((item = queue_input(&session->sendq, buf, pin, ctx))) {
+        session_want_write(session, ws->lwsi);
+
+        if(queue_bytes(&session->sendq) > ws->high_water)
+          ws->choked = TRUE;
+      }
 
   return item;
 }
+
+/* called after a frame went out: once the send queue fell below the low water mark, emit 'drain' */
+JSValue ws_drained(struct socket* ws, JSValueConst ws_obj) {
+  Queue* q;
+
+  if(!ws->choked || !(q = ws_queue(ws)) || queue_bytes(q) > ws->low_water)
+    return JS_UNDEFINED;
+
+  ws->choked = FALSE;
+
+  return callback_emit_this(&ws->ondrain, ws_obj, 1, (JSValue*)&ws_obj);
+}
+
+/**
+ * Whether frames deflated once can be sent to this connection: lws has permessage-deflate
+ * active on it and no offer limits the server's window below the 15 bits they're deflated
+ * with. As the peer's window also gets the text of frames which bypass lws, it's told not
+ * to carry its own compression context from one message to the next.
+ */
+BOOL ws_deflate_negotiated(struct lws* wsi) {
+  char buf[256], *param;
+
+  if(lws_hdr_copy(wsi, buf, sizeof(buf), WSI_TOKEN_EXTENSIONS) <= 0)
+    return FALSE;
+
+  for(param = strtok(buf, ",; \t"); param; param = strtok(0, ",; \t"))
+    if(!strncmp(param, "server_max_window_bits=", 23) && atoi(param + 23) != 15)
+      return FALSE;
+
+  /* fails when lws didn't accept the extension on this connection */
+  return lws_set_extension_option(wsi, "permessage-deflate", "server_no_context_takeover", "1") == 0;
+}
+
+/**
+ * Write the header of an unmasked frame with a payload of len bytes.
+ *
+ * @param flags  lws_write_protocol, LWS_WRITE_TEXT/BINARY/CONTINUATION optionally with LWS_WRITE_NO_FIN
+ * @param rsv1   set for a compressed message
+ * @return       header length, at most WS_FRAME_HEADER_MAX
+ */
+size_t ws_frame_header(uint8_t* hdr, size_t len, int flags, BOOL rsv1) {
+  int type = flags & 0xf;
+
+  hdr[0] = (flags & LWS_WRITE_NO_FIN ? 0 : 0x80) | (rsv1 ? 0x40 : 0) | (type == LWS_WRITE_TEXT ? 0x1 : type == LWS_WRITE_CONTINUATION ? 0x0 : 0x2);
+
+  if(len < 126) {
+    hdr[1] = len;
+    return 2;
+  }
+
+  if(len <= 0xffff) {
+    hdr[1] = 126;
+    hdr[2] = len >> 8;
+    hdr[3] = len;
+    return 4;
+  }
+
+  hdr[1] = 127;
+
+  for(int i = 0; i < 8; i++)
+    hdr[2 + i] = (uint64_t)len >> (56 - 8 * i);
+
+  return 10;
+}
+
+/**
+ * Build a complete, unmasked server frame of a message compressed as in RFC 7692, without
+ * the trailing 00 00 ff ff. When deflate does not make it smaller, the payload is stored
+ * as is and RSV1 stays clear.
+ *
+ * @param offset  receives the offset of the frame in the returned buffer, which has LWS_PRE in front of it
+ * @param size    receives the frame length
+ * @return        malloc()ed buffer, 0 on error
+ */
+uint8_t* ws_deflate_frame(const void* data, size_t len, BOOL binary, size_t* offset, size_t* size) {
+  z_stream z;
+  uint8_t *buf, *payload, *hdr;
+  size_t bound, n, hlen;
+  BOOL deflated = TRUE;
+
+  memset(&z, 0, sizeof(z));
+
+  if(deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return 0;
+
+  if((bound = deflateBound(&z, len) + 6) < len)
+    bound = len;
+
+  if(!(buf = malloc(LWS_PRE + WS_FRAME_HEADER_MAX + bound))) {
+    deflateEnd(&z);
+    return 0;
+  }
+
+  payload = buf + LWS_PRE + WS_FRAME_HEADER_MAX;
+
+  z.next_in = (Bytef*)data;
+  z.avail_in = len;
+  z.next_out = payload;
+  z.avail_out = bound;
+
+  if(deflate(&z, Z_SYNC_FLUSH) != Z_OK || z.avail_in > 0) {
+    deflateEnd(&z);
+    free(buf);
+    return 0;
+  }
+
+  n = bound - z.avail_out;
+  deflateEnd(&z);
+
+  if(n >= 4 && !memcmp(payload + n - 4, "\0\0\xff\xff", 4))
+    n -= 4;
+
+  if(n >= len) {
+    memcpy(payload, data, len);
+    n = len;
+    deflated = FALSE;
+  }
+
+  hlen = n < 126 ? 2 : n <= 0xffff ? 4 : 10;
+  hdr = payload - hlen;
+
+  ws_frame_header(hdr, n, binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT, deflated);
+
+  *offset = hdr - buf;
+  *size = hlen + n;
+
+  return buf;
+}
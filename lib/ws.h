@@ -8,6 +8,7 @@
 #include "opaque.h"
 #include "js-utils.h"
 #include "queue.h"
+#include "callback.h"
 
 #if(defined(HAVE_WINSOCK2_H) || defined(WIN32) || defined(WIN64) || defined(__MINGW32__) || defined(__MINGW64__)) && !defined(__MSYS__)
 #include <winsock2.h>
@@ -17,11 +18,17 @@ struct lws;
 struct http_request;
 struct http_response;
 
+#define WS_HIGH_WATER_MARK 65536
+#define WS_LOW_WATER_MARK 16384
+#define WS_FRAME_HEADER_MAX 10
+
 struct socket {
   int ref_count;
   struct lws* lwsi;
   int fd;
-  BOOL raw : 1, binary : 1, want_write : 1;
+  BOOL raw : 1, binary : 1, want_write : 1, choked : 1, deflate : 1, client : 1;
+  size_t high_water, low_water;
+  JSCallback ondrain;
 };
 
 struct socket* ws_new(struct lws*, JSContext* ctx);
@@ -30,7 +37,11 @@ void ws_free(struct socket*, JSRuntime* rt);
 struct socket* ws_dup(struct socket*);
 QueueItem* ws_enqueue(struct socket*, ByteBlock);
 Queue* ws_queue(struct socket* ws);
-QueueItem* ws_send(struct socket* ws, const void* data, size_t size, JSContext* ctx);
+QueueItem* ws_send(struct socket* ws, JSBuffer* buf, JSContext* ctx);
+JSValue ws_drained(struct socket* ws, JSValueConst ws_obj);
+BOOL ws_deflate_negotiated(struct lws*);
+size_t ws_frame_header(uint8_t* hdr, size_t len, int flags, BOOL rsv1);
+uint8_t* ws_deflate_frame(const void* data, size_t len, BOOL binary, size_t* offset, size_t* size);
 
 static inline struct session_data* lws_session(struct lws* wsi) {
   struct wsi_opaque_user_data* opaque;
@@ -0,0 +1,1384 @@
+#define _GNU_SOURCE
+#include "minnet-agent.h"
+#include "minnet-client.h"
+#include "minnet-dns.h"
+#include "minnet.h"
+#include "opaque.h"
+#include "request.h"
+#include "url.h"
+#include "js-utils.h"
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+THREAD_LOCAL JSValue minnet_agent_proto, minnet_agent_ctor;
+THREAD_LOCAL JSClassID minnet_agent_class_id;
+
+/* the agent of the requests which don't name one, it goes when nothing uses it anymore */
+static THREAD_LOCAL MinnetAgent* agent_global;
+
+enum {
+  AGENT_MAXSOCKETS,
+  AGENT_KEEPALIVE,
+  AGENT_MAXSTREAMS,
+  AGENT_HTTP2,
+  AGENT_MAXREQUESTS,
+  AGENT_MAXORIGINREQUESTS,
+  AGENT_STATS,
+  AGENT_CLOSEIDLE,
+};
+
+static void agent_schedule(MinnetAgent*, uint32_t ms);
+
+static BOOL agent_origin_used(MinnetAgent* agent, AgentOrigin* origin) {
+  if(!list_empty(&origin->waiting))
+    return TRUE;
+
+  for(uint32_t i = 0; i < agent->max_sockets; i++)
+    if(origin->slots[i].wsi || origin->slots[i].streams)
+      return TRUE;
+
+  return FALSE;
+}
+
+static BOOL agent_busy(MinnetAgent* agent) {
+  struct list_head* el;
+
+  if(!list_empty(&agent->sockets))
+    return TRUE;
+
+  list_for_each(el, &agent->origins) {
+    if(agent_origin_used(agent, list_entry(el, AgentOrigin, link)))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void agent_origin_free(MinnetAgent* agent, AgentOrigin* origin) {
+  list_del(&origin->link);
+  js_free(agent->js, origin->key);
+  js_free(agent->js, origin);
+}
+
+static void agent_credential_init(JSContext* ctx, AgentCredential* cred, JSValueConst value) {
+  if(JS_IsString(value))
+    cred->path = js_tostring(ctx, value);
+  else if(JS_IsObject(value))
+    cred->mem = js_toptrsize(ctx, &cred->len, value);
+}
+
+static void agent_credential_clear(JSContext* ctx, AgentCredential* cred) {
+  js_free(ctx, cred->path);
+  js_free(ctx, cred->mem);
+}
+
+static BOOL agent_credential_equal(const AgentCredential* a, const AgentCredential* b) {
+  if(a->path || b->path)
+    return a->path && b->path && !strcmp(a->path, b->path);
+
+  return a->len == b->len && (a->len == 0 || !memcmp(a->mem, b->mem, a->len));
+}
+
+static void agent_tls_free(MinnetAgent* agent, AgentTls* tls) {
+  list_del(&tls->link);
+  agent_credential_clear(agent->js, &tls->cert);
+  agent_credential_clear(agent->js, &tls->key);
+  agent_credential_clear(agent->js, &tls->ca);
+  js_free(agent->js, tls);
+}
+
+/**
+ * The vhosts for the TLS credentials in options, those with the same files or
+ * the same PEM data share them. They stay as long as the agent.
+ */
+static AgentTls* agent_tls(MinnetAgent* agent, JSValueConst options) {
+  static const char* const names[] = {"sslCert", "sslPrivateKey", "sslCA"};
+  JSContext* ctx = agent->js;
+  AgentTls tmp = {0}, *tls = 0;
+  AgentCredential* creds[] = {&tmp.cert, &tmp.key, &tmp.ca};
+  struct list_head* el;
+
+  for(size_t i = 0; i < countof(names); i++) {
+    JSValue value = JS_GetPropertyStr(ctx, options, names[i]);
+
+    agent_credential_init(ctx, creds[i], value);
+    JS_FreeValue(ctx, value);
+  }
+
+  list_for_each(el, &agent->tls) {
+    tls = list_entry(el, AgentTls, link);
+
+    if(agent_credential_equal(&tls->cert, &tmp.cert) && agent_credential_equal(&tls->key, &tmp.key) && agent_credential_equal(&tls->ca, &tmp.ca))
+      goto done;
+  }
+
+  if(!(tls = js_mallocz(ctx, sizeof(AgentTls) + agent->max_sockets * sizeof(struct lws_vhost*))))
+    goto fail;
+
+  tls->cert = tmp.cert;
+  tls->key = tmp.key;
+  tls->ca = tmp.ca;
+  list_add_tail(&tls->link, &agent->tls);
+  return tls;
+
+done:
+  for(size_t i = 0; i < countof(creds); i++)
+    agent_credential_clear(ctx, creds[i]);
+
+  return tls;
+
+fail:
+  for(size_t i = 0; i < countof(creds); i++)
+    agent_credential_clear(ctx, creds[i]);
+
+  /* never the last entry the search looked at */
+  return 0;
+}
+
+static AgentOrigin* agent_origin(MinnetAgent* agent, const URL* url, AgentTls* tls) {
+  enum protocol proto = protocol_number(url->protocol);
+  const char* host = url->host ? url->host : "";
+  char key[strlen(host) + 32];
+  struct list_head* el;
+  AgentOrigin* origin;
+
+  snprintf(key, sizeof(key), "%s://%s:%d", protocol_is_tls(proto) ? "https" : "http", host, url->port ? url->port : protocol_default_port(proto));
+
+  list_for_each(el, &agent->origins) {
+    if((origin = list_entry(el, AgentOrigin, link))->tls == tls && !strcasecmp(origin->key, key))
+      return origin;
+  }
+
+  if(!(origin = js_mallocz(agent->js, sizeof(AgentOrigin) + agent->max_sockets * sizeof(AgentSlot))))
+    return 0;
+
+  if(!(origin->key = js_strdup(agent->js, key))) {
+    js_free(agent->js, origin);
+    return 0;
+  }
+
+  origin->tls = tls;
+  init_list_head(&origin->waiting);
+  list_add_tail(&origin->link, &agent->origins);
+
+  return origin;
+}
+
+static uint32_t agent_origin_active(MinnetAgent* agent, AgentOrigin* origin) {
+  uint32_t n = 0;
+
+  for(uint32_t i = 0; i < agent->max_sockets; i++)
+    n += origin->slots[i].streams;
+
+  return n;
+}
+
+/* the requests on connections have reached maxRequests */
+static BOOL agent_full(MinnetAgent* agent) {
+  struct list_head* el;
+  uint32_t n = 0;
+
+  if(!agent->max_requests)
+    return FALSE;
+
+  list_for_each(el, &agent->origins) { n += agent_origin_active(agent, list_entry(el, AgentOrigin, link)); }
+
+  return n >= agent->max_requests;
+}
+
+/**
+ * An h2 connection of the origin with a stream to spare or an idle connection, else a
+ * lane it has no connection on. None while a connection is negotiating ALPN, should it
+ * become h2 the requests go on it, and none once the origin has max_origin_requests.
+ */
+static AgentSlot* agent_slot(MinnetAgent* agent, AgentOrigin* origin) {
+  AgentSlot* empty = 0;
+
+  if(agent->max_origin_requests && agent_origin_active(agent, origin) >= agent->max_origin_requests)
+    return 0;
+
+  for(uint32_t i = 0; i < agent->max_sockets; i++) {
+    AgentSlot* slot = &origin->slots[i];
+
+    if(slot->pending)
+      return 0;
+
+    if(slot->h2) {
+      if(slot->streams < agent->max_streams)
+        return slot;
+
+      continue;
+    }
+
+    if(slot->streams)
+      continue;
+
+    if(slot->wsi)
+      return slot;
+
+    if(!empty)
+      empty = slot;
+  }
+
+  return empty;
+}
+
+/* h2 is offered unless a connection to the origin settled on HTTP/1.1 already */
+static BOOL agent_offer_h2(MinnetAgent* agent, AgentOrigin* origin, MinnetClient* client) {
+  if(!agent->http2 || !agent->keep_alive || !protocol_is_tls(protocol_number(client->request->url.protocol)))
+    return FALSE;
+
+  for(uint32_t i = 0; i < agent->max_sockets; i++)
+    if(origin->slots[i].wsi && !origin->slots[i].h2)
+      return FALSE;
+
+  return TRUE;
+}
+
+static struct lws_vhost* agent_lane(MinnetAgent* agent, AgentTls* tls, uint32_t i) {
+  if(!tls->lanes[i]) {
+    struct lws_context_creation_info info = agent->context.info;
+
+    info.vhost_name = "minnet-agent";
+    info.client_ssl_cert_filepath = tls->cert.path;
+    info.client_ssl_cert_mem = tls->cert.mem;
+    info.client_ssl_cert_mem_len = tls->cert.len;
+    info.client_ssl_private_key_filepath = tls->key.path;
+    info.client_ssl_key_mem = tls->key.mem;
+    info.client_ssl_key_mem_len = tls->key.len;
+    info.client_ssl_ca_filepath = tls->ca.path;
+    info.client_ssl_ca_mem = tls->ca.mem;
+    info.client_ssl_ca_mem_len = tls->ca.len;
+
+    tls->lanes[i] = lws_create_vhost(agent->lws, &info);
+  }
+
+  return tls->lanes[i];
+}
+
+static uint32_t agent_interval(MinnetAgent* agent) { return MAX(lws_service_adjust_timeout(agent->lws, 1000, 0), 10); }
+
+static BOOL agent_connect(MinnetAgent* agent, AgentOrigin* origin, AgentSlot* slot, MinnetClient* client) {
+  struct lws_client_connect_info* info = &client->connect_info;
+  struct wsi_opaque_user_data* opaque;
+  struct lws* idle = slot->wsi;
+  BOOL h2 = !idle && agent_offer_h2(agent, origin, client);
+
+  if(!(info->vhost = agent_lane(agent, origin->tls, slot - origin->slots)))
+    return FALSE;
+
+  /* the client is found through the opaque user data, the context is shared */
+  if(!(opaque = info->opaque_user_data) && !(opaque = info->opaque_user_data = opaque_new(agent->js)))
+    return FALSE;
+
+  opaque->sess = &client->session;
+
+  info->context = agent->lws;
+  info->pwsi = &client->wsi;
+  info->alpn = h2 || slot->h2 ? "h2,http/1.1" : "http/1.1";
+  info->keep_warm_secs = MIN(agent->keep_alive, UINT16_MAX);
+
+  /* lws puts the request on the vhost's connection to the same host and port when there is one, as a stream with h2 */
+  if(agent->keep_alive)
+    info->ssl_connection |= LCCSCF_PIPELINE;
+
+  client->wsi = 0;
+  client->slot = slot;
+  slot->streams++;
+  slot->pending = h2;
+
+  if(!lws_client_connect_via_info(info)) {
+    /* unless the callbacks had the error already */
+    if(!client->slot)
+      return TRUE;
+
+    client->slot = 0;
+    slot->streams--;
+    slot->pending = FALSE;
+    return FALSE;
+  }
+
+  /* an h2 slot has the network connection, minnet_agent_established() puts it there */
+  if(!slot->h2)
+    slot->wsi = client->wsi;
+
+  if(idle)
+    agent->stats.reused++;
+  else
+    agent->stats.connects++;
+
+  agent_schedule(agent, agent_interval(agent));
+  return TRUE;
+}
+
+/* a waiting request which didn't get its connection ends like one whose connection failed */
+static void agent_error(MinnetClient* client, JSValueConst err) {
+  JSContext* ctx = client->context.js;
+
+  if(js_async_pending(&client->promise))
+    js_async_reject(ctx, &client->promise, err);
+
+  if(callback_valid(&client->on.close)) {
+    JSValueConst argv[] = {JS_NewInt32(ctx, -1), err};
+
+    JS_FreeValue(ctx, minnet_client_exception(client, callback_emit(&client->on.close, countof(argv), argv)));
+  }
+
+  minnet_client_unsignal(client);
+}
+
+static void agent_fail(MinnetClient* client, const char* msg) {
+  JSValue err = js_error_new(client->context.js, "%s", msg);
+
+  agent_error(client, err);
+  JS_FreeValue(client->context.js, err);
+}
+
+/* behind the waiting requests of the same or a higher priority */
+static void agent_enqueue(MinnetAgent* agent, AgentOrigin* origin, MinnetClient* client) {
+  struct list_head* el;
+
+  list_for_each(el, &origin->waiting) {
+    if(list_entry(el, MinnetClient, link)->priority < client->priority)
+      break;
+  }
+
+  list_add_tail(&minnet_client_dup(client)->link, el);
+  client->queued = lws_now_usecs();
+  agent->stats.queued++;
+}
+
+/* the caller has the reference of the queue */
+static void agent_dequeue(MinnetAgent* agent, MinnetClient* client) {
+  int64_t wait = lws_now_usecs() - client->queued;
+
+  list_del(&client->link);
+  init_list_head(&client->link);
+  client->queued = 0;
+
+  agent->stats.wait_total += wait;
+  agent->stats.wait_max = MAX(agent->stats.wait_max, wait);
+}
+
+/* put the request of client on the agent again, a failure ends it like a failed connection */
+static void agent_start(MinnetAgent* agent, MinnetClient* client) {
+  enum protocol proto = protocol_number(client->request->url.protocol);
+
+  if(!(proto == PROTOCOL_HTTP || proto == PROTOCOL_HTTPS ? minnet_agent_request : minnet_agent_connect)(agent, client))
+    agent_fail(client, strerror(errno ? errno : ECONNREFUSED));
+}
+
+/**
+ * Connect waiting requests while there is room: of the origins with a connection to
+ * spare, the one whose next request has the highest priority, then waited longest.
+ */
+static void agent_dispatch(MinnetAgent* agent) {
+  agent->dispatch = FALSE;
+
+  /* unless they were aborted meanwhile */
+  while(!list_empty(&agent->retry)) {
+    MinnetClient* client = list_entry(agent->retry.next, MinnetClient, link);
+
+    list_del(&client->link);
+    init_list_head(&client->link);
+
+    if(client->resolving) {
+      client->resolving = FALSE;
+      agent_start(agent, client);
+    }
+
+    minnet_client_free(client, JS_GetRuntime(agent->js));
+  }
+
+  while(!agent_full(agent)) {
+    MinnetClient* client = 0;
+    AgentOrigin* origin = 0;
+    AgentSlot* slot = 0;
+    struct list_head* el;
+
+    list_for_each(el, &agent->origins) {
+      AgentOrigin* o = list_entry(el, AgentOrigin, link);
+      MinnetClient* c;
+      AgentSlot* s;
+
+      if(list_empty(&o->waiting) || !(s = agent_slot(agent, o)))
+        continue;
+
+      c = list_entry(o->waiting.next, MinnetClient, link);
+
+      if(!client || c->priority > client->priority || (c->priority == client->priority && c->queued < client->queued)) {
+        client = c;
+        origin = o;
+        slot = s;
+      }
+    }
+
+    if(!client)
+      break;
+
+    agent_dequeue(agent, client);
+
+    if(!agent_connect(agent, origin, slot, client))
+      agent_fail(client, strerror(errno ? errno : ECONNREFUSED));
+
+    minnet_client_free(client, JS_GetRuntime(agent->js));
+  }
+}
+
+/* run the lws timeouts which are due, then hand free connections to waiting requests */
+static void agent_service(MinnetAgent* agent) {
+  while(lws_service_adjust_timeout(agent->lws, 1000, 0) == 0)
+    lws_service_tsi(agent->lws, -1, 0);
+
+  if(agent->dispatch)
+    agent_dispatch(agent);
+}
+
+static JSValue agent_tick(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  MinnetAgent* agent = ptr;
+  struct list_head *el, *next;
+
+  JS_FreeValue(ctx, agent->timer);
+  agent->timer = JS_UNDEFINED;
+
+  agent_service(agent);
+
+  list_for_each_safe(el, next, &agent->origins) {
+    AgentOrigin* origin = list_entry(el, AgentOrigin, link);
+
+    if(!agent_origin_used(agent, origin))
+      agent_origin_free(agent, origin);
+  }
+
+  /* idle connections expire through lws timeouts, which need servicing while there are any */
+  if(agent_busy(agent))
+    agent_schedule(agent, agent_interval(agent));
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Run agent_tick() after ms, or sooner when it is armed already. The pending timer holds
+ * a reference, the agent stays while it has connections. Without an event loop only
+ * blocking requests run the agent.
+ */
+static void agent_schedule(MinnetAgent* agent, uint32_t ms) {
+  JSValue fn;
+
+  if(!agent->on_fd.ctx || agent->ref_count == 0)
+    return;
+
+  if(!JS_IsUndefined(agent->timer)) {
+    if(ms > 0)
+      return;
+
+    js_timer_cancel(agent->js, agent->timer);
+    JS_FreeValue(agent->js, agent->timer);
+  }
+
+  fn = js_function_cclosure(agent->js, agent_tick, 0, 0, minnet_agent_dup(agent), (void (*)(void*))minnet_agent_free);
+  agent->timer = js_timer_start(agent->js, fn, ms);
+  JS_FreeValue(agent->js, fn);
+}
+
+/**
+ * Connect to the first address of entry, minnet_agent_retry() has lws try the others when
+ * that fails. A failed lookup ends the request like a failed connection.
+ */
+static BOOL agent_address(MinnetClient* client, const DnsEntry* entry) {
+  if(entry->error) {
+    agent_fail(client, gai_strerror(entry->error));
+    return FALSE;
+  }
+
+  strncpy(client->address, entry->addrs[0], sizeof(client->address) - 1);
+  client->connect_info.address = client->address;
+  client->naddrs = entry->naddrs;
+  return TRUE;
+}
+
+static void agent_resolved(void* opaque, const DnsEntry* entry) {
+  MinnetClient* client = opaque;
+  MinnetAgent* agent = client->agent;
+
+  /* unless it was aborted meanwhile */
+  if(client->resolving) {
+    client->resolving = FALSE;
+
+    if(agent_address(client, entry))
+      agent_start(agent, client);
+  }
+
+  minnet_client_free(client, JS_GetRuntime(agent->js));
+}
+
+/**
+ * Look up the host of client in the thread's DNS cache, lws would block on getaddrinfo().
+ * 1 when the address is there, 0 when the lookup is pending or the request failed, the
+ * lookup holds a reference and goes on from agent_resolved(). -1 on error.
+ */
+static int agent_resolve(MinnetAgent* agent, MinnetClient* client) {
+  const char* host = client->connect_info.address;
+  const DnsEntry* entry;
+  int ret;
+
+  if(!host || host == client->address || client->fallback || dns_numeric(host))
+    return 1;
+
+  if((ret = minnet_dns_lookup(agent->js, host, &entry, agent_resolved, client)) == 1)
+    return agent_address(client, entry) ? 1 : 0;
+
+  if(ret == 0) {
+    minnet_client_dup(client);
+    client->resolving = TRUE;
+  } else {
+    errno = ENOMEM;
+  }
+
+  return ret;
+}
+
+/**
+ * Put the request of client on a connection to its origin: an idle one, a new one while
+ * the origin has less than max_sockets, otherwise it waits for one to become free.
+ */
+BOOL minnet_agent_request(MinnetAgent* agent, MinnetClient* client) {
+  AgentOrigin* origin;
+  AgentSlot* slot;
+  int ret;
+
+  if((ret = agent_resolve(agent, client)) <= 0)
+    return ret == 0;
+
+  if(!(origin = agent_origin(agent, &client->request->url, client->tls))) {
+    errno = ENOMEM;
+    return FALSE;
+  }
+
+  agent->stats.requests++;
+
+  if(!list_empty(&origin->waiting) || agent_full(agent) || !(slot = agent_slot(agent, origin))) {
+    agent_enqueue(agent, origin, client);
+    return TRUE;
+  }
+
+  return agent_connect(agent, origin, slot, client);
+}
+
+/**
+ * Open the WebSocket or raw connection of client on lane 0 of its credentials. lws
+ * doesn't share those, the connection is closed when the client goes first.
+ */
+BOOL minnet_agent_connect(MinnetAgent* agent, MinnetClient* client) {
+  struct lws_client_connect_info* info = &client->connect_info;
+  struct wsi_opaque_user_data* opaque;
+  int ret;
+
+  if((ret = agent_resolve(agent, client)) <= 0)
+    return ret == 0;
+
+  if(!(info->vhost = agent_lane(agent, client->tls, 0)))
+    return FALSE;
+
+  if(!(opaque = info->opaque_user_data) && !(opaque = info->opaque_user_data = opaque_new(agent->js)))
+    return FALSE;
+
+  opaque->sess = &client->session;
+
+  info->context = agent->lws;
+  info->pwsi = &client->wsi;
+
+  client->wsi = 0;
+  list_add_tail(&client->link, &agent->sockets);
+
+  if(!lws_client_connect_via_info(info)) {
+    minnet_agent_detach(client);
+    return FALSE;
+  }
+
+  agent_schedule(agent, agent_interval(agent));
+  return TRUE;
+}
+
+/* the connection of a WebSocket or raw client is gone */
+void minnet_agent_detach(MinnetClient* client) {
+  struct wsi_opaque_user_data* opaque;
+
+  if(client->slot)
+    return;
+
+  list_del(&client->link);
+  init_list_head(&client->link);
+
+  if((opaque = client->connect_info.opaque_user_data) && opaque->sess == &client->session)
+    opaque->sess = 0;
+
+  client->wsi = 0;
+}
+
+/**
+ * The response headers of client are there and ALPN is done. With h2 the request is
+ * on a stream of its own, the requests waiting for the connection can go on it too.
+ */
+void minnet_agent_established(MinnetClient* client, struct lws* wsi) {
+  MinnetAgent* agent = client->agent;
+  AgentSlot* slot;
+
+  if(!(slot = client->slot))
+    return;
+
+  client->wsi = wsi;
+
+  if(wsi_http2(wsi)) {
+    slot->h2 = TRUE;
+    slot->wsi = lws_get_network_wsi(wsi);
+  }
+
+  if(slot->pending) {
+    slot->pending = FALSE;
+    agent->dispatch = TRUE;
+    agent_schedule(agent, 0);
+  }
+}
+
+/**
+ * The request of client is done. With keep, its connection stays open for the
+ * next request to the origin, lws closes it after keep_alive seconds idle. An h2
+ * connection stays with its other streams, unless it was wsi which went.
+ */
+void minnet_agent_release(MinnetClient* client, struct lws* wsi, BOOL keep) {
+  MinnetAgent* agent = client->agent;
+  struct wsi_opaque_user_data* opaque;
+  AgentSlot* slot;
+
+  if(!(slot = client->slot))
+    return;
+
+  keep = keep && agent->keep_alive;
+
+  client->slot = 0;
+  slot->streams--;
+  slot->pending = FALSE;
+
+  if(!slot->h2)
+    slot->wsi = keep ? wsi : 0;
+  else if(!keep && wsi == slot->wsi) {
+    slot->wsi = 0;
+    slot->h2 = FALSE;
+  }
+
+  /* what happens to the idle connection is none of the client's business */
+  if(keep && (opaque = lws_get_opaque_user_data(wsi)) && opaque->sess == &client->session)
+    opaque->sess = 0;
+
+  agent->dispatch = TRUE;
+  agent_schedule(agent, 0);
+}
+
+/**
+ * The connection of client to the first address of its host failed. When the host has
+ * more, the request goes on by host name from agent_dispatch(), outside the callback of
+ * the failed wsi, and lws tries every address getaddrinfo() gives it. FALSE otherwise.
+ */
+BOOL minnet_agent_retry(MinnetClient* client) {
+  MinnetAgent* agent = client->agent;
+
+  if(client->fallback || client->naddrs < 2 || client->connect_info.address != client->address)
+    return FALSE;
+
+  /* the failed wsi doesn't find the client anymore */
+  minnet_agent_detach(client);
+
+  client->fallback = TRUE;
+  client->connect_info.address = client->request->url.host;
+  client->resolving = TRUE;
+
+  list_add_tail(&minnet_client_dup(client)->link, &agent->retry);
+  agent->dispatch = TRUE;
+  agent_schedule(agent, 0);
+  return TRUE;
+}
+
+/**
+ * The request of client is aborted: it leaves the queue, or its connection is closed.
+ * FALSE when it's done already.
+ */
+BOOL minnet_agent_abort(MinnetClient* client) {
+  MinnetAgent* agent = client->agent;
+
+  /* the lookup goes on for the cache, agent_resolved() or agent_dispatch() drops its reference */
+  if(client->resolving) {
+    client->resolving = FALSE;
+    agent->stats.aborted++;
+    return TRUE;
+  }
+
+  if(client->queued) {
+    agent_dequeue(agent, client);
+    agent->stats.aborted++;
+    minnet_client_free(client, JS_GetRuntime(agent->js));
+    return TRUE;
+  }
+
+  if(client->slot && client->wsi) {
+    lws_wsi_close(client->wsi, LWS_TO_KILL_ASYNC);
+    agent->stats.aborted++;
+    agent_schedule(agent, 0);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/**
+ * The client goes while its request is on a connection, the connection is left to finish it.
+ * A WebSocket or raw connection is closed.
+ */
+void minnet_agent_forget(MinnetClient* client) {
+  struct wsi_opaque_user_data* opaque;
+  AgentSlot* slot;
+
+  if((slot = client->slot)) {
+    client->slot = 0;
+    slot->streams--;
+  } else if(client->wsi && !list_empty(&client->link)) {
+    lws_wsi_close(client->wsi, LWS_TO_KILL_ASYNC);
+    list_del(&client->link);
+    init_list_head(&client->link);
+    agent_schedule(client->agent, 0);
+  }
+
+  if((opaque = client->connect_info.opaque_user_data) && opaque->sess == &client->session)
+    opaque->sess = 0;
+}
+
+/* a wsi of the agent goes, when it held an idle or an h2 connection the lane is free again */
+void minnet_agent_closed(MinnetAgent* agent, struct lws* wsi) {
+  struct list_head* el;
+
+  list_for_each(el, &agent->origins) {
+    AgentOrigin* origin = list_entry(el, AgentOrigin, link);
+
+    for(uint32_t i = 0; i < agent->max_sockets; i++) {
+      AgentSlot* slot = &origin->slots[i];
+
+      if(slot->wsi == wsi && (slot->h2 || !slot->streams)) {
+        slot->wsi = 0;
+        slot->h2 = FALSE;
+        agent->dispatch = TRUE;
+        agent_schedule(agent, 0);
+        return;
+      }
+    }
+  }
+}
+
+/* a request still on the agent: resolving, queued or on a connection */
+static BOOL agent_running(MinnetClient* client) { return client && client->agent && (client->slot || client->queued || client->resolving); }
+
+/**
+ * Abort the blocking request of client when one of its timeouts passed, its close
+ * handler gets a TimeoutError. Otherwise returns the ms until the next one would.
+ */
+static int agent_expire(MinnetClient* client, int64_t now) {
+  static const char* const names[] = {"connect", "read", "total"};
+  const uint32_t ms[] = {client->timeout.connect, client->timeout.read, client->timeout.total};
+  /* connecting counts from the start until the request is sent, reading from the last data */
+  int64_t deadline[] = {
+      ms[0] && !client->activity ? client->started + ms[0] * 1000ll : 0,
+      ms[1] && client->activity ? client->activity + ms[1] * 1000ll : 0,
+      ms[2] ? client->started + ms[2] * 1000ll : 0,
+  };
+  int64_t next = INT64_MAX;
+
+  for(size_t i = 0; i < countof(deadline); i++) {
+    if(!deadline[i])
+      continue;
+
+    if(deadline[i] <= now) {
+      JSContext* ctx = client->context.js;
+      JSValue err = js_error_new(ctx, "%s timeout of %u ms exceeded", names[i], ms[i]);
+
+      JS_SetPropertyStr(ctx, err, "name", JS_NewString(ctx, "TimeoutError"));
+
+      /* it fires once, the request may take a while to close */
+      memset(&client->timeout, 0, sizeof(client->timeout));
+
+      minnet_agent_abort(client);
+      agent_error(client, err);
+      JS_FreeValue(ctx, err);
+      return 0;
+    }
+
+    next = MIN(next, deadline[i]);
+  }
+
+  return next == INT64_MAX ? 1000 : (int)MIN((next - now + 999) / 1000, 1000);
+}
+
+/**
+ * The blocking engine: runs the agents of clients until all their requests are done,
+ * servicing only the fds poll() found ready. The DNS answers come in here too, and the
+ * timeouts of the requests are checked in between. FALSE with an exception when out of
+ * memory or poll() fails, the requests are left on their agents.
+ */
+BOOL minnet_agent_wait(JSContext* ctx, MinnetClient* const clients[], size_t n) {
+  MinnetAgent **agents, **owner = 0;
+  struct pollfd* pfds = 0;
+  size_t size = 0;
+  BOOL ret = TRUE;
+
+  if(!(agents = js_malloc(ctx, MAX(n, 1) * sizeof(MinnetAgent*))))
+    return FALSE;
+
+  for(;;) {
+    size_t i, j, k, nagents = 0, nfds = 0;
+    int64_t now = lws_now_usecs();
+    int r, timeout = 1000;
+    BOOL serviced = FALSE;
+
+    for(i = 0; i < n; i++) {
+      if(!agent_running(clients[i]))
+        continue;
+
+      timeout = MIN(timeout, agent_expire(clients[i], now));
+
+      for(j = 0; j < nagents; j++)
+        if(agents[j] == clients[i]->agent)
+          break;
+
+      if(j == nagents)
+        agents[nagents++] = clients[i]->agent;
+    }
+
+    if(nagents == 0)
+      break;
+
+    for(j = 0; j < nagents; j++) {
+      MinnetAgent* agent = agents[j];
+      int t;
+
+      if(agent->dispatch) {
+        agent_dispatch(agent);
+        serviced = TRUE;
+      } else if((t = lws_service_adjust_timeout(agent->lws, 1000, 0)) == 0) {
+        lws_service_tsi(agent->lws, -1, 0);
+        serviced = TRUE;
+      } else {
+        timeout = MIN(timeout, t);
+      }
+
+      nfds += agent->nfds;
+    }
+
+    if(serviced)
+      continue;
+
+    /* a copy, servicing one fd may add or remove others */
+    if(nfds + 1 > size) {
+      struct pollfd* p;
+      MinnetAgent** o;
+
+      if((p = js_realloc(ctx, pfds, (nfds + 1) * sizeof(struct pollfd))))
+        pfds = p;
+
+      if(!p || !(o = js_realloc(ctx, owner, (nfds + 1) * sizeof(MinnetAgent*)))) {
+        ret = FALSE;
+        break;
+      }
+
+      owner = o;
+      size = nfds + 1;
+    }
+
+    for(j = 0, k = 0; j < nagents; j++)
+      for(i = 0; i < agents[j]->nfds; i++) {
+        pfds[k] = agents[j]->pfds[i];
+        owner[k++] = agents[j];
+      }
+
+    pfds[nfds] = (struct pollfd){minnet_dns_fd(), POLLIN, 0};
+
+    if((r = poll(pfds, nfds + 1, timeout)) == -1 && errno != EINTR) {
+      JS_ThrowInternalError(ctx, "poll() failed: %s", strerror(errno));
+      ret = FALSE;
+      break;
+    }
+
+    if(r <= 0)
+      continue;
+
+    if(pfds[nfds].revents)
+      minnet_dns_process(ctx);
+
+    for(i = 0; i < nfds; i++)
+      if(pfds[i].revents) {
+        struct lws_pollfd ready = {pfds[i].fd, pfds[i].events, pfds[i].revents};
+
+        lws_service_fd(owner[i]->lws, &ready);
+      }
+  }
+
+  js_free(ctx, pfds);
+  js_free(ctx, owner);
+  js_free(ctx, agents);
+  return ret;
+}
+
+/* keeps the fds of the context for minnet_agent_wait(), then hands them to the event loop */
+int minnet_agent_poll(MinnetAgent* agent, struct lws* wsi, enum lws_callback_reasons reason, struct lws_pollargs* args) {
+  size_t i;
+
+  for(i = 0; i < agent->nfds; i++)
+    if(agent->pfds[i].fd == args->fd)
+      break;
+
+  switch(reason) {
+    case LWS_CALLBACK_ADD_POLL_FD:
+    case LWS_CALLBACK_CHANGE_MODE_POLL_FD: {
+      if(i == agent->nfds) {
+        struct pollfd* pfds;
+
+        if(!(pfds = realloc(agent->pfds, (agent->nfds + 1) * sizeof(struct pollfd))))
+          return -1;
+
+        agent->pfds = pfds;
+        agent->pfds[agent->nfds++] = (struct pollfd){args->fd, 0, 0};
+      }
+
+      agent->pfds[i].events = args->events;
+      break;
+    }
+
+    case LWS_CALLBACK_DEL_POLL_FD: {
+      if(i < agent->nfds) {
+        memmove(&agent->pfds[i], &agent->pfds[i + 1], (agent->nfds - (i + 1)) * sizeof(struct pollfd));
+        --agent->nfds;
+      }
+
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  return minnet_pollfds_change(wsi, reason, &agent->on_fd, args);
+}
+
+MinnetAgent* minnet_agent_new(JSContext* ctx, JSValueConst options) {
+  MinnetAgent* agent;
+  struct lws_context_creation_info* info;
+  JSValue value;
+
+  if(!(agent = js_mallocz(ctx, sizeof(MinnetAgent))))
+    return 0;
+
+  agent->ref_count = 1;
+  agent->js = ctx;
+  agent->context.shared = TRUE;
+  agent->context.error = JS_NULL;
+  agent->context.crt = JS_UNDEFINED;
+  agent->context.key = JS_UNDEFINED;
+  agent->context.ca = JS_UNDEFINED;
+  js_async_zero(&agent->context.promise);
+  callback_zero(&agent->on_fd);
+  init_list_head(&agent->tls);
+  init_list_head(&agent->origins);
+  init_list_head(&agent->sockets);
+  init_list_head(&agent->retry);
+  agent->max_sockets = AGENT_MAX_SOCKETS;
+  agent->keep_alive = AGENT_KEEP_ALIVE;
+  agent->max_streams = AGENT_MAX_STREAMS;
+  agent->http2 = TRUE;
+  agent->max_requests = AGENT_MAX_REQUESTS;
+  agent->timer = JS_UNDEFINED;
+
+  if(JS_IsObject(options)) {
+    if(js_has_propertystr(ctx, options, "maxSockets"))
+      agent->max_sockets = MAX(js_get_propertystr_uint32(ctx, options, "maxSockets"), 1);
+
+    if(js_has_propertystr(ctx, options, "keepAlive"))
+      agent->keep_alive = js_get_propertystr_uint32(ctx, options, "keepAlive");
+
+    if(js_has_propertystr(ctx, options, "maxStreams"))
+      agent->max_streams = MAX(js_get_propertystr_uint32(ctx, options, "maxStreams"), 1);
+
+    if(js_has_propertystr(ctx, options, "maxRequests"))
+      agent->max_requests = js_get_propertystr_uint32(ctx, options, "maxRequests");
+
+    if(js_has_propertystr(ctx, options, "maxOriginRequests"))
+      agent->max_origin_requests = js_get_propertystr_uint32(ctx, options, "maxOriginRequests");
+
+    if(js_has_propertystr(ctx, options, "http2"))
+      agent->http2 = js_get_propertystr_bool(ctx, options, "http2");
+
+    if(JS_IsFunction(ctx, (value = JS_GetPropertyStr(ctx, options, "onFd"))))
+      agent->on_fd = CALLBACK_INIT(ctx, value, JS_UNDEFINED);
+    else
+      JS_FreeValue(ctx, value);
+
+    if(minnet_event_loop(ctx, options, &agent->context))
+      goto fail;
+  }
+
+  if(!agent->on_fd.ctx) {
+    /* without globalThis.os, only blocking requests run the agent */
+    if(JS_IsException((value = minnet_default_fd_callback(ctx))))
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    else
+      agent->on_fd = CALLBACK_INIT(ctx, value, JS_UNDEFINED);
+  }
+
+  info = &agent->context.info;
+  info->options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+  info->options |= LWS_SERVER_OPTION_H2_JUST_FIX_WINDOW_UPDATE_OVERFLOW;
+  info->options |= LWS_SERVER_OPTION_PEER_CERT_NOT_REQUIRED;
+  info->options |= LWS_SERVER_OPTION_IGNORE_MISSING_CERT;
+  info->options |= LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+  info->port = CONTEXT_PORT_NO_LISTEN;
+  info->protocols = client_protocols;
+  info->user = agent;
+
+  if(!(agent->lws = lws_create_context(info))) {
+    JS_ThrowInternalError(ctx, "minnet-agent: libwebsockets init failed");
+    goto fail;
+  }
+
+  return agent;
+
+fail:
+  minnet_agent_free(agent);
+  return 0;
+}
+
+MinnetAgent* minnet_agent_dup(MinnetAgent* agent) {
+  ++agent->ref_count;
+  return agent;
+}
+
+void minnet_agent_free(MinnetAgent* agent) {
+  if(--agent->ref_count == 0) {
+    JSContext* ctx = agent->js;
+    struct list_head *el, *next;
+
+    if(agent_global == agent)
+      agent_global = 0;
+
+    /* closing the connections calls back, the origins are still there */
+    minnet_event_loop_release(&agent->context, &agent->on_fd);
+    context_clear(&agent->context);
+
+    list_for_each_safe(el, next, &agent->origins) { agent_origin_free(agent, list_entry(el, AgentOrigin, link)); }
+    list_for_each_safe(el, next, &agent->tls) { agent_tls_free(agent, list_entry(el, AgentTls, link)); }
+
+    JS_FreeValue(ctx, agent->timer);
+    callback_clear(&agent->on_fd);
+
+    free(agent->pfds);
+    js_free(ctx, agent);
+  }
+}
+
+static MinnetAgent* agent_default(JSContext* ctx) {
+  if(agent_global)
+    return minnet_agent_dup(agent_global);
+
+  return agent_global = minnet_agent_new(ctx, JS_UNDEFINED);
+}
+
+/* options.priority: a number, or "high", "low" and "auto" as with fetch() */
+static int32_t agent_priority(JSContext* ctx, JSValueConst options) {
+  JSValue value = JS_GetPropertyStr(ctx, options, "priority");
+  int32_t ret = 0;
+
+  if(JS_IsString(value)) {
+    const char* str = JS_ToCString(ctx, value);
+
+    ret = !strcmp(str, "high") ? 1 : !strcmp(str, "low") ? -1 : 0;
+    JS_FreeCString(ctx, str);
+  } else if(JS_IsNumber(value)) {
+    JS_ToInt32(ctx, &ret, value);
+  }
+
+  JS_FreeValue(ctx, value);
+  return ret;
+}
+
+/**
+ * The agent of a client: options.agent, or the one of the thread, and the vhosts for its
+ * TLS credentials. With agent: false, and with onFd or eventLoop of its own, a client
+ * gets a context of its own; a blocking one gets an agent of its own instead.
+ */
+int minnet_agent_select(JSContext* ctx, JSValueConst options, MinnetClient* client) {
+  static const char* const own[] = {"onFd", "eventLoop"};
+  JSValue value = JS_GetPropertyStr(ctx, options, "agent");
+  BOOL block = js_get_propertystr_bool(ctx, options, "block");
+  MinnetAgent* agent = 0;
+  BOOL separate = FALSE;
+  int ret = 0;
+
+  /* blocking requests are run by minnet_agent_wait(), they don't use an event loop */
+  for(size_t i = 0; i < countof(own); i++)
+    if(!block && js_has_propertystr(ctx, options, own[i]))
+      separate = TRUE;
+
+  if(js_is_nullish(value)) {
+    if(!separate && !(agent = agent_default(ctx)))
+      ret = -1;
+
+  } else if(minnet_agent_data(value)) {
+    if(separate) {
+      JS_ThrowTypeError(ctx, "a client with an agent can't have onFd or eventLoop");
+      ret = -1;
+    } else {
+      agent = minnet_agent_dup(minnet_agent_data(value));
+    }
+
+  } else if(!JS_IsBool(value) || JS_ToBool(ctx, value)) {
+    JS_ThrowTypeError(ctx, "agent must be an Agent or false");
+    ret = -1;
+
+  } else if(block) {
+    /* a context of its own, which goes with the request */
+    if((agent = minnet_agent_new(ctx, JS_UNDEFINED)))
+      agent->keep_alive = 0;
+    else
+      ret = -1;
+  }
+
+  JS_FreeValue(ctx, value);
+
+  if(agent && !(client->tls = agent_tls(agent, options))) {
+    minnet_agent_free(agent);
+    JS_ThrowOutOfMemory(ctx);
+    return -1;
+  }
+
+  client->agent = agent;
+
+  if(agent)
+    client->priority = agent_priority(ctx, options);
+
+  return ret;
+}
+
+JSValue minnet_agent_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj;
+  MinnetAgent* agent;
+
+  if(!(agent = minnet_agent_new(ctx, argc > 0 ? argv[0] : JS_UNDEFINED)))
+    return JS_EXCEPTION;
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    proto = JS_DupValue(ctx, minnet_agent_proto);
+
+  obj = JS_NewObjectProtoClass(ctx, proto, minnet_agent_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj)) {
+    minnet_agent_free(agent);
+    return JS_EXCEPTION;
+  }
+
+  JS_SetOpaque(obj, agent);
+  return obj;
+}
+
+JSValue minnet_agent_wrap(JSContext* ctx, MinnetAgent* agent) {
+  JSValue ret = JS_NewObjectProtoClass(ctx, minnet_agent_proto, minnet_agent_class_id);
+
+  if(JS_IsException(ret))
+    return JS_EXCEPTION;
+
+  JS_SetOpaque(ret, agent);
+  return ret;
+}
+
+static JSValue minnet_agent_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  MinnetAgent* agent;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(agent = minnet_agent_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case AGENT_MAXSOCKETS: {
+      ret = JS_NewUint32(ctx, agent->max_sockets);
+      break;
+    }
+
+    case AGENT_KEEPALIVE: {
+      ret = JS_NewUint32(ctx, agent->keep_alive);
+      break;
+    }
+
+    case AGENT_MAXSTREAMS: {
+      ret = JS_NewUint32(ctx, agent->max_streams);
+      break;
+    }
+
+    case AGENT_HTTP2: {
+      ret = JS_NewBool(ctx, agent->http2);
+      break;
+    }
+
+    case AGENT_MAXREQUESTS: {
+      ret = JS_NewUint32(ctx, agent->max_requests);
+      break;
+    }
+
+    case AGENT_MAXORIGINREQUESTS: {
+      ret = JS_NewUint32(ctx, agent->max_origin_requests);
+      break;
+    }
+
+    case AGENT_STATS: {
+      uint32_t origins = 0, active = 0, idle = 0, h2 = 0, waiting = 0, sockets = 0, vhosts = 0;
+      struct list_head *el, *el2;
+
+      list_for_each(el, &agent->sockets) { sockets++; }
+
+      list_for_each(el, &agent->tls) {
+        AgentTls* tls = list_entry(el, AgentTls, link);
+
+        for(uint32_t i = 0; i < agent->max_sockets; i++)
+          if(tls->lanes[i])
+            vhosts++;
+      }
+
+      list_for_each(el, &agent->origins) {
+        AgentOrigin* origin = list_entry(el, AgentOrigin, link);
+
+        origins++;
+
+        list_for_each(el2, &origin->waiting) { waiting++; }
+
+        for(uint32_t i = 0; i < agent->max_sockets; i++) {
+          active += origin->slots[i].streams;
+
+          if(origin->slots[i].h2)
+            h2++;
+
+          if(origin->slots[i].wsi && !origin->slots[i].streams)
+            idle++;
+        }
+      }
+
+      ret = JS_NewObject(ctx);
+
+      JS_SetPropertyStr(ctx, ret, "requests", JS_NewInt64(ctx, agent->stats.requests));
+      JS_SetPropertyStr(ctx, ret, "connects", JS_NewInt64(ctx, agent->stats.connects));
+      JS_SetPropertyStr(ctx, ret, "reused", JS_NewInt64(ctx, agent->stats.reused));
+      JS_SetPropertyStr(ctx, ret, "origins", JS_NewUint32(ctx, origins));
+      JS_SetPropertyStr(ctx, ret, "active", JS_NewUint32(ctx, active));
+      JS_SetPropertyStr(ctx, ret, "idle", JS_NewUint32(ctx, idle));
+      JS_SetPropertyStr(ctx, ret, "h2", JS_NewUint32(ctx, h2));
+      JS_SetPropertyStr(ctx, ret, "waiting", JS_NewUint32(ctx, waiting));
+      JS_SetPropertyStr(ctx, ret, "queued", JS_NewInt64(ctx, agent->stats.queued));
+      JS_SetPropertyStr(ctx, ret, "aborted", JS_NewInt64(ctx, agent->stats.aborted));
+      JS_SetPropertyStr(ctx, ret, "waitTime", JS_NewFloat64(ctx, agent->stats.wait_total / 1000.0));
+      JS_SetPropertyStr(ctx, ret, "maxWait", JS_NewFloat64(ctx, agent->stats.wait_max / 1000.0));
+      JS_SetPropertyStr(ctx, ret, "sockets", JS_NewUint32(ctx, sockets));
+      JS_SetPropertyStr(ctx, ret, "vhosts", JS_NewUint32(ctx, vhosts));
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue minnet_agent_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  MinnetAgent* agent;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(agent = minnet_agent_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case AGENT_CLOSEIDLE: {
+      struct list_head* el;
+      uint32_t n = 0;
+
+      list_for_each(el, &agent->origins) {
+        AgentOrigin* origin = list_entry(el, AgentOrigin, link);
+
+        for(uint32_t i = 0; i < agent->max_sockets; i++) {
+          if(origin->slots[i].wsi && !origin->slots[i].streams) {
+            lws_wsi_close(origin->slots[i].wsi, LWS_TO_KILL_ASYNC);
+            n++;
+          }
+        }
+      }
+
+      if(n)
+        agent_schedule(agent, 0);
+
+      ret = JS_NewUint32(ctx, n);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue minnet_agent_global(JSContext* ctx, JSValueConst this_val) {
+  MinnetAgent* agent;
+
+  if(!(agent = agent_default(ctx)))
+    return JS_EXCEPTION;
+
+  return minnet_agent_wrap(ctx, agent);
+}
+
+static void minnet_agent_finalizer(JSRuntime* rt, JSValue val) {
+  MinnetAgent* agent;
+
+  if((agent = minnet_agent_data(val)))
+    minnet_agent_free(agent);
+}
+
+static const JSClassDef minnet_agent_class = {
+    "MinnetAgent",
+    .finalizer = minnet_agent_finalizer,
+};
+
+static const JSCFunctionListEntry minnet_agent_proto_funcs[] = {
+    JS_CGETSET_MAGIC_FLAGS_DEF("maxSockets", minnet_agent_get, 0, AGENT_MAXSOCKETS, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("keepAlive", minnet_agent_get, 0, AGENT_KEEPALIVE, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("maxStreams", minnet_agent_get, 0, AGENT_MAXSTREAMS, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("http2", minnet_agent_get, 0, AGENT_HTTP2, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("maxRequests", minnet_agent_get, 0, AGENT_MAXREQUESTS, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("maxOriginRequests", minnet_agent_get, 0, AGENT_MAXORIGINREQUESTS, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("stats", minnet_agent_get, 0, AGENT_STATS, 0),
+    JS_CFUNC_MAGIC_DEF("closeIdle", 0, minnet_agent_method, AGENT_CLOSEIDLE),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MinnetAgent", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry minnet_agent_static_funcs[] = {
+    JS_CGETSET_DEF("globalAgent", minnet_agent_global, 0),
+};
+
+int minnet_agent_init(JSContext* ctx, JSModuleDef* m) {
+  JS_NewClassID(&minnet_agent_class_id);
+
+  JS_NewClass(JS_GetRuntime(ctx), minnet_agent_class_id, &minnet_agent_class);
+  minnet_agent_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, minnet_agent_proto, minnet_agent_proto_funcs, countof(minnet_agent_proto_funcs));
+  JS_SetClassProto(ctx, minnet_agent_class_id, minnet_agent_proto);
+
+  minnet_agent_ctor = JS_NewCFunction2(ctx, minnet_agent_constructor, "MinnetAgent", 1, JS_CFUNC_constructor, 0);
+  JS_SetConstructor(ctx, minnet_agent_ctor, minnet_agent_proto);
+  JS_SetPropertyFunctionList(ctx, minnet_agent_ctor, minnet_agent_static_funcs, countof(minnet_agent_static_funcs));
+
+  if(m)
+    JS_SetModuleExport(ctx, m, "Agent", minnet_agent_ctor);
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef MINNET_AGENT_H
+#define MINNET_AGENT_H
+
+#include <list.h>
+#include <poll.h>
+#include "minnet-client.h"
+
+#define AGENT_MAX_SOCKETS 6
+#define AGENT_KEEP_ALIVE 5
+#define AGENT_MAX_STREAMS 100
+#define AGENT_MAX_REQUESTS 256
+
+/* a connection of an origin, on one of the agent's lanes */
+typedef struct agent_slot {
+  struct lws* wsi;  /* the request on it, or the one which left it idle; with h2 the network connection */
+  uint32_t streams; /* the requests on it, more than one only with h2 */
+  BOOL h2;          /* ALPN settled on h2, requests go on it as streams */
+  BOOL pending;     /* h2 was offered and ALPN isn't done, the origin's requests wait for it */
+} AgentSlot;
+
+/* a client certificate, key or CA: a file, or PEM data */
+typedef struct agent_credential {
+  char* path;
+  uint8_t* mem;
+  unsigned int len;
+} AgentCredential;
+
+/* the vhosts of one set of client TLS credentials */
+typedef struct agent_tls {
+  struct list_head link;
+  AgentCredential cert, key, ca;
+  struct lws_vhost* lanes[0]; /* lws reuses a connection only within its vhost, lane n has the n-th connection of each origin */
+} AgentTls;
+
+/* the connections to one scheme://host:port with one set of credentials */
+typedef struct agent_origin {
+  struct list_head link;
+  char* key;
+  AgentTls* tls;
+  struct list_head waiting; /* requests over the cap, in the order they came */
+  AgentSlot slots[0];       /* one per lane */
+} AgentOrigin;
+
+typedef struct agent {
+  union {
+    struct {
+      int ref_count;
+      JSContext* js;
+      struct lws_context* lws;
+    };
+    struct context context;
+  };
+  JSCallback on_fd;
+  struct list_head tls;     /* the credentials seen so far, the first are none */
+  struct list_head origins;
+  struct list_head sockets; /* WebSocket and raw clients */
+  struct list_head retry;   /* clients whose first address failed, they connect again by host name */
+  uint32_t max_sockets, keep_alive, max_streams;
+  uint32_t max_requests, max_origin_requests; /* concurrent requests in all and per origin, 0 for no limit */
+  BOOL http2;
+  BOOL dispatch; /* a connection became free while requests wait */
+  JSValue timer;
+  struct pollfd* pfds; /* the fds of the context, blocking requests poll() them */
+  size_t nfds;
+  struct {
+    uint64_t requests, connects, reused;
+    uint64_t queued, aborted;
+    int64_t wait_total, wait_max; /* µs the queued requests waited */
+  } stats;
+} MinnetAgent;
+
+MinnetAgent* minnet_agent_new(JSContext*, JSValueConst options);
+MinnetAgent* minnet_agent_dup(MinnetAgent*);
+void minnet_agent_free(MinnetAgent*);
+int minnet_agent_select(JSContext*, JSValueConst options, MinnetClient*);
+BOOL minnet_agent_request(MinnetAgent*, MinnetClient*);
+BOOL minnet_agent_connect(MinnetAgent*, MinnetClient*);
+void minnet_agent_detach(MinnetClient*);
+void minnet_agent_established(MinnetClient*, struct lws*);
+void minnet_agent_release(MinnetClient*, struct lws*, BOOL keep);
+BOOL minnet_agent_retry(MinnetClient*);
+BOOL minnet_agent_abort(MinnetClient*);
+void minnet_agent_forget(MinnetClient*);
+void minnet_agent_closed(MinnetAgent*, struct lws*);
+BOOL minnet_agent_wait(JSContext*, MinnetClient* const[], size_t n);
+int minnet_agent_poll(MinnetAgent*, struct lws*, enum lws_callback_reasons, struct lws_pollargs*);
+JSValue minnet_agent_constructor(JSContext*, JSValueConst, int, JSValueConst[]);
+JSValue minnet_agent_wrap(JSContext*, MinnetAgent*);
+int minnet_agent_init(JSContext*, JSModuleDef*);
+
+extern THREAD_LOCAL JSValue minnet_agent_proto, minnet_agent_ctor;
+extern THREAD_LOCAL JSClassID minnet_agent_class_id;
+
+static inline MinnetAgent* minnet_agent_data(JSValueConst obj) { return JS_GetOpaque(obj, minnet_agent_class_id); }
+
+static inline MinnetAgent* minnet_agent_data2(JSContext* ctx, JSValueConst obj) { return JS_GetOpaque2(ctx, obj, minnet_agent_class_id); }
+
+#endif /* MINNET_AGENT_H */
@@ -0,0 +1,217 @@
+#include "minnet-channel.h"
+#include "minnet-websocket.h"
+#include "session.h"
+#include "opaque.h"
+#include "js-utils.h"
+#include <quickjs.h>
+#include <assert.h>
+#include <libwebsockets.h>
+
+THREAD_LOCAL JSClassID minnet_channel_class_id;
+THREAD_LOCAL JSValue minnet_channel_proto, minnet_channel_ctor;
+
+enum {
+  CHANNEL_SUBSCRIBE,
+  CHANNEL_UNSUBSCRIBE,
+  CHANNEL_PUBLISH,
+};
+
+enum {
+  CHANNEL_NAME,
+  CHANNEL_SUBSCRIBERS,
+  CHANNEL_CAPACITY_PROP,
+  CHANNEL_POLICY,
+  CHANNEL_PUBLISHED,
+  CHANNEL_DROPPED,
+};
+
+JSValue minnet_channel_wrap(JSContext* ctx, MinnetChannel* ch) {
+  JSValue ret = JS_NewObjectProtoClass(ctx, minnet_channel_proto, minnet_channel_class_id);
+
+  if(JS_IsException(ret))
+    return JS_EXCEPTION;
+
+  JS_SetOpaque(ret, channel_dup(ch));
+
+  return ret;
+}
+
+static JSValue minnet_channel_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  MinnetChannel* ch;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(ch = minnet_channel_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case CHANNEL_SUBSCRIBE:
+    case CHANNEL_UNSUBSCRIBE: {
+      MinnetWebsocket* ws;
+      struct wsi_opaque_user_data* opaque;
+      struct session_data* session;
+
+      if(argc < 1 || !(ws = minnet_ws_data2(ctx, argv[0])))
+        return JS_EXCEPTION;
+
+      if(!ws->lwsi || !(session = ws_session(ws))) {
+        ret = JS_FALSE;
+        break;
+      }
+
+      if(magic == CHANNEL_UNSUBSCRIBE) {
+        ret = JS_NewBool(ctx, channel_unsubscribe(ch, session, JS_GetRuntime(ctx)));
+        break;
+      }
+
+      if(!(opaque = ws_opaque(ws)) || opaque->status >= CLOSING) {
+        ret = JS_FALSE;
+        break;
+      }
+
+      if(ws->client)
+        return JS_ThrowTypeError(ctx, "Channel.subscribe() takes server-side connections only");
+
+      if(!channel_subscribe(ch, session, ws->lwsi, ctx))
+        return JS_ThrowOutOfMemory(ctx);
+
+      ret = JS_TRUE;
+      break;
+    }
+
+    case CHANNEL_PUBLISH: {
+      JSBuffer jsbuf;
+      BOOL binary;
+      int i, n;
+
+      if(argc == 0)
+        return JS_ThrowTypeError(ctx, "argument 1 expecting String/ArrayBuffer");
+
+      i = js_buffer_fromargs(ctx, argc, argv, &jsbuf);
+      binary = !JS_IsString(jsbuf.value);
+
+      if(argc > i) {
+        int32_t protocol = LWS_WRITE_TEXT;
+
+        JS_ToInt32(ctx, &protocol, argv[i]);
+        binary = protocol != LWS_WRITE_TEXT;
+      }
+
+      n = channel_publish(ch, jsbuf.data, jsbuf.size, binary, JS_GetRuntime(ctx));
+      js_buffer_free(&jsbuf, JS_GetRuntime(ctx));
+
+      if(n < 0)
+        return JS_ThrowInternalError(ctx, "Channel.publish() failed");
+
+      ret = JS_NewInt32(ctx, n);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue minnet_channel_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  MinnetChannel* ch;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(ch = minnet_channel_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case CHANNEL_NAME: {
+      ret = JS_NewString(ctx, ch->name);
+      break;
+    }
+
+    case CHANNEL_SUBSCRIBERS: {
+      ret = JS_NewUint32(ctx, ch->count);
+      break;
+    }
+
+    case CHANNEL_CAPACITY_PROP: {
+      ret = JS_NewInt64(ctx, ch->capacity);
+      break;
+    }
+
+    case CHANNEL_POLICY: {
+      ret = JS_NewString(ctx, channel_policy_name(ch->policy));
+      break;
+    }
+
+    case CHANNEL_PUBLISHED: {
+      ret = JS_NewInt64(ctx, ch->published);
+      break;
+    }
+
+    case CHANNEL_DROPPED: {
+      ret = JS_NewInt64(ctx, ch->dropped);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue minnet_channel_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int magic) {
+  MinnetChannel* ch;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(ch = minnet_channel_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case CHANNEL_POLICY: {
+      const char* str;
+
+      if((str = JS_ToCString(ctx, value))) {
+        ch->policy = channel_policy(str);
+        JS_FreeCString(ctx, str);
+      }
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void minnet_channel_finalizer(JSRuntime* rt, JSValue val) {
+  MinnetChannel* ch;
+
+  if((ch = minnet_channel_data(val)))
+    channel_free(ch, rt);
+}
+
+static const JSClassDef minnet_channel_class = {
+    "MinnetChannel",
+    .finalizer = minnet_channel_finalizer,
+};
+
+static const JSCFunctionListEntry minnet_channel_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("subscribe", 1, minnet_channel_method, CHANNEL_SUBSCRIBE),
+    JS_CFUNC_MAGIC_DEF("unsubscribe", 1, minnet_channel_method, CHANNEL_UNSUBSCRIBE),
+    JS_CFUNC_MAGIC_DEF("publish", 1, minnet_channel_method, CHANNEL_PUBLISH),
+    JS_CGETSET_MAGIC_FLAGS_DEF("name", minnet_channel_get, 0, CHANNEL_NAME, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_FLAGS_DEF("subscribers", minnet_channel_get, 0, CHANNEL_SUBSCRIBERS, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_DEF("capacity", minnet_channel_get, 0, CHANNEL_CAPACITY_PROP),
+    JS_CGETSET_MAGIC_DEF("policy", minnet_channel_get, minnet_channel_set, CHANNEL_POLICY),
+    JS_CGETSET_MAGIC_DEF("published", minnet_channel_get, 0, CHANNEL_PUBLISHED),
+    JS_CGETSET_MAGIC_DEF("dropped", minnet_channel_get, 0, CHANNEL_DROPPED),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MinnetChannel", JS_PROP_CONFIGURABLE),
+};
+
+int minnet_channel_init(JSContext* ctx, JSModuleDef* m) {
+  JS_NewClassID(&minnet_channel_class_id);
+
+  JS_NewClass(JS_GetRuntime(ctx), minnet_channel_class_id, &minnet_channel_class);
+  minnet_channel_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, minnet_channel_proto, minnet_channel_proto_funcs, countof(minnet_channel_proto_funcs));
+  JS_SetClassProto(ctx, minnet_channel_class_id, minnet_channel_proto);
+
+  minnet_channel_ctor = JS_NewObject(ctx);
+  JS_SetConstructor(ctx, minnet_channel_ctor, minnet_channel_proto);
+
+  if(m)
+    JS_SetModuleExport(ctx, m, "Channel", minnet_channel_ctor);
+
+  return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef MINNET_CHANNEL_H
+#define MINNET_CHANNEL_H
+
+#include "utils.h"
+#include "channel.h"
+
+typedef struct channel MinnetChannel;
+
+JSValue minnet_channel_wrap(JSContext*, MinnetChannel*);
+int minnet_channel_init(JSContext*, JSModuleDef*);
+
+extern THREAD_LOCAL JSValue minnet_channel_proto, minnet_channel_ctor;
+extern THREAD_LOCAL JSClassID minnet_channel_class_id;
+
+static inline MinnetChannel* minnet_channel_data(JSValueConst obj) { return JS_GetOpaque(obj, minnet_channel_class_id); }
+
+static inline MinnetChannel* minnet_channel_data2(JSContext* ctx, JSValueConst obj) { return JS_GetOpaque2(ctx, obj, minnet_channel_class_id); }
+#endif /* MINNET_CHANNEL_H */
@@ -1,5 +1,6 @@
 #include "minnet-client.h"
 #include "minnet-client-http.h"
+#include "minnet-agent.h"
 #include "minnet-websocket.h"
 #include "minnet-response.h"
 #include "minnet.h"
@@ -53,6 +54,9 @@ static int http_client_established(MinnetClient* cli, struct lws* wsi, JSContext
     cli->session.resp_obj = minnet_response_wrap(ctx, opaque->resp);
   }
 
+  if(cli->digest && !resp->digest)
+    resp->digest = digest_new(cli->digest);
+
   if((type = response_type(resp, ctx))) {
     if(!strncmp(type, "text/", 5)) {
       response_generator(resp, ctx);
@@ -69,6 +73,7 @@ static int http_client_established(MinnetClient* cli, struct lws* wsi, JSContext
   if(!opaque->ws)
     opaque->ws = ws_new(wsi, ctx);
 
+  opaque->ws->client = TRUE;
   cli->session.ws_obj = minnet_ws_wrap(ctx, opaque->ws);
 
   {
@@ -219,6 +224,9 @@ static int http_client_completed(MinnetClient* cli, struct lws* wsi, struct wsi_
 
   assure(minnet_client_lws(cli) == wsi);
 
+  if(opaque->resp->digest)
+    digest_final(opaque->resp->digest);
+
   if(opaque->resp->body)
     generator_finish(opaque->resp->body);
 
@@ -255,7 +263,10 @@ static int http_client_completed(MinnetClient* cli, struct lws* wsi, struct wsi_
       cli->request = req;
       cli->response = response_new(cli->on.http.ctx);
 
-      lws_client_connect_via_info(&cli->connect_info);
+      if(cli->agent)
+        minnet_agent_request(cli->agent, cli);
+      else
+        lws_client_connect_via_info(&cli->connect_info);
 
       r32 = 0;
     } /*else if(js_is_promise(ctx, ret)) {
@@ -282,18 +293,29 @@ static int http_client_completed(MinnetClient* cli, struct lws* wsi, struct wsi_
 }
 
 int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
-  MinnetClient* client = lws_client(wsi);
-  struct session_data* session = &client->session;
-  JSContext* ctx = client ? client->context.js : 0;
+  MinnetClient* client;
+  struct session_data* session;
+  JSContext* ctx;
   struct wsi_opaque_user_data* opaque;
 
   if(reason == LWS_CALLBACK_OPENSSL_LOAD_EXTRA_CLIENT_VERIFY_CERTS)
     return 0;
 
   if(lws_reason_poll(reason))
-    return minnet_pollfds_change(wsi, reason, &client->on.fd, in);
+    return minnet_client_poll(wsi, reason, in);
+
+  /* a connection an agent keeps, after the request on it was done */
+  if(!(client = lws_client(wsi))) {
+    if(reason == LWS_CALLBACK_WSI_DESTROY)
+      minnet_agent_closed(wsi_context(wsi), wsi);
+
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
+  }
 
-  if((opaque = opaque_from_wsi(wsi, ctx)) && !opaque->sess && session)
+  session = &client->session;
+  ctx = client->context.js;
+
+  if((opaque = opaque_from_wsi(wsi, ctx)) && !opaque->sess)
     opaque->sess = session;
 
   if(reason != LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ)
@@ -350,6 +372,13 @@ int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reaso
     }
 
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR: {
+      if(client->agent) {
+        minnet_agent_release(client, wsi, FALSE);
+
+        if(minnet_agent_retry(client))
+          return 0;
+      }
+
       return http_client_error(client, in, len, session, opaque, ctx);
     }
 
@@ -370,7 +399,7 @@ int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reaso
         }
       }
 
-      session_init(session, wsi_context(wsi));
+      session_init(session, minnet_client_context(client));
 
       session->req_obj = JS_NULL;
       session->resp_obj = JS_NULL;
@@ -387,6 +416,9 @@ int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reaso
       ByteBuffer buf = BUFFER_N(*(uint8_t**)in, len);
       size_t n;
 
+      /* connected, the read timeout takes over */
+      client->activity = lws_now_usecs();
+
       req->h2 = wsi_http2(wsi);
 
       n = headers_write(&req->headers, wsi, &buf.write, buf.end);
@@ -406,6 +438,9 @@ int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reaso
     }
 
     case LWS_CALLBACK_WSI_DESTROY: {
+      if(client->agent)
+        minnet_agent_release(client, wsi, FALSE);
+
       if(client->wsi == wsi)
         if(js_async_pending(&client->promise))
           js_async_resolve(ctx, &client->promise, JS_UNDEFINED);
@@ -416,10 +451,18 @@ int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reaso
     case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP: {
       lwsl_user("%-26s" FGC(171, "%-34s") "wsi#%d status=%d\n", "CLIENT-HTTP", lws_callback_name(reason) + 13, opaque ? (int)opaque->serial : -1, opaque->resp ? opaque->resp->status : -1);
 
+      client->activity = lws_now_usecs();
+
+      if(client->agent)
+        minnet_agent_established(client, wsi);
+
       return http_client_established(client, wsi, ctx);
     }
 
     case LWS_CALLBACK_CLOSED_CLIENT_HTTP: {
+      if(client->agent)
+        minnet_agent_release(client, wsi, FALSE);
+
       if(client->iter)
         asynciterator_stop(client->iter, JS_UNDEFINED, ctx);
 
@@ -496,9 +539,15 @@ int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reaso
       lwsl_user("DEBUG %-22s LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ len=%zu in='%.*s'", __func__, len, /*len > 30 ? 30 :*/ (int)len, (char*)in);
 #endif
 
+      client->activity = lws_now_usecs();
+
       if(!resp->body)
         resp->body = generator_new(ctx);
 
+      /* hashed on the way through, verifying the body costs no second pass */
+      if(resp->digest)
+        digest_update(resp->digest, in, len);
+
       generator_write(resp->body, in, len, JS_UNDEFINED);
 
       return 0;
@@ -507,6 +556,13 @@ int minnet_http_client_callback(struct lws* wsi, enum lws_callback_reasons reaso
     case LWS_CALLBACK_COMPLETED_CLIENT_HTTP: {
       LOGCB("CLIENT-HTTP(2)", "resp->body=%p resp->body->q=%p", opaque->resp ? opaque->resp->body : 0, opaque->resp && opaque->resp->body ? opaque->resp->body->q : 0);
 
+      if(client->agent) {
+        /* the connection goes back to the agent, whatever the handler returns the request is done */
+        minnet_agent_release(client, wsi, TRUE);
+        http_client_completed(client, wsi, opaque);
+        return 0;
+      }
+
       return http_client_completed(client, wsi, opaque);
     }
 
@@ -6,7 +6,10 @@
 #include "minnet-response.h"
 #include "minnet-asynciterator.h"
 #include "minnet-generator.h"
+#include "minnet-agent.h"
+#include "minnet-hash.h"
 #include "context.h"
+#include "channel.h"
 #include "closure.h"
 #include "minnet.h"
 #include "js-utils.h"
@@ -20,7 +23,7 @@ THREAD_LOCAL JSClassID minnet_client_class_id;
 
 static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len);
 
-static const struct lws_protocols client_protocols[] = {
+const struct lws_protocols client_protocols[] = {
     {"raw", minnet_client_callback, 0, 0, 0, 0, 0},
     {"http", minnet_http_client_callback, 0, 0, 0, 0, 0},
     {"ws", minnet_client_callback, 0, 0, 0, 0, 0},
@@ -37,14 +40,25 @@ typedef struct {
   JSContext* ctx;
 } MessageClosure;
 
-typedef struct {
-  size_t nfds;
-  struct pollfd* pfds;
+/* shared by a blocking client and its close handler, which may outlive it */
+typedef struct sync_fetch {
   int ref_count;
-  BOOL touched;
+  JSContext* ctx;
   JSValue exception;
 } SyncFetch;
 
+static SyncFetch* synchfetch_new(JSContext* ctx) {
+  SyncFetch* c;
+
+  if((c = js_malloc(ctx, sizeof(SyncFetch)))) {
+    c->ref_count = 1;
+    c->ctx = ctx;
+    c->exception = JS_NULL;
+  }
+
+  return c;
+}
+
 static SyncFetch* synchfetch_dup(SyncFetch* c) {
   ++c->ref_count;
   return c;
@@ -54,59 +68,11 @@ static void synchfetch_free(void* ptr) {
   SyncFetch* c = ptr;
 
   if(--c->ref_count == 0) {
-    memset(c, 0, sizeof(SyncFetch));
-    free(c);
+    JS_FreeValue(c->ctx, c->exception);
+    js_free(c->ctx, c);
   }
 }
 
-static ssize_t synchfetch_indexpollfd(SyncFetch* c, int fd) {
-  size_t i;
-
-  for(i = 0; i < c->nfds; i++)
-    if(c->pfds[i].fd == fd)
-      return i;
-
-  return -1;
-}
-
-static struct pollfd* synchfetch_getpollfd(SyncFetch* c, int fd) {
-  ssize_t i;
-
-  if((i = synchfetch_indexpollfd(c, fd)) == -1)
-    return 0;
-
-  return &c->pfds[i];
-}
-
-static void synchfetch_setevents(SyncFetch* c, int fd, int events) {
-  struct pollfd* pfd;
-
-  if(!(pfd = synchfetch_getpollfd(c, fd))) {
-    c->pfds = realloc(c->pfds, (c->nfds + 1) * sizeof(struct pollfd));
-    assert(c->pfds);
-    c->pfds[c->nfds] = (struct pollfd){fd, 0, 0};
-    pfd = &c->pfds[c->nfds++];
-  }
-
-  if(pfd->events != events) {
-    pfd->events = events;
-    c->touched = TRUE;
-  }
-}
-
-static void synchfetch_removefd(SyncFetch* c, int fd) {
-  size_t n;
-  ssize_t i = synchfetch_indexpollfd(c, fd);
-
-  assert(i != -1);
-
-  if((n = (c->nfds - (i + 1))))
-    memcpy(&c->pfds[i], &c->pfds[i + 1], n * sizeof(struct pollfd));
-
-  --c->nfds;
-  c->touched = TRUE;
-}
-
 static JSValue close_status(JSContext* ctx, const char* in, size_t len) {
   if(len >= 2)
     return JS_NewInt32(ctx, ((uint8_t*)in)[0] << 8 | ((uint8_t*)in)[1]);
@@ -176,11 +142,28 @@ void minnet_client_free(MinnetClient* client, JSRuntime* rt) {
 
     js_async_free(rt, &client->promise);
 
+    /* the lws context is the agent's */
+    if(client->agent) {
+      minnet_agent_forget(client);
+      client->context.lws = 0;
+    }
+
+    minnet_event_loop_release(minnet_client_context(client), &client->on.fd);
     context_clear(minnet_client_context(client));
     context_delete(minnet_client_context(client));
 
+    if(client->agent) {
+      minnet_agent_free(client->agent);
+      client->agent = 0;
+    }
+
     session_clear(&client->session, rt);
 
+    if(client->sync) {
+      synchfetch_free(client->sync);
+      client->sync = 0;
+    }
+
     if(client->gen) {
       generator_free(client->gen);
       client->gen = 0;
@@ -194,10 +177,13 @@ void minnet_client_zero(MinnetClient* client) {
   client->ref_count = 1;
   client->body = JS_NULL;
   client->next = JS_NULL;
+  client->signal = JS_UNDEFINED;
+  client->onabort = JS_UNDEFINED;
 
   session_init(&client->session, 0);
   js_async_zero(&client->promise);
   callbacks_zero(&client->on);
+  init_list_head(&client->link);
 
   client->iter = 0;
 
@@ -223,7 +209,28 @@ Generator* minnet_client_generator(MinnetClient* client, JSContext* ctx) {
   return client->gen;
 }
 
-MinnetClient* lws_client(struct lws* wsi) { return lws_context_user(lws_get_context(wsi)); }
+MinnetClient* lws_client(struct lws* wsi) {
+  struct context* context = wsi_context(wsi);
+  struct wsi_opaque_user_data* opaque;
+
+  if(!context->shared)
+    return (MinnetClient*)context;
+
+  /* on an agent's context the request knows its client, a connection kept idle has none */
+  if((opaque = lws_get_opaque_user_data(wsi)) && opaque->sess)
+    return minnet_client_from_session(opaque->sess);
+
+  return 0;
+}
+
+int minnet_client_poll(struct lws* wsi, enum lws_callback_reasons reason, struct lws_pollargs* args) {
+  struct context* context = wsi_context(wsi);
+
+  if(context->shared)
+    return minnet_agent_poll((MinnetAgent*)context, wsi, reason, args);
+
+  return minnet_pollfds_change(wsi, reason, &((MinnetClient*)context)->on.fd, args);
+}
 
 static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
   MinnetClient* client = lws_client(wsi);
@@ -232,11 +239,14 @@ static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons rea
   int ret = 0;
 
   if(lws_reason_poll(reason))
-    return minnet_pollfds_change(wsi, reason, &client->on.fd, in);
+    return minnet_client_poll(wsi, reason, in);
 
   if(lws_reason_http(reason))
     return minnet_http_client_callback(wsi, reason, user, in, len);
 
+  if(!client)
+    return 0;
+
   if((ctx = client->context.js))
     opaque = opaque_from_wsi(wsi, ctx);
 
@@ -280,7 +290,7 @@ static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons rea
 
     case LWS_CALLBACK_WS_CLIENT_BIND_PROTOCOL:
     case LWS_CALLBACK_RAW_SKT_BIND_PROTOCOL: {
-      session_init(&client->session, wsi_context(wsi));
+      session_init(&client->session, minnet_client_context(client));
       break;
     }
 
@@ -313,6 +323,9 @@ static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons rea
       int32_t r32 = -1, err = -1;
       JSCallback* cb;
 
+      if(reason == LWS_CALLBACK_CLIENT_CONNECTION_ERROR && client->agent && minnet_agent_retry(client))
+        return 0;
+
       if(reason == LWS_CALLBACK_CLIENT_CONNECTION_ERROR && in) {
         if(!strncmp("conn fail: ", in, 11)) {
           err = atoi(&((const char*)in)[11]);
@@ -387,6 +400,7 @@ static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons rea
 
       opaque->ws = minnet_ws_data(client->session.ws_obj);
       opaque->ws->raw = reason == LWS_CALLBACK_RAW_CONNECTED;
+      opaque->ws->client = TRUE;
 
       if(js_async_pending(&client->promise)) {
         JSValue cli = minnet_client_wrap(ctx, minnet_client_dup(client));
@@ -408,6 +422,16 @@ static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons rea
 
     case LWS_CALLBACK_CLIENT_WRITEABLE:
     case LWS_CALLBACK_RAW_WRITEABLE: {
+      /* queued send() frames go out first, onWriteable gets the socket when they are written */
+      if(queue_size(&client->session.sendq) > 0 || channel_pending(&client->session)) {
+        session_writable(&client->session, wsi, ctx);
+
+        if(callback_valid(&client->on.writeable))
+          lws_callback_on_writable(wsi);
+
+        return 0;
+      }
+
       if(callback_valid(&client->on.writeable)) {
         JSValue ret = minnet_client_exception(client, callback_emit(&client->on.writeable, 1, &client->session.ws_obj));
 
@@ -538,6 +562,12 @@ static int minnet_client_callback(struct lws* wsi, enum lws_callback_reasons rea
 
         if((opaque = lws_get_opaque_user_data(wsi)) && opaque->ws)
           opaque->ws->lwsi = 0;
+
+        /* the agent's context outlives the client */
+        if(client->agent)
+          minnet_agent_detach(client);
+
+        minnet_client_unsignal(client);
       }
 
       break;
@@ -764,63 +794,147 @@ JSValue minnet_client_response(JSContext* ctx, JSValueConst this_val, int argc,
   return JS_NewInt32(ctx, 1);
 }
 
-JSValue minnet_client_pollfd(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
-  int32_t fd;
-  BOOL rd = JS_ToBool(ctx, argv[1]), wr = JS_ToBool(ctx, argv[2]);
+static void client_closure_free(void* ptr) {
+  MinnetClient* client = ptr;
 
-  JS_ToInt32(ctx, &fd, argv[0]);
+  minnet_client_free(client, JS_GetRuntime(client->context.js));
+}
 
-  if(!rd && !wr)
-    synchfetch_removefd(ptr, fd);
-  else
-    synchfetch_setevents(ptr, fd, (rd ? POLLIN : 0) | (wr ? POLLOUT : 0));
+/* the request of client is aborted: it leaves the agent's queue or its connection is closed, the promise is rejected with reason */
+static void minnet_client_abort(MinnetClient* client, JSValueConst reason) {
+  BOOL pending = js_async_pending(&client->promise);
 
-#ifdef DEBUG_OUTPUT
-  lwsl_user("DEBUG                    %-22s argc=%d fd=%d rd=%d wr=%d c->nfds=%zu\n", __func__, argc, fd, rd, wr, ((SyncFetch*)ptr)->nfds);
-#endif
+  if(client->agent)
+    minnet_agent_abort(client);
+  else if(pending && client->wsi)
+    lws_wsi_close(client->wsi, LWS_TO_KILL_ASYNC);
+
+  if(pending)
+    js_async_reject(client->context.js, &client->promise, reason);
 
+  minnet_client_unsignal(client);
+}
+
+static JSValue minnet_client_abortreason(JSContext* ctx, JSValueConst signal) {
+  JSValue ret = JS_IsObject(signal) ? JS_GetPropertyStr(ctx, signal, "reason") : JS_UNDEFINED;
+
+  if(js_is_nullish(ret)) {
+    ret = js_error_new(ctx, "The operation was aborted");
+    JS_SetPropertyStr(ctx, ret, "name", JS_NewString(ctx, "AbortError"));
+  }
+
+  return ret;
+}
+
+/* the 'abort' listener, called on the signal or with an event whose target it is */
+static JSValue minnet_client_onabort(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  MinnetClient* client = ptr;
+  JSValue signal = JS_IsObject(this_val) ? JS_DupValue(ctx, this_val) : argc > 0 && JS_IsObject(argv[0]) ? JS_GetPropertyStr(ctx, argv[0], "target") : JS_UNDEFINED;
+  JSValue reason = minnet_client_abortreason(ctx, signal);
+
+  minnet_client_abort(client, reason);
+
+  JS_FreeValue(ctx, reason);
+  JS_FreeValue(ctx, signal);
   return JS_UNDEFINED;
 }
 
-JSValue minnet_client_onclose(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
-  SyncFetch* c = ptr;
-  int32_t fd = -1;
-  MinnetWebsocket* ws;
-  BOOL is_error = argc > 1 && JS_IsError(ctx, argv[1]);
+/**
+ * Hook the request of client to an AbortSignal, anything with 'aborted', 'reason' and
+ * addEventListener(). Returns 1 when it's aborted already, with the reason in *reason.
+ */
+static int minnet_client_signal(JSContext* ctx, MinnetClient* client, JSValueConst signal, JSValue* reason) {
+  JSValue fn, args[3], ret;
 
-  if((ws = minnet_ws_data(argv[0])) && ws->fd != -1)
-    fd = ws->fd;
-  else
-    JS_ToInt32(ctx, &fd, argv[0]);
+  if(!JS_IsObject(signal)) {
+    JS_ThrowTypeError(ctx, "signal must be an AbortSignal");
+    return -1;
+  }
 
-#ifdef DEBUG_OUTPUT
-  {
-    const char* s = JS_ToCString(ctx, argv[1]);
-    lwsl_user("DEBUG                    %-22s err=%i argv[1]=%s\n", __func__, is_error, s);
-    JS_FreeCString(ctx, s);
+  if(js_get_propertystr_bool(ctx, signal, "aborted")) {
+    *reason = minnet_client_abortreason(ctx, signal);
+    return 1;
   }
-#endif
 
-  if(fd != -1)
-    synchfetch_removefd(c, fd);
+  fn = js_function_cclosure(ctx, minnet_client_onabort, 1, 0, minnet_client_dup(client), client_closure_free);
+  args[0] = JS_NewString(ctx, "abort");
+  args[1] = fn;
+  args[2] = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, args[2], "once", JS_TRUE);
+  ret = js_invoke(ctx, signal, "addEventListener", countof(args), args);
 
-  if(is_error) {
-    // JS_Throw(ctx, argv[1]);
-    c->exception = JS_DupValue(ctx, argv[1]);
+  JS_FreeValue(ctx, args[0]);
+  JS_FreeValue(ctx, args[2]);
+
+  if(JS_IsException(ret)) {
+    JS_FreeValue(ctx, fn);
+    return -1;
   }
 
-#ifdef DEBUG_OUTPUT_
-  lwsl_user("DEBUG                    %-22s fd=%d c=%p c->nfds=%zu\n", __func__, fd, c, c->nfds);
-#endif
+  /* kept to remove it once the request is over, a signal used for many requests holds none of them */
+  client->signal = JS_DupValue(ctx, signal);
+  client->onabort = fn;
+
+  JS_FreeValue(ctx, ret);
+  return 0;
+}
+
+/* the request is over, its 'abort' listener goes and with it the reference to client it holds */
+void minnet_client_unsignal(MinnetClient* client) {
+  JSContext* ctx = client->context.js;
+  JSValue signal = client->signal, fn = client->onabort, args[2], ret;
+
+  if(JS_IsUndefined(fn))
+    return;
+
+  client->signal = JS_UNDEFINED;
+  client->onabort = JS_UNDEFINED;
+
+  args[0] = JS_NewString(ctx, "abort");
+  args[1] = fn;
+  ret = js_invoke(ctx, signal, "removeEventListener", countof(args), args);
+
+  if(JS_IsException(ret))
+    JS_FreeValue(ctx, JS_GetException(ctx));
+
+  JS_FreeValue(ctx, ret);
+  JS_FreeValue(ctx, args[0]);
+  JS_FreeValue(ctx, signal);
+
+  /* this may be the last reference */
+  JS_FreeValue(ctx, fn);
+}
+
+/* a blocking request keeps the first error it gets, to throw once it's done */
+static JSValue minnet_client_onclose(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  SyncFetch* c = ptr;
+
+  if(argc > 1 && JS_IsError(ctx, argv[1]) && JS_IsNull(c->exception))
+    c->exception = JS_DupValue(ctx, argv[1]);
 
   return JS_UNDEFINED;
 }
 
+/* what a blocking request ended with: its Response, or with *failed the error */
+JSValue minnet_client_result(MinnetClient* client, BOOL* failed) {
+  SyncFetch* c = client->sync;
+
+  if((*failed = c && !JS_IsNull(c->exception))) {
+    JSValue ret = c->exception;
+
+    c->exception = JS_NULL;
+    return ret;
+  }
+
+  return JS_DupValue(client->context.js, client->session.resp_obj);
+}
+
 JSValue minnet_client_closure(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
   int argind = 0;
   JSValue value, options, ret = JS_UNDEFINED;
   MinnetClient* client = 0;
-  struct lws* wsi2;
+  struct lws* wsi2 = 0;
+  BOOL connected;
   MinnetProtocol proto;
   struct context* context;
 
@@ -853,22 +967,38 @@ JSValue minnet_client_closure(JSContext* ctx, JSValueConst this_val, int argc, J
   context->js = ctx;
   context->error = JS_NULL;
 
-  memset(&context->info, 0, sizeof(struct lws_context_creation_info));
-  context->info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
-  context->info.options |= LWS_SERVER_OPTION_H2_JUST_FIX_WINDOW_UPDATE_OVERFLOW;
-  context->info.options |= LWS_SERVER_OPTION_PEER_CERT_NOT_REQUIRED;
-  context->info.options |= LWS_SERVER_OPTION_IGNORE_MISSING_CERT;
-  context->info.port = CONTEXT_PORT_NO_LISTEN;
-  context->info.protocols = client_protocols;
-  context->info.user = client;
-
-  if(!context->lws) {
-    minnet_client_certificate(minnet_client_context(client), options);
-
-    if(!(context->lws = lws_create_context(&context->info))) {
-      lwsl_err("minnet-client: libwebsockets init failed\n");
+  proto = protocol_number(client->request->url.protocol);
 
-      return JS_ThrowInternalError(ctx, "minnet-client: libwebsockets init failed");
+  /* clients share the context of an agent, unless told otherwise; UDP sockets are adopted, not connected */
+  if(!(client->request->url.protocol && !strcmp(client->request->url.protocol, "udp")))
+    if(minnet_agent_select(ctx, options, client))
+      return JS_EXCEPTION;
+
+  if(client->agent) {
+    context->lws = client->agent->lws;
+  } else {
+    memset(&context->info, 0, sizeof(struct lws_context_creation_info));
+    context->info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+    context->info.options |= LWS_SERVER_OPTION_H2_JUST_FIX_WINDOW_UPDATE_OVERFLOW;
+    context->info.options |= LWS_SERVER_OPTION_PEER_CERT_NOT_REQUIRED;
+    context->info.options |= LWS_SERVER_OPTION_IGNORE_MISSING_CERT;
+    context->info.port = CONTEXT_PORT_NO_LISTEN;
+    context->info.protocols = client_protocols;
+    context->info.user = client;
+
+    /* the blocking path polls its own fds */
+    if(!js_get_propertystr_bool(ctx, options, "block"))
+      if(minnet_event_loop(ctx, options, context))
+        return JS_EXCEPTION;
+
+    if(!context->lws) {
+      minnet_client_certificate(minnet_client_context(client), options);
+
+      if(!(context->lws = lws_create_context(&context->info))) {
+        lwsl_err("minnet-client: libwebsockets init failed\n");
+
+        return JS_ThrowInternalError(ctx, "minnet-client: libwebsockets init failed");
+      }
     }
   }
 
@@ -916,14 +1046,22 @@ JSValue minnet_client_closure(JSContext* ctx, JSValueConst this_val, int argc, J
     client->buf_size = js_get_propertystr_uint32(ctx, argv[1], "buffering");
   }
 
+  if(js_has_propertystr(ctx, options, "digest")) {
+    JSValue opt_digest = JS_GetPropertyStr(ctx, options, "digest");
+
+    client->digest = minnet_hash_type(ctx, opt_digest);
+    JS_FreeValue(ctx, opt_digest);
+
+    if(!client->digest)
+      return JS_ThrowRangeError(ctx, "digest must be one of Hash.TYPE_* or its name");
+  }
+
   client->response = response_new(ctx);
 
   url_copy(&client->response->url, client->request->url, ctx);
 
   // client->response->body = generator_new(ctx);
 
-  proto = protocol_number(client->request->url.protocol);
-
   url_info(client->request->url, &client->connect_info);
 
   if(!js_is_nullish((value = JS_GetPropertyStr(ctx, options, "protocol")))) {
@@ -987,54 +1125,80 @@ JSValue minnet_client_closure(JSContext* ctx, JSValueConst this_val, int argc, J
       client->on.close = CALLBACK_INIT(ctx, JS_DupValue(ctx, client->promise.reject), JS_NULL);
   }
 
-  errno = 0;
-  SyncFetch* c = 0;
+  if(!js_is_nullish((value = JS_GetPropertyStr(ctx, options, "signal")))) {
+    JSValue reason = JS_UNDEFINED;
+    int r = minnet_client_signal(ctx, client, value, &reason);
 
-  if(client->blocking) {
+    JS_FreeValue(ctx, value);
 
-    if(!(c = malloc(sizeof(SyncFetch))))
-      return JS_ThrowOutOfMemory(ctx);
+    if(r == -1 || (r == 1 && client->blocking)) {
+      JS_FreeValue(ctx, ret);
+      return r == 1 ? JS_Throw(ctx, reason) : JS_EXCEPTION;
+    }
 
-    c->ref_count = 1;
-    c->nfds = 0;
-    c->pfds = 0;
-    c->touched = FALSE;
-    c->exception = JS_NULL;
+    /* aborted before it started */
+    if(r == 1) {
+      js_async_reject(ctx, &client->promise, reason);
+      JS_FreeValue(ctx, reason);
+      return ret;
+    }
+  }
 
-    client->on.fd = CALLBACK_INIT(ctx, js_function_cclosure(ctx, minnet_client_pollfd, 0, 0, synchfetch_dup(c), synchfetch_free), JS_UNDEFINED);
-    JS_DefinePropertyValueStr(ctx, client->on.fd.func_obj, "name", JS_NewString(ctx, "onFd"), 0);
+  errno = 0;
 
-    client->on.close = CALLBACK_INIT(ctx, js_function_cclosure(ctx, minnet_client_onclose, 0, 0, synchfetch_dup(c), synchfetch_free), JS_UNDEFINED);
+  if(client->blocking) {
+    if(!(client->sync = synchfetch_new(ctx))) {
+      minnet_client_free(client, JS_GetRuntime(ctx));
+      return JS_EXCEPTION;
+    }
+
+    client->on.close = CALLBACK_INIT(ctx, js_function_cclosure(ctx, minnet_client_onclose, 0, 0, synchfetch_dup(client->sync), synchfetch_free), JS_UNDEFINED);
+
+    client->timeout.connect = js_get_propertystr_uint32(ctx, options, "connectTimeout");
+    client->timeout.read = js_get_propertystr_uint32(ctx, options, "readTimeout");
+    client->timeout.total = js_get_propertystr_uint32(ctx, options, "timeout");
   }
 
+  client->started = lws_now_usecs();
+
+  if(client->agent) {
+    connected = proto == PROTOCOL_HTTP || proto == PROTOCOL_HTTPS ? minnet_agent_request(client->agent, client) : minnet_agent_connect(client->agent, client);
+  } else
 #ifdef LWS_WITH_UDP
-  if(proto == PROTOCOL_RAW && client->request->url.protocol && !strcmp(client->request->url.protocol, "udp")) {
+    if(proto == PROTOCOL_RAW && client->request->url.protocol && !strcmp(client->request->url.protocol, "udp")) {
     struct lws_vhost* vhost;
     MinnetURL* url = &client->request->url;
 
     vhost = lws_create_vhost(client->context.lws, &minnet_client_context(client)->info);
     wsi2 = lws_create_adopt_udp(vhost, url->host, url->port, 0, "raw", 0, 0, 0, 0, 0);
     *client->connect_info.pwsi = wsi2;
+    connected = !!client->wsi;
   } else
 #endif
-
+  {
     wsi2 = lws_client_connect_via_info(&client->connect_info);
+    connected = !!client->wsi;
+  }
 
 #ifdef DEBUG_OUTPUT
   lwsl_user("DEBUG %-22s client->wsi = %p, wsi2 = %p, h2 = %d, ssl = %d\n", __func__, client->wsi, wsi2, wsi_http2(client->wsi), wsi_tls(client->wsi));
 #endif
 
-  if(!client->wsi /*&& !wsi2*/) {
+  if(!connected /*&& !wsi2*/) {
+    JSValue err = js_error_new(ctx, "[2] Connection failed: %s", strerror(errno));
+
     if(!client->blocking) {
-      if(js_async_pending(&client->promise)) {
-        JSValue err = js_error_new(ctx, "[2] Connection failed: %s", strerror(errno));
+      if(js_async_pending(&client->promise))
         js_async_reject(ctx, &client->promise, err);
-        JS_FreeValue(ctx, err);
-      }
-    } else {
-      // ret = JS_Throw(ctx, c->exception);
-      goto fail;
+    } else if(JS_IsNull(client->sync->exception)) {
+      client->sync->exception = JS_DupValue(ctx, err);
     }
+
+    JS_FreeValue(ctx, err);
+    minnet_client_unsignal(client);
+
+    if(client->blocking)
+      goto fail;
   }
 
   switch(magic) {
@@ -1044,58 +1208,33 @@ JSValue minnet_client_closure(JSContext* ctx, JSValueConst this_val, int argc, J
       break;
     }
 
-    case RETURN_RESPONSE: {
+    case RETURN_RESPONSE:
+    case RETURN_STARTED: {
       if(!client->blocking) {
-        ResolveFunctions fns;
-        ret = js_async_create(ctx, &fns);
-
-        client->on.http = CALLBACK_INIT(ctx, JS_NewCFunctionData(ctx, minnet_client_response, 2, 0, 2, &fns.resolve), JS_UNDEFINED);
-        js_async_free(JS_GetRuntime(ctx), &fns);
+        /* the response settles the promise of the client, so failing to get one or an abort reject it */
+        client->on.http = CALLBACK_INIT(ctx, JS_NewCFunctionData(ctx, minnet_client_response, 2, 0, 2, &client->promise.resolve), JS_UNDEFINED);
       } else {
-        synchfetch_setevents(c, lws_get_socket_fd(lws_get_network_wsi(client->wsi)), POLLIN | POLLOUT);
+        struct wsi_opaque_user_data* opaque;
+        Generator* gen;
+
+        /* a request still resolving or queued on the agent has no wsi yet, its opaque is handed to the connection later */
+        if(!(opaque = client->connect_info.opaque_user_data))
+          opaque = client->connect_info.opaque_user_data = opaque_new(ctx);
 
-        struct wsi_opaque_user_data* opaque = opaque_from_wsi(client->wsi, ctx);
         opaque->resp = client->response;
-        Generator* gen = response_generator(opaque->resp, ctx);
+        gen = response_generator(opaque->resp, ctx);
 
         assert(opaque->resp->body);
         generator_continuous(gen, JS_NULL);
 
         opaque->resp->sync = TRUE;
 
-        for(;;) {
-          size_t i;
-
-#ifdef DEBUG_OUTPUT
-          lwsl_user("DEBUG                    %-22s c->nfds=%zu\n", __func__, c->nfds);
-#endif
-          poll(c->pfds, c->nfds, 1000);
-
-          c->touched = FALSE;
-
-          for(i = 0; i < c->nfds; i++) {
-            struct pollfd* x = &c->pfds[i];
-
-#ifdef DEBUG_OUTPUT
-            lwsl_user("DEBUG                    %-22s c->pfds[%zu] = { %d, %d, %d }\n", __func__, i, x->fd, x->events, x->revents);
-#endif
-
-            if(x->events) {
-              struct lws_pollfd lpfd = {x->fd, x->events, x->revents};
-              lws_service_fd(client->context.lws, &lpfd);
-            }
-
-            if(c->touched)
-              break;
-          }
-
-          // printf("%s c->nfds=%zu\n", __func__, c->nfds);
-
-          if(c->nfds == 0)
-            break;
+        /* fetchAll() waits for all of its requests at once */
+        if(magic == RETURN_RESPONSE && !minnet_agent_wait(ctx, &client, 1)) {
+          minnet_agent_abort(client);
+          JS_FreeValue(ctx, client->sync->exception);
+          client->sync->exception = JS_GetException(ctx);
         }
-
-        ret = JS_DupValue(ctx, client->session.resp_obj);
       }
 
       break;
@@ -1104,13 +1243,18 @@ JSValue minnet_client_closure(JSContext* ctx, JSValueConst this_val, int argc, J
 
 fail:
 
-  if(c) {
-    if(!JS_IsNull(c->exception)) {
-      ret = JS_Throw(ctx, c->exception);
-      c->exception = JS_NULL;
-    }
+  if(client->blocking && magic != RETURN_STARTED) {
+    BOOL failed;
+    JSValue result = minnet_client_result(client, &failed);
 
-    synchfetch_free(c);
+    if(failed) {
+      JS_FreeValue(ctx, ret);
+      ret = JS_Throw(ctx, result);
+    } else if(magic == RETURN_RESPONSE) {
+      ret = result;
+    } else {
+      JS_FreeValue(ctx, result);
+    }
   }
 
   return ret;
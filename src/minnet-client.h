@@ -4,6 +4,7 @@
 #include <libwebsockets.h>
 #include <quickjs.h>
 #include <stdint.h>
+#include <stddef.h>
 #include "callback.h"
 #include "context.h"
 #include <cutils.h>
@@ -15,6 +16,10 @@
 
 #define minnet_client_exception(client, retval) context_exception(&(client->context), (retval))
 
+struct agent;
+struct agent_tls;
+struct agent_slot;
+
 typedef struct {
   union {
     struct {
@@ -40,11 +45,29 @@ typedef struct {
   BOOL blocking, buffering, line_buffered, binary;
   size_t buf_size;
   int lwsret;
+  struct agent* agent;     /* the shared context it is on, 0 when it has one of its own */
+  struct agent_tls* tls;   /* the agent's vhosts for its TLS credentials */
+  struct agent_slot* slot; /* the agent's connection it is on, 0 while it waits and once it's done */
+  struct list_head link;   /* in the waiting list of its origin, or the agent's sockets */
+  int32_t priority;        /* higher ones leave the agent's queue first */
+  int64_t queued;          /* when it started waiting for a connection, 0 while it doesn't */
+  BOOL resolving;          /* its host is being looked up */
+  char address[46];        /* the address its host resolved to, the host name stays for SNI and the Host header */
+  uint32_t naddrs;         /* its host has, with more than one a failed connection to address is retried */
+  BOOL fallback;           /* retried by host name, lws resolves it and goes through every address */
+  struct {
+    uint32_t connect, read, total; /* ms a blocking request may take to connect, between reads, in all; 0 for no limit */
+  } timeout;
+  int64_t started, activity; /* µs: when the request started, when it last sent or got data; 0 before it connected */
+  struct sync_fetch* sync;   /* the error a blocking request ends with */
+  int digest;                /* LWS_GENHASH_TYPE_* the response body is hashed with as it arrives */
+  JSValue signal, onabort;   /* the AbortSignal and its listener, which holds a reference, until the request is over */
 } MinnetClient;
 
 enum {
   RETURN_CLIENT = 0,
   RETURN_RESPONSE,
+  RETURN_STARTED, /* a blocking request is left running, for minnet_agent_wait() */
 };
 
 void minnet_client_certificate(struct context*, JSValueConst);
@@ -52,15 +75,19 @@ MinnetClient* minnet_client_new(JSContext*);
 void minnet_client_free(MinnetClient*, JSRuntime*);
 void minnet_client_zero(MinnetClient*);
 MinnetClient* minnet_client_dup(MinnetClient*);
+void minnet_client_unsignal(MinnetClient*);
 Generator* minnet_client_generator(MinnetClient*, JSContext*);
 MinnetClient* lws_client(struct lws*);
+int minnet_client_poll(struct lws*, enum lws_callback_reasons, struct lws_pollargs*);
 JSValue minnet_client_closure(JSContext*, JSValueConst, int, JSValueConst[], int, void*);
+JSValue minnet_client_result(MinnetClient*, BOOL* failed);
 JSValue minnet_client(JSContext*, JSValueConst, int, JSValueConst[]);
 JSValue minnet_client_wrap(JSContext*, MinnetClient*);
 int minnet_client_init(JSContext*, JSModuleDef*);
 
 static inline struct context* minnet_client_context(MinnetClient* client) { return &client->context; }
 
+extern const struct lws_protocols client_protocols[];
 extern THREAD_LOCAL JSClassID minnet_client_class_id;
 extern THREAD_LOCAL JSValue minnet_client_proto, minnet_client_ctor;
 
@@ -70,4 +97,6 @@ static inline MinnetClient* minnet_client_data2(JSContext* ctx, JSValueConst obj
 
 static inline struct lws* minnet_client_lws(MinnetClient* client) { return client->wsi; }
 
+static inline MinnetClient* minnet_client_from_session(struct session_data* session) { return (MinnetClient*)((char*)session - offsetof(MinnetClient, session)); }
+
 #endif
@@ -0,0 +1,193 @@
+#include "minnet-dns.h"
+#include "js-utils.h"
+#include <netdb.h>
+
+/* lookups run on the resolver's threads, the answers come back on this one's event loop */
+static THREAD_LOCAL DnsResolver* dns_resolver;
+static THREAD_LOCAL BOOL dns_watching;
+
+typedef struct dns_request {
+  JSContext* ctx;
+  ResolveFunctions async;
+} DnsRequest;
+
+DnsResolver* minnet_dns(void) {
+  if(!dns_resolver && !(dns_resolver = dns_new(DNS_THREADS)))
+    lwsl_err("%s: failed to create the resolver", __func__);
+
+  return dns_resolver;
+}
+
+int minnet_dns_fd(void) { return dns_resolver ? dns_fd(dns_resolver) : -1; }
+
+static JSValue minnet_dns_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  minnet_dns_process(ctx);
+  return JS_UNDEFINED;
+}
+
+/**
+ * The resolver's fd is on the event loop only while lookups are pending, an idle
+ * cache doesn't keep the loop alive. Without one, blocking requests poll it themselves.
+ */
+static void minnet_dns_watch(JSContext* ctx) {
+  BOOL watch = dns_stats(dns_resolver)->pending > 0;
+  JSValue fn, ret;
+
+  if(watch == dns_watching)
+    return;
+
+  if(JS_IsException((fn = minnet_default_fd_callback(ctx)))) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    return;
+  }
+
+  {
+    JSValueConst args[] = {
+        JS_NewInt32(ctx, dns_fd(dns_resolver)),
+        watch ? JS_NewCFunction(ctx, minnet_dns_handler, "dns", 0) : JS_NULL,
+        JS_NULL,
+    };
+
+    ret = JS_Call(ctx, fn, JS_UNDEFINED, countof(args), args);
+    JS_FreeValue(ctx, args[1]);
+  }
+
+  JS_FreeValue(ctx, ret);
+  JS_FreeValue(ctx, fn);
+  dns_watching = watch;
+}
+
+/* like dns_lookup(), on the thread's resolver */
+int minnet_dns_lookup(JSContext* ctx, const char* host, const DnsEntry** entryp, dns_callback* cb, void* opaque) {
+  int ret;
+
+  if(!minnet_dns())
+    return -1;
+
+  if((ret = dns_lookup(dns_resolver, host, entryp, cb, opaque)) == 0)
+    minnet_dns_watch(ctx);
+
+  return ret;
+}
+
+void minnet_dns_process(JSContext* ctx) {
+  if(!dns_resolver)
+    return;
+
+  dns_process(dns_resolver);
+  minnet_dns_watch(ctx);
+}
+
+static JSValue minnet_dns_addresses(JSContext* ctx, const DnsEntry* entry) {
+  JSValue ret;
+
+  if(entry->error)
+    return js_error_new(ctx, "%s: %s", entry->host, gai_strerror(entry->error));
+
+  ret = JS_NewArray(ctx);
+
+  for(uint32_t i = 0; i < entry->naddrs; i++)
+    JS_SetPropertyUint32(ctx, ret, i, JS_NewString(ctx, entry->addrs[i]));
+
+  return ret;
+}
+
+static void minnet_dns_settle(DnsRequest* req, const DnsEntry* entry) {
+  JSContext* ctx = req->ctx;
+  JSValue value = minnet_dns_addresses(ctx, entry);
+
+  (entry->error ? js_async_reject : js_async_resolve)(ctx, &req->async, value);
+  JS_FreeValue(ctx, value);
+}
+
+static void minnet_dns_resolved(void* opaque, const DnsEntry* entry) {
+  DnsRequest* req = opaque;
+
+  minnet_dns_settle(req, entry);
+  js_free(req->ctx, req);
+}
+
+/* resolve(host): a Promise of the host's addresses, from the cache when it has them */
+JSValue minnet_resolve(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  const DnsEntry* entry;
+  DnsRequest* req;
+  const char* host;
+  JSValue ret;
+  int r;
+
+  if(!(host = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if(!(req = js_mallocz(ctx, sizeof(DnsRequest)))) {
+    JS_FreeCString(ctx, host);
+    return JS_EXCEPTION;
+  }
+
+  req->ctx = ctx;
+  ret = js_async_create(ctx, &req->async);
+
+  if(dns_numeric(host)) {
+    DnsEntry numeric = {.host = (char*)host, .naddrs = 1, .addrs = (char**)&host};
+
+    minnet_dns_settle(req, &numeric);
+    r = 1;
+  } else if((r = minnet_dns_lookup(ctx, host, &entry, minnet_dns_resolved, req)) == 1) {
+    minnet_dns_settle(req, entry);
+  } else if(r == -1) {
+    JSValue err = js_error_new(ctx, "%s: out of memory", host);
+
+    js_async_reject(ctx, &req->async, err);
+    JS_FreeValue(ctx, err);
+  }
+
+  if(r != 0)
+    js_free(ctx, req);
+
+  JS_FreeCString(ctx, host);
+  return ret;
+}
+
+/* the counters of this thread's DNS cache, with a true argument it is flushed first */
+JSValue minnet_dns_stats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  const DnsStats* st;
+  JSValue ret;
+
+  if(!minnet_dns())
+    return JS_ThrowOutOfMemory(ctx);
+
+  if(argc > 0 && JS_ToBool(ctx, argv[0]))
+    dns_flush(dns_resolver);
+
+  st = dns_stats(dns_resolver);
+  ret = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, ret, "hits", JS_NewInt64(ctx, st->hits));
+  JS_SetPropertyStr(ctx, ret, "negativeHits", JS_NewInt64(ctx, st->negative_hits));
+  JS_SetPropertyStr(ctx, ret, "misses", JS_NewInt64(ctx, st->misses));
+  JS_SetPropertyStr(ctx, ret, "lookups", JS_NewInt64(ctx, st->lookups));
+  JS_SetPropertyStr(ctx, ret, "failures", JS_NewInt64(ctx, st->failures));
+  JS_SetPropertyStr(ctx, ret, "expired", JS_NewInt64(ctx, st->expired));
+  JS_SetPropertyStr(ctx, ret, "entries", JS_NewUint32(ctx, st->entries));
+  JS_SetPropertyStr(ctx, ret, "pending", JS_NewUint32(ctx, st->pending));
+
+  return ret;
+}
+
+/* setDns({ ttl, negativeTtl }): how many seconds answers and failures stay in the cache */
+JSValue minnet_set_dns(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  uint32_t ttl = DNS_TTL, negative_ttl = DNS_NEGATIVE_TTL;
+
+  if(!minnet_dns())
+    return JS_ThrowOutOfMemory(ctx);
+
+  if(argc > 0 && JS_IsObject(argv[0])) {
+    if(js_has_propertystr(ctx, argv[0], "ttl"))
+      ttl = js_get_propertystr_uint32(ctx, argv[0], "ttl");
+
+    if(js_has_propertystr(ctx, argv[0], "negativeTtl"))
+      negative_ttl = js_get_propertystr_uint32(ctx, argv[0], "negativeTtl");
+  }
+
+  dns_ttl(dns_resolver, ttl, negative_ttl);
+  return JS_UNDEFINED;
+}
@@ -0,0 +1,15 @@
+#ifndef MINNET_DNS_H
+#define MINNET_DNS_H
+
+#include "minnet.h"
+#include "dns.h"
+
+DnsResolver* minnet_dns(void);
+int minnet_dns_fd(void);
+int minnet_dns_lookup(JSContext*, const char* host, const DnsEntry** entryp, dns_callback* cb, void* opaque);
+void minnet_dns_process(JSContext*);
+JSValue minnet_resolve(JSContext*, JSValueConst, int, JSValueConst[]);
+JSValue minnet_dns_stats(JSContext*, JSValueConst, int, JSValueConst[]);
+JSValue minnet_set_dns(JSContext*, JSValueConst, int, JSValueConst[]);
+
+#endif /* MINNET_DNS_H */
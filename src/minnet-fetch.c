@@ -2,6 +2,8 @@
 #include "minnet-request.h"
 #include "minnet-response.h"
 #include "minnet-client.h"
+#include "minnet-agent.h"
+#include "minnet-fetch.h"
 #include "minnet.h"
 #include "buffer.h"
 #include "closure.h"
@@ -74,22 +76,20 @@ static JSValue fetch_handler(JSContext* ctx, JSValueConst this_val, int argc, JS
   return JS_UNDEFINED;
 }
 
-JSValue minnet_fetch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+/* one request of fetch() or fetchAll(), with magic RETURN_STARTED a blocking one is left running */
+static JSValue fetch_request(JSContext* ctx, JSValueConst this_val, JSValueConst url, JSValueConst options, int magic, MinnetClient** clientp) {
   JSValue ret, handlers[4], args[2];
   union closure* cc;
   BOOL block = TRUE;
 
-  if(argc >= 2 && !JS_IsObject(argv[1]))
-    return JS_ThrowTypeError(ctx, "argument 2 must be an object");
-
   if(!(cc = closure_new(ctx)))
     return JS_EXCEPTION;
 
-  args[0] = argv[0];
-  args[1] = argc > 1 ? JS_DupValue(ctx, argv[1]) : JS_NewObject(ctx);
+  args[0] = url;
+  args[1] = JS_IsObject(options) ? JS_DupValue(ctx, options) : JS_NewObject(ctx);
 
-  if(argc > 1 && js_has_propertystr(ctx, argv[1], "block"))
-    block = js_get_propertystr_bool(ctx, argv[1], "block");
+  if(JS_IsObject(options) && js_has_propertystr(ctx, options, "block"))
+    block = js_get_propertystr_bool(ctx, options, "block");
 
   handlers[0] = js_function_cclosure(ctx, &fetch_handler, 2, ON_HTTP, closure_dup(cc), closure_free);
   handlers[1] = js_function_cclosure(ctx, &fetch_handler, 2, ON_ERROR, closure_dup(cc), closure_free);
@@ -104,7 +104,7 @@ JSValue minnet_fetch(JSContext* ctx, JSValueConst this_val, int argc, JSValueCon
   if(!js_has_propertystr(ctx, args[1], "block"))
     JS_SetPropertyStr(ctx, args[1], "block", JS_NewBool(ctx, block));
 
-  ret = minnet_client_closure(ctx, this_val, 2, args, RETURN_RESPONSE, cc);
+  ret = minnet_client_closure(ctx, this_val, 2, args, magic, cc);
 
   JS_FreeValue(ctx, args[1]);
 
@@ -116,7 +116,119 @@ JSValue minnet_fetch(JSContext* ctx, JSValueConst this_val, int argc, JSValueCon
   }
 #endif
 
-  cc->pointer = minnet_client_dup(cc->pointer);
+  if(cc->pointer) {
+    cc->pointer = minnet_client_dup(cc->pointer);
+
+    if(clientp)
+      *clientp = minnet_client_dup(cc->pointer);
+  }
+
+  return ret;
+}
+
+JSValue minnet_fetch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  if(argc >= 2 && !JS_IsObject(argv[1]))
+    return JS_ThrowTypeError(ctx, "argument 2 must be an object");
+
+  return fetch_request(ctx, this_val, argv[0], argc > 1 ? argv[1] : JS_UNDEFINED, RETURN_RESPONSE, 0);
+}
+
+static JSValue fetch_settled(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) { return JS_DupValue(ctx, argv[0]); }
+
+/**
+ * fetchAll(requests[, options]): the requests run in parallel on the agents' connections.
+ * Blocking, returns their Responses in order, an Error for each one which failed; otherwise
+ * a Promise of the same.
+ */
+JSValue minnet_fetch_all(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValueConst options = argc > 1 ? argv[1] : JS_UNDEFINED;
+  BOOL block = TRUE;
+  int64_t len;
+  uint32_t i;
+  JSValue ret;
+
+  if(argc >= 2 && !JS_IsObject(argv[1]))
+    return JS_ThrowTypeError(ctx, "argument 2 must be an object");
+
+  if((len = js_array_length(ctx, argv[0])) < 0)
+    return JS_ThrowTypeError(ctx, "argument 1 must be an array");
+
+  if(len > FETCH_MAX_REQUESTS)
+    return JS_ThrowRangeError(ctx, "fetchAll() takes at most %d requests", FETCH_MAX_REQUESTS);
+
+  if(JS_IsObject(options) && js_has_propertystr(ctx, options, "block"))
+    block = js_get_propertystr_bool(ctx, options, "block");
+
+  ret = JS_NewArray(ctx);
+
+  if(!block) {
+    JSValue promise = js_global_get(ctx, "Promise"), settled = JS_NewCFunction(ctx, fetch_settled, "settled", 1), all;
+
+    for(i = 0; i < len; i++) {
+      JSValue url = JS_GetPropertyUint32(ctx, argv[0], i), p = fetch_request(ctx, this_val, url, options, RETURN_RESPONSE, 0);
+
+      JS_SetPropertyUint32(ctx, ret, i, JS_IsException(p) ? JS_GetException(ctx) : js_async_catch(ctx, p, settled));
+      JS_FreeValue(ctx, p);
+      JS_FreeValue(ctx, url);
+    }
+
+    all = js_invoke(ctx, promise, "all", 1, &ret);
+
+    JS_FreeValue(ctx, settled);
+    JS_FreeValue(ctx, promise);
+    JS_FreeValue(ctx, ret);
+    return all;
+  }
+
+  {
+    MinnetClient** clients;
+    JSValue err = JS_UNDEFINED;
+
+    if(!(clients = js_mallocz(ctx, (len ? len : 1) * sizeof(MinnetClient*)))) {
+      JS_FreeValue(ctx, ret);
+      return JS_EXCEPTION;
+    }
+
+    /* started all before any is waited for, a failed start is there in the result already */
+    for(i = 0; i < len; i++) {
+      JSValue url = JS_GetPropertyUint32(ctx, argv[0], i), value;
+
+      value = fetch_request(ctx, this_val, url, options, RETURN_STARTED, &clients[i]);
+      JS_FreeValue(ctx, url);
+
+      if(JS_IsException(value)) {
+        JS_SetPropertyUint32(ctx, ret, i, JS_GetException(ctx));
+
+        if(clients[i])
+          minnet_client_free(clients[i], JS_GetRuntime(ctx));
+
+        clients[i] = 0;
+      } else {
+        JS_FreeValue(ctx, value);
+      }
+    }
+
+    /* out of memory or poll() failed: those still running are aborted and get the error */
+    if(!minnet_agent_wait(ctx, clients, len))
+      err = JS_GetException(ctx);
+
+    for(i = 0; i < len; i++) {
+      BOOL failed;
+
+      if(!clients[i])
+        continue;
+
+      if(!JS_IsUndefined(err) && minnet_agent_abort(clients[i]))
+        JS_SetPropertyUint32(ctx, ret, i, JS_DupValue(ctx, err));
+      else
+        JS_SetPropertyUint32(ctx, ret, i, minnet_client_result(clients[i], &failed));
+
+      minnet_client_free(clients[i], JS_GetRuntime(ctx));
+    }
+
+    JS_FreeValue(ctx, err);
+    js_free(ctx, clients);
+  }
 
   return ret;
 }
@@ -3,6 +3,10 @@
 
 #include <quickjs.h>
 
+/* fetchAll() keeps a pointer per request */
+#define FETCH_MAX_REQUESTS 65536
+
 JSValue minnet_fetch(JSContext*, JSValueConst this_val, int argc, JSValueConst argv[]);
+JSValue minnet_fetch_all(JSContext*, JSValueConst this_val, int argc, JSValueConst argv[]);
 
 #endif /* MINNET_FETCH_H */
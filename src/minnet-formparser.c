@@ -2,6 +2,7 @@
 #include <quickjs.h>
 #include <cutils.h>
 #include "minnet-formparser.h"
+#include "minnet-hash.h"
 #include "callback.h"
 #include "js-utils.h"
 #include <ctype.h>
@@ -27,7 +28,11 @@ JSValue minnet_formparser_constructor(JSContext* ctx, JSValueConst new_target, i
   MinnetWebsocket* ws;
   char** param_names;
   int param_count;
-  uint64_t chunk_size = 1024;
+  uint64_t chunk_size = 1024, max_size = 0;
+  uint32_t max_files = 0;
+  int digest = LWS_GENHASH_TYPE_UNKNOWN;
+  const char* save_to = 0;
+  BOOL valid = TRUE;
 
   if(!(fp = formparser_alloc(ctx)))
     return JS_EXCEPTION;
@@ -69,12 +74,53 @@ JSValue minnet_formparser_constructor(JSContext* ctx, JSValueConst new_target, i
     GETCB(cb_close, fp->cb.close)
     GETCB(cb_finalize, fp->cb.finalize)
 
+    if(js_has_propertystr(ctx, argv[2], "saveTo")) {
+      JSValue opt_dir = JS_GetPropertyStr(ctx, argv[2], "saveTo");
+
+      save_to = JS_ToCString(ctx, opt_dir);
+      JS_FreeValue(ctx, opt_dir);
+
+      /* file parts are written, not passed around: fewer, larger chunks */
+      chunk_size = 65536;
+      max_files = js_get_propertystr_uint32(ctx, argv[2], "maxFiles");
+
+      if(js_has_propertystr(ctx, argv[2], "maxFileSize")) {
+        JSValue opt_max = JS_GetPropertyStr(ctx, argv[2], "maxFileSize");
+        JS_ToIndex(ctx, &max_size, opt_max);
+        JS_FreeValue(ctx, opt_max);
+      }
+
+      if(js_has_propertystr(ctx, argv[2], "digest")) {
+        JSValue opt_digest = JS_GetPropertyStr(ctx, argv[2], "digest");
+        digest = minnet_hash_type(ctx, opt_digest);
+        valid = digest != LWS_GENHASH_TYPE_UNKNOWN;
+        JS_FreeValue(ctx, opt_digest);
+      }
+    }
+
     if(JS_IsNumber(opt_chunksz))
       JS_ToIndex(ctx, &chunk_size, opt_chunksz);
   }
 
   formparser_init(fp, ws, param_count, (const char* const*)param_names, chunk_size);
 
+  /* initialized, the finalizer cleans up from here */
+  if(save_to) {
+    int r = valid ? formparser_save(fp, save_to, max_size, max_files, digest) : -1;
+
+    JS_FreeCString(ctx, save_to);
+
+    if(r) {
+      if(!valid)
+        JS_ThrowRangeError(ctx, "digest must be one of Hash.TYPE_* or its name");
+      else
+        JS_ThrowOutOfMemory(ctx);
+
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+  }
+
   struct wsi_opaque_user_data* opaque = ws_opaque(ws);
 
   if(opaque->form_parser)
@@ -283,6 +329,9 @@ static JSValue minnet_formparser_call(JSContext* ctx, JSValueConst func_obj, JSV
     ret = JS_NewInt32(ctx, formparser_process(fp, buf.data, buf.size));
 
     js_buffer_free(&buf, JS_GetRuntime(ctx));
+
+    if(fp->status)
+      return JS_ThrowRangeError(ctx, "form data rejected with status %d", fp->status);
   }
   if(!JS_IsNull(fp->exception)) {
 
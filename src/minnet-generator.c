@@ -2,6 +2,7 @@
 #include "js-utils.h"
 #include <quickjs.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <libwebsockets.h>
 
 THREAD_LOCAL JSClassID minnet_generator_class_id;
@@ -17,8 +18,41 @@ enum {
   GENERATOR_BUFFERING,
   GENERATOR_STOP,
   GENERATOR_ITERATOR,
+  GENERATOR_BATCHES,
+  GENERATOR_READ_INTO,
 };
 
+/* an iterator handing out whatever is queued at once, instead of chunk by chunk */
+typedef struct generator_batches {
+  int ref_count;
+  MinnetGenerator* gen;
+  size_t max_bytes;
+  uint32_t max_chunks;
+  BOOL concat;
+} GeneratorBatches;
+
+static GeneratorBatches* batches_dup(GeneratorBatches* b) {
+  ++b->ref_count;
+  return b;
+}
+
+static void batches_free(void* ptr) {
+  GeneratorBatches* b = ptr;
+
+  if(--b->ref_count == 0) {
+    generator_free(b->gen);
+    free(b);
+  }
+}
+
+static const JSCFunctionListEntry minnet_generator_iter[] = {
+    JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, (JSCFunction*)&JS_DupValue),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MinnetGeneratorIterator", JS_PROP_CONFIGURABLE),
+};
+
+static JSValue minnet_generator_batches(JSContext*, MinnetGenerator*, JSValueConst options);
+static JSValue minnet_generator_read_into(JSContext*, MinnetGenerator*, JSValueConst target);
+
 static JSValue minnet_generator_function(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
   MinnetGenerator* gen = (MinnetGenerator*)opaque;
   JSValue ret = JS_UNDEFINED;
@@ -29,6 +63,16 @@ static JSValue minnet_generator_function(JSContext* ctx, JSValueConst this_val,
       break;
     }
 
+    case GENERATOR_BATCHES: {
+      ret = minnet_generator_batches(ctx, gen, argc > 0 ? argv[0] : JS_UNDEFINED);
+      break;
+    }
+
+    case GENERATOR_READ_INTO: {
+      ret = minnet_generator_read_into(ctx, gen, argc > 0 ? argv[0] : JS_UNDEFINED);
+      break;
+    }
+
     case GENERATOR_RETURN: {
       ResolveFunctions async = {JS_NULL, JS_NULL};
 
@@ -53,6 +97,184 @@ static JSValue minnet_generator_function(JSContext* ctx, JSValueConst this_val,
   return ret;
 }
 
+/* the first chunk arrived, whatever was queued along with it joins the batch */
+static JSValue minnet_generator_batch_first(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  GeneratorBatches* b = opaque;
+  JSValue first, value, ret;
+  BOOL done;
+
+  if(js_get_propertystr_bool(ctx, argv[0], "done"))
+    return JS_DupValue(ctx, argv[0]);
+
+  first = JS_GetPropertyStr(ctx, argv[0], "value");
+  value = generator_drain(b->gen, first, b->max_bytes, b->max_chunks, b->concat, &done);
+  ret = js_iterator_result(ctx, value, FALSE);
+
+  JS_FreeValue(ctx, first);
+  JS_FreeValue(ctx, value);
+  return ret;
+}
+
+static JSValue minnet_generator_batch_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  GeneratorBatches* b = opaque;
+  MinnetGenerator* gen = b->gen;
+  JSValue ret, tmp, fn;
+
+  /* what's queued already makes a batch right away */
+  if(!asynciterator_pending(&gen->iterator)) {
+    ResolveFunctions async;
+    BOOL done;
+    JSValue value = generator_drain(gen, JS_UNDEFINED, b->max_bytes, b->max_chunks, b->concat, &done);
+
+    if(!JS_IsUndefined(value) || done) {
+      JSValue result = js_iterator_result(ctx, value, JS_IsUndefined(value));
+
+      ret = js_async_create(ctx, &async);
+      js_async_resolve(ctx, &async, result);
+      js_async_free(JS_GetRuntime(ctx), &async);
+
+      JS_FreeValue(ctx, result);
+      JS_FreeValue(ctx, value);
+      return ret;
+    }
+  }
+
+  /* otherwise the next chunk to arrive starts one */
+  tmp = generator_next(gen, JS_UNDEFINED);
+  fn = js_function_cclosure(ctx, minnet_generator_batch_first, 1, 0, batches_dup(b), batches_free);
+  ret = js_invoke(ctx, tmp, "then", 1, &fn);
+
+  JS_FreeValue(ctx, fn);
+  JS_FreeValue(ctx, tmp);
+  return ret;
+}
+
+/**
+ * batches({ maxBytes, maxChunks, concat }): an async iterator over the same data, each
+ * next() resolves with all chunks queued at the time, in an Array or with concat merged.
+ */
+static JSValue minnet_generator_batches(JSContext* ctx, MinnetGenerator* gen, JSValueConst options) {
+  static const char* method_names[] = {
+      "return",
+      "throw",
+  };
+  GeneratorBatches* b;
+  JSValue ret, proto;
+
+  if(!(b = calloc(1, sizeof(GeneratorBatches))))
+    return JS_ThrowOutOfMemory(ctx);
+
+  b->ref_count = 1;
+  b->gen = generator_dup(gen);
+
+  if(JS_IsObject(options)) {
+    b->max_bytes = js_get_propertystr_uint32(ctx, options, "maxBytes");
+    b->max_chunks = js_get_propertystr_uint32(ctx, options, "maxChunks");
+    b->concat = js_get_propertystr_bool(ctx, options, "concat");
+  }
+
+  proto = js_asyncgenerator_prototype(ctx);
+  ret = JS_NewObjectProto(ctx, proto);
+  JS_FreeValue(ctx, proto);
+
+  JS_DefinePropertyValueStr(ctx, ret, "next", js_function_cclosure(ctx, minnet_generator_batch_next, 0, 0, b, batches_free), JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE);
+
+  for(size_t i = 0; i < countof(method_names); i++) {
+    JSValue func = js_function_cclosure(ctx, minnet_generator_function, 0, GENERATOR_RETURN + i, generator_dup(gen), (void*)&generator_free);
+    JS_DefinePropertyValueStr(ctx, ret, method_names[i], func, JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE);
+  }
+
+  JS_SetPropertyFunctionList(ctx, ret, minnet_generator_iter, countof(minnet_generator_iter));
+
+  return ret;
+}
+
+/* copies first and whatever is queued to the bytes target views, -1 with an exception thrown */
+static ssize_t minnet_generator_read(JSContext* ctx, MinnetGenerator* gen, JSValueConst target, JSValueConst first, BOOL* done_p) {
+  JSBuffer out = js_input_buffer(ctx, target);
+  size_t offset = 0, size = out.size;
+  ssize_t ret;
+
+  if(!out.data) {
+    if(!JS_IsException(out.value)) {
+      JS_FreeValue(ctx, out.value);
+      JS_ThrowTypeError(ctx, "readInto() needs an ArrayBuffer or a typed array");
+    }
+
+    return -1;
+  }
+
+  /* a typed array views only a part of its buffer */
+  if(out.range.length >= 0) {
+    offset = MIN((size_t)out.range.offset, size);
+    size = MIN((size_t)out.range.length, size - offset);
+  }
+
+  if(size == 0) {
+    js_buffer_free(&out, JS_GetRuntime(ctx));
+    JS_ThrowRangeError(ctx, "readInto() needs a buffer of at least one byte");
+    return -1;
+  }
+
+  if((ret = generator_read_into(gen, first, out.data + offset, size, done_p)) == -1)
+    JS_ThrowOutOfMemory(ctx);
+
+  js_buffer_free(&out, JS_GetRuntime(ctx));
+  return ret;
+}
+
+/* the chunk readInto() waited for arrived, argv[0] is the target bound to this function */
+static JSValue minnet_generator_read_chunk(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  MinnetGenerator* gen = opaque;
+  JSValue value;
+  ssize_t r;
+  BOOL done;
+
+  if(js_get_propertystr_bool(ctx, argv[1], "done"))
+    return JS_NewInt32(ctx, 0);
+
+  value = JS_GetPropertyStr(ctx, argv[1], "value");
+  r = minnet_generator_read(ctx, gen, argv[0], value, &done);
+  JS_FreeValue(ctx, value);
+
+  return r == -1 ? JS_EXCEPTION : JS_NewInt64(ctx, r);
+}
+
+/**
+ * readInto(target): copies queued bytes into an ArrayBuffer or typed array of the caller
+ * and resolves with their number, 0 at the end. It waits only when nothing is queued.
+ */
+static JSValue minnet_generator_read_into(JSContext* ctx, MinnetGenerator* gen, JSValueConst target) {
+  JSValue ret, tmp, fn, bound;
+  ssize_t r;
+  BOOL done;
+
+  if((r = minnet_generator_read(ctx, gen, target, JS_UNDEFINED, &done)) == -1)
+    return JS_EXCEPTION;
+
+  if(r > 0 || done) {
+    ResolveFunctions async;
+    JSValue value = JS_NewInt64(ctx, r);
+
+    ret = js_async_create(ctx, &async);
+    js_async_resolve(ctx, &async, value);
+    js_async_free(JS_GetRuntime(ctx), &async);
+
+    JS_FreeValue(ctx, value);
+    return ret;
+  }
+
+  tmp = generator_next(gen, JS_UNDEFINED);
+  fn = js_function_cclosure(ctx, minnet_generator_read_chunk, 2, 0, generator_dup(gen), (void*)&generator_free);
+  bound = js_function_bind_1(ctx, fn, target);
+  ret = js_invoke(ctx, tmp, "then", 1, &bound);
+
+  JS_FreeValue(ctx, bound);
+  JS_FreeValue(ctx, fn);
+  JS_FreeValue(ctx, tmp);
+  return ret;
+}
+
 static JSValue minnet_generator_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   MinnetGenerator* gen;
   JSValue ret = JS_UNDEFINED;
@@ -99,6 +321,16 @@ static JSValue minnet_generator_method(JSContext* ctx, JSValueConst this_val, in
       ret = minnet_generator_iterator(ctx, gen);
       break;
     }
+
+    case GENERATOR_BATCHES: {
+      ret = minnet_generator_batches(ctx, gen, argc > 0 ? argv[0] : JS_UNDEFINED);
+      break;
+    }
+
+    case GENERATOR_READ_INTO: {
+      ret = minnet_generator_read_into(ctx, gen, argc > 0 ? argv[0] : JS_UNDEFINED);
+      break;
+    }
   }
 
   return ret;
@@ -243,11 +475,6 @@ JSValue minnet_generator_constructor(JSContext* ctx, JSValueConst new_target, in
   return minnet_generator_wrap(ctx, gen);
 }
 
-static const JSCFunctionListEntry minnet_generator_iter[] = {
-    JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, (JSCFunction*)&JS_DupValue),
-    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MinnetGeneratorIterator", JS_PROP_CONFIGURABLE),
-};
-
 static const JSCFunctionListEntry minnet_generator_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("write", 1, minnet_generator_method, GENERATOR_WRITE),
     JS_CFUNC_MAGIC_DEF("enqueue", 1, minnet_generator_method, GENERATOR_ENQUEUE),
@@ -264,6 +491,8 @@ static const JSCFunctionListEntry minnet_generator_proto_funcs[] = {
     JS_CGETSET_MAGIC_DEF("chunksWritten", minnet_generator_get, 0, GENERATOR_CHUNKS_WRITTEN),
     JS_CGETSET_MAGIC_DEF("chunkSize", minnet_generator_get, 0, GENERATOR_CHUNK_SIZE),
     JS_CFUNC_MAGIC_DEF("[Symbol.asyncIterator]", 0, minnet_generator_method, GENERATOR_ITERATOR),
+    JS_CFUNC_MAGIC_DEF("batches", 0, minnet_generator_method, GENERATOR_BATCHES),
+    JS_CFUNC_MAGIC_DEF("readInto", 1, minnet_generator_method, GENERATOR_READ_INTO),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MinnetGenerator", JS_PROP_CONFIGURABLE),
 };
 
@@ -273,6 +502,10 @@ JSValue minnet_generator_iterator(JSContext* ctx, MinnetGenerator* gen) {
       "return",
       "throw",
   };
+  static const char* read_names[] = {
+      "batches",
+      "readInto",
+  };
   JSValue ret, proto = js_asyncgenerator_prototype(ctx);
   ret = JS_NewObjectProto(ctx, proto);
   JS_FreeValue(ctx, proto);
@@ -282,6 +515,11 @@ JSValue minnet_generator_iterator(JSContext* ctx, MinnetGenerator* gen) {
     JS_DefinePropertyValueStr(ctx, ret, method_names[i], func, JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE);
   }
 
+  for(size_t i = 0; i < countof(read_names); i++) {
+    JSValue func = js_function_cclosure(ctx, minnet_generator_function, 0, GENERATOR_BATCHES + i, generator_dup(gen), (void*)&generator_free);
+    JS_DefinePropertyValueStr(ctx, ret, read_names[i], func, JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE);
+  }
+
   JS_SetPropertyFunctionList(ctx, ret, minnet_generator_iter, countof(minnet_generator_iter));
 
   return ret;
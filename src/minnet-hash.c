@@ -84,6 +84,24 @@ static BOOL hash_finalize(MinnetHash* h) {
   return TRUE;
 }
 
+/* a Hash.TYPE_* or its name like "sha256", LWS_GENHASH_TYPE_UNKNOWN for anything else */
+int minnet_hash_type(JSContext* ctx, JSValueConst value) {
+  int32_t type = LWS_GENHASH_TYPE_UNKNOWN;
+
+  if(JS_IsString(value)) {
+    const char* name;
+
+    if((name = JS_ToCString(ctx, value))) {
+      type = digest_type(name);
+      JS_FreeCString(ctx, name);
+    }
+  } else if(JS_IsNumber(value)) {
+    JS_ToInt32(ctx, &type, value);
+  }
+
+  return digest_name(type) ? type : LWS_GENHASH_TYPE_UNKNOWN;
+}
+
 JSValue minnet_hash_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
   JSValue proto, obj;
   MinnetHash* h = NULL;
@@ -3,6 +3,7 @@
 
 #include "utils.h"
 #include "js-utils.h"
+#include "digest.h"
 #include <libwebsockets.h>
 
 typedef struct hash_hmac {
@@ -16,6 +17,7 @@ typedef struct hash_hmac {
 } MinnetHash;
 
 JSValue minnet_hash_constructor(JSContext*, JSValueConst, int, JSValueConst[]);
+int minnet_hash_type(JSContext*, JSValueConst);
 int minnet_hash_init(JSContext*, JSModuleDef*);
 
 extern THREAD_LOCAL JSValue minnet_hash_proto, minnet_hash_ctor;
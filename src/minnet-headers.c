@@ -24,6 +24,7 @@ enum {
 
 struct MinnetHeadersOpaque {
   ByteBuffer* headers;
+  HeaderIndex* index;
   void* opaque;
   HeadersFreeFunc* free_func;
   struct {
@@ -50,7 +51,7 @@ ByteBuffer* minnet_headers_data2(JSContext* ctx, JSValueConst obj) {
   return ptr->headers;
 }
 
-JSValue minnet_headers_value(JSContext* ctx, ByteBuffer* headers, JSValueConst obj) {
+JSValue minnet_headers_value(JSContext* ctx, ByteBuffer* headers, HeaderIndex* index, JSValueConst obj) {
   JSValue headers_obj = JS_NewObjectProtoClass(ctx, minnet_headers_proto, minnet_headers_class_id);
   struct MinnetHeadersOpaque* ptr;
 
@@ -61,6 +62,7 @@ JSValue minnet_headers_value(JSContext* ctx, ByteBuffer* headers, JSValueConst o
     return JS_EXCEPTION;
 
   ptr->headers = headers;
+  ptr->index = index;
   ptr->opaque = minnet_headers_dup_obj(ctx, obj);
   ptr->free_func = minnet_headers_free_obj;
   ptr->separator.item = "\r\n";
@@ -71,7 +73,7 @@ JSValue minnet_headers_value(JSContext* ctx, ByteBuffer* headers, JSValueConst o
   return headers_obj;
 }
 
-JSValue minnet_headers_wrap(JSContext* ctx, ByteBuffer* headers, void* opaque, void (*free_func)(void* opaque, JSRuntime* rt)) {
+JSValue minnet_headers_wrap(JSContext* ctx, ByteBuffer* headers, HeaderIndex* index, void* opaque, void (*free_func)(void* opaque, JSRuntime* rt)) {
   JSValue headers_obj = JS_NewObjectProtoClass(ctx, minnet_headers_proto, minnet_headers_class_id);
   struct MinnetHeadersOpaque* ptr;
 
@@ -82,6 +84,7 @@ JSValue minnet_headers_wrap(JSContext* ctx, ByteBuffer* headers, void* opaque, v
     return JS_EXCEPTION;
 
   ptr->headers = headers;
+  ptr->index = index;
   ptr->opaque = opaque;
   ptr->free_func = free_func;
   ptr->separator.item = "\r\n";
@@ -124,8 +127,8 @@ static JSValue minnet_headers_method(JSContext* ctx, JSValueConst this_val, int
       const char* value = JS_ToCStringLen(ctx, &valuelen, argv[1]);
 
       ssize_t index;
-      if((index = headers_appendb(headers, name, namelen, value, valuelen, ptr->separator.item)) == -1)
-        index = headers_set(headers, name, value, ptr->separator.item);
+      if((index = headers_appendb(headers, ptr->index, name, namelen, value, valuelen, ptr->separator.item)) == -1)
+        index = headers_set(headers, ptr->index, name, value, ptr->separator.item);
       ret = JS_NewInt64(ctx, index);
       JS_FreeCString(ctx, name);
       JS_FreeCString(ctx, value);
@@ -136,7 +139,7 @@ static JSValue minnet_headers_method(JSContext* ctx, JSValueConst this_val, int
       size_t namelen;
       const char* name = JS_ToCStringLen(ctx, &namelen, argv[0]);
 
-      ret = JS_NewInt64(ctx, headers_unsetb(headers, name, namelen, ptr->separator.item));
+      ret = JS_NewInt64(ctx, headers_unsetb(headers, ptr->index, name, namelen, ptr->separator.item));
       break;
     }
 
@@ -145,7 +148,7 @@ static JSValue minnet_headers_method(JSContext* ctx, JSValueConst this_val, int
       const char* name = JS_ToCString(ctx, argv[0]);
       const char* value;
 
-      if((value = headers_getlen(headers, &valuelen, name, ptr->separator.item, ptr->separator.key)))
+      if((value = headers_getlen(headers, ptr->index, &valuelen, name, ptr->separator.item, ptr->separator.key)))
         ret = JS_NewStringLen(ctx, value, valuelen);
       break;
     }
@@ -154,7 +157,7 @@ static JSValue minnet_headers_method(JSContext* ctx, JSValueConst this_val, int
       size_t namelen;
       const char* name = JS_ToCStringLen(ctx, &namelen, argv[0]);
 
-      ret = JS_NewBool(ctx, headers_findb(headers, name, namelen, ptr->separator.item) != -1);
+      ret = JS_NewBool(ctx, headers_findb(headers, ptr->index, name, namelen, ptr->separator.item) != -1);
       break;
     }
 
@@ -164,7 +167,7 @@ static JSValue minnet_headers_method(JSContext* ctx, JSValueConst this_val, int
       name = JS_ToCString(ctx, argv[0]);
       value = JS_ToCString(ctx, argv[1]);
 
-      ret = JS_NewInt64(ctx, headers_set(headers, name, value, ptr->separator.item));
+      ret = JS_NewInt64(ctx, headers_set(headers, ptr->index, name, value, ptr->separator.item));
 
       break;
     }
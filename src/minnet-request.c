@@ -41,8 +41,8 @@ JSValue minnet_request_constructor(JSContext* ctx, JSValueConst new_target, int
     req->secure = other->secure;
     req->h2 = other->h2;
     req->method = other->method;
-    req->url = url_clone(other->url, ctx);
-    buffer_clone(&req->headers, &other->headers);
+    req->url = url_clone(*request_url(other, ctx), ctx);
+    buffer_clone(&req->headers, request_headers(other, ctx));
 
   } else {
     url_fromvalue(&req->url, argv[0], ctx);
@@ -66,7 +66,7 @@ JSValue minnet_request_clone(JSContext* ctx, JSValueConst this_val, int argc, JS
   if(!(req = minnet_request_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
-  if((req2 = request_new(url_clone(req->url, ctx), req->method, ctx)))
+  if((req2 = request_new(url_clone(*request_url(req, ctx), ctx), req->method, ctx)))
     return minnet_request_wrap(ctx, req2);
 
   return JS_EXCEPTION;
@@ -80,15 +80,20 @@ JSValue minnet_request_wrap(JSContext* ctx, MinnetRequest* req) {
 
   JS_SetOpaque(ret, request_dup(req));
 
+  /* whatever a handler gets from it (headers, body) keeps the Request, not this object */
+  req->exposed = TRUE;
+
   return ret;
 }
 
 enum {
   REQUEST_BODY,
+  REQUEST_DIGEST,
   REQUEST_H2,
   REQUEST_HEADERS,
   REQUEST_IP,
   REQUEST_METHOD,
+  REQUEST_PARAMS,
   REQUEST_PATH,
   REQUEST_PROTOCOL,
   REQUEST_REFERER,
@@ -113,7 +118,7 @@ static JSValue minnet_request_get(JSContext* ctx, JSValueConst this_val, int mag
     case REQUEST_TYPE: {
       char* type;
 
-      if((type = headers_get(&req->headers, "content-type", "\r\n", ":", ctx))) {
+      if((type = request_header(req, "content-type", ctx))) {
         ret = JS_NewString(ctx, type);
         js_free(ctx, type);
       }
@@ -121,7 +126,7 @@ static JSValue minnet_request_get(JSContext* ctx, JSValueConst this_val, int mag
     }
 
     case REQUEST_URI: {
-      ret = minnet_url_new(ctx, req->url);
+      ret = minnet_url_new(ctx, *request_url(req, ctx));
       break;
     }
 
@@ -130,8 +135,13 @@ static JSValue minnet_request_get(JSContext* ctx, JSValueConst this_val, int mag
       break;
     }
 
+    case REQUEST_PARAMS: {
+      ret = route_params_object(ctx, req->route, &req->params, req->url.path);
+      break;
+    }
+
     case REQUEST_HEADERS: {
-      ret = minnet_headers_wrap(ctx, &req->headers, request_dup(req), (HeadersFreeFunc*)&request_free);
+      ret = minnet_headers_wrap(ctx, request_headers(req, ctx), &req->header_index, request_dup(req), (HeadersFreeFunc*)&request_free);
       // minnet_headers_value(ctx,  this_val);
       break;
     }
@@ -139,7 +149,7 @@ static JSValue minnet_request_get(JSContext* ctx, JSValueConst this_val, int mag
     case REQUEST_REFERER: {
       char* ref;
 
-      if((ref = headers_get(&req->headers, "referer", "\r\n", ":", ctx))) {
+      if((ref = request_header(req, "referer", ctx))) {
         ret = JS_NewString(ctx, ref);
         js_free(ctx, ref);
       }
@@ -147,6 +157,14 @@ static JSValue minnet_request_get(JSContext* ctx, JSValueConst this_val, int mag
       break;
     }
 
+    /* hex, null until the whole body is in */
+    case REQUEST_DIGEST: {
+      char hex[LWS_GENHASH_LARGEST * 2 + 1];
+
+      ret = req->digest && digest_hex(req->digest, hex) ? JS_NewString(ctx, hex) : JS_NULL;
+      break;
+    }
+
     case REQUEST_BODY: {
       switch(req->method) {
         case METHOD_GET:
@@ -173,6 +191,14 @@ static JSValue minnet_request_get(JSContext* ctx, JSValueConst this_val, int mag
       break;
     }
 
+    case REQUEST_IP: {
+      const char* ip;
+
+      if((ip = request_ip(req)))
+        ret = JS_NewString(ctx, ip);
+      break;
+    }
+
     case REQUEST_SECURE: {
       ret = JS_NewBool(ctx, req->secure);
       break;
@@ -215,6 +241,7 @@ static JSValue minnet_request_set(JSContext* ctx, JSValueConst this_val, JSValue
     case REQUEST_URI: {
       url_free(&req->url, JS_GetRuntime(ctx));
       url_parse(&req->url, str, ctx);
+      req->lazy_host = FALSE;
       break;
     }
 
@@ -230,7 +257,7 @@ static JSValue minnet_request_set(JSContext* ctx, JSValueConst this_val, JSValue
     case REQUEST_HEADERS: {
 
       if(JS_IsObject(value))
-        headers_fromobj(&req->headers, value, "\n", ": ", ctx);
+        headers_fromobj(request_headers(req, ctx), value, "\n", ": ", ctx);
       else
         ret = JS_ThrowReferenceError(ctx, "headers must be an object");
 
@@ -344,7 +371,7 @@ static JSValue minnet_request_getheader(JSContext* ctx, JSValueConst this_val, i
 
   key = JS_ToCString(ctx, argv[0]);
 
-  if((value = headers_get(&req->headers, key, "\r\n", ":", ctx))) {
+  if((value = request_header(req, key, ctx))) {
     ret = JS_NewString(ctx, value);
     js_free(ctx, (void*)value);
   }
@@ -371,13 +398,16 @@ static const JSCFunctionListEntry minnet_request_proto_funcs[] = {
     JS_CGETSET_MAGIC_FLAGS_DEF("url", minnet_request_get, minnet_request_set, REQUEST_URI, JS_PROP_ENUMERABLE),
     JS_CGETSET_MAGIC_FLAGS_DEF("method", minnet_request_get, minnet_request_set, REQUEST_METHOD, JS_PROP_ENUMERABLE),
     JS_CGETSET_MAGIC_FLAGS_DEF("path", minnet_request_get, minnet_request_set, REQUEST_PATH, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("params", minnet_request_get, 0, REQUEST_PARAMS, 0),
     JS_CGETSET_MAGIC_FLAGS_DEF("protocol", minnet_request_get, 0, REQUEST_PROTOCOL, 0),
     JS_CGETSET_MAGIC_FLAGS_DEF("headers", minnet_request_get, minnet_request_set, REQUEST_HEADERS, 0),
     JS_CGETSET_MAGIC_FLAGS_DEF("referer", minnet_request_get, 0, REQUEST_REFERER, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("ip", minnet_request_get, 0, REQUEST_IP, 0),
     JS_CFUNC_MAGIC_DEF("arrayBuffer", 0, minnet_request_method, REQUEST_ARRAYBUFFER),
     JS_CFUNC_MAGIC_DEF("text", 0, minnet_request_method, REQUEST_TEXT),
     JS_CFUNC_MAGIC_DEF("json", 0, minnet_request_method, REQUEST_JSON),
     JS_CGETSET_MAGIC_FLAGS_DEF("body", minnet_request_get, 0, REQUEST_BODY, 0),
+    JS_CGETSET_MAGIC_DEF("digest", minnet_request_get, 0, REQUEST_DIGEST),
     JS_CGETSET_MAGIC_FLAGS_DEF("secure", minnet_request_get, 0, REQUEST_SECURE, JS_PROP_ENUMERABLE),
     JS_CGETSET_MAGIC_FLAGS_DEF("h2", minnet_request_get, 0, REQUEST_H2, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE),
     JS_CFUNC_DEF("get", 1, minnet_request_getheader),
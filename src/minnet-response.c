@@ -22,6 +22,7 @@ enum {
   RESPONSE_REDIRECTED,
   RESPONSE_BODYUSED,
   RESPONSE_BODY,
+  RESPONSE_DIGEST,
   RESPONSE_TYPE,
   RESPONSE_OFFSET,
   RESPONSE_HEADERS,
@@ -191,7 +192,7 @@ static JSValue minnet_response_header(JSContext* ctx, JSValueConst this_val, int
       size_t vlen;
       char* v;
 
-      if((v = headers_getlen(&resp->headers, &vlen, key, "\r\n", ":")))
+      if((v = headers_getlen(&resp->headers, &resp->header_index, &vlen, key, "\r\n", ":")))
         ret = JS_NewStringLen(ctx, v, vlen);
 
       break;
@@ -201,7 +202,7 @@ static JSValue minnet_response_header(JSContext* ctx, JSValueConst this_val, int
       const char* v;
 
       if((v = JS_ToCString(ctx, argv[1])))
-        ret = JS_NewInt32(ctx, headers_set(&resp->headers, key, v, "\r\n"));
+        ret = JS_NewInt32(ctx, headers_set(&resp->headers, &resp->header_index, key, v, "\r\n"));
 
       break;
     }
@@ -211,13 +212,13 @@ static JSValue minnet_response_header(JSContext* ctx, JSValueConst this_val, int
       size_t vlen;
 
       if((v = JS_ToCStringLen(ctx, &vlen, argv[1])))
-        ret = JS_NewInt32(ctx, headers_appendb(&resp->headers, key, keylen, v, vlen, "\r\n"));
+        ret = JS_NewInt32(ctx, headers_appendb(&resp->headers, &resp->header_index, key, keylen, v, vlen, "\r\n"));
 
       break;
     }
 
     case RESPONSE_HEADERS_LOCATION: {
-      ret = JS_NewInt32(ctx, headers_set(&resp->headers, "Location", key, "\r\n"));
+      ret = JS_NewInt32(ctx, headers_set(&resp->headers, &resp->header_index, "Location", key, "\r\n"));
       break;
     }
   }
@@ -285,7 +286,7 @@ static JSValue minnet_response_get(JSContext* ctx, JSValueConst this_val, int ma
 
     case RESPONSE_HEADERS: {
       ret = headers_object(ctx, resp->headers.start, resp->headers.end);
-      // ret = minnet_headers_wrap(ctx, &resp->headers, response_dup(resp), (HeadersFreeFunc*)&response_free);
+      // ret = minnet_headers_wrap(ctx, &resp->headers, &resp->header_index, response_dup(resp), (HeadersFreeFunc*)&response_free);
       break;
     }
 
@@ -300,6 +301,14 @@ static JSValue minnet_response_get(JSContext* ctx, JSValueConst this_val, int ma
         ret = minnet_generator_iterator(ctx, generator_dup(resp->body));
       break;
     }
+
+    /* hex, null until the whole body is in */
+    case RESPONSE_DIGEST: {
+      char hex[LWS_GENHASH_LARGEST * 2 + 1];
+
+      ret = resp->digest && digest_hex(resp->digest, hex) ? JS_NewString(ctx, hex) : JS_NULL;
+      break;
+    }
   }
 
   return ret;
@@ -348,6 +357,7 @@ static JSValue minnet_response_set(JSContext* ctx, JSValueConst this_val, JSValu
 
     case RESPONSE_HEADERS: {
       buffer_reset(&resp->headers);
+      headers_index_reset(&resp->header_index);
       headers_fromobj(&resp->headers, value, "\n", ": ", ctx);
       break;
     }
@@ -441,6 +451,7 @@ static const JSCFunctionListEntry minnet_response_proto_funcs[] = {
     JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, minnet_response_iterator),
     JS_CGETSET_MAGIC_FLAGS_DEF("body", minnet_response_get, minnet_response_set, RESPONSE_BODY, 0),
     JS_CGETSET_MAGIC_FLAGS_DEF("bodyUsed", minnet_response_get, 0, RESPONSE_BODYUSED, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_DEF("digest", minnet_response_get, 0, RESPONSE_DIGEST),
     JS_CGETSET_MAGIC_FLAGS_DEF("headers", minnet_response_get, minnet_response_set, RESPONSE_HEADERS, JS_PROP_ENUMERABLE),
     JS_CGETSET_MAGIC_DEF("headersSent", minnet_response_get, 0, RESPONSE_HEADERS_SENT),
     JS_CGETSET_MAGIC_DEF("ok", minnet_response_get, 0, RESPONSE_OK),
@@ -7,6 +7,7 @@
 #include <libwebsockets.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/types.h>
@@ -18,12 +19,18 @@
 #include "minnet-request.h"
 #include "minnet-response.h"
 #include "minnet-server.h"
+#include "minnet-server-static.h"
 #include "minnet-url.h"
 #include "minnet-websocket.h"
 #include "opaque.h"
 #include <quickjs.h>
 #include "utils.h"
 #include "buffer.h"
+#include "assets.h"
+
+/* bytes coalesced into one lws_write(), and how many queue items may go into it */
+#define HTTP_WRITE_MAX 65536
+#define HTTP_WRITE_IOV 64
 
 static int serve_generator(JSContext* ctx, struct session_data* session, struct lws* wsi, BOOL* done_p);
 
@@ -173,10 +180,16 @@ MinnetHttpMount* mount_new(JSContext* ctx, const char* mnt, const char* org, con
     m->mnt = js_strdup(ctx, mnt);
     m->org = org ? js_strdup(ctx, org) : 0;
     m->def = def ? js_strdup(ctx, def) : 0;
-    m->pro = pro ? pro : js_strdup(ctx, /*origin_proto == LWSMPRO_CALLBACK ? "http" :*/ "defprot");
+    m->pro = pro ? pro : js_strdup(ctx, origin_proto == LWSMPRO_FILE ? "http" : "defprot");
 
     m->lws.origin_protocol = origin_proto;
     m->lws.mountpoint_len = strlen(mnt);
+
+    /* lws hands requests for a directory to the "http" protocol, static_serve() answers them */
+    if(origin_proto == LWSMPRO_FILE) {
+      m->files = TRUE;
+      m->lws.origin_protocol = LWSMPRO_CALLBACK;
+    }
   }
 
   return m;
@@ -251,85 +264,77 @@ MinnetHttpMount* mount_fromobj(JSContext* ctx, JSValueConst obj, const char* key
   return ret;
 }
 
-MinnetHttpMount* mount_find(MinnetHttpMount* mounts, const char* x, size_t n) {
-  struct lws_http_mount *p, *m = 0;
-  int protocol = n == 0 ? LWSMPRO_CALLBACK : LWSMPRO_HTTP;
-  size_t l = 0;
+static MinnetHttpMount* mount_last(RouteNode* node) {
+  RouteEntry* e;
 
-  if(n == 0)
-    n = strlen(x);
+  if(!node)
+    return 0;
 
-  if(protocol == LWSMPRO_CALLBACK && x[0] == '/') {
-    x++;
-    n--;
-  }
+  for(e = node->entries; e->next; e = e->next) {}
 
-  for(p = (struct lws_http_mount*)mounts; p; p = (struct lws_http_mount*)p->mount_next) {
-    if(protocol != LWSMPRO_CALLBACK || p->origin_protocol == LWSMPRO_CALLBACK) {
-      const char* mnt = p->mountpoint;
-      size_t len = p->mountpoint_len;
+  return e->ptr;
+}
 
-      if(protocol == LWSMPRO_CALLBACK && mnt[0] == '/') {
-        mnt++;
-        len--;
-      }
+/**
+ * Compile the mount list into prefix trees, one over all mountpoints and one over the
+ * callback mounts with their leading '/' stripped. Entries keep the order of the list.
+ */
+void mount_index(MinnetMountIndex* index, MinnetHttpMount* mounts, JSContext* ctx) {
+  MinnetHttpMount* m;
 
-#ifdef DEBUG_OUTPUT
-      lwsl_user("DEBUG %-22s x='%.*s' '%.*s'", __func__, (int)n, x, (int)len, mnt);
-#endif
+  mount_index_clear(index, JS_GetRuntime(ctx));
 
-      if((len == n || (n > len && (x[len] == '/' || x[len] == '?'))) && !strncmp(x, mnt, n)) {
-        if(len >= l) {
-          m = p;
-          l = len;
-        }
-      }
+  for(m = mounts; m; m = m->next) {
+    const char* mnt = m->lws.mountpoint;
+    RouteEntry* e;
 
-      if(n >= len && len >= l && !strncmp(mnt, x, MIN(len, n))) {
-        m = p;
-        l = len;
-      }
-    }
-  }
+    if((e = route_add(&index->all, mnt, -1, FALSE, ctx)))
+      e->ptr = m;
 
-#ifdef DEBUG_OUTPUT
-  lwsl_user("DEBUG %-22s '%.*s' = %s", __func__, (int)n, x, m ? m->mountpoint : "0");
-  if(m) {
-    MinnetHttpMount* mm = (MinnetHttpMount*)m;
-    lwsl_user("DEBUG %-22s org=%s mnt=%s cb.ctx=%p", __func__, mm->org, mm->mnt, mm->callback.ctx);
+    if(m->lws.origin_protocol == LWSMPRO_CALLBACK && !m->files)
+      if((e = route_add(&index->callbacks, mnt + (mnt[0] == '/'), -1, FALSE, ctx)))
+        e->ptr = m;
   }
-#endif
+}
 
-  return (MinnetHttpMount*)m;
+void mount_index_clear(MinnetMountIndex* index, JSRuntime* rt) {
+  route_clear(&index->all, rt);
+  route_clear(&index->callbacks, rt);
 }
 
-MinnetHttpMount* mount_find_s(MinnetHttpMount* mounts, const char* x) {
-  struct lws_http_mount *p, *m = 0;
-  size_t n = strlen(x);
+/**
+ * Longest mountpoint which is a prefix of x[0..n), later mounts win a tie.
+ * With n == 0 only callback mounts are considered, compared without their leading '/'.
+ */
+MinnetHttpMount* mount_find(MinnetMountIndex* index, const char* x, size_t n) {
+  MinnetHttpMount* m;
+
+  if(n == 0) {
+    if(x[0] == '/')
+      x++;
 
-  for(p = (struct lws_http_mount*)mounts; p; p = (struct lws_http_mount*)p->mount_next) {
-    const char* mnt = p->mountpoint;
-    size_t len = p->mountpoint_len;
+    m = mount_last(route_prefix(&index->callbacks, x, strlen(x), 0));
+  } else {
+    m = mount_last(route_prefix(&index->all, x, n, 0));
+  }
 
 #ifdef DEBUG_OUTPUT
-    lwsl_user("DEBUG %-22s x='%.*s' '%.*s'", __func__, (int)n, x, (int)len, mnt);
+  lwsl_user("DEBUG %-22s '%s' = %s", __func__, x, m ? m->mnt : "0");
 #endif
 
-    if(len == n && !strncmp(x, mnt, n)) {
-      m = p;
-      break;
-    }
+  return m;
+}
 
-    if(len == 1 && mnt[0] == '/')
-      m = p;
+/**
+ * Longest mountpoint which is x or is followed in x by '/' or '?', else the "/" mount.
+ */
+MinnetHttpMount* mount_find_s(MinnetMountIndex* index, const char* x) {
+  RouteNode* node;
 
-    if((n > len && (x[len] == '/' || x[len] == '?')) && (len == 0 || !strncmp(x, mnt, len))) {
-      m = p;
-      break;
-    }
-  }
+  if(!(node = route_prefix(&index->all, x, strlen(x), "/?")))
+    node = route_prefix(&index->all, "/", 1, 0);
 
-  return (MinnetHttpMount*)m;
+  return node ? node->entries->ptr : 0;
 }
 
 void mount_free(JSContext* ctx, MinnetHttpMount const* m) {
@@ -344,6 +349,9 @@ void mount_free(JSContext* ctx, MinnetHttpMount const* m) {
   if(m->pro)
     js_free(ctx, (void*)m->pro);
 
+  if(m->cache)
+    asset_cache_free(m->cache);
+
   js_free(ctx, (void*)m);
 }
 
@@ -382,7 +390,7 @@ static JSValue serve_rejected(JSContext* ctx, JSValueConst this_val, int argc, J
 
   DBG("wait_resolve=%i error=%s", session->wait_resolve, error);
 
-  if((server = lws_context_user(lws_get_context(closure->wsi))))
+  if((server = lws_server(closure->wsi)))
     minnet_server_exception(server, JS_Throw(ctx, argv[0]));
 
   queue_write(&session->sendq, error, strlen(error), ctx);
@@ -452,7 +460,7 @@ static JSValue serve_resolved(JSContext* ctx, JSValueConst this_val, int argc, J
     }
 
     if(out.data) {
-      queue_write(&session->sendq, out.data, out.size, ctx);
+      queue_input(&session->sendq, &out, FALSE, ctx);
 
       session_want_write(session, closure->wsi);
     }
@@ -557,7 +565,7 @@ static int serve_generator(JSContext* ctx, struct session_data* session, struct
         if(js_buffer_from(ctx, &out, ret)) {
           DBG("out={ .data = '%.*s', .size = %zu }", (int)(out.size > 255 ? 255 : out.size), out.size > 255 ? &out.data[out.size - 255] : out.data, out.size);
 
-          queue_write(&session->sendq, out.data, out.size, ctx);
+          queue_input(&session->sendq, &out, FALSE, ctx);
         }
 
         js_buffer_free(&out, JS_GetRuntime(ctx));
@@ -619,22 +627,29 @@ static int serve_callback(JSCallback* cb, struct session_data* session, struct l
   return 0;
 }
 
-static BOOL has_transfer_encoding(MinnetRequest* req, const char* enc) {
-  const char* accept;
+BOOL has_transfer_encoding(MinnetRequest* req, const char* enc, JSContext* ctx) {
+  char* accept;
   size_t len, enclen = strlen(enc);
+  BOOL ret = FALSE;
 
-  if((accept = headers_getlen(&req->headers, &len, "accept-encoding", "\r\n", ":"))) {
+  if((accept = request_header(req, "accept-encoding", ctx))) {
     size_t toklen, pos;
 
+    len = strlen(accept);
+
     for(pos = 0; pos < len; (pos += toklen, pos += scan_charsetnskip(&accept[pos], ", ", len - pos))) {
       toklen = scan_noncharsetnskip(&accept[pos], ", ", len - pos);
 
-      if(toklen == enclen && !strncmp(&accept[pos], enc, toklen))
-        return TRUE;
+      if(toklen == enclen && !strncmp(&accept[pos], enc, toklen)) {
+        ret = TRUE;
+        break;
+      }
     }
+
+    js_free(ctx, accept);
   }
 
-  return FALSE;
+  return ret;
 }
 
 static int serve_response(struct lws* wsi, ByteBuffer* buf, MinnetResponse* resp, JSContext* ctx, struct session_data* session) {
@@ -654,7 +669,7 @@ static int serve_response(struct lws* wsi, ByteBuffer* buf, MinnetResponse* resp
     size_t len;
     char* loc;
 
-    if((loc = headers_getlen(&resp->headers, &len, "location", "\r\n", ":")))
+    if((loc = headers_getlen(&resp->headers, &resp->header_index, &len, "location", "\r\n", ":")))
 
       if(lws_http_redirect(wsi, resp->status, (const void*)loc, len, &buf->write, buf->end))
         return 1;
@@ -663,26 +678,37 @@ static int serve_response(struct lws* wsi, ByteBuffer* buf, MinnetResponse* resp
       return 1;
   }
 
-  for(const uint8_t *x = resp->headers.start, *end = resp->headers.write; x < end; x += headers_next(x, end, "\r\n")) {
-    size_t len, n;
-    len = headers_length(x, end, "\r\n");
-    n = headers_namelen(x, end);
+  if(!headers_index(&resp->header_index, &resp->headers))
+    return 1;
+
+  /* known names go by token, the others are terminated in place: nothing is allocated */
+  for(uint32_t i = 0; i < resp->header_index.count; i++) {
+    HeaderField* f = &resp->header_index.fields[i];
+    uint8_t *name = resp->headers.start + f->name, *value = resp->headers.start + f->value, tmp;
+    int ret;
 
-    if(n == 8 && !strncasecmp((const char*)x, "location", n))
+    if(f->namelen == 0 || f->value == f->name + f->namelen)
       continue;
 
-    if(len > n) {
-      char* prop = headers_name(x, end, ctx);
-      n = headers_value(x, end, ":");
+    if(f->namelen == 8 && !strncasecmp((const char*)name, "location", 8))
+      continue;
 
-      DBG("header=%s = value='%.*s'", prop, (int)(len - n), &x[n]);
-      if((lws_add_http_header_by_name(wsi, (const unsigned char*)prop, (const unsigned char*)&x[n], len - n, &buf->write, buf->end)))
-        JS_ThrowInternalError(ctx, "Adding header '%s' failed", prop);
-      js_free(ctx, (void*)prop);
+    DBG("header=%.*s = value='%.*s'", (int)f->namelen, name, (int)f->valuelen, value);
+
+    if(f->token != -1) {
+      ret = lws_add_http_header_by_token(wsi, (enum lws_token_indexes)f->token, value, f->valuelen, &buf->write, buf->end);
+    } else {
+      tmp = name[f->namelen];
+      name[f->namelen] = '\0';
+      ret = lws_add_http_header_by_name(wsi, name, value, f->valuelen, &buf->write, buf->end);
+      name[f->namelen] = tmp;
     }
+
+    if(ret)
+      JS_ThrowInternalError(ctx, "Adding header '%.*s' failed", (int)f->namelen, name);
   }
 
-  if(has_transfer_encoding(opaque->req, "deflate")) {
+  if(has_transfer_encoding(opaque->req, "deflate", ctx)) {
     if(!(byte_finds(buf->start, block_SIZE(buf), wsi_http2(wsi) ? "\020content-encoding" : "content-encoding") < block_SIZE(buf)))
       lws_http_compression_apply(wsi, "deflate", &buf->write, buf->end, 0);
   }
@@ -697,49 +723,109 @@ static int serve_response(struct lws* wsi, ByteBuffer* buf, MinnetResponse* resp
   return 0;
 }
 
+/* the Content-Length of the request, -1 when it has none */
+static int64_t http_content_length(struct lws* wsi) {
+  char buf[32];
+
+  if(lws_hdr_copy(wsi, buf, sizeof(buf), WSI_TOKEN_HTTP_CONTENT_LENGTH) <= 0)
+    return -1;
+
+  return strtoll(buf, 0, 10);
+}
+
+/**
+ * Answer the request with an error status instead of a handler. With h2 lws only queues
+ * the status, the stream stays until it's written. With h1 it's written right away and
+ * the connection closed, what's left of the body must not be taken for the next request.
+ */
+static int http_server_refuse(struct session_data* session, struct lws* wsi, unsigned int status) {
+  session->refused = TRUE;
+  session->response_sent = TRUE;
+
+  if(lws_return_http_status(wsi, status, 0))
+    return -1;
+
+  return wsi_http2(wsi) ? lws_http_transaction_completed(wsi) : -1;
+}
+
+/* the transaction is over, the request keeps a copy of what's still to be read only when it was handed to JS */
+static void http_server_detach(struct session_data* session, struct wsi_opaque_user_data* opaque, JSRuntime* rt) {
+  Request* req;
+
+  if(!opaque || !(req = opaque->req))
+    return;
+
+  request_detach(req, req->exposed, session->context->js);
+
+  /* the next request on this connection gets its own */
+  opaque->req = 0;
+  request_free(req, rt);
+}
+
+/**
+ * Write as much of the queue as fits one frame: the items up front are coalesced into a
+ * single lws_write(), a lone item is written in place using its LWS_PRE headroom. Nothing
+ * here is pinned, lws may put chunk or h2 frame headers in front of the data.
+ */
 static int http_server_writeable(struct session_data* session, struct lws* wsi, BOOL done) {
-  enum lws_write_protocol n, wp = -1;
-  size_t remain = 0;
+  struct iovec iov[HTTP_WRITE_IOV];
+  size_t len = 0, max = HTTP_WRITE_MAX;
   Queue* q = session_queue(session);
-  size_t qsize = queue_bytes(q);
+  int n;
+
+  /* h2 DATA frames stay within the default frame size and the peer's window */
+  if(wsi_http2(wsi)) {
+    lws_fileofs_t allowance = lws_get_peer_write_allowance(wsi);
 
-  DBG("callback=%" PRIu32 " generator=%d qsize=%zu done=%d", session->callback_count, resp->body != NULL, qsize, done);
+    max = HTTP2_WRITE_MAX;
 
-  n = done ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP;
+    if(allowance >= 0 && (size_t)allowance < max)
+      max = allowance;
+  }
 
-  if(qsize) {
-    ByteBlock buf;
-    size_t pos = 0;
-    BOOL binary = FALSE;
+  DBG("callback=%" PRIu32 " qsize=%zu done=%d", session->callback_count, queue_bytes(q), done);
 
-    buf = queue_next(q, &done, &binary);
+  if((n = queue_gather(q, iov, countof(iov), max, &len, 0)) > 0) {
+    enum lws_write_protocol wp;
+    ByteBlock tmp = BLOCK_0();
+    uint8_t* x = iov[0].iov_base;
+    int ret;
 
-    while((remain = block_SIZE(&buf) - pos) > 0) {
+    if(n > 1) {
+      if(!(x = block_alloc(&tmp, len)))
+        return -1;
 
-      uint8_t* x = block_BEGIN(&buf) + pos;
-      size_t l = wsi_http2(wsi) ? (remain > 1024 ? 1024 : remain) : remain;
+      for(int i = 0, pos = 0; i < n; pos += iov[i++].iov_len)
+        memcpy(x + pos, iov[i].iov_base, iov[i].iov_len);
+    }
 
-      if(l > 0) {
-        wp = queue_complete(q) && remain == l ? LWS_WRITE_HTTP_FINAL : n;
-        int ret = lws_write(wsi, x, l, wp);
+    wp = queue_complete(q) && len == queue_bytes(q) ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP;
+    ret = lws_write(wsi, x, len, wp);
 
-        assert(ret == l);
-        DBG("len=%zu final=%d ret=%zd data='%.*s'", l, wp == LWS_WRITE_HTTP_FINAL, ret, (int)(l > 32 ? 32 : l), x);
+    DBG("len=%zu iovecs=%d final=%d ret=%d", len, n, wp == LWS_WRITE_HTTP_FINAL, ret);
 
-        remain -= l;
-        pos += l;
-      }
-    }
+    block_free(&tmp);
 
-    block_free(&buf);
-  } else {
+    if(ret < 0)
+      return -1;
+
+    queue_consume(q, len);
+
+    if(queue_bytes(q))
+      session_want_write(session, wsi);
+  } else if(!queue_bytes(q)) {
     done = TRUE;
+  } else {
+    /* no window left, lws calls back when the peer grants more */
+    session_want_write(session, wsi);
   }
 
-  DBG("done=%i remain=%zu closed=%d", done, remain, queue_closed(q));
+  DBG("done=%i closed=%d", done, queue_closed(q));
 
-  if(done || queue_closed(q))
+  if(done || queue_closed(q)) {
+    http_server_detach(session, lws_get_opaque_user_data(wsi), JS_GetRuntime(session->context->js));
     return lws_http_transaction_completed(wsi);
+  }
 
   return 0;
 }
@@ -747,7 +833,7 @@ static int http_server_writeable(struct session_data* session, struct lws* wsi,
 int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
   int ret = 0;
   uint8_t buf[LWS_PRE + LWS_RECOMMENDED_MIN_HEADER_SPACE];
-  MinnetServer* server = lws_context_user(lws_get_context(wsi));
+  MinnetServer* server = lws_server(wsi);
   struct session_data* session = user;
   JSContext* ctx = server ? server->context.js : 0;
   struct wsi_opaque_user_data* opaque = lws_get_opaque_user_data(wsi);
@@ -820,7 +906,7 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
       break;
 
     case LWS_CALLBACK_FILTER_HTTP_CONNECTION: {
-      if((session->mount = mount_find((MinnetHttpMount*)server->context.info.mounts, in, len)))
+      if((session->mount = mount_find(&server->mounts, in, len)))
         if(mount_is_proxy(session->mount))
           lws_hdr_simple_create(wsi, wsi_http2(wsi) ? WSI_TOKEN_HTTP_COLON_AUTHORITY : WSI_TOKEN_HOST, "");
 
@@ -842,7 +928,7 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
     }
 
     case LWS_CALLBACK_HTTP_BIND_PROTOCOL: {
-      session_init(session, wsi_context(wsi));
+      session_init(session, &server->context);
 
       opaque->status = OPEN;
 
@@ -858,18 +944,42 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
 
     case LWS_CALLBACK_HTTP_BODY: {
       MinnetRequest* req = opaque->req;
+
+      if(session->refused)
+        return 0;
+
       session->in_body = TRUE;
+      session->body_size += len;
+
+      if(server->max_body_size && session->body_size > server->max_body_size) {
+        return http_server_refuse(session, wsi, HTTP_STATUS_REQ_ENTITY_TOO_LARGE);
+      }
+
+      /* the request may be gone already, when the response was finished before its body */
+      if(req && server->digest && !req->digest)
+        req->digest = digest_new(server->digest);
 
       if(len) {
+        /* hashed on the way through, verifying the body costs no second pass */
+        if(req && req->digest)
+          digest_update(req->digest, in, len);
+
         if(opaque->form_parser) {
-          formparser_process(opaque->form_parser, in, len);
-        } else {
+          /* a saveTo parser stops at the first part over its limits, don't wait for the rest */
+          if(formparser_process(opaque->form_parser, in, len) < 0 && opaque->form_parser->status) {
+            return http_server_refuse(session, wsi, opaque->form_parser->status);
+          }
+        } else if(req) {
           if(!req->body)
             req->body = generator_new(ctx);
 
           if(!req->body->q || !req->body->q->continuous)
             generator_continuous(req->body, JS_NULL);
 
+          /* a handler reading the body slower than it arrives pauses the connection */
+          if(server->high_water && !req->body->flow.fn)
+            request_flow(req, server->high_water);
+
           generator_write(req->body, in, len, JS_UNDEFINED);
         }
       }
@@ -888,12 +998,27 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
       MinnetFormParser* fp;
       JSCallback* cb;
       MinnetRequest* req = opaque->req;
-      Generator* gen = req->body;
+      Generator* gen = req ? req->body : 0;
+
+      if(session->refused)
+        return 0;
 
       session->in_body = FALSE;
 
       LOGCB("HTTP(2)", "%slen: %zu", wsi_http2(wsi) ? "h2, " : "", len);
 
+      if(req) {
+        if(server->digest && !req->digest)
+          req->digest = digest_new(server->digest);
+
+        if(req->digest)
+          digest_final(req->digest);
+      }
+
+      /* the connection may carry another request */
+      if(req)
+        request_flow(req, 0);
+
       if((fp = opaque->form_parser)) {
         lws_spa_finalize(fp->spa);
 
@@ -937,12 +1062,23 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
       MinnetRequest* req = opaque->req ? opaque->req : (opaque->req = request_fromwsi(wsi, ctx));
       char* path = in;
       size_t mountpoint_len = 0, pathlen = 0;
-      MinnetHttpMount *mounts, *mount;
+      MinnetMountIndex* mounts = &server->mounts;
+      MinnetHttpMount* mount;
       JSCallback* cb;
 
       assert(req);
       assert(req->url.path);
 
+      WORKER_STATS_ADD(server->stats, requests, 1);
+
+      session->body_size = 0;
+      session->refused = FALSE;
+
+      /* a body announced too large is refused before any of it is read */
+      if(server->max_body_size && http_content_length(wsi) > (int64_t)server->max_body_size) {
+        return http_server_refuse(session, wsi, HTTP_STATUS_REQ_ENTITY_TOO_LARGE);
+      }
+
       pathlen = req->url.path ? strlen(req->url.path) : 0;
 
       if(req->url.path && in && len < pathlen)
@@ -950,11 +1086,6 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
 
       LOGCB("HTTP(2)", "mountpoint='%.*s' path='%s'", (int)mountpoint_len, req->url.path, path);
 
-      if(!opaque->req->headers.write)
-        headers_tobuffer(ctx, &opaque->req->headers, wsi);
-
-      mounts = (MinnetHttpMount*)server->context.info.mounts;
-
       if(!session->mount && path)
         session->mount = mount_find(mounts, path, 0);
 
@@ -994,6 +1125,10 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
                 })[(uintptr_t)mount->lws.origin_protocol]);
         }
 
+        /* files are answered without making JS objects */
+        if(mount->files)
+          return static_serve(wsi, session, mount, req->url.path);
+
         session->req_obj = minnet_request_wrap(ctx, opaque->req);
 
         if(!JS_IsObject(session->ws_obj))
@@ -1008,30 +1143,13 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
         if(mount && !mount->callback.ctx)
           cb = 0;
 
-        if(mount && mount->lws.origin_protocol == LWSMPRO_FILE) {
-          if(!JS_IsObject(session->resp_obj))
-            session->resp_obj = minnet_response_new(ctx, req->url, 200, 0, TRUE, "text/html");
-
-          opaque->resp = minnet_response_data2(ctx, session->resp_obj);
-
-          if(*path == '\0' && mount->def) {
-            response_redirect(opaque->resp, HTTP_STATUS_MOVED_PERMANENTLY, mount->def);
-            session_want_write(session, wsi);
-            lws_set_timeout(wsi, PENDING_TIMEOUT_USER_REASON_BASE, 30);
-          } else {
-            mount = mount_find_s(mounts, "/404.html");
-
-            cb = &mount->callback;
-          }
-        }
-
         if(mount && mount->lws.origin_protocol == LWSMPRO_CALLBACK) {
           if(cb && cb->ctx)
             ret = serve_callback(cb, session, wsi);
         }
       }
 
-      if(callback_valid(&server->on.http)) {
+      if(callback_valid(&server->on.http) || !route_empty(&server->routes)) {
         cb = &server->on.http;
 
         if(!JS_IsObject(session->ws_obj) && opaque->ws)
@@ -1039,7 +1157,9 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
 
         session->req_obj = minnet_request_wrap(ctx, opaque->req);
 
-        minnet_server_exception(server, callback_emit_this(cb, session->ws_obj, 2, &session->req_obj));
+        /* onRequest goes first, returning 1 ends it before the get()/post()/use() handlers */
+        if(!callback_valid(cb) || minnet_server_exception(server, callback_emit_this(cb, session->ws_obj, 2, &session->req_obj)) != 1)
+          minnet_server_route(server, &session->req_obj);
       }
 
       return ret;
@@ -1121,6 +1241,8 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
     }
 
     case LWS_CALLBACK_HTTP_DROP_PROTOCOL: {
+      if(session && ctx)
+        http_server_detach(session, opaque, JS_GetRuntime(ctx));
       break;
     }
 
@@ -1129,6 +1251,8 @@ int minnet_http_server_callback(struct lws* wsi, enum lws_callback_reasons reaso
     }
 
     case LWS_CALLBACK_CLOSED_HTTP: {
+      if(session && ctx)
+        http_server_detach(session, opaque, JS_GetRuntime(ctx));
       return -1;
     }
 
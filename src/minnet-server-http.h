@@ -4,8 +4,13 @@
 #include <quickjs.h>
 #include "minnet.h"
 #include "session.h"
+#include "route.h"
+
+/* h2 DATA frames stay within the default SETTINGS_MAX_FRAME_SIZE */
+#define HTTP2_WRITE_MAX 16384
 
 struct http_request;
+struct asset_cache;
 struct http_response;
 
 typedef union http_vhost_options {
@@ -27,8 +32,16 @@ typedef struct http_mount {
     struct lws_http_mount lws;
   };
   JSCallback callback;
+  BOOL files;      /* a directory served by static_serve(), to lws it's a callback mount */
+  uint64_t served; /* bytes sent from the directory */
+  struct asset_cache* cache;
 } MinnetHttpMount;
 
+/* the mounts by mountpoint, compiled when the server starts listening */
+typedef struct http_mount_index {
+  RouteTable all, callbacks;
+} MinnetMountIndex;
+
 MinnetVhostOptions* vhost_options_create(JSContext*, const char*, const char*);
 MinnetVhostOptions* vhost_options_new(JSContext*, JSValue);
 MinnetVhostOptions* vhost_options_fromobj(JSContext* ctx, JSValueConst obj);
@@ -38,11 +51,14 @@ void vhost_options_free_list(JSContext*, MinnetVhostOptions*);
 void vhost_options_free(JSContext*, MinnetVhostOptions*);
 MinnetHttpMount* mount_new(JSContext*, const char*, const char*, const char* def, const char* pro);
 MinnetHttpMount* mount_fromobj(JSContext*, JSValue, const char*);
-struct http_mount* mount_find(MinnetHttpMount*, const char*, size_t);
-struct http_mount* mount_find_s(MinnetHttpMount*, const char*);
+void mount_index(MinnetMountIndex*, MinnetHttpMount*, JSContext*);
+void mount_index_clear(MinnetMountIndex*, JSRuntime*);
+struct http_mount* mount_find(MinnetMountIndex*, const char*, size_t);
+struct http_mount* mount_find_s(MinnetMountIndex*, const char*);
 void mount_fromvalue(JSContext* ctx, MinnetHttpMount** m, JSValueConst opt_mounts);
 void mount_free(JSContext*, MinnetHttpMount const*);
 BOOL mount_is_proxy(MinnetHttpMount const* m);
+BOOL has_transfer_encoding(struct http_request*, const char*, JSContext*);
 int minnet_http_server_callback(struct lws*, enum lws_callback_reasons, void*, void* in, size_t len);
 
 #endif /* MINNET_SERVER_HTTP_H */
@@ -0,0 +1,479 @@
+#include "minnet-server-static.h"
+#include "minnet-server.h"
+#include "lws-utils.h"
+#include "session.h"
+#include "opaque.h"
+#include "assets.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#define STATIC_SENDFILE 1
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define STATIC_CHUNK 16384
+#define STATIC_SENDFILE_MAX (1 << 20)
+
+/* the file below the mount's directory, 0 when path tries to leave it */
+static size_t static_filename(char* buf, size_t size, MinnetHttpMount* mount, const char* path) {
+  const char *org = mount->org, *s;
+  size_t n, len = strcspn(path, "?");
+
+  if(!strncmp(org, "file://", 7))
+    org += 7;
+
+  for(s = path; (s = strstr(s, "..")) && s < path + len; s += 2)
+    if((s == path || s[-1] == '/') && (s + 2 == path + len || s[2] == '/'))
+      return 0;
+
+  while(len > 0 && *path == '/') {
+    ++path;
+    --len;
+  }
+
+  if((n = snprintf(buf, size, "%s/%.*s", org, (int)len, path)) >= size)
+    return 0;
+
+  if(len == 0 || path[len - 1] == '/')
+    if((n += snprintf(buf + n, size - n, "%s", mount->def ? mount->def : "index.html")) >= size)
+      return 0;
+
+  return n;
+}
+
+/* weak, derived from what changes when the file does, each encoding has its own */
+static size_t static_etag(char* buf, size_t size, const struct stat* st, AssetEncoding enc) {
+  static const char* const suffixes[ASSET_ENCODINGS] = {"", "-gz", "-br"};
+
+  return snprintf(buf, size, "W/\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "%s\"", (uint64_t)st->st_ino, (uint64_t)st->st_mtime, (uint64_t)st->st_size, suffixes[enc]);
+}
+
+/* text compresses, most everything else is compressed already */
+static BOOL static_compressible(const char* mimetype) {
+  static const char* const types[] = {"text/", "application/javascript", "application/json", "application/xml", "image/svg+xml", "application/wasm"};
+
+  for(size_t i = 0; i < countof(types); i++)
+    if(!strncmp(mimetype, types[i], strlen(types[i])))
+      return TRUE;
+
+  return FALSE;
+}
+
+/* weak comparison against the entity tags of If-None-Match */
+static BOOL static_etag_match(const char* list, const char* etag) {
+  const char* tag = etag + 2;
+  size_t n, taglen = strlen(tag);
+
+  for(;;) {
+    list += strspn(list, " \t,");
+
+    if(!*list)
+      return FALSE;
+
+    if(*list == '*')
+      return TRUE;
+
+    if(!strncmp(list, "W/", 2))
+      list += 2;
+
+    for(n = strcspn(list, ","); n > 0 && (list[n - 1] == ' ' || list[n - 1] == '\t'); n--) {}
+
+    if(n == taglen && !memcmp(list, tag, n))
+      return TRUE;
+
+    list += strcspn(list, ",");
+  }
+}
+
+/**
+ * Parse a single "bytes=first-last" or "bytes=-suffix" range.
+ * Returns 0 when there's none to honour, then the whole file is sent, -1 when it can't be satisfied.
+ */
+static int static_range(const char* spec, off_t size, off_t* first, off_t* last) {
+  unsigned long long a, b;
+  char* e;
+
+  if(strncmp(spec, "bytes=", 6))
+    return 0;
+
+  spec += 6;
+
+  /* several ranges get the whole file */
+  if(strchr(spec, ','))
+    return 0;
+
+  if(*spec == '-') {
+    a = strtoull(spec + 1, &e, 10);
+
+    if(e == spec + 1 || *e)
+      return 0;
+
+    if(a == 0 || size == 0)
+      return -1;
+
+    *first = (off_t)a >= size ? 0 : size - (off_t)a;
+    *last = size - 1;
+    return 1;
+  }
+
+  a = strtoull(spec, &e, 10);
+
+  if(e == spec || *e != '-')
+    return 0;
+
+  spec = e + 1;
+  b = size - 1;
+
+  if(*spec) {
+    b = strtoull(spec, &e, 10);
+
+    if(*e || b < a)
+      return 0;
+  }
+
+  if((off_t)a >= size)
+    return -1;
+
+  *first = a;
+  *last = (off_t)b >= size ? size - 1 : (off_t)b;
+  return 1;
+}
+
+void static_free(MinnetStaticFile* sf) {
+  if(sf->fd != -1)
+    close(sf->fd);
+
+  if(sf->asset)
+    asset_free(sf->asset);
+
+  free(sf);
+}
+
+static void static_done(struct session_data* session) {
+  if(session->file) {
+    static_free(session->file);
+    session->file = 0;
+  }
+
+  session->callback = 0;
+}
+
+/**
+ * Answer a GET or HEAD for a file mount, with 304 on a matching If-None-Match or
+ * If-Modified-Since and 206 on a single Range. Nothing runs in JS unless there's an
+ * onCheckAccessRights handler. With the server's cache option, files come from the
+ * mount's AssetCache in the best encoding Accept-Encoding allows.
+ * The body is sent from static_callback().
+ */
+int static_serve(struct lws* wsi, struct session_data* session, MinnetHttpMount* mount, const char* path) {
+  static const char* const encodings[ASSET_ENCODINGS] = {0, "gzip", "br"};
+  uint8_t buf[LWS_PRE + LWS_RECOMMENDED_MIN_HEADER_SPACE], *start = &buf[LWS_PRE], *p = start, *end = &buf[sizeof(buf) - 1];
+  char file[PATH_MAX], etag[80], hdr[256];
+  MinnetServer* server = lws_server(wsi);
+  struct wsi_opaque_user_data* opaque = lws_get_opaque_user_data(wsi);
+  HTTPMethod method = wsi_method(wsi);
+  size_t mlen = strlen(mount->mnt);
+  AssetEncoding enc = ASSET_IDENTITY;
+  Asset* asset = 0;
+  const char* mimetype;
+  MinnetStaticFile* sf;
+  struct stat st;
+  off_t size, first = 0, last = -1;
+  int n, fd = -1, status = HTTP_STATUS_OK;
+
+  if(method != METHOD_GET && method != METHOD_HEAD) {
+    status = HTTP_STATUS_METHOD_NOT_ALLOWED;
+    goto error;
+  }
+
+  if(!static_filename(file, sizeof(file), mount, strncmp(path, mount->mnt, mlen) ? path : path + mlen)) {
+    status = HTTP_STATUS_FORBIDDEN;
+    goto error;
+  }
+
+  if(!mount->cache && server->cache_limit)
+    mount->cache = asset_cache_new(server->cache_limit);
+
+  if(mount->cache && (asset = asset_cache_get(mount->cache, file))) {
+    st = asset->st;
+  } else if((fd = open(file, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1) {
+    status = errno == EACCES ? HTTP_STATUS_FORBIDDEN : HTTP_STATUS_NOT_FOUND;
+    goto error;
+  }
+
+  /* a directory without the trailing slash, relative links in its index need it */
+  if(S_ISDIR(st.st_mode)) {
+    close(fd);
+
+    n = snprintf(hdr, sizeof(hdr), "%.*s/", (int)strcspn(path, "?"), path);
+
+    if(n >= (int)sizeof(hdr) || lws_http_redirect(wsi, HTTP_STATUS_MOVED_PERMANENTLY, (const unsigned char*)hdr, n, &p, end) < 0)
+      return -1;
+
+    return lws_http_transaction_completed(wsi);
+  }
+
+  if(!S_ISREG(st.st_mode)) {
+    status = HTTP_STATUS_NOT_FOUND;
+    goto error;
+  }
+
+  if(callback_valid(&server->on.check_access_rights)) {
+    struct lws_process_html_args pa = {.p = file, .len = strlen(file)};
+
+    if(minnet_http_server_callback(wsi, LWS_CALLBACK_CHECK_ACCESS_RIGHTS, session, &pa, 0)) {
+      status = HTTP_STATUS_FORBIDDEN;
+      goto error;
+    }
+  }
+
+  if(!(mimetype = lws_get_mimetype(file, &mount->lws)))
+    mimetype = "application/octet-stream";
+
+  if(!asset && mount->cache)
+    if((asset = asset_cache_put(mount->cache, file, fd, &st, static_compressible(mimetype)))) {
+      close(fd);
+      fd = -1;
+    }
+
+  if(asset && opaque && opaque->req) {
+    JSContext* ctx = server->context.js;
+
+    if(asset->variant[ASSET_BR].data && has_transfer_encoding(opaque->req, "br", ctx))
+      enc = ASSET_BR;
+    else if(asset->variant[ASSET_GZIP].data && has_transfer_encoding(opaque->req, "gzip", ctx))
+      enc = ASSET_GZIP;
+  }
+
+  size = asset ? (off_t)asset->variant[enc].size : st.st_size;
+  static_etag(etag, sizeof(etag), &st, enc);
+
+  if(lws_hdr_copy(wsi, hdr, sizeof(hdr), WSI_TOKEN_HTTP_IF_NONE_MATCH) > 0) {
+    if(static_etag_match(hdr, etag))
+      status = HTTP_STATUS_NOT_MODIFIED;
+  } else if(lws_hdr_copy(wsi, hdr, sizeof(hdr), WSI_TOKEN_HTTP_IF_MODIFIED_SINCE) > 0) {
+    time_t t;
+
+    if(!lws_http_date_parse_unix(hdr, strlen(hdr), &t) && st.st_mtime <= t)
+      status = HTTP_STATUS_NOT_MODIFIED;
+  }
+
+  /* the validator of If-Range would have to compare strong, ours is weak */
+  if(status == HTTP_STATUS_OK && !wsi_token_exists(wsi, WSI_TOKEN_HTTP_IF_RANGE) && lws_hdr_copy(wsi, hdr, sizeof(hdr), WSI_TOKEN_HTTP_RANGE) > 0) {
+    switch(static_range(hdr, size, &first, &last)) {
+      case 1: status = HTTP_STATUS_PARTIAL_CONTENT; break;
+      case -1: status = HTTP_STATUS_REQ_RANGE_NOT_SATISFIABLE; break;
+    }
+  }
+
+  if(status == HTTP_STATUS_OK) {
+    first = 0;
+    last = size - 1;
+  } else if(status != HTTP_STATUS_PARTIAL_CONTENT) {
+    first = 0;
+    last = -1;
+  }
+
+  /* a 304 has no body, a Content-Length of 0 would describe the representation as empty */
+  if(lws_add_http_common_headers(wsi,
+                                 status,
+                                 status == HTTP_STATUS_NOT_MODIFIED ? NULL : mimetype,
+                                 status == HTTP_STATUS_NOT_MODIFIED ? LWS_ILLEGAL_HTTP_CONTENT_LEN : (lws_filepos_t)(last + 1 - first),
+                                 &p,
+                                 end))
+    goto fail;
+
+  if(lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_ETAG, (const unsigned char*)etag, strlen(etag), &p, end))
+    goto fail;
+
+  if(!lws_http_date_render_from_unix(hdr, sizeof(hdr), &st.st_mtime))
+    if(lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_LAST_MODIFIED, (const unsigned char*)hdr, strlen(hdr), &p, end))
+      goto fail;
+
+  if(lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_ACCEPT_RANGES, (const unsigned char*)"bytes", 5, &p, end))
+    goto fail;
+
+  if(asset && (asset->variant[ASSET_GZIP].data || asset->variant[ASSET_BR].data))
+    if(lws_add_http_header_by_name(wsi, (const unsigned char*)"vary:", (const unsigned char*)"accept-encoding", 15, &p, end))
+      goto fail;
+
+  if(enc != ASSET_IDENTITY)
+    if(lws_add_http_header_by_name(wsi, (const unsigned char*)"content-encoding:", (const unsigned char*)encodings[enc], strlen(encodings[enc]), &p, end))
+      goto fail;
+
+  if(status == HTTP_STATUS_PARTIAL_CONTENT || status == HTTP_STATUS_REQ_RANGE_NOT_SATISFIABLE) {
+    if(status == HTTP_STATUS_PARTIAL_CONTENT)
+      n = snprintf(hdr, sizeof(hdr), "bytes %" PRId64 "-%" PRId64 "/%" PRId64, (int64_t)first, (int64_t)last, (int64_t)size);
+    else
+      n = snprintf(hdr, sizeof(hdr), "bytes */%" PRId64, (int64_t)size);
+
+    if(lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_CONTENT_RANGE, (const unsigned char*)hdr, n, &p, end))
+      goto fail;
+  }
+
+  if(lws_finalize_write_http_header(wsi, start, &p, end))
+    goto fail;
+
+  if(method == METHOD_HEAD || last < first) {
+    if(fd != -1)
+      close(fd);
+
+    return lws_http_transaction_completed(wsi);
+  }
+
+  if(!(sf = malloc(sizeof(MinnetStaticFile))))
+    goto fail;
+
+  sf->fd = fd;
+  sf->asset = asset ? asset_dup(asset) : 0;
+  sf->data = asset ? asset->variant[enc].data : 0;
+  sf->offset = first;
+  sf->remain = last + 1 - first;
+  sf->mount = mount;
+  sf->direct = !wsi_tls(wsi) && !wsi_http2(wsi);
+#ifndef STATIC_SENDFILE
+  /* without sendfile() only what's in memory goes to the socket directly */
+  sf->direct = sf->direct && asset;
+#endif
+
+  session->file = sf;
+  session->callback = static_callback;
+
+  lws_callback_on_writable(wsi);
+  return 0;
+
+error:
+  if(fd != -1)
+    close(fd);
+
+  if(lws_return_http_status(wsi, status, NULL))
+    return -1;
+
+  return lws_http_transaction_completed(wsi);
+
+fail:
+  if(fd != -1)
+    close(fd);
+
+  return -1;
+}
+
+static int static_writeable(struct lws* wsi, struct session_data* session) {
+  MinnetStaticFile* sf = session->file;
+  ssize_t n = -1;
+
+  if(sf->direct) {
+    /* what lws still holds of the headers goes out first */
+    if(lws_partial_buffered(wsi)) {
+      lws_callback_on_writable(wsi);
+      return 0;
+    }
+
+    if(sf->data) {
+      if((n = send(lws_get_socket_fd(wsi), sf->data + sf->offset, MIN(sf->remain, STATIC_SENDFILE_MAX), MSG_NOSIGNAL)) > 0)
+        sf->offset += n;
+    }
+#ifdef STATIC_SENDFILE
+    else {
+      n = sendfile(lws_get_socket_fd(wsi), sf->fd, &sf->offset, MIN(sf->remain, STATIC_SENDFILE_MAX));
+    }
+#endif
+
+    if(n == -1 && (errno == EAGAIN || errno == EINTR)) {
+      lws_callback_on_writable(wsi);
+      return 0;
+    }
+  } else {
+    uint8_t buf[LWS_PRE + STATIC_CHUNK];
+    size_t len = STATIC_CHUNK;
+
+    /* h2 DATA frames stay within the default frame size and the peer's window, like http_server_writeable() */
+    if(wsi_http2(wsi)) {
+      lws_fileofs_t allowance = lws_get_peer_write_allowance(wsi);
+
+      len = MIN(len, HTTP2_WRITE_MAX);
+
+      if(allowance >= 0 && (size_t)allowance < len)
+        len = allowance;
+
+      /* the window opens again with the peer's WINDOW_UPDATE */
+      if(len == 0) {
+        lws_callback_on_writable(wsi);
+        return 0;
+      }
+    }
+
+    len = MIN(sf->remain, len);
+
+    /* lws_write() needs LWS_PRE bytes in front it may write to, the cached data has none */
+    if(sf->data)
+      memcpy(&buf[LWS_PRE], sf->data + sf->offset, (n = len));
+    else
+      n = pread(sf->fd, &buf[LWS_PRE], len, sf->offset);
+
+    if(n > 0) {
+      if(lws_write(wsi, &buf[LWS_PRE], n, n == sf->remain ? LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP) < 0)
+        n = -1;
+      else
+        sf->offset += n;
+    }
+  }
+
+  /* a file which shrank since the headers went out can't be completed either */
+  if(n <= 0) {
+    static_done(session);
+    return -1;
+  }
+
+  sf->remain -= n;
+  __atomic_add_fetch(&sf->mount->served, n, __ATOMIC_RELAXED);
+
+  if(sf->remain > 0) {
+    lws_callback_on_writable(wsi);
+    return 0;
+  }
+
+  static_done(session);
+  return lws_http_transaction_completed(wsi);
+}
+
+/* installed as session->callback while a body is sent, everything else goes on to the HTTP callback */
+int static_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
+  struct session_data* session = user;
+
+  switch(reason) {
+    case LWS_CALLBACK_HTTP_WRITEABLE: {
+      return static_writeable(wsi, session);
+    }
+
+    case LWS_CALLBACK_HTTP_DROP_PROTOCOL:
+    case LWS_CALLBACK_CLOSED_HTTP:
+    case LWS_CALLBACK_WSI_DESTROY: {
+      static_done(session);
+      break;
+    }
+
+    default: {
+      int ret;
+
+      session->callback = 0;
+      ret = minnet_http_server_callback(wsi, reason, user, in, len);
+      session->callback = static_callback;
+      return ret;
+    }
+  }
+
+  return minnet_http_server_callback(wsi, reason, user, in, len);
+}
@@ -0,0 +1,22 @@
+#ifndef MINNET_SERVER_STATIC_H
+#define MINNET_SERVER_STATIC_H
+
+#include <sys/types.h>
+#include "minnet.h"
+#include "minnet-server-http.h"
+
+/* the body of a file being sent, while it's there the session's callbacks go to static_callback() */
+typedef struct static_file {
+  int fd; /* -1 when sent from the cache */
+  struct asset* asset;
+  const uint8_t* data; /* the cached variant being sent */
+  off_t offset, remain;
+  MinnetHttpMount* mount;
+  BOOL direct; /* sendfile() or send() to the socket, no TLS or HTTP/2 framing in between */
+} MinnetStaticFile;
+
+int static_serve(struct lws*, struct session_data*, MinnetHttpMount*, const char* path);
+int static_callback(struct lws*, enum lws_callback_reasons, void*, void* in, size_t len);
+void static_free(MinnetStaticFile*);
+
+#endif /* MINNET_SERVER_STATIC_H */
@@ -0,0 +1,164 @@
+#include "minnet-server-supervisor.h"
+#include "js-utils.h"
+#include <libwebsockets.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+MinnetServerSupervisor* supervisor_new(JSContext* ctx, uint32_t count) {
+  MinnetServerSupervisor* sup;
+  void* mem;
+
+  if(!(sup = js_mallocz(ctx, sizeof(MinnetServerSupervisor))))
+    return 0;
+
+  /* mapped before fork(), so the workers write to the very same pages the supervisor reads */
+  if((mem = mmap(0, sizeof(MinnetWorkerStats) * count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+    lwsl_err("mmap() error: %s\n", strerror(errno));
+    js_free(ctx, sup);
+    return 0;
+  }
+
+  sup->count = count;
+  sup->workers = mem;
+  return sup;
+}
+
+void supervisor_free(MinnetServerSupervisor* sup, JSRuntime* rt) {
+  munmap(sup->workers, sizeof(MinnetWorkerStats) * sup->count);
+  js_free_rt(rt, sup);
+}
+
+void supervisor_stop(MinnetServerSupervisor* sup) {
+  uint32_t i;
+
+  for(i = 0; i < sup->count; i++)
+    if(sup->workers[i].pid > 0)
+      kill(sup->workers[i].pid, SIGTERM);
+
+  for(i = 0; i < sup->count; i++)
+    if(sup->workers[i].pid > 0) {
+      waitpid(sup->workers[i].pid, 0, 0);
+      sup->workers[i].pid = 0;
+    }
+}
+
+/* in a worker: keep only its own slot of the shared mapping */
+MinnetWorkerStats* supervisor_detach(MinnetServerSupervisor* sup, uint32_t index, JSRuntime* rt) {
+  MinnetWorkerStats* ret = &sup->workers[index];
+
+  js_free_rt(rt, sup);
+  return ret;
+}
+
+/**
+ * Fork the worker for the slot at index
+ *
+ * @return 0 in the worker, its pid in the supervisor or -1 on error
+ */
+pid_t supervisor_spawn(MinnetServerSupervisor* sup, uint32_t index) {
+  MinnetWorkerStats* w = &sup->workers[index];
+  pid_t pid;
+
+  if((pid = fork()) == -1) {
+    lwsl_err("fork() error: %s\n", strerror(errno));
+    w->pid = 0;
+    return -1;
+  }
+
+  if(pid == 0) {
+    w->pid = getpid();
+    w->started = time(0);
+    w->active = 0;
+    return 0;
+  }
+
+  w->pid = pid;
+  return pid;
+}
+
+/**
+ * Collect one exited worker without blocking
+ *
+ * @return slot index of the worker to restart or -1 when there is none
+ */
+int supervisor_reap(MinnetServerSupervisor* sup) {
+  pid_t pid;
+  int status;
+  uint32_t i;
+
+  /* not waitpid(-1, ...), that would also reap processes started by the script */
+  for(i = 0; i < sup->count; i++) {
+    /* a slot without pid is one whose fork() failed before */
+    if((pid = sup->workers[i].pid) == 0)
+      return i;
+
+    if(waitpid(pid, &status, WNOHANG) != pid)
+      continue;
+
+    if(WIFSIGNALED(status))
+      lwsl_warn("worker #%" PRIu32 " (pid %d) killed by signal %d\n", i, (int)pid, WTERMSIG(status));
+    else
+      lwsl_warn("worker #%" PRIu32 " (pid %d) exited with status %d\n", i, (int)pid, WEXITSTATUS(status));
+
+    sup->workers[i].pid = 0;
+    sup->workers[i].active = 0;
+    return i;
+  }
+
+  return -1;
+}
+
+JSValue supervisor_worker_object(JSContext* ctx, const MinnetWorkerStats* w) {
+  JSValue ret = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, ret, "pid", JS_NewInt32(ctx, w->pid));
+  JS_SetPropertyStr(ctx, ret, "restarts", JS_NewUint32(ctx, w->restarts));
+  JS_SetPropertyStr(ctx, ret, "started", js_date_new(ctx, JS_NewInt64(ctx, w->started * 1000)));
+  JS_SetPropertyStr(ctx, ret, "requests", JS_NewInt64(ctx, __atomic_load_n(&w->requests, __ATOMIC_RELAXED)));
+  JS_SetPropertyStr(ctx, ret, "connections", JS_NewInt64(ctx, __atomic_load_n(&w->connections, __ATOMIC_RELAXED)));
+  JS_SetPropertyStr(ctx, ret, "active", JS_NewInt64(ctx, __atomic_load_n(&w->active, __ATOMIC_RELAXED)));
+
+  return ret;
+}
+
+JSValue supervisor_workers(JSContext* ctx, MinnetServerSupervisor* sup) {
+  JSValue ret = JS_NewArray(ctx);
+  uint32_t i;
+
+  for(i = 0; i < sup->count; i++)
+    JS_SetPropertyUint32(ctx, ret, i, supervisor_worker_object(ctx, &sup->workers[i]));
+
+  return ret;
+}
+
+JSValue supervisor_totals(JSContext* ctx, MinnetServerSupervisor* sup) {
+  JSValue ret = JS_NewObject(ctx);
+  uint64_t requests = 0, connections = 0;
+  int64_t active = 0;
+  uint32_t i, alive = 0, restarts = 0;
+
+  for(i = 0; i < sup->count; i++) {
+    MinnetWorkerStats* w = &sup->workers[i];
+
+    if(w->pid > 0)
+      ++alive;
+
+    restarts += w->restarts;
+    requests += __atomic_load_n(&w->requests, __ATOMIC_RELAXED);
+    connections += __atomic_load_n(&w->connections, __ATOMIC_RELAXED);
+    active += __atomic_load_n(&w->active, __ATOMIC_RELAXED);
+  }
+
+  JS_SetPropertyStr(ctx, ret, "workers", JS_NewUint32(ctx, alive));
+  JS_SetPropertyStr(ctx, ret, "restarts", JS_NewUint32(ctx, restarts));
+  JS_SetPropertyStr(ctx, ret, "requests", JS_NewInt64(ctx, requests));
+  JS_SetPropertyStr(ctx, ret, "connections", JS_NewInt64(ctx, connections));
+  JS_SetPropertyStr(ctx, ret, "active", JS_NewInt64(ctx, active));
+
+  return ret;
+}
@@ -0,0 +1,41 @@
+#ifndef MINNET_SERVER_SUPERVISOR_H
+#define MINNET_SERVER_SUPERVISOR_H
+
+#include <sys/types.h>
+#include <quickjs.h>
+#include "utils.h"
+
+struct TimerClosure;
+
+/* counters of one worker process, they live in memory shared with the supervisor */
+typedef struct server_worker_stats {
+  pid_t pid;
+  uint32_t restarts;
+  int64_t started;
+  uint64_t requests, connections;
+  int64_t active; /* signed, it's decremented with WORKER_STATS_ADD() */
+} MinnetWorkerStats;
+
+typedef struct server_supervisor {
+  uint32_t count;
+  MinnetWorkerStats* workers;
+  struct TimerClosure* timer;
+} MinnetServerSupervisor;
+
+#define WORKER_STATS_ADD(stats, field, n) \
+  do { \
+    if(stats) \
+      __atomic_add_fetch(&(stats)->field, (n), __ATOMIC_RELAXED); \
+  } while(0)
+
+MinnetServerSupervisor* supervisor_new(JSContext*, uint32_t count);
+void supervisor_free(MinnetServerSupervisor*, JSRuntime*);
+void supervisor_stop(MinnetServerSupervisor*);
+MinnetWorkerStats* supervisor_detach(MinnetServerSupervisor*, uint32_t index, JSRuntime*);
+pid_t supervisor_spawn(MinnetServerSupervisor*, uint32_t index);
+int supervisor_reap(MinnetServerSupervisor*);
+JSValue supervisor_worker_object(JSContext*, const MinnetWorkerStats*);
+JSValue supervisor_workers(JSContext*, MinnetServerSupervisor*);
+JSValue supervisor_totals(JSContext*, MinnetServerSupervisor*);
+
+#endif /* MINNET_SERVER_SUPERVISOR_H */
@@ -0,0 +1,268 @@
+#include "minnet-server-thread.h"
+#include "minnet-server.h"
+#include "js-utils.h"
+#include "opaque.h"
+#include "ws.h"
+#include "pool.h"
+#include <list.h>
+#include <quickjs-libc.h>
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+/* set in every service thread, createServer() then attaches to the shared lws_context instead of creating one */
+THREAD_LOCAL MinnetServerThread* minnet_server_thread = 0;
+
+static void server_thread_signal(MinnetServerThread* t, int state) {
+  pthread_mutex_lock(&t->lock);
+  t->state = state;
+  pthread_cond_signal(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+}
+
+static void server_thread_jobs(JSRuntime* rt) {
+  JSContext* ctx;
+
+  while(JS_ExecutePendingJob(rt, &ctx) > 0) {}
+}
+
+/* connections of this thread hold values of its JSRuntime, so they have to be closed here and not in lws_context_destroy() */
+static void server_thread_close(void) {
+  struct list_head* el;
+  struct lws** wsis;
+  size_t i, n = 0;
+
+  if(opaque_list.prev == NULL)
+    return;
+
+  list_for_each(el, &opaque_list) ++n;
+
+  if(!n || !(wsis = malloc(sizeof(struct lws*) * n)))
+    return;
+
+  n = 0;
+
+  list_for_each(el, &opaque_list) {
+    struct wsi_opaque_user_data* opaque = list_entry(el, struct wsi_opaque_user_data, link);
+
+    if(opaque->ws && opaque->ws->lwsi)
+      wsis[n++] = opaque->ws->lwsi;
+  }
+
+  for(i = 0; i < n; i++)
+    lws_set_timeout(wsis[i], PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_SYNC);
+
+  free(wsis);
+}
+
+/* 'net' and 'minnet' (with or without .so) are this library, which is loaded already */
+static BOOL server_thread_self(const char* name) {
+  const char* base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+  size_t len = strlen(base);
+
+  if(len > 3 && !strcmp(base + len - 3, ".so"))
+    len -= 3;
+
+  return (len == 3 && !strncmp(base, "net", 3)) || (len == 6 && !strncmp(base, "minnet", 6));
+}
+
+/**
+ * Load a module for a service thread the way qjs does for the main script: bare names are
+ * looked up in the directories of QUICKJS_MODULE_PATH, as they are, with .so and with .js.
+ */
+static JSModuleDef* server_thread_loader(JSContext* ctx, const char* name, void* opaque) {
+  const char *path, *end;
+  char buf[PATH_MAX];
+
+  if(server_thread_self(name))
+    return JS_INIT_MODULE(ctx, name);
+
+  if(name[0] != '/' && name[0] != '.' && (path = getenv("QUICKJS_MODULE_PATH"))) {
+    static const char* const suffixes[] = {"", ".so", ".js"};
+
+    for(; *path; path = *end ? end + 1 : end) {
+      end = path + strcspn(path, ":");
+
+      for(size_t i = 0; i < countof(suffixes); i++) {
+        snprintf(buf, sizeof(buf), "%.*s/%s%s", (int)(end - path), path, name, suffixes[i]);
+
+        if(!access(buf, R_OK))
+          return js_module_loader(ctx, buf, opaque);
+      }
+    }
+  }
+
+  return js_module_loader(ctx, name, opaque);
+}
+
+static BOOL server_thread_eval(JSContext* ctx, const char* module) {
+  uint8_t* buf;
+  size_t len;
+  JSValue val;
+
+  if(!(buf = js_load_file(ctx, &len, module))) {
+    lwsl_err("service thread: could not load '%s'\n", module);
+    return FALSE;
+  }
+
+  val = JS_Eval(ctx, (const char*)buf, len, module, JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+
+  if(!JS_IsException(val)) {
+    js_module_set_import_meta(ctx, val, TRUE, TRUE);
+    val = JS_EvalFunction(ctx, val);
+  }
+
+  js_free(ctx, buf);
+
+  if(JS_IsException(val)) {
+    js_std_dump_error(ctx);
+    return FALSE;
+  }
+
+  JS_FreeValue(ctx, val);
+  return TRUE;
+}
+
+static void* server_thread_run(void* arg) {
+  MinnetServerThread* t = arg;
+  JSRuntime* rt;
+  JSContext* ctx;
+  BOOL ok;
+
+  minnet_server_thread = t;
+
+  rt = JS_NewRuntime();
+  js_std_init_handlers(rt);
+  ctx = JS_NewContext(rt);
+  JS_SetModuleLoaderFunc(rt, NULL, server_thread_loader, NULL);
+
+  js_std_add_helpers(ctx, 0, 0);
+  js_init_module_std(ctx, "std");
+  js_init_module_os(ctx, "os");
+
+  ok = server_thread_eval(ctx, t->module);
+  server_thread_jobs(rt);
+
+  /* the module did not call createServer(): service the connections without JS handlers */
+  if(!minnet_server_local) {
+    JSValue options = JS_NewObject(ctx), server;
+
+    server = minnet_server_closure(ctx, JS_UNDEFINED, 1, &options, 0, 0);
+
+    JS_FreeValue(ctx, server);
+    JS_FreeValue(ctx, options);
+  }
+
+  server_thread_signal(t, ok && minnet_server_local ? THREAD_RUNNING : THREAD_FAILED);
+
+  lwsl_user("service thread #%d running '%s'\n", t->tsi, t->module);
+
+  while(!t->stop) {
+    if(lws_service_tsi(t->lws, 250, t->tsi) < 0)
+      break;
+
+    server_thread_jobs(rt);
+  }
+
+  server_thread_close();
+  server_thread_jobs(rt);
+
+  if(minnet_server_local) {
+    callbacks_clear(&minnet_server_local->on);
+
+    /* the lws_context belongs to the main thread */
+    minnet_server_local->context.lws = 0;
+    minnet_server_free(minnet_server_local);
+    minnet_server_local = 0;
+  }
+
+  js_std_free_handlers(rt);
+  JS_FreeContext(ctx);
+  JS_FreeRuntime(rt);
+
+  /* the freelists are per thread, nobody else would ever take these chunks */
+  pool_trim();
+
+  minnet_server_thread = 0;
+  return 0;
+}
+
+MinnetServerThread* minnet_server_threads_start(JSContext* ctx, struct lws_context* lws, uint32_t count, const char* module, MinnetWorkerStats* stats) {
+  MinnetServerThread* threads;
+  uint32_t i;
+
+  if(!(threads = js_mallocz(ctx, sizeof(MinnetServerThread) * count)))
+    return 0;
+
+  /* one at a time: module and class initialization is not re-entrant */
+  for(i = 0; i < count; i++) {
+    MinnetServerThread* t = &threads[i];
+
+    t->tsi = i;
+    t->lws = lws;
+    t->module = strdup(module);
+    t->stats = stats;
+    pthread_mutex_init(&t->lock, 0);
+    pthread_cond_init(&t->cond, 0);
+
+    if(pthread_create(&t->id, 0, &server_thread_run, t)) {
+      lwsl_err("failed creating service thread #%" PRIu32 "\n", i);
+      minnet_server_threads_stop(threads, i, JS_GetRuntime(ctx));
+      return 0;
+    }
+
+    pthread_mutex_lock(&t->lock);
+
+    while(t->state == THREAD_STARTING)
+      pthread_cond_wait(&t->cond, &t->lock);
+
+    pthread_mutex_unlock(&t->lock);
+
+    if(t->state == THREAD_FAILED)
+      lwsl_warn("service thread #%" PRIu32 " has no handlers\n", i);
+  }
+
+  return threads;
+}
+
+void minnet_server_threads_stop(MinnetServerThread* threads, uint32_t count, JSRuntime* rt) {
+  uint32_t i;
+
+  for(i = 0; i < count; i++)
+    threads[i].stop = TRUE;
+
+  if(count)
+    lws_cancel_service(threads[0].lws);
+
+  for(i = 0; i < count; i++) {
+    pthread_join(threads[i].id, 0);
+    pthread_cond_destroy(&threads[i].cond);
+    pthread_mutex_destroy(&threads[i].lock);
+    free(threads[i].module);
+  }
+
+  js_free_rt(rt, threads);
+}
+
+char* minnet_server_thread_module(JSContext* ctx, JSValueConst options) {
+  JSValue value = JS_GetPropertyStr(ctx, options, "module");
+  char* ret = 0;
+
+  /* default to the main script, it is evaluated again in every service thread */
+  if(js_is_nullish(value)) {
+    JSValue args = js_global_get(ctx, "scriptArgs");
+
+    if(JS_IsArray(ctx, args))
+      value = JS_GetPropertyUint32(ctx, args, 0);
+
+    JS_FreeValue(ctx, args);
+  }
+
+  if(JS_IsString(value))
+    ret = js_tostring(ctx, value);
+
+  JS_FreeValue(ctx, value);
+  return ret;
+}
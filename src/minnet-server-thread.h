@@ -0,0 +1,29 @@
+#ifndef MINNET_SERVER_THREAD_H
+#define MINNET_SERVER_THREAD_H
+
+#include <pthread.h>
+#include <quickjs.h>
+#include "utils.h"
+#include "minnet-server-supervisor.h"
+
+struct lws_context;
+
+typedef struct server_thread {
+  pthread_t id;
+  int tsi;
+  struct lws_context* lws;
+  char* module;
+  enum { THREAD_STARTING = 0, THREAD_RUNNING, THREAD_FAILED } state;
+  volatile BOOL stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  MinnetWorkerStats* stats;
+} MinnetServerThread;
+
+MinnetServerThread* minnet_server_threads_start(JSContext*, struct lws_context*, uint32_t count, const char* module, MinnetWorkerStats* stats);
+void minnet_server_threads_stop(MinnetServerThread*, uint32_t count, JSRuntime* rt);
+char* minnet_server_thread_module(JSContext*, JSValueConst options);
+
+extern THREAD_LOCAL MinnetServerThread* minnet_server_thread;
+
+#endif /* MINNET_SERVER_THREAD_H */
@@ -4,6 +4,7 @@
 #include "js-utils.h"
 #include "ssl-utils.h"
 #include "headers.h"
+#include "channel.h"
 #include "minnet-response.h"
 #include <assert.h>
 #include <libwebsockets.h>
@@ -80,7 +81,7 @@ static int minnet_ws_server_cert_verify(int _ok, X509_STORE_CTX* store_ctx) {
 
 int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
   struct session_data* session = user;
-  MinnetServer* server = lws_context_user(lws_get_context(wsi));
+  MinnetServer* server = lws_server(wsi);
   JSContext* ctx = server->context.js;
   struct wsi_opaque_user_data* opaque = lws_get_opaque_user_data(wsi);
 
@@ -141,7 +142,7 @@ int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason,
         opaque = opaque_from_wsi(wsi, ctx);
 
       if(opaque && session) {
-        session_init(session, wsi_context(wsi));
+        session_init(session, &server->context);
         opaque->sess = session;
       }
 
@@ -161,6 +162,13 @@ int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason,
       if(!opaque->ws)
         opaque->ws = ws_new(wsi, ctx);
 
+      /* every accepted connection comes here first, plain HTTP ones as well as WebSockets */
+      if(opaque && !opaque->counted) {
+        opaque->counted = TRUE;
+        WORKER_STATS_ADD(server->stats, connections, 1);
+        WORKER_STATS_ADD(server->stats, active, 1);
+      }
+
       return 0;
     }
 
@@ -175,6 +183,11 @@ int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason,
 
       lws_set_opaque_user_data(wsi, 0);
 
+      if(opaque && opaque->counted) {
+        opaque->counted = FALSE;
+        WORKER_STATS_ADD(server->stats, active, -1);
+      }
+
       /*if(opaque->sess) {
         session_clear(opaque->sess, JS_GetRuntime(ctx));
         opaque->sess = 0;
@@ -220,7 +233,7 @@ int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason,
       if(!opaque->req) {
         opaque->req = request_new(url, METHOD_GET, ctx);
         opaque->req->secure = wsi_tls(wsi);
-        headers_tobuffer(ctx, &opaque->req->headers, wsi);
+        opaque->req->wsi = wsi;
       } else {
         url_free(&url, JS_GetRuntime(ctx));
       }
@@ -238,7 +251,7 @@ int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason,
       if(opaque->req) {
         url = &opaque->req->url;
 
-        if((mount = mount_find_s((MinnetHttpMount*)server->context.info.mounts, url->path))) {
+        if((mount = mount_find_s(&server->mounts, url->path))) {
           // printf("found mount mnt=%s org=%s def=%s pro=%s\n", mount->mnt, mount->org, mount->def, mount->pro);
         }
 
@@ -250,6 +263,9 @@ int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason,
 
       opaque->status = OPEN;
 
+      if(opaque->ws && server->context.info.extensions)
+        opaque->ws->deflate = ws_deflate_negotiated(wsi);
+
       if(callback_valid(&server->on.connect)) {
         if(!JS_IsObject(session->ws_obj)) {
           session->ws_obj = opaque->ws ? minnet_ws_wrap(ctx, opaque->ws) : minnet_ws_fromwsi(ctx, wsi);
@@ -263,11 +279,19 @@ int minnet_ws_server_callback(struct lws* wsi, enum lws_callback_reasons reason,
         minnet_server_exception(server, callback_emit_this(&server->on.connect, session->ws_obj, 1, &session->ws_obj));
       }
 
+      /* lws drops the header table after this, the session keeps the request for the connection's lifetime */
+      if(opaque->req)
+        request_detach(opaque->req, TRUE, ctx);
+
       return 0;
     }
 
     case LWS_CALLBACK_WS_PEER_INITIATED_CLOSE:
     case LWS_CALLBACK_CLOSED: {
+      /* lws frees the session with the connection */
+      if(session && ctx)
+        channel_unsubscribe_all(session, JS_GetRuntime(ctx));
+
       if(opaque->status < CLOSING) {
         JSValue why = JS_UNDEFINED;
         int code = -1;
@@ -6,6 +6,8 @@
 #include "minnet-server-proxy.h"
 #include "minnet-response.h"
 #include "minnet-request.h"
+#include "minnet-channel.h"
+#include "minnet-hash.h"
 #include "closure.h"
 #include <list.h>
 #include <quickjs-libc.h>
@@ -18,11 +20,13 @@
 
 THREAD_LOCAL JSValue minnet_server_proto, minnet_server_ctor;
 THREAD_LOCAL JSClassID minnet_server_class_id = 0;
+THREAD_LOCAL MinnetServer* minnet_server_local = 0;
 
 int minnet_proxy_callback(struct lws*, enum lws_callback_reasons, void*, void*, size_t);
 int minnet_ws_server_callback(struct lws*, enum lws_callback_reasons, void*, void*, size_t);
 
 static JSValue minnet_server_timeout(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr);
+static JSValue minnet_server_supervise(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr);
 
 static struct lws_protocols protocols[] = {
     {"ws", minnet_ws_server_callback, sizeof(struct session_data), 1024, 0, NULL, 0},
@@ -98,6 +102,12 @@ static MinnetServer* server_new(JSContext* ctx) {
 
   callbacks_zero(&server->on);
 
+  init_list_head(&server->channels);
+
+  route_init(&server->mounts.all);
+  route_init(&server->mounts.callbacks);
+  route_init(&server->routes);
+
   return server;
 }
 
@@ -106,10 +116,89 @@ MinnetServer* minnet_server_dup(MinnetServer* srv) {
   return srv;
 }
 
+/* called from a service thread: handlers of this JSContext serve the connections of that thread */
+static void server_attach(MinnetServer* server) {
+  server->context.lws = minnet_server_thread->lws;
+  server->stats = minnet_server_thread->stats;
+  server->listening = TRUE;
+
+  mount_index(&server->mounts, (MinnetHttpMount*)server->context.info.mounts, server->context.js);
+
+  /* the service thread polls by itself */
+  callback_clear(&server->on.fd);
+
+  if(!minnet_server_local)
+    minnet_server_local = minnet_server_dup(server);
+}
+
+/* in a forked worker: drop the supervisor state, the worker only updates its own slot */
+static void server_worker(MinnetServer* server, uint32_t index) {
+  MinnetServerSupervisor* sup = server->supervisor;
+
+  server->supervisor = 0;
+  server->listening = FALSE;
+  server->stats = supervisor_detach(sup, index, JS_GetRuntime(server->context.js));
+
+  /* an epoll set survives fork(), the worker needs one of its own */
+  if(server->context.loop) {
+    evloop_free(server->context.loop);
+    server->context.loop = evloop_new(server->context.js);
+  }
+}
+
+/* fork the workers, which listen on the same port with SO_REUSEPORT while this process only supervises */
+static BOOL server_supervise(MinnetServer* server) {
+  JSValue timer_cb;
+  uint32_t i;
+
+  if(!(server->supervisor = supervisor_new(server->context.js, server->nworkers)))
+    return FALSE;
+
+  for(i = 0; i < server->nworkers; i++) {
+    switch(supervisor_spawn(server->supervisor, i)) {
+      case 0: {
+        server_worker(server, i);
+        return TRUE;
+      }
+      case -1: {
+        /* don't leave the workers forked so far listening on the shared port */
+        supervisor_stop(server->supervisor);
+        supervisor_free(server->supervisor, JS_GetRuntime(server->context.js));
+        server->supervisor = 0;
+        return FALSE;
+      }
+    }
+  }
+
+  timer_cb = js_function_cclosure(server->context.js, minnet_server_supervise, 4, 0, server, 0);
+
+  server->supervisor->timer = js_timer_interval(server->context.js, timer_cb, 1000);
+  server->listening = TRUE;
+
+  JS_FreeValue(server->context.js, timer_cb);
+  return TRUE;
+}
+
 static BOOL server_listen(MinnetServer* server) {
   JSValue timer_cb;
   uint32_t interval;
 
+  if(server->nworkers > 0 && !server->stats) {
+    if(!server->supervisor && !server_supervise(server))
+      return FALSE;
+
+    if(server->supervisor)
+      return TRUE;
+  }
+
+  mount_index(&server->mounts, (MinnetHttpMount*)server->context.info.mounts, server->context.js);
+
+  if(server->nthreads > 1) {
+    /* ADD_POLL_FD of every pt must stay with the thread servicing it */
+    callback_clear(&server->on.fd);
+    server->context.info.count_threads = server->nthreads;
+  }
+
   if(!(server->context.lws = lws_create_context(&server->context.info))) {
     lwsl_err("libwebsockets init failed\n");
 
@@ -122,6 +211,13 @@ static BOOL server_listen(MinnetServer* server) {
     return FALSE;
   }
 
+  if(server->nthreads > 1) {
+    if((server->nthreads = lws_get_count_threads(server->context.lws)) < 2)
+      lwsl_warn("libwebsockets was built without SMP support (LWS_MAX_SMP), serving from the main thread\n");
+    else if(!(server->threads = minnet_server_threads_start(server->context.js, server->context.lws, server->nthreads, server->module, server->stats)))
+      return FALSE;
+  }
+
   timer_cb = js_function_cclosure(server->context.js, minnet_server_timeout, 4, 0, server, 0);
 
   if((interval = lws_service_adjust_timeout(server->context.lws, 15000, 0)) == 0)
@@ -135,10 +231,9 @@ static BOOL server_listen(MinnetServer* server) {
 
 int minnet_server_exception(MinnetServer* server, JSValue retval) {
   int32_t r = -1;
+  /* the same value, it's only freed once */
   JSValue ret = context_exception(&server->context, retval);
 
-  JS_FreeValue(server->context.js, retval);
-
   if(JS_IsException(ret))
     return -1;
 
@@ -153,121 +248,119 @@ void minnet_server_free(MinnetServer* server) {
   if(--server->ref_count == 0) {
     js_async_free(JS_GetRuntime(ctx), &server->promise);
 
+    if(server->threads) {
+      minnet_server_threads_stop(server->threads, server->nthreads, JS_GetRuntime(ctx));
+      server->threads = 0;
+    }
+
+    if(server->module)
+      js_free(ctx, server->module);
+
+    if(server->supervisor) {
+      if(server->supervisor->timer)
+        js_timer_cancel(ctx, server->supervisor->timer->id);
+
+      supervisor_stop(server->supervisor);
+      supervisor_free(server->supervisor, JS_GetRuntime(ctx));
+      server->supervisor = 0;
+    }
+
+    while(!list_empty(&server->channels)) {
+      struct channel* ch = list_entry(server->channels.next, struct channel, link);
+
+      list_del(&ch->link);
+      init_list_head(&ch->link);
+      channel_free(ch, JS_GetRuntime(ctx));
+    }
+
+    mount_index_clear(&server->mounts, JS_GetRuntime(ctx));
+    route_clear(&server->routes, JS_GetRuntime(ctx));
+
+    minnet_event_loop_release(&server->context, &server->on.fd);
     context_clear(&server->context);
 
     js_free(ctx, server);
   }
 }
 
-struct ServerMatchClosure {
+typedef struct {
   int ref_count;
   JSContext* ctx;
-  const char* path;
-  enum http_method method;
-  JSValue this_cb, prev_cb;
-  BOOL next;
-};
-
-static BOOL server_match_all(struct ServerMatchClosure* closure) { return closure->path == 0 && (int)closure->method == -1; }
+  BOOL called;
+} ServerNext;
 
-static struct ServerMatchClosure* server_match_dup(struct ServerMatchClosure* closure) {
-  ++closure->ref_count;
+static void server_next_free(void* ptr) {
+  ServerNext* next = ptr;
 
-  return closure;
-}
-
-static void server_match_free(void* ptr) {
-  struct ServerMatchClosure* closure = ptr;
-
-  if(--closure->ref_count == 0) {
-    JSContext* ctx = closure->ctx;
-
-    JS_FreeCString(ctx, closure->path);
-    JS_FreeValue(ctx, closure->this_cb);
-    JS_FreeValue(ctx, closure->prev_cb);
-  }
+  if(--next->ref_count == 0)
+    js_free(next->ctx, next);
 }
 
 static JSValue minnet_server_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
-  struct ServerMatchClosure* closure = opaque;
+  ServerNext* next = opaque;
 
-  closure->next = TRUE;
+  next->called = TRUE;
   return JS_UNDEFINED;
-};
+}
 
-static JSValue server_match(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
-  struct ServerMatchClosure* closure = opaque;
-  JSValue ret = JS_UNDEFINED;
+/**
+ * Run the handlers of get(), post() and use() which match the request, in the order they were added.
+ * A handler returning 1 ends the chain, so does a use() handler without a path which doesn't call next().
+ *
+ * @param argv  request and response object
+ */
+int minnet_server_route(MinnetServer* server, JSValueConst argv[]) {
+  JSContext* ctx = server->context.js;
   MinnetRequest* req;
-  int32_t n;
-  BOOL all = server_match_all(closure);
-  JSValueConst args[] = {
-      argv[0],
-      argv[1],
-      JS_NULL,
-  };
+  RouteNode* node;
+  RouteEntry *any, *path, *e;
+  int r = 0;
 
-  if(!js_is_nullish(closure->prev_cb))
-    ret = JS_Call(ctx, closure->prev_cb, JS_NULL, 2, args);
+  if(!(req = minnet_request_data(argv[0])) || !req->url.path)
+    return 0;
 
-  JS_ToInt32(ctx, &n, ret);
+  node = route_match(&server->routes, req->url.path, (int)req->method, &req->params);
+  any = server->routes.any;
+  path = node ? node->entries : 0;
 
-  DBG("all=%s ret=%" PRId32 " path=%s method=%s", all ? "TRUE" : "FALSE", n, closure->path, method_name(closure->method));
+  while((e = !path || (any && any->seq < path->seq) ? any : path)) {
+    BOOL all = e == any && e->method == -1;
+    JSValueConst args[] = {argv[0], argv[1], JS_NULL};
+    ServerNext* next = 0;
 
-  if(n == 1)
-    return ret;
-
-  if((req = minnet_request_data2(ctx, argv[0]))) {
-    BOOL match = request_match(req, closure->path, closure->method);
-
-    DBG("match=%s all=%s", match ? "TRUE" : "FALSE", all ? "TRUE" : "FALSE");
-
-    if(match) {
-      args[2] = js_function_cclosure(ctx, minnet_server_next, 0, 0, server_match_dup(closure), server_match_free);
+    if(e == any)
+      any = any->next;
+    else
+      path = path->next;
 
-      ret = JS_Call(ctx, closure->this_cb, JS_NULL, all ? 3 : 2, args);
+    if(e->method != -1 && e->method != (int)req->method)
+      continue;
 
-      if(all && !closure->next)
-        ret = JS_NewInt32(ctx, 1);
+    if(all) {
+      if(!(next = js_mallocz(ctx, sizeof(ServerNext))))
+        return -1;
 
-      JS_FreeValue(ctx, args[2]);
+      *next = (ServerNext){2, ctx, FALSE};
+      args[2] = js_function_cclosure(ctx, minnet_server_next, 0, 0, next, server_next_free);
     }
-  }
 
-  return ret;
-}
+    req->route = e;
+    r = minnet_server_exception(server, JS_Call(ctx, e->value, JS_NULL, all ? 3 : 2, args));
 
-JSValue minnet_server_match(MinnetServer* server, const char* path, enum http_method method, JSValue callback, JSValue prev_callback) {
-  JSContext* ctx = server->context.js;
-  struct ServerMatchClosure* closure;
-  JSValue ret = JS_UNDEFINED;
-
-  if(!(closure = js_mallocz(ctx, sizeof(struct ServerMatchClosure))))
-    return JS_EXCEPTION;
-
-  *closure = (struct ServerMatchClosure){
-      1,
-      ctx,
-      path,
-      method,
-      callback,
-      prev_callback,
-      FALSE,
-  };
-
-  ret = js_function_cclosure(ctx, server_match, 0, 0, closure, server_match_free);
+    if(all) {
+      JS_FreeValue(ctx, args[2]);
 
-  JS_DefinePropertyValueStr(ctx, ret, "name", JS_NewString(ctx, path != 0 ? path : "*"), 0);
+      if(!next->called && r != -1)
+        r = 1;
 
-  if((int)method != -1)
-    JS_SetPropertyStr(ctx, ret, "method", JS_NewString(ctx, method_name(method)));
+      server_next_free(next);
+    }
 
-  if(JS_IsFunction(ctx, prev_callback)) {
-    JS_SetPropertyStr(ctx, prev_callback, "next", ret);
-    JS_SetPropertyStr(ctx, ret, "prev", JS_DupValue(ctx, prev_callback));
+    if(r == 1 || r == -1)
+      break;
   }
 
-  return ret;
+  return r;
 }
 
 void minnet_server_mounts(MinnetServer* server, JSValueConst opt_mounts) {
@@ -377,6 +470,9 @@ JSValue minnet_server_wrap(JSContext* ctx, MinnetServer* srv) {
 enum {
   SERVER_ONREQUEST,
   SERVER_LISTENING,
+  SERVER_WORKERS,
+  SERVER_STATS,
+  SERVER_SERVED,
 };
 
 JSValue minnet_server_get(JSContext* ctx, JSValueConst this_val, int magic) {
@@ -396,6 +492,31 @@ JSValue minnet_server_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = JS_NewBool(ctx, server->context.lws != 0);
       break;
     }
+
+    case SERVER_WORKERS: {
+      if(server->supervisor)
+        ret = supervisor_workers(ctx, server->supervisor);
+      break;
+    }
+
+    case SERVER_STATS: {
+      if(server->supervisor)
+        ret = supervisor_totals(ctx, server->supervisor);
+      else if(server->stats)
+        ret = supervisor_worker_object(ctx, server->stats);
+      break;
+    }
+
+    case SERVER_SERVED: {
+      MinnetHttpMount* m;
+
+      ret = JS_NewObject(ctx);
+
+      for(m = (MinnetHttpMount*)server->context.info.mounts; m; m = m->next)
+        if(m->files)
+          JS_SetPropertyStr(ctx, ret, m->mnt, JS_NewInt64(ctx, __atomic_load_n(&m->served, __ATOMIC_RELAXED)));
+      break;
+    }
   }
   return ret;
 }
@@ -424,6 +545,7 @@ enum {
   SERVER_POST,
   SERVER_USE,
   SERVER_MOUNT,
+  SERVER_CHANNEL,
 };
 
 JSValue minnet_server_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
@@ -443,7 +565,9 @@ JSValue minnet_server_method(JSContext* ctx, JSValueConst this_val, int argc, JS
       if(port != -1)
         server->context.info.port = port;
 
-      if(!server_listen(server))
+      if(minnet_server_thread)
+        server_attach(server);
+      else if(!server_listen(server))
         ret = JS_ThrowInternalError(ctx, "server_listen failed");
 
       break;
@@ -455,22 +579,19 @@ JSValue minnet_server_method(JSContext* ctx, JSValueConst this_val, int argc, JS
       const char* path = 0;
       int index = 0;
       enum http_method method = magic == SERVER_GET ? METHOD_GET : magic == SERVER_POST ? METHOD_POST : -1;
-      JSValue new_cb;
+      RouteEntry* entry;
 
       if(JS_IsString(argv[0]) && argc > 1)
         path = JS_ToCString(ctx, argv[index++]);
 
       if(!JS_IsFunction(ctx, argv[index])) {
         ret = JS_ThrowTypeError(ctx, "argument %d must be a function", index + 1);
-        break;
+      } else if(!(entry = route_add(&server->routes, path, method, TRUE, ctx))) {
+        ret = JS_ThrowOutOfMemory(ctx);
+      } else {
+        entry->value = JS_DupValue(ctx, argv[index]);
       }
 
-      new_cb = minnet_server_match(server, path, method, JS_DupValue(ctx, argv[index]), server->on.http.func_obj);
-      path = 0;
-
-      server->on.http.func_obj = new_cb;
-      server->on.http.ctx = ctx;
-
       if(path)
         JS_FreeCString(ctx, path);
       break;
@@ -517,11 +638,50 @@ JSValue minnet_server_method(JSContext* ctx, JSValueConst this_val, int argc, JS
 
       ADD(m, mount, next);
 
+      if(server->listening)
+        mount_index(&server->mounts, (MinnetHttpMount*)server->context.info.mounts, ctx);
+
       if(path)
         JS_FreeCString(ctx, path);
 
       break;
     }
+
+    case SERVER_CHANNEL: {
+      struct channel* ch;
+      const char* name;
+
+      if(argc < 1 || !(name = JS_ToCString(ctx, argv[0])))
+        return JS_ThrowTypeError(ctx, "argument 1 must be a channel name");
+
+      if(!(ch = channel_find(&server->channels, name))) {
+        uint32_t capacity = 0;
+
+        if(argc > 1 && JS_IsObject(argv[1]))
+          capacity = js_get_propertystr_uint32(ctx, argv[1], "capacity");
+
+        if(!(ch = channel_new(ctx, name, capacity))) {
+          JS_FreeCString(ctx, name);
+          return JS_ThrowOutOfMemory(ctx);
+        }
+
+        list_add_tail(&ch->link, &server->channels);
+      }
+
+      if(argc > 1 && JS_IsObject(argv[1])) {
+        const char* policy;
+
+        if((policy = js_get_propertystr_cstring(ctx, argv[1], "policy"))) {
+          ch->policy = channel_policy(policy);
+          JS_FreeCString(ctx, policy);
+        }
+      }
+
+      JS_FreeCString(ctx, name);
+
+      ret = minnet_channel_wrap(ctx, ch);
+      break;
+    }
   }
 
   return ret;
@@ -539,6 +699,12 @@ static JSValue minnet_server_timeout(JSContext* ctx, JSValueConst this_val, int
     lwsl_user("DEBUG timeout %" PRIu32 "\n", timer->interval);
 #endif
 
+    /* the service threads handle timeouts, the timer only keeps the main loop alive */
+    if(server->threads) {
+      js_timer_restart(timer);
+      return JS_FALSE;
+    }
+
     do {
       new_interval = lws_service_adjust_timeout(server->context.lws, 15000, 0);
 
@@ -570,9 +736,43 @@ static JSValue minnet_server_timeout(JSContext* ctx, JSValueConst this_val, int
   return JS_TRUE;
 }
 
+static JSValue minnet_server_supervise(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  MinnetServer* server = ptr;
+  MinnetServerSupervisor* sup;
+  int index;
+
+  if(!(sup = server->supervisor))
+    return JS_FALSE;
+
+  while((index = supervisor_reap(sup)) != -1) {
+    ++sup->workers[index].restarts;
+
+    switch(supervisor_spawn(sup, index)) {
+      case 0: {
+        server_worker(server, index);
+
+        if(!server_listen(server)) {
+          lwsl_err("worker #%d: server_listen failed\n", index);
+          exit(EXIT_FAILURE);
+        }
+
+        /* the restarted worker does not supervise */
+        return JS_FALSE;
+      }
+      case -1: {
+        /* try again on the next tick */
+        --sup->workers[index].restarts;
+        return JS_TRUE;
+      }
+    }
+  }
+
+  return JS_TRUE;
+}
+
 JSValue minnet_server_closure(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
   int argind = 0, a = 0;
-  BOOL block = FALSE, is_tls = FALSE, is_h2 = TRUE, per_message_deflate = FALSE;
+  BOOL block = FALSE, is_tls = FALSE, is_h2 = TRUE, per_message_deflate = FALSE, reuse_port = FALSE;
   MinnetServer* server;
   MinnetURL url = {0};
   JSValue ret, options;
@@ -631,9 +831,6 @@ JSValue minnet_server_closure(JSContext* ctx, JSValueConst this_val, int argc, J
   JSValue opt_error_document = JS_GetPropertyStr(ctx, options, "errorDocument");
   JSValue opt_options = JS_GetPropertyStr(ctx, options, "options");
 
-  if(!JS_IsFunction(ctx, opt_on_fd))
-    opt_on_fd = minnet_default_fd_callback(ctx);
-
   if(!JS_IsUndefined(opt_tls)) {
 
     is_tls = JS_ToBool(ctx, opt_tls);
@@ -662,6 +859,73 @@ JSValue minnet_server_closure(JSContext* ctx, JSValueConst this_val, int argc, J
 
   BOOL_OPTION(opt_h2, "h2", is_h2);
   BOOL_OPTION(opt_pmd, "permessageDeflate", per_message_deflate);
+  BOOL_OPTION(opt_reuse_port, "reusePort", reuse_port);
+
+  if(minnet_event_loop(ctx, options, &server->context))
+    return JS_EXCEPTION;
+
+  if(!minnet_server_thread && js_has_propertystr(ctx, options, "threads")) {
+    server->nthreads = js_get_propertystr_uint32(ctx, options, "threads");
+
+    if(server->nthreads > 1) {
+      if(!(server->module = minnet_server_thread_module(ctx, options)))
+        return JS_ThrowTypeError(ctx, "threads: option 'module' must be the path of the handler module");
+
+      if(server->context.loop) {
+        lwsl_warn("eventLoop: \"native\" is not used with threads\n");
+        evloop_free(server->context.loop);
+        server->context.loop = 0;
+      }
+    }
+
+#if !defined(LWS_MAX_SMP) || LWS_MAX_SMP < 2
+    if(server->nthreads > 1) {
+      lwsl_warn("libwebsockets was built without SMP support (LWS_MAX_SMP), serving from the main thread\n");
+      server->nthreads = 1;
+    }
+#endif
+  }
+
+  /* with threads every service thread polls the fds of its own pt, none of them may reach this runtime */
+  if(server->nthreads > 1) {
+    if(JS_IsFunction(ctx, opt_on_fd))
+      lwsl_warn("onFd is not used with threads\n");
+
+    JS_FreeValue(ctx, opt_on_fd);
+    opt_on_fd = JS_UNDEFINED;
+  } else if(!JS_IsFunction(ctx, opt_on_fd) && !minnet_server_thread) {
+    opt_on_fd = minnet_default_fd_callback(ctx);
+  }
+
+  if(!minnet_server_thread && js_has_propertystr(ctx, options, "workers")) {
+    /* every worker binds the port itself */
+    if((server->nworkers = js_get_propertystr_uint32(ctx, options, "workers")) > 0)
+      reuse_port = TRUE;
+  }
+
+  /* bytes of files each directory mount keeps in memory */
+  if(js_has_propertystr(ctx, options, "cache"))
+    server->cache_limit = js_get_propertystr_uint32(ctx, options, "cache");
+
+  if(js_has_propertystr(ctx, options, "maxBodySize")) {
+    JSValue opt_max = JS_GetPropertyStr(ctx, options, "maxBodySize");
+
+    JS_ToIndex(ctx, &server->max_body_size, opt_max);
+    JS_FreeValue(ctx, opt_max);
+  }
+
+  if(js_has_propertystr(ctx, options, "highWaterMark"))
+    server->high_water = js_get_propertystr_uint32(ctx, options, "highWaterMark");
+
+  if(js_has_propertystr(ctx, options, "digest")) {
+    JSValue opt_digest = JS_GetPropertyStr(ctx, options, "digest");
+
+    server->digest = minnet_hash_type(ctx, opt_digest);
+    JS_FreeValue(ctx, opt_digest);
+
+    if(!server->digest)
+      return JS_ThrowRangeError(ctx, "digest must be one of Hash.TYPE_* or its name");
+  }
 
   GETCB(opt_on_pong, server->on.pong)
   GETCB(opt_on_close, server->on.close)
@@ -703,6 +967,9 @@ JSValue minnet_server_closure(JSContext* ctx, JSValueConst this_val, int argc, J
 
   info->options |= LWS_SERVER_OPTION_REQUIRE_VALID_OPENSSL_CLIENT_CERT;
 
+  if(reuse_port)
+    info->options |= LWS_SERVER_OPTION_ALLOW_LISTEN_SHARE;
+
   if(is_tls) {
     minnet_server_certificate(&server->context, options);
 
@@ -766,13 +1033,15 @@ lwsl_user("DEBUG pvo mimetype %s %s\n", pvo->name, pvo->value);
 
   minnet_server_mounts(server, opt_mounts);
 
-  if(server->context.info.port > 0)
+  if(minnet_server_thread)
+    server_attach(server);
+  else if(server->context.info.port > 0)
     if(!server_listen(server))
       return JS_ThrowInternalError(ctx, "libwebsockets init failed");
 
   ret = minnet_server_wrap(ctx, server);
 
-  if(!block)
+  if(!block || minnet_server_thread)
     return ret;
 
   while(a >= 0) {
@@ -781,7 +1050,7 @@ lwsl_user("DEBUG pvo mimetype %s %s\n", pvo->name, pvo->value);
       break;
     }
 
-    if(callback_valid(&server->on.fd))
+    if(callback_valid(&server->on.fd) || server->threads || server->supervisor)
       js_std_loop(ctx);
     else
       a = lws_service(server->context.lws, 20);
@@ -876,8 +1145,12 @@ static const JSCFunctionListEntry minnet_server_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("post", 2, minnet_server_method, SERVER_POST),
     JS_CFUNC_MAGIC_DEF("use", 2, minnet_server_method, SERVER_USE),
     JS_CFUNC_MAGIC_DEF("mount", 1, minnet_server_method, SERVER_MOUNT),
+    JS_CFUNC_MAGIC_DEF("channel", 1, minnet_server_method, SERVER_CHANNEL),
     JS_CGETSET_MAGIC_DEF("onrequest", minnet_server_get, minnet_server_set, SERVER_ONREQUEST),
     JS_CGETSET_MAGIC_FLAGS_DEF("listening", minnet_server_get, 0, SERVER_LISTENING, JS_PROP_ENUMERABLE),
+    JS_CGETSET_MAGIC_DEF("workers", minnet_server_get, 0, SERVER_WORKERS),
+    JS_CGETSET_MAGIC_DEF("stats", minnet_server_get, 0, SERVER_STATS),
+    JS_CGETSET_MAGIC_DEF("served", minnet_server_get, 0, SERVER_SERVED),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MinnetServer", JS_PROP_CONFIGURABLE),
 };
 
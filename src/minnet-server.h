@@ -5,7 +5,10 @@
 #include "buffer.h"
 #include "minnet.h"
 #include "minnet-server-http.h"
+#include "minnet-server-thread.h"
+#include "minnet-server-supervisor.h"
 #include "context.h"
+#include "route.h"
 
 struct http_mount;
 
@@ -23,13 +26,26 @@ typedef struct {
   CallbackList on;
   MinnetVhostOptions* mimetypes;
   BOOL listening;
+  uint32_t nthreads;
+  MinnetServerThread* threads;
+  char* module;
+  uint32_t nworkers;
+  MinnetServerSupervisor* supervisor;
+  MinnetWorkerStats* stats;
+  struct list_head channels;
+  MinnetMountIndex mounts;
+  RouteTable routes;
+  uint32_t cache_limit;
+  int digest; /* LWS_GENHASH_TYPE_* request bodies are hashed with as they arrive */
+  uint64_t max_body_size; /* larger request bodies are refused with 413, 0 for no limit */
+  uint32_t high_water;    /* unread bytes of a request body at which the connection stops reading it, 0 for never */
 } MinnetServer;
 
 struct proxy_connection;
 
 MinnetServer* minnet_server_dup(MinnetServer*);
 void minnet_server_free(MinnetServer*);
-JSValue minnet_server_match(MinnetServer*, const char*, enum http_method, JSValueConst callback, JSValueConst prev_callback);
+int minnet_server_route(MinnetServer*, JSValueConst argv[]);
 void minnet_server_mounts(MinnetServer*, JSValueConst);
 void minnet_server_certificate(struct context*, JSValueConst);
 JSValue minnet_server_wrap(JSContext*, MinnetServer*);
@@ -41,8 +57,10 @@ int minnet_server_init(JSContext*, JSModuleDef*);
 
 extern THREAD_LOCAL JSClassID minnet_server_class_id;
 extern THREAD_LOCAL JSValue minnet_server_proto, minnet_server_ctor;
+extern THREAD_LOCAL MinnetServer* minnet_server_local;
 
-static inline MinnetServer* lws_server(struct lws* wsi) { return lws_context_user(lws_get_context(wsi)); }
+/* in a service thread the handlers live in that thread's own MinnetServer */
+static inline MinnetServer* lws_server(struct lws* wsi) { return minnet_server_local ? minnet_server_local : lws_context_user(lws_get_context(wsi)); }
 
 static inline MinnetServer* minnet_server_data(JSValueConst obj) { return JS_GetOpaque(obj, minnet_server_class_id); }
 
@@ -31,6 +31,10 @@ enum {
   WEBSOCKET_READYSTATE,
   WEBSOCKET_SERIAL,
   WEBSOCKET_CONTEXT,
+  WEBSOCKET_HIGHWATERMARK,
+  WEBSOCKET_LOWWATERMARK,
+  WEBSOCKET_ONDRAIN,
+  WEBSOCKET_DEFLATE,
   /*  WEBSOCKET_RESERVED_BITS,
     WEBSOCKET_FINAL_FRAGMENT,
     WEBSOCKET_FIRST_FRAGMENT,
@@ -91,45 +95,50 @@ JSValue minnet_ws_fromwsi(JSContext* ctx, struct lws* wsi) {
   return ret;
 }
 
+/**
+ * Queue a frame, it is written from the writeable callback.
+ *
+ * @return Promise resolving to true when the frame was written, false when the connection closed before
+ */
 static JSValue minnet_ws_send(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   MinnetWebsocket* ws;
-  JSValue ret = JS_UNDEFINED;
+  JSValue ret;
   JSBuffer jsbuf;
   struct wsi_opaque_user_data* opaque;
+  ResolveFunctions fns;
+  QueueItem* item = 0;
+  int32_t protocol;
 
   if(!(ws = minnet_ws_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
-  // assert(ws->lwsi);
-  if(ws->lwsi == 0 || ((size_t)ws->lwsi) >> 4 == 0xfffffffffffffff)
-    return ret;
-
   if(argc == 0)
     return JS_ThrowTypeError(ctx, "argument 1 expecting String/ArrayBuffer");
 
-  int i = js_buffer_fromargs(ctx, argc, argv, &jsbuf);
-
-  if((opaque = ws_opaque(ws)) /*&& opaque->writable*/) {
-    int result;
-    int32_t protocol = JS_IsString(jsbuf.value) ? LWS_WRITE_TEXT : LWS_WRITE_BINARY;
+  jsbuf = js_input_chars(ctx, argv[0]);
+  protocol = JS_IsString(jsbuf.value) ? LWS_WRITE_TEXT : LWS_WRITE_BINARY;
 
-    if(argc > i)
-      JS_ToInt32(ctx, &protocol, argv[i]);
+  /* the flags go out as they are: LWS_WRITE_NO_FIN, LWS_WRITE_CONTINUATION etc. fragment a message */
+  if(argc > 1)
+    JS_ToInt32(ctx, &protocol, argv[1]);
 
-    result = lws_write(ws->lwsi, jsbuf.data, jsbuf.size, protocol);
-    ret = JS_NewInt32(ctx, result);
+  ret = js_async_create(ctx, &fns);
 
-  } /*else if((item = ws_send(ws, jsbuf.data, jsbuf.size, ctx))) {
-    ResolveFunctions fns;
-
-    ret = js_async_create(ctx, &fns);
+  // assert(ws->lwsi);
+  if(ws->lwsi && ((size_t)ws->lwsi) >> 4 != 0xfffffffffffffff)
+    if((opaque = ws_opaque(ws)) && opaque->status < CLOSING)
+      item = ws_send(ws, &jsbuf, ctx);
 
-    item->binary = js_is_arraybuffer(ctx, jsbuf.value);
+  if(item) {
+    item->binary = (protocol & 0xf) != LWS_WRITE_TEXT;
+    item->flags = protocol;
     item->unref = deferred_newjs(fns.resolve, ctx);
-    // item->unref = deferred_new(&JS_FreeValue,  fns.resolve, ctx);
     JS_FreeValue(ctx, fns.reject);
-  }*/
+  } else {
+    js_async_resolve(ctx, &fns, JS_FALSE);
+  }
 
+  js_buffer_free(&jsbuf, JS_GetRuntime(ctx));
   return ret;
 }
 
@@ -395,6 +404,26 @@ static JSValue minnet_ws_get(JSContext* ctx, JSValueConst this_val, int magic) {
 
       break;
     }
+
+    case WEBSOCKET_HIGHWATERMARK: {
+      ret = JS_NewInt64(ctx, ws->high_water);
+      break;
+    }
+
+    case WEBSOCKET_LOWWATERMARK: {
+      ret = JS_NewInt64(ctx, ws->low_water);
+      break;
+    }
+
+    case WEBSOCKET_ONDRAIN: {
+      ret = JS_DupValue(ctx, ws->ondrain.func_obj);
+      break;
+    }
+
+    case WEBSOCKET_DEFLATE: {
+      ret = JS_NewBool(ctx, ws->deflate);
+      break;
+    }
   }
   return ret;
 }
@@ -411,6 +440,30 @@ static JSValue minnet_ws_set(JSContext* ctx, JSValueConst this_val, JSValueConst
       ws->binary = JS_ToBool(ctx, value);
       break;
     }
+
+    case WEBSOCKET_HIGHWATERMARK:
+    case WEBSOCKET_LOWWATERMARK: {
+      int64_t n = -1;
+
+      JS_ToInt64(ctx, &n, value);
+
+      if(n < 0)
+        return JS_ThrowRangeError(ctx, "water mark must be >= 0");
+
+      if(magic == WEBSOCKET_HIGHWATERMARK)
+        ws->high_water = n;
+      else
+        ws->low_water = n;
+      break;
+    }
+
+    case WEBSOCKET_ONDRAIN: {
+      callback_clear(&ws->ondrain);
+
+      if(JS_IsFunction(ctx, value))
+        ws->ondrain = CALLBACK_INIT(ctx, JS_DupValue(ctx, value), JS_UNDEFINED);
+      break;
+    }
   }
 
   return ret;
@@ -480,6 +533,10 @@ static const JSCFunctionListEntry minnet_ws_proto_funcs[] = {
     JS_CGETSET_MAGIC_FLAGS_DEF("peer", minnet_ws_get, 0, WEBSOCKET_PEER, 0),
     JS_CGETSET_MAGIC_DEF("tls", minnet_ws_get, 0, WEBSOCKET_TLS),
     JS_CGETSET_MAGIC_DEF("bufferedAmount", minnet_ws_get, 0, WEBSOCKET_BUFFEREDAMOUNT),
+    JS_CGETSET_MAGIC_DEF("highWaterMark", minnet_ws_get, minnet_ws_set, WEBSOCKET_HIGHWATERMARK),
+    JS_CGETSET_MAGIC_DEF("lowWaterMark", minnet_ws_get, minnet_ws_set, WEBSOCKET_LOWWATERMARK),
+    JS_CGETSET_MAGIC_FLAGS_DEF("ondrain", minnet_ws_get, minnet_ws_set, WEBSOCKET_ONDRAIN, 0),
+    JS_CGETSET_MAGIC_FLAGS_DEF("deflate", minnet_ws_get, 0, WEBSOCKET_DEFLATE, 0),
     JS_CGETSET_MAGIC_FLAGS_DEF("raw", minnet_ws_get, 0, WEBSOCKET_RAW, 0),
     JS_CGETSET_MAGIC_FLAGS_DEF("binary", minnet_ws_get, minnet_ws_set, WEBSOCKET_BINARY, 0),
     JS_CGETSET_MAGIC_FLAGS_DEF("readyState", minnet_ws_get, 0, WEBSOCKET_READYSTATE, JS_PROP_ENUMERABLE),
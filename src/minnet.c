@@ -5,16 +5,22 @@
 #include "minnet-response.h"
 #include "minnet-websocket.h"
 #include "minnet-ringbuffer.h"
+#include "minnet-channel.h"
 #include "minnet-generator.h"
 #include "minnet-asynciterator.h"
 #include "minnet-formparser.h"
 #include "minnet-hash.h"
 #include "minnet-fetch.h"
+#include "minnet-agent.h"
+#include "minnet-dns.h"
 #include "minnet-headers.h"
 #include "js-utils.h"
 #include "utils.h"
 #include "buffer.h"
+#include "pool.h"
 #include "ssl-utils.h"
+#include "context.h"
+#include "evloop.h"
 #include <libwebsockets.h>
 #include <openssl/pem.h>
 #include <openssl/x509.h>
@@ -285,7 +291,107 @@ static int minnet_pollfds_handle(struct lws* wsi, struct js_callback* cb, struct
   return 0;
 }
 
+static JSValue minnet_evloop_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) { return JS_NewInt32(ctx, evloop_dispatch(ptr)); }
+
+static void minnet_evloop_register(struct event_loop* loop, struct js_callback* cb, BOOL enable) {
+  JSValue ret, argv[3] = {
+                    JS_NewInt32(cb->ctx, loop->fd),
+                    enable ? js_function_cclosure(cb->ctx, minnet_evloop_handler, 0, 0, evloop_dup(loop), (void (*)(void*))evloop_free) : JS_NULL,
+                    JS_NULL,
+                };
+
+  ret = callback_emit(cb, countof(argv), argv);
+
+  JS_FreeValue(cb->ctx, ret);
+  js_argv_free(cb->ctx, countof(argv), argv);
+
+  loop->registered = enable;
+}
+
+/* eventLoop: "native" keeps all sockets in one epoll set, only the epoll fd itself is handed to the JS loop */
+static int minnet_pollfds_native(struct lws* wsi, enum lws_callback_reasons reason, struct js_callback* cb, struct event_loop* loop, struct lws_pollargs* args) {
+  switch(reason) {
+    case LWS_CALLBACK_ADD_POLL_FD: {
+      if(!loop->lws)
+        loop->lws = lws_get_context(wsi);
+
+      if(evloop_add(loop, args->fd, args->events))
+        return -1;
+
+      if(!loop->registered && cb->ctx)
+        minnet_evloop_register(loop, cb, TRUE);
+
+      break;
+    }
+
+    case LWS_CALLBACK_DEL_POLL_FD: {
+      evloop_delete(loop, args->fd);
+
+      if(loop->nfds == 0 && loop->registered && cb->ctx)
+        minnet_evloop_register(loop, cb, FALSE);
+
+      break;
+    }
+
+    case LWS_CALLBACK_CHANGE_MODE_POLL_FD: {
+      if(args->events != args->prev_events)
+        return evloop_modify(loop, args->fd, args->events);
+
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int minnet_event_loop(JSContext* ctx, JSValueConst options, struct context* context) {
+  JSValue value = JS_GetPropertyStr(ctx, options, "eventLoop");
+  const char* str;
+  int ret = 0;
+
+  if(js_is_nullish(value))
+    return 0;
+
+  if((str = JS_ToCString(ctx, value))) {
+    if(!strcmp(str, "native")) {
+      if(!evloop_supported()) {
+        lwsl_warn("eventLoop: \"native\" is not supported on this platform, using \"os\"\n");
+      } else if(!context->loop && !(context->loop = evloop_new(ctx))) {
+        JS_ThrowInternalError(ctx, "failed creating native event loop");
+        ret = -1;
+      }
+
+    } else if(strcmp(str, "os")) {
+      JS_ThrowTypeError(ctx, "eventLoop must be \"os\" or \"native\"");
+      ret = -1;
+    }
+
+    JS_FreeCString(ctx, str);
+  }
+
+  JS_FreeValue(ctx, value);
+  return ret;
+}
+
+/* before the lws_context goes away: the JS read handler holds a reference of its own to the loop */
+void minnet_event_loop_release(struct context* context, struct js_callback* cb) {
+  struct event_loop* loop;
+
+  if(!(loop = context->loop))
+    return;
+
+  if(loop->registered && cb->ctx)
+    minnet_evloop_register(loop, cb, FALSE);
+
+  loop->lws = 0;
+}
+
 int minnet_pollfds_change(struct lws* wsi, enum lws_callback_reasons reason, struct js_callback* cb, struct lws_pollargs* args) {
+  struct context* context = wsi_context(wsi);
 
   if(reason != LWS_CALLBACK_LOCK_POLL && reason != LWS_CALLBACK_UNLOCK_POLL)
     LOG("POLL",
@@ -298,6 +404,9 @@ int minnet_pollfds_change(struct lws* wsi, enum lws_callback_reasons reason, str
         : args->events == POLLOUT          ? "OUT"
                                            : "");
 
+  if(context && context->loop && reason != LWS_CALLBACK_LOCK_POLL && reason != LWS_CALLBACK_UNLOCK_POLL)
+    return minnet_pollfds_native(wsi, reason, cb, context->loop, args);
+
   switch(reason) {
     case LWS_CALLBACK_LOCK_POLL:
     case LWS_CALLBACK_UNLOCK_POLL: {
@@ -592,6 +701,28 @@ static JSValue minnet_get_sessions(JSContext* ctx, JSValueConst this_val, int ar
   return ret;
 }
 
+/* the counters of this thread's buffer pools, one object per size class, the last for larger allocations */
+static JSValue minnet_pool_stats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue ret = JS_NewArray(ctx);
+
+  if(argc > 0 && JS_ToBool(ctx, argv[0]))
+    pool_trim();
+
+  for(int i = 0; i <= POOL_LARGE; i++) {
+    const PoolStats* st = pool_stats(i);
+    JSValue obj = JS_NewObject(ctx);
+
+    JS_SetPropertyStr(ctx, obj, "size", JS_NewInt64(ctx, st->size));
+    JS_SetPropertyStr(ctx, obj, "allocs", JS_NewInt64(ctx, st->allocs));
+    JS_SetPropertyStr(ctx, obj, "reused", JS_NewInt64(ctx, st->reused));
+    JS_SetPropertyStr(ctx, obj, "inUse", JS_NewInt64(ctx, st->in_use));
+    JS_SetPropertyStr(ctx, obj, "cached", JS_NewUint32(ctx, st->cached));
+    JS_SetPropertyUint32(ctx, ret, i, obj);
+  }
+
+  return ret;
+}
+
 static const JSCFunctionListEntry minnet_loglevels[] = {
     JS_INDEX_STRING_DEF(1, "ERR"),
     JS_INDEX_STRING_DEF(2, "WARN"),
@@ -612,7 +743,12 @@ static const JSCFunctionListEntry minnet_funcs[] = {
     JS_CFUNC_DEF("createServer", 1, minnet_server),
     JS_CFUNC_DEF("client", 1, minnet_client),
     JS_CFUNC_DEF("fetch", 1, minnet_fetch),
+    JS_CFUNC_DEF("fetchAll", 1, minnet_fetch_all),
     JS_CFUNC_DEF("getSessions", 0, minnet_get_sessions),
+    JS_CFUNC_DEF("poolStats", 0, minnet_pool_stats),
+    JS_CFUNC_DEF("resolve", 1, minnet_resolve),
+    JS_CFUNC_DEF("dnsStats", 0, minnet_dns_stats),
+    JS_CFUNC_DEF("setDns", 1, minnet_set_dns),
     JS_CFUNC_DEF("setLog", 1, minnet_set_log),
     JS_CFUNC_DEF("generateCert", 1, minnet_generate_cert),
     JS_PROP_INT32_DEF("METHOD_GET", METHOD_GET, 0),
@@ -664,6 +800,7 @@ static int js_minnet_init(JSContext* ctx, JSModuleDef* m) {
   minnet_response_init(ctx, m);
   minnet_request_init(ctx, m);
   minnet_ringbuffer_init(ctx, m);
+  minnet_channel_init(ctx, m);
   minnet_generator_init(ctx, m);
   minnet_ws_init(ctx, m);
   minnet_formparser_init(ctx, m);
@@ -672,6 +809,7 @@ static int js_minnet_init(JSContext* ctx, JSModuleDef* m) {
   minnet_url_init(ctx, m);
   minnet_headers_init(ctx, m);
   minnet_client_init(ctx, m);
+  minnet_agent_init(ctx, m);
   minnet_server_init(ctx, m);
 
   return 0;
@@ -686,6 +824,7 @@ UNUSED VISIBLE JSModuleDef* JS_INIT_MODULE(JSContext* ctx, const char* module_na
   JS_AddModuleExport(ctx, m, "Response");
   JS_AddModuleExport(ctx, m, "Request");
   JS_AddModuleExport(ctx, m, "Ringbuffer");
+  JS_AddModuleExport(ctx, m, "Channel");
   JS_AddModuleExport(ctx, m, "Generator");
   JS_AddModuleExport(ctx, m, "Socket");
   JS_AddModuleExport(ctx, m, "FormParser");
@@ -694,13 +833,16 @@ UNUSED VISIBLE JSModuleDef* JS_INIT_MODULE(JSContext* ctx, const char* module_na
   JS_AddModuleExport(ctx, m, "URL");
   JS_AddModuleExport(ctx, m, "Headers");
   JS_AddModuleExport(ctx, m, "Client");
+  JS_AddModuleExport(ctx, m, "Agent");
   JS_AddModuleExport(ctx, m, "Server");
 
   JS_AddModuleExportList(ctx, m, minnet_funcs, countof(minnet_funcs));
 
   minnet_log_ctx = ctx;
 
-  lws_set_log_level(minnet_log_level, minnet_log_callback);
+  /* the log level is process-wide, service threads keep the one of the main thread */
+  if(!minnet_server_thread)
+    lws_set_log_level(minnet_log_level, minnet_log_callback);
 
   return m;
 }
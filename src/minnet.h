@@ -66,10 +66,14 @@ typedef union {
 
 typedef enum socket_state MinnetStatus;
 struct js_callback;
+struct context;
 
 void minnet_io_handlers(JSContext*, struct lws*, struct lws_pollargs, JSValueConst[2]);
 JSValue minnet_default_fd_callback(JSContext*);
+int minnet_event_loop(JSContext*, JSValueConst, struct context*);
+void minnet_event_loop_release(struct context*, struct js_callback*);
 int minnet_pollfds_change(struct lws*, enum lws_callback_reasons, struct js_callback*, struct lws_pollargs*);
 int minnet_lws_unhandled(const char*, int);
+JSModuleDef* JS_INIT_MODULE(JSContext*, const char*);
 
 #endif /* MINNET_H */
@@ -1,4 +1,4 @@
-import { close, exec, O_RDWR, open, readlink, stat } from 'os';
+import { close, exec, O_RDWR, open, readlink, setTimeout, stat } from 'os';
 import { open as fopen } from 'std';
 
 export function assert(actual, expected, message) {
@@ -55,6 +55,27 @@ export async function save(generator, file) {
   handle.close();
 }
 
+/* resolves once cond() holds, rejects after ms */
+export function until(cond, ms = 2000) {
+  return new Promise((resolve, reject) => {
+    const t0 = Date.now();
+    const check = () => (cond() ? resolve() : Date.now() - t0 > ms ? reject(new Error('timed out')) : setTimeout(check, 10));
+    check();
+  });
+}
+
+/* calls check() with what fn() throws, fails when it doesn't */
+export function throws(fn, check) {
+  try {
+    fn();
+  } catch(error) {
+    check(error);
+    return;
+  }
+
+  throw new Error('no exception thrown');
+}
+
 export function MakeCert(sslCert, sslPrivateKey, hostname = 'localhost') {
   const stderr = open('/dev/null', O_RDWR);
   const ret = exec(['openssl', 'req', '-x509', '-out', sslCert, '-keyout', sslPrivateKey, '-newkey', 'rsa:2048', '-nodes', '-sha256', '-subj', '/CN=' + hostname], { stderr });
@@ -62,4 +83,4 @@ export function MakeCert(sslCert, sslPrivateKey, hostname = 'localhost') {
   return ret;
 }
 
-export default { assert, getpid, once, exists, randStr, escape, abbreviate, save, MakeCert, exists };
+export default { assert, getpid, once, exists, randStr, escape, abbreviate, save, until, throws, MakeCert, exists };
@@ -1,5 +1,5 @@
 import { AsyncIterator , createServer, Generator, Hash, LLL_DEBUG, LLL_USER, LLL_WARN, logLevels, Request, Response, Ringbuffer, setLog, Socket, URL } from 'net';
-import { close, setReadHandler, setWriteHandler, Worker } from 'os';
+import { close, setReadHandler, setTimeout, setWriteHandler, Worker } from 'os';
 import { Connection, RPCApi, RPCClient, RPCConnect, RPCFactory, RPCListen, RPCObject, RPCProxy, RPCServer, RPCSocket, SerializeValue } from '../js/rpc.js';
 import { exists, MakeCert } from './common.js';
 import { Init, Levels, log } from './log.js';
@@ -128,6 +128,12 @@ export function Server(...args) {
           yield 'response';
           yield '\n';
         },
+        async *slow(req, res) {
+          log('/slow', { req, res });
+          yield 'slow';
+          await new Promise(resolve => setTimeout(resolve, 2000));
+          yield '\n';
+        },
       },
       onConnect(ws, req) {
         log('onConnect(1)', { ws, req });
@@ -1,7 +1,192 @@
-import { fetch, LLL_DEBUG, LLL_INFO, LLL_NOTICE, LLL_USER, logLevels, setLog } from 'net';
+import { Agent, dnsStats, fetch, fetchAll, LLL_DEBUG, LLL_INFO, LLL_NOTICE, LLL_USER, logLevels, resolve, setLog } from 'net';
+import { kill, SIGCONT, SIGSTOP, SIGTERM, sleep, WNOHANG } from 'os';
+import { throws } from './common.js';
 import { log } from './log.js';
+import { spawn, wait4 } from './spawn.js';
+import { assert, eq, tests } from './tinytest.js';
 import { exit, open, puts } from 'std';
 
+const base = 'https://localhost:30001';
+
+/* what the client uses of an AbortSignal */
+function Signal() {
+  const listeners = new Set();
+
+  return {
+    aborted: false,
+    reason: undefined,
+    listeners,
+    addEventListener(type, fn) {
+      if(type == 'abort') listeners.add(fn);
+    },
+    removeEventListener(type, fn) {
+      listeners.delete(fn);
+    },
+    abort(reason) {
+      this.aborted = true;
+      this.reason = reason;
+
+      for(const fn of [...listeners]) fn.call(this, { type: 'abort', target: this });
+
+      listeners.clear();
+    },
+  };
+}
+
+/* against server.js: the agent, fetchAll() and the timeouts of blocking requests */
+function LocalTests() {
+  let pid = spawn('server.js', ['localhost', 30001], 'test-fetch-server.log');
+  let status = [];
+
+  sleep(100);
+
+  return tests({
+    'Agent reuses keep-alive connections'() {
+      const agent = new Agent({ maxSockets: 1, keepAlive: 5, http2: false });
+
+      for(let i = 0; i < 3; i++) eq(fetch(base + '/generator', { agent }).text(), 'This is a generated response\n');
+
+      const { requests, connects, reused } = agent.stats;
+      eq(requests, 3);
+      eq(connects, 1);
+      eq(reused, 2);
+      eq(agent.closeIdle(), 1);
+    },
+    'clients share the agent\'s context'() {
+      const agent = new Agent({ maxSockets: 1, http2: false });
+
+      for(let i = 0; i < 3; i++) fetch(base + '/generator', { agent }).text();
+
+      eq(agent.stats.vhosts, 1);
+
+      /* one of its own, without touching the thread's agent */
+      const { requests } = Agent.globalAgent.stats;
+      eq(fetch(base + '/generator', { agent: false }).text(), 'This is a generated response\n');
+      eq(Agent.globalAgent.stats.requests, requests);
+    },
+    async 'h2 streams share a connection'() {
+      const agent = new Agent({ maxSockets: 1, http2: true });
+      const responses = await Promise.all([1, 2, 3].map(() => fetch(base + '/generator', { agent, block: false })));
+
+      for(const response of responses) eq(await response.text(), 'This is a generated response\n');
+
+      eq(agent.stats.connects, 1);
+      eq(agent.stats.h2, 1);
+    },
+    async 'Agent queue by priority'() {
+      const agent = new Agent({ maxSockets: 1, maxRequests: 1, http2: false });
+      const order = [];
+      const request = (name, priority) => fetch(base + '/generator', { agent, priority, block: false }).then(() => order.push(name));
+
+      /* the first takes the connection, the others wait for it */
+      await Promise.all([request('first', 0), request('low', 'low'), request('high', 'high')]);
+
+      eq(order.join(' '), 'first high low');
+      eq(agent.stats.queued, 2);
+    },
+    async 'abort listener goes with the request'() {
+      const signal = Signal();
+
+      for(let i = 0; i < 3; i++) await (await fetch(base + '/generator', { signal, block: false })).text();
+
+      eq(signal.listeners.size, 0);
+
+      const request = fetch(base + '/slow', { signal, block: false });
+      eq(signal.listeners.size, 1);
+      signal.abort();
+
+      try {
+        await request;
+      } catch(error) {
+        eq(error.name, 'AbortError');
+        return;
+      }
+
+      throw new Error('not aborted');
+    },
+    async 'resolve() caches the answer'() {
+      dnsStats(true);
+
+      const addrs = await resolve('localhost');
+      assert(addrs.length > 0, 'has addresses');
+      assert(addrs.every(a => a == '127.0.0.1' || a == '::1'), 'loopback addresses');
+
+      const { hits } = dnsStats();
+      eq((await resolve('localhost')).join(), addrs.join());
+      eq(dnsStats().hits, hits + 1);
+    },
+    async 'resolve() failure'() {
+      try {
+        await resolve('nonexistent.invalid');
+      } catch(error) {
+        assert(error instanceof Error, 'Error');
+        eq(dnsStats().entries > 0, true);
+        return;
+      }
+
+      throw new Error('resolved');
+    },
+    'fetchAll() responses in order'() {
+      const [a, b] = fetchAll([base + '/generator', base + '/404.html']);
+
+      eq(a.status, 200);
+      eq(a.text(), 'This is a generated response\n');
+      assert(/<h1>403<\/h1>/.test(b.text()), 'second response');
+    },
+    'fetchAll() error in place of a failed request'() {
+      const [a, b] = fetchAll([base + '/generator', 'http://localhost:1/']);
+
+      eq(a.status, 200);
+      assert(b instanceof Error, 'failed request is an Error');
+    },
+    async 'fetchAll() non-blocking'() {
+      const [a, b] = await fetchAll([base + '/generator', base + '/generator'], { block: false });
+
+      eq(await a.text(), 'This is a generated response\n');
+      eq(await b.text(), 'This is a generated response\n');
+    },
+    'fetchAll() too many requests'() {
+      throws(
+        () => fetchAll(new Array(1e7)),
+        error => assert(error instanceof RangeError, 'RangeError'),
+      );
+    },
+    'connectTimeout'() {
+      /* a stopped server never accepts, the kernel queues the connection and the TLS handshake never starts */
+      const stopped = spawn('server.js', ['localhost', 30002], 'test-fetch-stopped.log');
+
+      sleep(100);
+      kill(stopped, SIGSTOP);
+
+      try {
+        throws(
+          () => fetch('https://localhost:30002/', { connectTimeout: 200 }),
+          error => eq(error.name, 'TimeoutError'),
+        );
+      } finally {
+        kill(stopped, SIGTERM);
+        kill(stopped, SIGCONT);
+        wait4(stopped, []);
+      }
+    },
+    'readTimeout'() {
+      throws(
+        () => fetch(base + '/slow', { readTimeout: 200 }),
+        error => eq(error.name, 'TimeoutError'),
+      );
+    },
+    'timeout'() {
+      throws(
+        () => fetch(base + '/slow', { timeout: 500 }),
+        error => eq(error.name, 'TimeoutError'),
+      );
+    },
+  }).finally(() => {
+    kill(pid, SIGTERM);
+    wait4(pid, status, WNOHANG);
+  });
+}
+
 function WriteFile(name, data) {
   try {
     let f = open(name, 'w+');
@@ -80,7 +265,8 @@ function main(...args) {
     .catch(run);
 
   function run() {
-    FetchNext(args)
+    LocalTests()
+      .then(() => FetchNext(args))
       .then(() => {
         log('SUCCEEDED');
       })
@@ -1,5 +1,7 @@
 import { Generator } from 'net.so';
-import { eq, tests } from './tinytest.js';
+import { assert, eq, tests } from './tinytest.js';
+
+const text = value => (typeof value == 'string' ? value : String.fromCharCode(...new Uint8Array(value)));
 
 tests({
   async 'next() value'() {
@@ -100,4 +102,91 @@ tests({
     eq(r.done, true);
     eq(r.value, undefined);
   },
+  async 'queue grows past its ring'() {
+    const gen = new Generator(async (push, stop) => {});
+    const buf = new Uint8Array(7);
+    let expected = '',
+      actual = '',
+      n;
+
+    for(let i = 0; i < 1000; i++) {
+      gen.write(`${i},`);
+      expected += `${i},`;
+    }
+
+    gen.stop();
+    eq(gen.chunksWritten, 1000);
+
+    while((n = await gen.readInto(buf))) actual += text(buf.subarray(0, n));
+
+    eq(actual, expected);
+  },
+  async 'batches() maxChunks/concat'() {
+    const gen = new Generator(async (push, stop) => {});
+
+    for(const chunk of ['a', 'b', 'c', 'd', 'e']) gen.write(chunk);
+
+    let r = await gen.batches({ maxChunks: 2 }).next();
+    eq(r.done, false);
+    assert(Array.isArray(r.value), 'batch is an array');
+    eq(r.value.map(text).join('|'), 'a|b');
+
+    const it = gen.batches({ concat: true });
+    r = await it.next();
+    eq(text(r.value), 'cde');
+
+    gen.stop();
+    eq((await it.next()).done, true);
+  },
+  async 'batches() waits for the next chunk'() {
+    const gen = new Generator(async (push, stop) => {
+      await push('first');
+      stop();
+    });
+
+    const it = gen.batches();
+    let r = await it.next();
+    eq(r.value.map(text).join('|'), 'first');
+
+    r = await it.next();
+    eq(r.done, true);
+  },
+  async 'readInto() partial chunk'() {
+    const gen = new Generator(async (push, stop) => {
+      await push('abcdefghij');
+      stop();
+    });
+    const buf = new Uint8Array(4);
+    const read = async () => text(buf.subarray(0, await gen.readInto(buf)));
+
+    /* waits for the chunk, what doesn't fit stays queued */
+    eq(await read(), 'abcd');
+    eq(await read(), 'efgh');
+    eq(await read(), 'ij');
+    eq(await gen.readInto(buf), 0);
+  },
+  async 'readInto() typed array view'() {
+    const gen = new Generator(async (push, stop) => {});
+    const buf = new Uint8Array(8).fill(46);
+
+    gen.write('xyz');
+    eq(await gen.readInto(new Uint8Array(buf.buffer, 2, 2)), 2);
+    eq(text(buf), '..xy....');
+
+    gen.stop();
+    eq(await gen.readInto(buf), 1);
+    eq(text(buf), 'z.xy....');
+  },
+  'readInto() empty buffer'() {
+    const gen = new Generator(async (push, stop) => {});
+
+    try {
+      gen.readInto(new ArrayBuffer(0));
+    } catch(error) {
+      assert(error instanceof RangeError, 'RangeError');
+      return;
+    }
+
+    throw new Error('no exception thrown');
+  },
 });
@@ -1,9 +1,296 @@
-import { kill, SIGTERM, sleep, WNOHANG } from 'os';
+import { createServer, fetch, FormParser, Hash, poolStats, Response } from 'net';
+import { kill, remove, setTimeout, SIGTERM, sleep, WNOHANG } from 'os';
 import Client from './client.js';
-import { randStr } from './common.js';
+import { randStr, until } from './common.js';
 import { log } from './log.js';
 import { spawn, wait4 } from './spawn.js';
-import { exit, loadFile } from 'std';
+import { assert, eq, tests } from './tinytest.js';
+import { exit, loadFile, open } from 'std';
+
+/* a plain HTTP server in this process, the requests to it don't block */
+function LocalServer(port, options = {}) {
+  return createServer({ host: 'localhost', port, protocol: 'http', tls: false, block: false, ...options });
+}
+
+const get = (url, options = {}) => fetch(url, { block: false, ...options });
+
+function writeFile(path, data) {
+  const f = open(path, 'w');
+
+  f.puts(data);
+  f.close();
+}
+
+function sha256(data) {
+  const hash = new Hash(Hash.TYPE_SHA256);
+
+  hash.update(data);
+  hash.finalize();
+  return hash.toString();
+}
+
+function multipart(boundary, name, filename, content) {
+  return `--${boundary}\r\nContent-Disposition: form-data; name="${name}"; filename="${filename}"\r\nContent-Type: text/plain\r\n\r\n${content}\r\n--${boundary}--\r\n`;
+}
+
+function LocalTests() {
+  const hits = [],
+    saved = [],
+    kept = [];
+  const server = LocalServer(30020, {
+    mounts: {
+      *users(req, res) {
+        yield 'user';
+      },
+      *upload(req, res) {
+        yield 'uploaded';
+      },
+      async *echo(req, res) {
+        let n = 0;
+
+        for await(const chunk of req.body) n += chunk.byteLength ?? chunk.length;
+
+        yield `${n} ${req.digest}`;
+      },
+      async *slow(req, res) {
+        let n = 0;
+
+        /* reads slower than the body arrives, the connection is paused in between */
+        for await(const chunk of req.body) {
+          n += chunk.byteLength ?? chunk.length;
+          await new Promise(resolve => setTimeout(resolve, 1));
+        }
+
+        yield `${n}`;
+      },
+    },
+    digest: 'sha256',
+    highWaterMark: 4096,
+    onRequest(req, res) {
+      /* file parts go to /tmp without passing through JS */
+      if(req.url.path == '/upload')
+        new FormParser(this, ['file'], {
+          saveTo: '/tmp',
+          maxFileSize: 1024,
+          onClose(name, file) {
+            if(file) saved.push(file);
+          },
+        });
+    },
+  });
+  const base = 'http://localhost:30020';
+
+  LocalServer(30021, {
+    mounts: {
+      async *echo(req, res) {
+        let n = 0;
+
+        for await(const chunk of req.body) n += chunk.byteLength ?? chunk.length;
+
+        yield `${n}`;
+      },
+    },
+    maxBodySize: 1024,
+  });
+
+  /* this directory, served without calling into JS */
+  const mydir = scriptArgs[0].replace(/\/[^\/]*$/, '').replace(/^[^\/]*\.js$/, '.');
+  const file = loadFile(mydir + '/tinytest.js');
+
+  LocalServer(30022, { mounts: { '/files': [mydir] } });
+  LocalServer(30024, {
+    mounts: {
+      *native(req, res) {
+        yield 'epoll';
+      },
+    },
+    eventLoop: 'native',
+  });
+  LocalServer(30023, { mounts: { '/files': [mydir], '/tmp': ['/tmp'] }, cache: 1 << 20 });
+
+  server.post('/users/new', req => void hits.push('post new'));
+  server.get('/users/:id', req => void hits.push(`get ${req.params.id}`));
+  server.get('/users/:id/whoami', req => void kept.push(req));
+  server.get('/users/:id/files/*rest', req => void hits.push(`files ${req.params.id} ${req.params.rest}`));
+  server.get('/users/:id/async', async req => void hits.push(`async ${req.params.id}`));
+  server.get('/users/:id/object', req => ({ id: req.params.id }));
+
+  return tests({
+    async 'route params'() {
+      eq((await get(base + '/users/42')).status, 200);
+      eq(hits.pop(), 'get 42');
+    },
+    async 'routes are method-aware'() {
+      await get(base + '/users/new');
+      eq(hits.pop(), 'get new');
+
+      await get(base + '/users/new', { method: 'POST', body: 'x' });
+      eq(hits.pop(), 'post new');
+    },
+    async 'route wildcard'() {
+      await get(base + '/users/7/files/a/b.txt');
+      eq(hits.pop(), 'files 7 a/b.txt');
+      eq(hits.length, 0);
+    },
+    async 'route handlers returning a Promise or an object'() {
+      eq((await get(base + '/users/8/async')).status, 200);
+      eq(hits.pop(), 'async 8');
+
+      eq(await (await get(base + '/users/9/object')).text(), 'user');
+      eq((await get(base + '/users/10')).status, 200);
+      eq(hits.pop(), 'get 10');
+    },
+    async 'request kept past its response'() {
+      eq(await (await get(base + '/users/3/whoami', { headers: { 'x-test': 'lazy' } })).text(), 'user');
+
+      /* read after the connection moved on, from the copy made when the response was sent */
+      const [req] = kept;
+      eq(req.get('x-test'), 'lazy');
+      eq(req.url.path, '/users/3/whoami');
+      assert(['127.0.0.1', '::1', '::ffff:127.0.0.1'].includes(req.ip), 'peer address');
+    },
+    async 'request digest'() {
+      const body = 'hashed on the way in\n'.repeat(1000);
+      const response = await get(base + '/echo', { method: 'POST', body });
+
+      eq(await response.text(), `${body.length} ${sha256(body)}`);
+    },
+    async 'response digest'() {
+      const response = await get(base + '/users/1', { digest: 'sha256' });
+
+      eq(await response.text(), 'user');
+      eq(response.digest, sha256('user'));
+    },
+    async 'maxBodySize'() {
+      let response = await get('http://localhost:30021/echo', { method: 'POST', body: 'x'.repeat(1024) });
+      eq(await response.text(), '1024');
+
+      response = await get('http://localhost:30021/echo', { method: 'POST', body: 'x'.repeat(1025) });
+      eq(response.status, 413);
+    },
+    async 'highWaterMark'() {
+      const body = 'y'.repeat(1 << 18);
+      const response = await get(base + '/slow', { method: 'POST', body });
+
+      eq(await response.text(), `${body.length}`);
+    },
+    async 'body of a request answered before it arrived'() {
+      /* the handler doesn't read it, the rest of the body comes in once the request is detached */
+      const response = await get(base + '/users/5', { method: 'POST', body: 'z'.repeat(1 << 18) });
+
+      eq(await response.text(), 'user');
+      eq((await get(base + '/users/6')).status, 200);
+      hits.splice(0);
+    },
+    async 'FormParser saveTo'() {
+      const content = 'saved to disk\n'.repeat(10);
+
+      await get(base + '/upload', {
+        method: 'POST',
+        headers: { 'content-type': 'multipart/form-data; boundary=minnet' },
+        body: multipart('minnet', 'file', 'a.txt', content),
+      });
+      await until(() => saved.length);
+
+      const [file] = saved;
+      eq(file.filename, 'a.txt');
+      eq(file.size, content.length);
+      assert(file.path.startsWith('/tmp/upload-'), 'named in saveTo');
+      eq(loadFile(file.path), content);
+      remove(file.path);
+    },
+    async 'FormParser saveTo maxFileSize'() {
+      const response = await get(base + '/upload', {
+        method: 'POST',
+        headers: { 'content-type': 'multipart/form-data; boundary=minnet' },
+        body: multipart('minnet', 'file', 'b.txt', 'x'.repeat(4096)),
+      });
+
+      eq(response.status, 413);
+    },
+    async 'directory mount'() {
+      const response = await get('http://localhost:30022/files/tinytest.js');
+
+      eq(response.status, 200);
+      eq(await response.text(), file);
+      eq(response.get('accept-ranges'), 'bytes');
+      assert(/^W\/"/.test(response.get('etag')), 'weak ETag');
+    },
+    async 'directory mount If-None-Match'() {
+      const etag = (await get('http://localhost:30022/files/tinytest.js')).get('etag');
+      const response = await get('http://localhost:30022/files/tinytest.js', { headers: { 'if-none-match': etag } });
+
+      eq(response.status, 304);
+    },
+    async 'directory mount Range'() {
+      let response = await get('http://localhost:30022/files/tinytest.js', { headers: { range: 'bytes=10-19' } });
+
+      eq(response.status, 206);
+      eq(response.get('content-range'), `bytes 10-19/${file.length}`);
+      eq(await response.text(), file.slice(10, 20));
+
+      response = await get('http://localhost:30022/files/tinytest.js', { headers: { range: `bytes=${file.length}-` } });
+      eq(response.status, 416);
+    },
+    async 'cached file'() {
+      for(let i = 0; i < 2; i++) {
+        const response = await get('http://localhost:30023/files/tinytest.js', { headers: { 'accept-encoding': 'identity' } });
+
+        eq(await response.text(), file);
+        eq(response.get('content-encoding'), undefined);
+      }
+    },
+    async 'cached file gzip variant'() {
+      const response = await get('http://localhost:30023/files/tinytest.js', { headers: { 'accept-encoding': 'gzip' } });
+
+      eq(response.status, 200);
+      eq(response.get('content-encoding'), 'gzip');
+      eq(response.get('vary'), 'accept-encoding');
+      assert(response.get('etag').endsWith('-gz"'), 'ETag of the variant');
+    },
+    async 'cached file changed on disk'() {
+      const path = '/tmp/minnet-cache-test.txt',
+        headers = { 'accept-encoding': 'identity' };
+
+      writeFile(path, 'before');
+      eq(await (await get('http://localhost:30023/tmp/minnet-cache-test.txt', { headers })).text(), 'before');
+
+      writeFile(path, 'and after');
+      eq(await (await get('http://localhost:30023/tmp/minnet-cache-test.txt', { headers })).text(), 'and after');
+      remove(path);
+    },
+    async 'native event loop'() {
+      const responses = await Promise.all([1, 2, 3].map(() => get('http://localhost:30024/native')));
+
+      for(const response of responses) eq(await response.text(), 'epoll');
+    },
+    'poolStats'() {
+      const stats = poolStats();
+
+      eq(stats[stats.length - 1].size, 0);
+      assert(stats.slice(0, -1).every((c, i, a) => c.size > 0 && (i == 0 || c.size > a[i - 1].size)), 'size classes ascend');
+      assert(stats.some(c => c.reused > 0), 'the requests above reused pooled memory');
+
+      for(const c of poolStats(true)) eq(c.cached, 0);
+    },
+    'response headers'() {
+      const response = new Response();
+
+      for(let i = 0; i < 40; i++) response.set(`X-Header-${i}`, `${i}`);
+
+      for(let i = 0; i < 40; i++) eq(response.get(`x-header-${i}`), `${i}`);
+
+      /* both shift the fields after the one they change */
+      response.append('X-HEADER-5', 'five');
+      response.set('x-header-10', 'ten');
+
+      eq(response.get('X-Header-5'), '5, five');
+      eq(response.get('X-Header-10'), 'ten');
+      eq(response.get('X-Header-39'), '39');
+      eq(response.get('X-Header-40'), undefined);
+    },
+  });
+}
 
 function TestClient(url) {
   const message = randStr(100);
@@ -40,6 +327,10 @@ function TestClient(url) {
 function main(...args) {
   import('console').then(({ Console }) => (globalThis.console = new Console({ inspectOptions: { compact: 2 } })));
 
+  LocalTests().then(() => RemoteTest());
+}
+
+function RemoteTest() {
   let pid = spawn('server.js', ['localhost', 30000], scriptArgs[0].replace(/.*\//g, '').replace('.js', '.log'));
   let status = [];
 
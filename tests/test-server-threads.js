@@ -0,0 +1,40 @@
+import { createServer, fetch } from 'net';
+import { log } from './log.js';
+import { eq, tests } from './tinytest.js';
+import { exit } from 'std';
+
+/* evaluated again in every service thread, where scriptArgs is empty */
+const main = scriptArgs.length > 0;
+
+const server = createServer({
+  host: 'localhost',
+  port: 30041,
+  protocol: 'http',
+  tls: false,
+  block: false,
+  threads: 2,
+  mounts: {
+    *where(req, res) {
+      yield main ? 'main' : 'service thread';
+    },
+  },
+});
+
+function LocalTests() {
+  return tests({
+    async 'service threads answer'() {
+      const responses = await Promise.all([...Array(8)].map(() => fetch('http://localhost:30041/where', { agent: false, block: false })));
+
+      for(const response of responses) eq(await response.text(), 'service thread');
+    },
+  }).finally(() => exit(0));
+}
+
+if(main) {
+  try {
+    LocalTests();
+  } catch(error) {
+    log(`FAIL: ${error && error.message}\n${error && error.stack}`);
+    exit(1);
+  }
+}
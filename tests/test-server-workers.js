@@ -0,0 +1,63 @@
+import { createServer, fetch } from 'net';
+import { kill, setTimeout, SIGTERM } from 'os';
+import { getpid, until } from './common.js';
+import { log } from './log.js';
+import { assert, eq, tests } from './tinytest.js';
+import { exit } from 'std';
+
+/* the workers continue this script from here, only the supervisor runs the tests */
+const server = createServer({
+  host: 'localhost',
+  port: 30040,
+  protocol: 'http',
+  tls: false,
+  block: false,
+  workers: 2,
+  mounts: {
+    *pid(req, res) {
+      yield `${getpid()}`;
+    },
+  },
+});
+
+function LocalTests() {
+  const pids = server.workers.map(w => w.pid);
+
+  return tests({
+    async 'workers are forked'() {
+      eq(pids.length, 2);
+      assert(pids.every(pid => pid > 0 && pid != getpid()), 'worker pids');
+
+      /* give them time to bind the port */
+      await new Promise(resolve => setTimeout(resolve, 200));
+    },
+    async 'workers answer'() {
+      /* a connection each, so the kernel may hand them to either worker */
+      const responses = await Promise.all([...Array(8)].map(() => fetch('http://localhost:30040/pid', { agent: false, block: false })));
+
+      for(const response of responses) assert(pids.includes(+(await response.text())), 'served by a worker');
+    },
+    async 'stats add up the workers'() {
+      await until(() => server.stats.requests == 8 && server.stats.active == 0);
+
+      const { workers, requests, connections } = server.stats;
+      eq(workers, 2);
+      eq(requests, 8);
+      eq(connections, 8);
+      eq(server.workers.reduce((n, w) => n + w.requests, 0), 8);
+    },
+  }).finally(() => {
+    for(const pid of pids) kill(pid, SIGTERM);
+
+    exit(0);
+  });
+}
+
+if(server.workers) {
+  try {
+    LocalTests();
+  } catch(error) {
+    log(`FAIL: ${error && error.message}\n${error && error.stack}`);
+    exit(1);
+  }
+}
@@ -1,10 +1,188 @@
+import { client, createServer, LWS_WRITE_BINARY, LWS_WRITE_CONTINUATION, LWS_WRITE_NO_FIN } from 'net';
 import { kill, SIGTERM, sleep, WNOHANG } from 'os';
 import Client from './client.js';
-import { randStr } from './common.js';
+import { randStr, throws, until } from './common.js';
 import { log } from './log.js';
 import { spawn, wait4 } from './spawn.js';
+import { assert, eq, tests } from './tinytest.js';
 import { exit } from 'std';
 
+/* a server in this process whose connections are subscribed to a Channel */
+function LocalTests() {
+  const server = createServer({
+    host: 'localhost',
+    port: 30030,
+    protocol: 'http',
+    tls: false,
+    block: false,
+    onConnect(ws) {
+      accepted.push(ws);
+      server.channel('news').subscribe(ws);
+    },
+    onMessage(ws, msg, first, final) {
+      if(typeof msg == 'string') return;
+      fragments.push(new Uint8Array(msg));
+      if(final) binaries.push(join(fragments.splice(0, fragments.length)));
+    },
+  });
+  const news = server.channel('news');
+  const received = [[], []],
+    sockets = [],
+    accepted = [],
+    fragments = [],
+    binaries = [],
+    pongs = [];
+
+  const connect = i =>
+    new Promise(resolve =>
+      client('ws://localhost:30030/ws', {
+        tls: false,
+        block: false,
+        onConnect(ws) {
+          sockets[i] = ws;
+          resolve();
+        },
+        onMessage(ws, msg) {
+          received[i].push(msg);
+        },
+        onPong(ws, data) {
+          pongs.push(i);
+        },
+      }),
+    );
+
+  return tests({
+    async 'Channel fan-out'() {
+      await Promise.all([connect(0), connect(1)]);
+      await until(() => news.subscribers == 2);
+
+      eq(news.publish('hello'), 2);
+      eq(news.publish('world'), 2);
+      await until(() => received.every(r => r.length == 2));
+
+      for(const r of received) eq(r.join(' '), 'hello world');
+
+      eq(news.published, 2);
+    },
+    'Channel deflates only for peers offering it'() {
+      /* the client doesn't offer permessage-deflate, its frames go out as published */
+      eq(accepted.length, 2);
+      for(const ws of accepted) eq(ws.deflate, false);
+    },
+    'Channel refuses client sockets'() {
+      throws(
+        () => news.subscribe(sockets[0]),
+        error => assert(error instanceof TypeError, 'TypeError'),
+      );
+    },
+    async 'Channel unsubscribe'() {
+      eq(news.subscribers, 2);
+      sockets[1].close(1000);
+      await until(() => news.subscribers == 1);
+
+      eq(news.publish('only one'), 1);
+      await until(() => received[0].length == 3);
+      eq(received[1].length, 2);
+    },
+    async 'send() queues until writeable'() {
+      const ws = sockets[0];
+      const data = pattern(1000);
+      const sent = ws.send(data.buffer);
+
+      assert(ws.bufferedAmount >= data.length, 'bufferedAmount counts the queued message');
+      eq(await sent, true);
+      eq(ws.bufferedAmount, 0);
+
+      await until(() => binaries.length == 1);
+      eq(binaries[0].join(','), data.join(','));
+    },
+    async 'send() of a large buffer goes out in fragments'() {
+      const ws = sockets[0];
+      const data = pattern(200 * 1024);
+      const view = data.subarray(1024, 1024 + 150 * 1024);
+
+      eq(await ws.send(view), true);
+
+      await until(() => binaries.length == 2);
+      eq(binaries[1].length, view.length);
+      eq(binaries[1].every((b, i) => b == view[i]), true);
+    },
+    async 'send() of a detached buffer is dropped'() {
+      const ws = sockets[0];
+
+      if(typeof ArrayBuffer.prototype.transfer != 'function') return;
+
+      const data = pattern(64 * 1024);
+      const sent = ws.send(data.buffer);
+
+      data.buffer.transfer();
+      eq(await sent, false);
+      eq(ws.readyState, ws.OPEN);
+    },
+    async 'send() keeps writeFlags fragmenting a message'() {
+      const ws = sockets[0];
+      const data = pattern(300);
+
+      eq(await ws.send(data.slice(0, 100).buffer, LWS_WRITE_BINARY | LWS_WRITE_NO_FIN), true);
+      eq(await ws.send(data.slice(100, 200).buffer, LWS_WRITE_CONTINUATION | LWS_WRITE_NO_FIN), true);
+      eq(await ws.send(data.slice(200).buffer, LWS_WRITE_CONTINUATION), true);
+
+      await until(() => binaries.length == 3);
+      eq(binaries[2].join(','), data.join(','));
+    },
+    async 'send() from the server writes a large buffer in place'() {
+      const ws = accepted.find(ws => ws.readyState == ws.OPEN);
+      const data = letters(100 * 1024);
+      const sent = ws.send(data.buffer);
+
+      /* the buffer is held, not copied: it goes out as it is at write time */
+      data[0] = 0x41;
+      eq(await sent, true);
+
+      await until(() => received[0].length == 4);
+      eq(received[0][3].length, data.length);
+      eq(received[0][3], Array.from(data, c => String.fromCharCode(c)).join(''));
+    },
+    async 'a ping is answered while a large send from the server is under way'() {
+      const ws = accepted.find(ws => ws.readyState == ws.OPEN);
+      const data = letters(4 << 20);
+      const sent = ws.send(data.buffer);
+
+      /* the pong goes out between two frames of the message */
+      sockets[0].ping(new ArrayBuffer(4));
+
+      eq(await sent, true);
+      await until(() => received[0].length == 5 && pongs.length == 1);
+
+      const msg = received[0][4];
+      eq(msg.length, data.length);
+      for(let i = 0; i < msg.length; i += 4099) eq(msg.charCodeAt(i), data[i]);
+      eq(msg.charCodeAt(msg.length - 1), data[data.length - 1]);
+    },
+  });
+}
+
+/* bytes 0..255 repeated */
+function pattern(n) {
+  const a = new Uint8Array(n);
+  for(let i = 0; i < n; i++) a[i] = i & 0xff;
+  return a;
+}
+
+/* 'a'..'z' repeated */
+function letters(n) {
+  const a = new Uint8Array(n);
+  for(let i = 0; i < n; i++) a[i] = 0x61 + (i % 26);
+  return a;
+}
+
+function join(parts) {
+  const a = new Uint8Array(parts.reduce((n, p) => n + p.length, 0));
+  let pos = 0;
+  for(const p of parts) (a.set(p, pos), (pos += p.length));
+  return a;
+}
+
 function TestClient(url) {
   const message = randStr(100);
 
@@ -30,6 +208,10 @@ function TestClient(url) {
 }
 
 function main(...args) {
+  LocalTests().then(() => RemoteTest());
+}
+
+function RemoteTest() {
   let pid = spawn('server.js', ['localhost', 30000], scriptArgs[0].replace(/.*\//g, '').replace('.js', '.log'));
   let status = [];
 